@@ -81,6 +81,18 @@ ber_pvt_sb_copy_out LDAP_P(( Sockbuf_Buf *sbb, char *buf, ber_len_t len ));
 LBER_F( int )
 ber_pvt_socket_set_nonblock LDAP_P(( ber_socket_t sd, int nb ));
 
+/*
+ * encode.c
+ */
+LBER_F( int )
+ber_pvt_put_ref LDAP_P(( BerElement *ber, struct berval *bv, ber_tag_t tag ));
+
+/*
+ * io.c
+ */
+LBER_F( int )
+ber_pvt_inline_refs LDAP_P(( BerElement *ber ));
+
 /*
  * memory.c
  */
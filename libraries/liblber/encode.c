@@ -262,6 +262,70 @@ ber_put_berval(
 	return ber_put_ostring( ber, bv->bv_val, bv->bv_len, tag );
 }
 
+/*
+ * Like ber_put_berval(), but only the tag and length go into the
+ * buffer.  The contents are written straight from bv->bv_val when
+ * the element is flushed, so they must stay put until then, or until
+ * ber_pvt_inline_refs() copies them in.
+ */
+int
+ber_pvt_put_ref(
+	BerElement *ber,
+	struct berval *bv,
+	ber_tag_t tag )
+{
+	int rc;
+	unsigned char header[HEADER_SIZE], *ptr;
+	struct ber_ref *ref;
+
+	if ( tag == LBER_DEFAULT ) {
+		tag = LBER_OCTETSTRING;
+	}
+
+	if ( bv->bv_len > MAXINT_BERSIZE ) {
+		return -1;
+	}
+
+	if ( ber->ber_nrefs == ber->ber_maxrefs ) {
+		int n = ber->ber_maxrefs ? 2 * ber->ber_maxrefs : 8;
+		ref = ber_memrealloc_x( ber->ber_refs, n * sizeof(struct ber_ref),
+			ber->ber_memctx );
+		if ( ref == NULL ) {
+			return -1;
+		}
+		ber->ber_refs = ref;
+		ber->ber_maxrefs = n;
+	}
+
+	ptr = ber_prepend_len( &header[sizeof(header)], bv->bv_len );
+	ptr = ber_prepend_tag( ptr, tag );
+
+	rc = ber_write( ber, (char *) ptr, &header[sizeof(header)] - ptr, 0 );
+	if ( rc < 0 ) {
+		return -1;
+	}
+
+	ref = &ber->ber_refs[ber->ber_nrefs++];
+	ref->br_off = ( ber->ber_sos_ptr ? ber->ber_sos_ptr : ber->ber_ptr )
+		- ber->ber_buf;
+	ref->br_len = bv->bv_len;
+	ref->br_val = bv->bv_val;
+
+	return rc + (int) bv->bv_len;
+}
+
+ber_len_t
+ber_int_refs_len( const BerElement *ber, ber_len_t off )
+{
+	ber_len_t len = 0;
+	int i;
+
+	for ( i = ber->ber_nrefs; --i >= 0 && ber->ber_refs[i].br_off >= off; ) {
+		len += ber->ber_refs[i].br_len;
+	}
+	return len;
+}
+
 int
 ber_put_string(
 	BerElement *ber,
@@ -438,6 +502,7 @@ ber_put_seqorset( BerElement *ber )
 	unsigned char	*lenptr;	/* length octets in the sequence/set */
 	ber_len_t		len;		/* length(contents) */
 	ber_len_t		xlen;		/* len + length(length) */
+	ber_len_t		reflen = 0;	/* part of len not in ber_buf */
 
 	assert( ber != NULL );
 	assert( LBER_VALID( ber ) );
@@ -446,7 +511,10 @@ ber_put_seqorset( BerElement *ber )
 
 	lenptr = (unsigned char *) ber->ber_buf + ber->ber_sos_inner;
 	xlen = ber->ber_sos_ptr - (char *) lenptr;
-	if ( xlen > MAXINT_BERSIZE + SOS_LENLEN ) {
+	if ( ber->ber_nrefs ) {
+		reflen = ber_int_refs_len( ber, ber->ber_sos_inner + SOS_LENLEN );
+	}
+	if ( xlen + reflen > MAXINT_BERSIZE + SOS_LENLEN ) {
 		return -1;
 	}
 
@@ -454,7 +522,7 @@ ber_put_seqorset( BerElement *ber )
 	memcpy( SOS_TAG_END(header), lenptr, SOS_LENLEN );
 
 	/* Store length, and close gap of leftover reserved length octets */
-	len = xlen - SOS_LENLEN;
+	len = xlen - SOS_LENLEN + reflen;
 	if ( !(ber->ber_options & LBER_USE_DER) ) {
 		int i;
 		lenptr[0] = SOS_LENLEN - 1 + 0x80; /* length(length)-1 */
@@ -469,6 +537,15 @@ ber_put_seqorset( BerElement *ber )
 			xlen -= unused;
 			AC_MEMCPY( lenptr, p, xlen );
 			ber->ber_sos_ptr = (char *) lenptr + xlen;
+			if ( reflen ) {
+				/* refs inside the contents moved with them */
+				int i;
+				ber_len_t off = ber->ber_sos_inner + SOS_LENLEN;
+				for ( i = ber->ber_nrefs;
+					--i >= 0 && ber->ber_refs[i].br_off >= off; ) {
+					ber->ber_refs[i].br_off -= unused;
+				}
+			}
 		}
 	}
 
@@ -479,7 +556,7 @@ ber_put_seqorset( BerElement *ber )
 		ber->ber_sos_ptr = NULL;
 	}
 
-	return xlen + *SOS_TAG_END(header); /* lenlen + len + taglen */
+	return xlen + reflen + *SOS_TAG_END(header); /* lenlen + len + taglen */
 }
 
 int
@@ -44,6 +44,10 @@
 #include <io.h>
 #endif
 
+#ifdef HAVE_SYS_UIO_H
+#include <sys/uio.h>
+#endif
+
 #include "lber-int.h"
 #include "ldap_log.h"
 
@@ -189,9 +193,12 @@ ber_free_buf( BerElement *ber )
 	assert( LBER_VALID( ber ) );
 
 	if ( ber->ber_buf) ber_memfree_x( ber->ber_buf, ber->ber_memctx );
+	if ( ber->ber_refs ) ber_memfree_x( ber->ber_refs, ber->ber_memctx );
 
 	ber->ber_buf = NULL;
 	ber->ber_sos_ptr = NULL;
+	ber->ber_refs = NULL;
+	ber->ber_nrefs = ber->ber_maxrefs = 0;
 	ber->ber_valid = LBER_UNINITIALIZED;
 }
 
@@ -216,6 +223,157 @@ ber_flush( Sockbuf *sb, BerElement *ber, int freeit )
 			: LBER_FLUSH_FREE_NEVER );
 }
 
+/*
+ * Copy the contents of the refs into the buffer, making this an
+ * ordinary BerElement again.  A flush that was interrupted can be
+ * resumed afterwards.
+ */
+int
+ber_pvt_inline_refs( BerElement *ber )
+{
+	ber_len_t	extra, len, written;
+	char		*from, *to;
+	int		i;
+
+	assert( ber != NULL );
+	assert( LBER_VALID( ber ) );
+
+	if ( ber->ber_nrefs == 0 ) {
+		return 0;
+	}
+
+	extra = ber_int_refs_len( ber, 0 );
+	if ( extra > (ber_len_t) (ber->ber_end - ber->ber_ptr) &&
+		ber_realloc( ber, extra ) != 0 ) {
+		return -1;
+	}
+
+	/* Where the write cursor ends up */
+	written = ber->ber_refdone;
+	for ( i = 0; i < ber->ber_refnext; i++ ) {
+		written += ber->ber_refs[i].br_len;
+	}
+
+	/* Open up the gaps from the end, so nothing is overwritten */
+	from = ber->ber_ptr;
+	to = from + extra;
+	for ( i = ber->ber_nrefs; --i >= 0; ) {
+		struct ber_ref *ref = &ber->ber_refs[i];
+		char *at = ber->ber_buf + ref->br_off;
+
+		len = from - at;
+		to -= len;
+		AC_MEMCPY( to, at, len );
+		to -= ref->br_len;
+		AC_MEMCPY( to, ref->br_val, ref->br_len );
+		from = at;
+	}
+
+	ber->ber_ptr += extra;
+	if ( ber->ber_rwptr != NULL ) {
+		ber->ber_rwptr += written;
+	}
+	ber_memfree_x( ber->ber_refs, ber->ber_memctx );
+	ber->ber_refs = NULL;
+	ber->ber_nrefs = ber->ber_maxrefs = 0;
+	ber->ber_refnext = 0;
+	ber->ber_refdone = 0;
+	return 0;
+}
+
+#ifdef HAVE_SYS_UIO_H
+#define BER_IOV_MAX	64
+
+/* True if every layer of sb's I/O stack would pass what is written
+ * straight to the descriptor, so that writing to sb_fd bypasses
+ * nothing.  The debug layer only does so while it isn't logging
+ * packets.
+ */
+static int
+ber_sb_is_plain( Sockbuf *sb )
+{
+	Sockbuf_IO_Desc	*p;
+
+	for ( p = sb->sb_iod; p != NULL; p = p->sbiod_next ) {
+		if ( p->sbiod_io == &ber_sockbuf_io_debug ) {
+			if ( sb->sb_debug & LDAP_DEBUG_PACKETS )
+				return 0;
+		} else if ( p->sbiod_io != &ber_sockbuf_io_tcp &&
+			p->sbiod_io != &ber_sockbuf_io_fd &&
+			p->sbiod_io != &ber_sockbuf_io_readahead )
+		{
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/* Write the buffer and the refs in between with writev() */
+static int
+ber_flush_refs( Sockbuf *sb, BerElement *ber )
+{
+	struct iovec	iov[BER_IOV_MAX];
+	ber_len_t	len;
+
+	for (;;) {
+		char		*p = ber->ber_rwptr, *end;
+		ber_len_t	done = ber->ber_refdone;
+		ber_slen_t	rc;
+		int		i = ber->ber_refnext, n = 0;
+
+		/* gather the rest, alternating buffer and refs */
+		while ( n < BER_IOV_MAX ) {
+			end = i < ber->ber_nrefs ?
+				ber->ber_buf + ber->ber_refs[i].br_off : ber->ber_ptr;
+			if ( p < end ) {
+				iov[n].iov_base = p;
+				iov[n].iov_len = end - p;
+				n++;
+				p = end;
+			} else if ( i < ber->ber_nrefs ) {
+				iov[n].iov_base = (char *) ber->ber_refs[i].br_val + done;
+				iov[n].iov_len = ber->ber_refs[i].br_len - done;
+				n++;
+				done = 0;
+				i++;
+			} else {
+				break;
+			}
+		}
+		if ( n == 0 ) {
+			return 0;
+		}
+
+		rc = writev( sb->sb_fd, iov, n );
+		if ( rc <= 0 ) {
+			if ( rc < 0 && errno == EINTR ) continue;
+			return -1;
+		}
+
+		/* and move the cursor past what was written */
+		while ( rc > 0 ) {
+			i = ber->ber_refnext;
+			end = i < ber->ber_nrefs ?
+				ber->ber_buf + ber->ber_refs[i].br_off : ber->ber_ptr;
+			if ( ber->ber_rwptr < end ) {
+				len = end - ber->ber_rwptr;
+				if ( len > (ber_len_t) rc ) len = rc;
+				ber->ber_rwptr += len;
+			} else {
+				len = ber->ber_refs[i].br_len - ber->ber_refdone;
+				if ( len > (ber_len_t) rc ) len = rc;
+				ber->ber_refdone += len;
+				if ( ber->ber_refdone == ber->ber_refs[i].br_len ) {
+					ber->ber_refnext++;
+					ber->ber_refdone = 0;
+				}
+			}
+			rc -= len;
+		}
+	}
+}
+#endif /* HAVE_SYS_UIO_H */
+
 int
 ber_flush2( Sockbuf *sb, BerElement *ber, int freeit )
 {
@@ -230,6 +388,32 @@ ber_flush2( Sockbuf *sb, BerElement *ber, int freeit )
 	if ( ber->ber_rwptr == NULL ) {
 		ber->ber_rwptr = ber->ber_buf;
 	}
+
+	if ( ber->ber_nrefs ) {
+#ifdef HAVE_SYS_UIO_H
+		if ( ber_sb_is_plain( sb ) ) {
+			if ( sb->sb_debug ) {
+				ber_log_printf( LDAP_DEBUG_TRACE, sb->sb_debug,
+					"ber_flush2: %ld bytes in %d refs to sd %ld\n",
+					(long) ( ber->ber_ptr - ber->ber_buf +
+						ber_int_refs_len( ber, 0 )),
+					ber->ber_nrefs, (long) sb->sb_fd );
+			}
+			rc = ber_flush_refs( sb, ber );
+			if ( rc < 0 ) {
+				if ( freeit & LBER_FLUSH_FREE_ON_ERROR ) ber_free( ber, 1 );
+				return -1;
+			}
+			if ( freeit & LBER_FLUSH_FREE_ON_SUCCESS ) ber_free( ber, 1 );
+			return 0;
+		}
+#endif
+		/* TLS, SASL or packet logging want it all in one piece */
+		if ( ber_pvt_inline_refs( ber ) != 0 ) {
+			if ( freeit & LBER_FLUSH_FREE_ON_ERROR ) ber_free( ber, 1 );
+			return -1;
+		}
+	}
 	towrite = ber->ber_ptr - ber->ber_rwptr;
 
 	if ( sb->sb_debug ) {
@@ -307,6 +491,17 @@ ber_dup( BerElement *ber )
 
 	*new = *ber;
 
+	if ( ber->ber_nrefs ) {
+		new->ber_refs = ber_memalloc_x(
+			ber->ber_maxrefs * sizeof(struct ber_ref), ber->ber_memctx );
+		if ( new->ber_refs == NULL ) {
+			ber_memfree_x( new, ber->ber_memctx );
+			return NULL;
+		}
+		AC_MEMCPY( new->ber_refs, ber->ber_refs,
+			ber->ber_nrefs * sizeof(struct ber_ref) );
+	}
+
 	assert( LBER_VALID( new ) );
 	return( new );
 }
@@ -402,6 +597,9 @@ int ber_flatten2(
 		/* unmatched "{" and "}" */
 		return -1;
 
+	} else if ( ber->ber_nrefs && ber_pvt_inline_refs( ber ) != 0 ) {
+		return -1;
+
 	} else {
 		/* copy the berval */
 		ber_len_t len = ber_pvt_ber_write( ber );
@@ -456,6 +654,15 @@ ber_reset( BerElement *ber, int was_writing )
 	assert( ber != NULL );
 	assert( LBER_VALID( ber ) );
 
+	if ( ber->ber_nrefs ) {
+		/* what is read back must be in the buffer */
+		if ( !was_writing || ber_pvt_inline_refs( ber ) != 0 ) {
+			ber->ber_nrefs = 0;
+			ber->ber_refnext = 0;
+			ber->ber_refdone = 0;
+		}
+	}
+
 	if ( was_writing ) {
 		ber->ber_end = ber->ber_ptr;
 		ber->ber_ptr = ber->ber_buf;
@@ -120,9 +120,29 @@ struct berelement {
 
 	char		*ber_rwptr;
 	void		*ber_memctx;
+
+	/*
+	 * Contents added by ber_pvt_put_ref() are not copied to ber_buf,
+	 * they are taken from where they are by ber_flush2().  Each
+	 * occupies br_len octets of the encoding but none of ber_buf,
+	 * it goes in at offset br_off of ber_buf.
+	 *   ber_refnext   First ref not completely written out.
+	 *   ber_refdone   Octets of it that were.
+	 */
+	struct ber_ref	*ber_refs;
+	int		ber_nrefs;
+	int		ber_maxrefs;
+	int		ber_refnext;
+	ber_len_t	ber_refdone;
 };
 #define LBER_VALID(ber)	((ber)->ber_valid==LBER_VALID_BERELEMENT)
 
+struct ber_ref {
+	ber_len_t	br_off;
+	ber_len_t	br_len;
+	const char	*br_val;
+};
+
 #define ber_pvt_ber_remaining(ber)	((ber)->ber_end - (ber)->ber_ptr)
 #define ber_pvt_ber_total(ber)		((ber)->ber_end - (ber)->ber_buf)
 #define ber_pvt_ber_write(ber)		((ber)->ber_ptr - (ber)->ber_buf)
@@ -167,6 +187,12 @@ LBER_F (int) ber_len LDAP_P(( BerElement * ));
 LBER_F (int) ber_ptrlen LDAP_P(( BerElement * ));
 LBER_F (void) ber_rewind LDAP_P(( BerElement * ));
 
+/* octets of the refs at or after offset off of ber_buf */
+LBER_F( ber_len_t )
+ber_int_refs_len LDAP_P((
+	const BerElement *ber,
+	ber_len_t off ));
+
 /*
  * bprint.c
  */
@@ -98,7 +98,8 @@ ber_get_option(
 
 	case LBER_OPT_BER_BYTES_TO_WRITE:
 		assert( LBER_VALID( ber ) );
-		*((ber_len_t *) outvalue) = ber_pvt_ber_write(ber);
+		*((ber_len_t *) outvalue) = ber_pvt_ber_write(ber) +
+			ber_int_refs_len(ber, 0);
 		return LBER_OPT_SUCCESS;
 
 	case LBER_OPT_BER_MEMCTX:
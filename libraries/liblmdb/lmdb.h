@@ -77,6 +77,12 @@
  *	  access to locks and lock file. Exceptions: On read-only filesystems
  *	  or with the #MDB_NOLOCK flag described under #mdb_env_open().
  *
+ *	- Readers claim their slot in the lock file with an atomic
+ *	  compare-and-swap where the compiler supports it, and under a
+ *	  mutex otherwise or when built with MDB_NO_READER_CAS. Programs
+ *	  built the two ways can't use an environment at the same time;
+ *	  the second one gets #MDB_VERSION_MISMATCH.
+ *
  *	- An LMDB configuration will often reserve considerable \b unused
  *	  memory address space and maybe file size for future growth.
  *	  This does not use actual memory or disk space, but users may need
@@ -303,6 +309,8 @@ typedef void (MDB_rel_func)(MDB_val *item, void *oldptr, void *newptr, void *rel
 #define MDB_NORDAHEAD	0x800000
 	/** don't initialize malloc'd memory before writing to datafile */
 #define MDB_NOMEMINIT	0x1000000
+	/** record the txn that wrote each page, for #mdb_env_copyfd_incr() */
+#define MDB_INCREMENTAL	0x2000000
 /** @} */
 
 /**	@defgroup	mdb_dbi_open	Database Flags
@@ -594,6 +602,10 @@ int  mdb_env_create(MDB_env **env);
 	 *		read requests by default. This option turns it off if the OS
 	 *		supports it. Turning it off may help random read performance
 	 *		when the DB is larger than RAM and system RAM is full.
+	 *		Cursors stepping through the DB with #MDB_NEXT or #MDB_PREV
+	 *		still ask the OS to read ahead the leaf and overflow pages
+	 *		they are about to visit, so sequential scans don't have to
+	 *		wait for one page at a time.
 	 *		The option is not implemented on Windows.
 	 *	<li>#MDB_NOMEMINIT
 	 *		Don't initialize malloc'd memory before writing to unused spaces
@@ -614,6 +626,14 @@ int  mdb_env_create(MDB_env **env);
 	 *		caller is expected to overwrite all of the memory that was
 	 *		reserved in that case.
 	 *		This flag may be changed at any time using #mdb_env_set_flags().
+	 *	<li>#MDB_INCREMENTAL
+	 *		Keep a record of the transaction that last wrote each page, in
+	 *		the file "txns.mdb" next to the data file (or the path with
+	 *		"-txns" appended, with #MDB_NOSUBDIR), for #mdb_env_copyfd_incr().
+	 *		It holds 8 bytes per page of the map size, and is synced along
+	 *		with the data file on each commit. Every process writing to the
+	 *		environment should use this flag. The option is not implemented
+	 *		on Windows.
 	 * </ul>
 	 * @param[in] mode The UNIX permissions to set on created files and semaphores.
 	 * This parameter is ignored on Windows.
@@ -705,6 +725,95 @@ int  mdb_env_copy2(MDB_env *env, const char *path, unsigned int flags);
 	 */
 int  mdb_env_copyfd2(MDB_env *env, mdb_filehandle_t fd, unsigned int flags);
 
+	/** @brief Copy an LMDB environment to the specified path, with options,
+	 *	on several threads.
+	 *
+	 * Like #mdb_env_copy2(), but a compacting copy is spread over \b threads
+	 * threads: each named DB, or each subtree under the root of a large one,
+	 * is copied by one thread and written at its own place in the output.
+	 * Each thread has its own pair of write buffers. It helps most with many
+	 * named DBs or large ones, on storage that serves parallel reads well.
+	 * Without #MDB_CP_COMPACT, or with less than 2 threads, this is the same
+	 * as #mdb_env_copy2().
+	 * @note Not supported on Windows, where the copy is done on one thread.
+	 * @param[in] env An environment handle returned by #mdb_env_create(). It
+	 * must have already been opened successfully.
+	 * @param[in] path The directory in which the copy will reside. This
+	 * directory must already exist and be writable but must otherwise be
+	 * empty.
+	 * @param[in] flags Special options for this operation.
+	 * See #mdb_env_copy2() for options.
+	 * @param[in] threads The number of threads to copy with.
+	 * @return A non-zero error value on failure and 0 on success.
+	 */
+int  mdb_env_copy3(MDB_env *env, const char *path, unsigned int flags, unsigned int threads);
+
+	/** @brief Copy an LMDB environment to the specified file descriptor,
+	 *	with options, on several threads.
+	 *
+	 * See #mdb_env_copy3() for details. The copy is written out of order,
+	 * so it is only done on several threads when \b fd is seekable, and
+	 * then it goes at the start of the file.
+	 * @param[in] env An environment handle returned by #mdb_env_create(). It
+	 * must have already been opened successfully.
+	 * @param[in] fd The filedescriptor to write the copy to. It must
+	 * have already been opened for Write access.
+	 * @param[in] flags Special options for this operation.
+	 * See #mdb_env_copy2() for options.
+	 * @param[in] threads The number of threads to copy with.
+	 * @return A non-zero error value on failure and 0 on success.
+	 */
+int  mdb_env_copyfd3(MDB_env *env, mdb_filehandle_t fd, unsigned int flags, unsigned int threads);
+
+	/** @brief Write an incremental copy of an LMDB environment to the
+	 *	specified file descriptor.
+	 *
+	 * The incremental copy holds the pages written after transaction \b txnid
+	 * which are in use, and the meta pages of the current transaction. Applied
+	 * with #mdb_env_apply_incr() to a full copy made by #mdb_env_copy() (not
+	 * compacting) at \b txnid or later, it brings that copy up to the current
+	 * transaction. Only changed subtrees are read, so this is much faster
+	 * than a full copy when little has changed.
+	 *
+	 * It needs the record of the transaction that wrote each page, which is
+	 * kept in an extra file next to the data file while the environment is
+	 * opened with #MDB_INCREMENTAL for writing. The record starts when this
+	 * flag is first used, and starts over if the environment is written
+	 * without it. An incremental copy from before that point fails with
+	 * #MDB_INCOMPATIBLE, a full copy is needed instead.
+	 * @note Not supported on Windows.
+	 * @param[in] env An environment handle returned by #mdb_env_create(). It
+	 * must have already been opened successfully.
+	 * @param[in] fd The filedescriptor to write the copy to. It must
+	 * have already been opened for Write access.
+	 * @param[in] txnid The transaction ID of the full copy this copy is for.
+	 * It is shown as "Last transaction ID" by mdb_stat -e on the copy.
+	 * @return A non-zero error value on failure and 0 on success.
+	 */
+int  mdb_env_copyfd_incr(MDB_env *env, mdb_filehandle_t fd, size_t txnid);
+
+	/** @brief Apply an incremental copy to an LMDB environment.
+	 *
+	 * Reads a copy made by #mdb_env_copyfd_incr() and writes it over the
+	 * environment, which must be a copy made by #mdb_env_copy() at or after
+	 * the transaction the incremental copy is based on, and before the one
+	 * it was made at. Incremental copies are applied in the order they were
+	 * made. No other transactions may be active. If this fails after writing
+	 * some pages, the environment is no longer usable and must be copied
+	 * from the full copy again.
+	 * @note Not supported on Windows.
+	 * @param[in] env An environment handle returned by #mdb_env_create(). It
+	 * must have already been opened successfully, for writing.
+	 * @param[in] fd The filedescriptor to read the incremental copy from.
+	 * @return A non-zero error value on failure and 0 on success. Some
+	 * possible errors are:
+	 * <ul>
+	 *	<li>#MDB_INCOMPATIBLE - the incremental copy is for another transaction.
+	 *	<li>#MDB_CORRUPTED - it is not an incremental copy, or it is truncated.
+	 * </ul>
+	 */
+int  mdb_env_apply_incr(MDB_env *env, mdb_filehandle_t fd);
+
 	/** @brief Return statistics about the LMDB environment.
 	 *
 	 * @param[in] env An environment handle returned by #mdb_env_create()
@@ -1052,6 +1161,33 @@ void mdb_txn_reset(MDB_txn *txn);
 	 */
 int  mdb_txn_renew(MDB_txn *txn);
 
+	/** @brief Give back free pages at the end of the data file.
+	 *
+	 * Free pages that old readers no longer need and that sit at the very
+	 * end of the file are dropped from the freelist, so the transaction
+	 * commits a smaller database. The file itself is truncated to the
+	 * size used by the two most recent commits, which is where the pages
+	 * dropped by earlier calls go away. Nothing is truncated with
+	 * #MDB_WRITEMAP, where the file always covers the whole map, and
+	 * the environment must not be open with #MDB_WRITEMAP in another
+	 * process either. Pages freed by the last commit can only be used
+	 * after one more commit, so if such pages exist and no reader
+	 * holds them, this transaction is committed even if nothing else
+	 * changed in it.
+	 * See #mdb_cursor_compact() for moving used pages out of the way.
+	 * @param[in] txn A top-level write transaction.
+	 * @param[out] pages The number of pages dropped from the end of the
+	 *	database. May be NULL.
+	 * @return A non-zero error value on failure and 0 on success. Some possible
+	 * errors are:
+	 * <ul>
+	 *	<li>EACCES - an attempt was made to write in a read-only transaction.
+	 *	<li>EINVAL - an invalid parameter was specified.
+	 *	<li>EIO - the file could not be truncated.
+	 * </ul>
+	 */
+int  mdb_txn_shrink(MDB_txn *txn, size_t *pages);
+
 /** Compat with version <= 0.9.4, avoid clash with libmdb from MDB Tools project */
 #define mdb_open(txn,name,flags,dbi)	mdb_dbi_open(txn,name,flags,dbi)
 /** Compat with version <= 0.9.4, avoid clash with libmdb from MDB Tools project */
@@ -1259,6 +1395,32 @@ int  mdb_set_relfunc(MDB_txn *txn, MDB_dbi dbi, MDB_rel_func *rel);
 	 */
 int  mdb_set_relctx(MDB_txn *txn, MDB_dbi dbi, void *ctx);
 
+	/** @brief Keep the overflow pages of a database apart from B-tree pages.
+	 *
+	 * Values too big to fit on a leaf page go to runs of overflow pages.
+	 * Normally these are taken from wherever the free list has a run that
+	 * fits, so in a database with many big values the branch and leaf
+	 * pages end up scattered among them. With this set, runs for this
+	 * database's overflow pages are taken from the highest free pages
+	 * instead, while single pages for B-trees are always taken from the
+	 * lowest ones. Over time the two collect at opposite ends of the file
+	 * and the B-tree pages stay dense. Existing pages don't move.
+	 *
+	 * The setting is not stored in the database; it applies to the
+	 * environment handle until the DBI is closed, for pages allocated
+	 * after it is set.
+	 * @param[in] txn A transaction handle returned by #mdb_txn_begin()
+	 * @param[in] dbi A database handle returned by #mdb_dbi_open()
+	 * @param[in] onoff Non-zero to keep overflow pages apart, 0 for the
+	 * default allocation.
+	 * @return A non-zero error value on failure and 0 on success. Some possible
+	 * errors are:
+	 * <ul>
+	 *	<li>EINVAL - an invalid parameter was specified.
+	 * </ul>
+	 */
+int  mdb_set_ovzone(MDB_txn *txn, MDB_dbi dbi, int onoff);
+
 	/** @brief Get items from a database.
 	 *
 	 * This function retrieves key/data pairs from the database. The address
@@ -1431,6 +1593,13 @@ MDB_dbi mdb_cursor_dbi(MDB_cursor *cursor);
 	 * the address and length of the data are returned in the object to which \b data
 	 * refers.
 	 * See #mdb_get() for restrictions on using the output values.
+	 *
+	 * A positioned cursor looking up a key past its current page does not
+	 * start again from the root: it resumes from the lowest page on its
+	 * stack that covers the key. Callers with a batch of keys to look up
+	 * or store (with #mdb_cursor_put()) should present them in ascending
+	 * order on one cursor, so each search only revisits the pages it
+	 * doesn't share with the previous key.
 	 * @param[in] cursor A cursor handle returned by #mdb_cursor_open()
 	 * @param[in,out] key The key for a retrieved item
 	 * @param[in,out] data The data of a retrieved item
@@ -1544,6 +1713,40 @@ int  mdb_cursor_del(MDB_cursor *cursor, unsigned int flags);
 	 */
 int  mdb_cursor_count(MDB_cursor *cursor, size_t *countp);
 
+	/** @brief Move pages at the end of the file into free space.
+	 *
+	 * Walks the cursor's database in key order, starting at \b key, and
+	 * rewrites every page that lies in the tail of the file (the part
+	 * that would be empty if all free pages were at the end) into a
+	 * free page nearer the start. This includes branch and leaf pages,
+	 * overflow pages and the pages of #MDB_DUPSORT sub-databases. The
+	 * data itself is unchanged. Pages moved this way become free when
+	 * the transaction commits, and #mdb_txn_shrink() can drop them from
+	 * the end of the file once no reader uses them any more.
+	 *
+	 * The walk stops after \b maxpages leaf pages have been visited or
+	 * that many pages have been moved, or when there is no more room
+	 * in the free space or the transaction's dirty list, so a large
+	 * database can be compacted in many small transactions.
+	 * @param[in] cursor A cursor handle returned by #mdb_cursor_open(),
+	 *	in a top-level write transaction.
+	 * @param[in,out] key The key to start at, or a key of size 0 to start
+	 *	at the first key. On success it is set to the key to resume at.
+	 *	It points into the database and must be copied before the
+	 *	transaction ends.
+	 * @param[in] maxpages The most leaf pages to visit or pages to move.
+	 * @param[out] moved The number of pages that were moved.
+	 * @return A non-zero error value on failure and 0 on success. Some possible
+	 * errors are:
+	 * <ul>
+	 *	<li>#MDB_NOTFOUND - the walk reached the end of the database.
+	 *	<li>EACCES - an attempt was made to write in a read-only transaction.
+	 *	<li>EINVAL - an invalid parameter was specified.
+	 * </ul>
+	 */
+int  mdb_cursor_compact(MDB_cursor *cursor, MDB_val *key, size_t maxpages,
+	size_t *moved);
+
 	/** @brief Compare two data items according to a particular database.
 	 *
 	 * This returns a comparison as if the two data items were keys in the
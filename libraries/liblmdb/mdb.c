@@ -541,6 +541,24 @@ static txnid_t mdb_debug_start;
 	/**	The version number for a database's lockfile format. */
 #define MDB_LOCK_VERSION	 1
 
+	/**	@defgroup txnsfile	Txnid File
+	 *	With #MDB_INCREMENTAL, the txnid that last wrote each page is
+	 *	kept in an array of #txnid_t after a small header.
+	 *	@{
+	 */
+#define MDB_TXNS_HDR	4	/**< Number of header slots */
+#define MDB_TXNS_ID		0	/**< Header slot holding #MDB_TXNS_MAGIC */
+#define MDB_TXNS_START	1	/**< Page txnids are valid after this txn */
+#define MDB_TXNS_LAST	2	/**< The last txn recorded */
+	/**	A stamp that identifies a txnid file. */
+#define MDB_TXNS_MAGIC	 0xBEEF71D5
+	/** @} */
+
+	/**	A stamp that identifies an incremental copy. */
+#define MDB_INCR_MAGIC	 0xBEEFD1FF
+	/**	The version number for the format of incremental copies. */
+#define MDB_INCR_VERSION	 1
+
 	/**	@brief The max size of a key we can write, or 0 for computed max.
 	 *
 	 *	This macro should normally be left alone or set to 0.
@@ -670,6 +688,26 @@ typedef uint16_t	 indx_t;
 	 */
 #ifndef CACHELINE
 #define CACHELINE	64
+#endif
+
+	/**	Claim reader slots with an atomic compare-and-swap on the slot's
+	 *	pid, instead of under the reader table mutex, when the compiler
+	 *	provides one. Build with MDB_NO_READER_CAS to always use the mutex.
+	 *	Processes claiming slots the two ways can't share a lock file,
+	 *	so this is part of #MDB_LOCK_FORMAT.
+	 */
+#ifndef MDB_NO_READER_CAS
+# if defined(_WIN32)
+#  define MDB_CAS(ptr, old, new) \
+	(InterlockedCompareExchange((LONG volatile *)(ptr), (LONG)(new), (LONG)(old)) == (LONG)(old))
+# elif (__GNUC__ * 100 + __GNUC_MINOR__ >= 404) || defined(__clang__)
+#  define MDB_CAS(ptr, old, new)	__sync_bool_compare_and_swap(ptr, old, new)
+# endif
+#endif
+#ifdef MDB_CAS
+# define MDB_READER_CAS	1
+#else
+# define MDB_READER_CAS	0
 #endif
 
 	/**	The information we store in a single slot of the reader table.
@@ -778,7 +816,8 @@ typedef struct MDB_txninfo {
 	((uint32_t) \
 	 ((MDB_LOCK_VERSION) \
 	  /* Flags which describe functionality */ \
-	  + (((MDB_PIDLOCK) != 0) << 16)))
+	  + (((MDB_PIDLOCK) != 0) << 16) \
+	  + (((MDB_READER_CAS) != 0) << 17)))
 /** @} */
 
 /** Common header for all page types. The page type depends on #mp_flags.
@@ -1073,6 +1112,7 @@ typedef struct MDB_dbx {
 	MDB_cmp_func	*md_dcmp;	/**< function for comparing data items */
 	MDB_rel_func	*md_rel;	/**< user relocate function */
 	void		*md_relctx;		/**< user-provided context for md_rel */
+	int			md_ovzone;		/**< see #mdb_set_ovzone() */
 } MDB_dbx;
 
 	/** A database transaction.
@@ -1252,11 +1292,21 @@ typedef struct MDB_pgstate {
 	txnid_t		mf_pglast;	/**< ID of last used record, or 0 if !mf_pghead */
 } MDB_pgstate;
 
+	/** A run of contiguous pages in me_pghead, for multi-page allocations.
+	 *	The run is named by its highest page so that single-page allocations,
+	 *	which take the lowest pages in me_pghead, only ever shorten it.
+	 */
+typedef struct MDB_pgrun {
+	pgno_t		mr_high;	/**< highest page of the run */
+	pgno_t		mr_len;		/**< number of pages in the run */
+} MDB_pgrun;
+
 	/** The database environment. */
 struct MDB_env {
 	HANDLE		me_fd;		/**< The main data file */
 	HANDLE		me_lfd;		/**< The lock file */
 	HANDLE		me_mfd;		/**< For writing and syncing the meta pages */
+	HANDLE		me_tfd;		/**< The txnid file, with #MDB_INCREMENTAL */
 	/** Failed to update the meta page. Probably an I/O error. */
 #define	MDB_FATAL_ERROR	0x80000000U
 	/** Some fields are initialized. */
@@ -1278,6 +1328,11 @@ struct MDB_env {
 	char		*me_map;		/**< the memory map of the data file */
 	MDB_txninfo	*me_txns;		/**< the memory map of the lock file or NULL */
 	MDB_meta	*me_metas[NUM_METAS];	/**< pointers to the two meta pages */
+	/** The memory map of the txnid file: a header of #MDB_TXNS_HDR
+	 *	txnids, then the txnid that last wrote each page.
+	 */
+	txnid_t		*me_tmap;
+	size_t		me_tsize;		/**< size of the txnid file memory map */
 	void		*me_pbuf;		/**< scratch area for DUPSORT put() */
 	MDB_txn		*me_txn;		/**< current write transaction */
 	MDB_txn		*me_txn0;		/**< prealloc'd write transaction */
@@ -1289,9 +1344,19 @@ struct MDB_env {
 	unsigned int	*me_dbiseqs;	/**< array of dbi sequence numbers */
 	pthread_key_t	me_txkey;	/**< thread-key for readers */
 	txnid_t		me_pgoldest;	/**< ID of oldest reader last time we looked */
+	txnid_t		me_pgoldest_txn;	/**< write txn which set me_pgoldest */
 	MDB_pgstate	me_pgstate;		/**< state of old pages from freeDB */
 #	define		me_pglast	me_pgstate.mf_pglast
 #	define		me_pghead	me_pgstate.mf_pghead
+	/** Runs of 2 or more pages in me_pghead, sorted by length. Only a
+	 *	hint: entries are checked against me_pghead before use.
+	 */
+	MDB_pgrun	*me_pgruns;
+	unsigned	me_pgruns_num;	/**< number of entries in me_pgruns */
+	unsigned	me_pgruns_max;	/**< allocated size of me_pgruns */
+	pgno_t		*me_pgruns_mop;	/**< me_pghead that me_pgruns describes */
+	pgno_t		me_pgruns_len;	/**< length of me_pghead when last synced */
+	txnid_t		me_pgruns_txnid;	/**< txn that me_pgruns belongs to */
 	MDB_page	*me_dpages;		/**< list of malloc'd blocks for re-use */
 	/** IDL of pages that became unused in a write txn */
 	MDB_IDL		me_free_pgs;
@@ -2112,6 +2177,23 @@ mdb_find_oldest(MDB_txn *txn)
 	return oldest;
 }
 
+/** Return the oldest txnid still referenced, scanning the reader table
+ *	at most once per write txn. Readers only move forward and new ones
+ *	start from the last commit, so the value found remains a safe bound
+ *	until this txn commits.
+ */
+static txnid_t
+mdb_oldest_reader(MDB_txn *txn)
+{
+	MDB_env *env = txn->mt_env;
+
+	if (env->me_pgoldest_txn != txn->mt_txnid) {
+		env->me_pgoldest = mdb_find_oldest(txn);
+		env->me_pgoldest_txn = txn->mt_txnid;
+	}
+	return env->me_pgoldest;
+}
+
 /** Add a page to the txn's dirty list */
 static void
 mdb_page_dirty(MDB_txn *txn, MDB_page *mp)
@@ -2131,6 +2213,160 @@ mdb_page_dirty(MDB_txn *txn, MDB_page *mp)
 	txn->mt_dirty_room--;
 }
 
+/** Tell if the free-run index still describes \b mop.
+ * Every change to me_pghead outside #mdb_page_alloc() and
+ * #mdb_ovpage_free() moves its length or its address, so a stale
+ * index is noticed here and rebuilt.
+ */
+#define MDB_PGRUNS_SYNCED(env, txn, mop) \
+	((env)->me_pgruns_mop == (mop) && (env)->me_pgruns_len == (mop)[0] && \
+	 (env)->me_pgruns_txnid == (txn)->mt_txnid)
+
+static int
+mdb_pgrun_cmp(const void *a, const void *b)
+{
+	const MDB_pgrun *ra = a, *rb = b;
+	if (ra->mr_len != rb->mr_len)
+		return ra->mr_len < rb->mr_len ? -1 : 1;
+	/* Among equals prefer the lower pages, as the old tail scan did */
+	return ra->mr_high < rb->mr_high ? -1 : ra->mr_high > rb->mr_high;
+}
+
+/** Make room for \b n more entries in the free-run index.
+ * @return 0 on success, ENOMEM on failure.
+ */
+static int
+mdb_pgruns_need(MDB_env *env, unsigned n)
+{
+	MDB_pgrun *runs;
+	unsigned max = env->me_pgruns_num + n;
+
+	if (max <= env->me_pgruns_max)
+		return 0;
+	if (max < 2 * env->me_pgruns_max)
+		max = 2 * env->me_pgruns_max;
+	if (max < 64)
+		max = 64;
+	runs = realloc(env->me_pgruns, max * sizeof(MDB_pgrun));
+	if (!runs)
+		return ENOMEM;
+	env->me_pgruns = runs;
+	env->me_pgruns_max = max;
+	return 0;
+}
+
+/** Rebuild the free-run index from \b mop in one pass.
+ * @return 0 on success, ENOMEM on failure.
+ */
+static int
+mdb_pgruns_build(MDB_env *env, MDB_txn *txn, pgno_t *mop)
+{
+	unsigned i, j, len = mop[0];
+
+	env->me_pgruns_mop = NULL;
+	env->me_pgruns_num = 0;
+	for (i = 1; i <= len; i = j) {
+		for (j = i + 1; j <= len && mop[j] == mop[i] - (j - i); j++) ;
+		if (j - i < 2)
+			continue;
+		if (mdb_pgruns_need(env, 1))
+			return ENOMEM;
+		env->me_pgruns[env->me_pgruns_num].mr_high = mop[i];
+		env->me_pgruns[env->me_pgruns_num].mr_len = j - i;
+		env->me_pgruns_num++;
+	}
+	qsort(env->me_pgruns, env->me_pgruns_num, sizeof(MDB_pgrun),
+		mdb_pgrun_cmp);
+	env->me_pgruns_mop = mop;
+	env->me_pgruns_len = len;
+	env->me_pgruns_txnid = txn->mt_txnid;
+	return 0;
+}
+
+/** Put index entry \b k back in order after its run got shorter,
+ * or drop it if it is no longer a run.
+ */
+static void
+mdb_pgruns_shrunk(MDB_env *env, unsigned k)
+{
+	MDB_pgrun *runs = env->me_pgruns, r = runs[k];
+
+	if (r.mr_len < 2) {
+		env->me_pgruns_num--;
+		memmove(runs + k, runs + k + 1,
+			(env->me_pgruns_num - k) * sizeof(MDB_pgrun));
+		return;
+	}
+	for (; k && mdb_pgrun_cmp(&runs[k-1], &r) > 0; k--)
+		runs[k] = runs[k-1];
+	runs[k] = r;
+}
+
+/** Find \b num contiguous pages in me_pghead.
+ * Takes the shortest run that is long enough, or with \b high the
+ * highest one, instead of scanning all of me_pghead. The index is
+ * rebuilt only when me_pghead has grown or changed hands, and each
+ * candidate is verified against me_pghead, so a stale entry can cost
+ * a retry but never hands out a page that is not free.
+ * @param[in] txn the write transaction.
+ * @param[in] mop me_pghead.
+ * @param[in] num the number of pages wanted, at least 2.
+ * @param[in] high take the run with the highest pages, for
+ *	#mdb_set_ovzone().
+ * @param[out] ip index in \b mop of the lowest page of the range.
+ * @return 1 if found, 0 if not, -1 if the index could not be built.
+ */
+static int
+mdb_pgruns_find(MDB_txn *txn, pgno_t *mop, unsigned num, int high,
+	unsigned *ip)
+{
+	MDB_env *env = txn->mt_env;
+	MDB_pgrun *r;
+	unsigned lo, hi, k, p, len, n2 = num - 1;
+
+	if (!MDB_PGRUNS_SYNCED(env, txn, mop) &&
+		mdb_pgruns_build(env, txn, mop))
+		return -1;
+
+	for (;;) {
+		/* First entry with mr_len >= num */
+		for (lo = 0, hi = env->me_pgruns_num; lo < hi; ) {
+			k = (lo + hi) >> 1;
+			if (env->me_pgruns[k].mr_len < num)
+				lo = k + 1;
+			else
+				hi = k;
+		}
+		if (lo == env->me_pgruns_num)
+			return 0;
+		if (high) {
+			/* All runs from lo on are long enough */
+			for (k = lo + 1; k < env->me_pgruns_num; k++)
+				if (env->me_pgruns[k].mr_high > env->me_pgruns[lo].mr_high)
+					lo = k;
+		}
+		r = &env->me_pgruns[lo];
+		p = mdb_midl_search(mop, r->mr_high);
+		if (p + n2 <= mop[0] && mop[p] == r->mr_high &&
+			mop[p + n2] == r->mr_high - n2)
+			break;
+		/* Single-page allocations took the low end, see what is left */
+		len = 0;
+		if (p <= mop[0] && mop[p] == r->mr_high)
+			for (len = 1; len < r->mr_len && p + len <= mop[0] &&
+				mop[p + len] == r->mr_high - len; len++) ;
+		r->mr_len = len;
+		mdb_pgruns_shrunk(env, lo);
+	}
+
+	/* Take the high end, the rest stays a (shorter) run */
+	*ip = p + n2;
+	r->mr_high -= num;
+	r->mr_len -= num;
+	mdb_pgruns_shrunk(env, lo);
+	return 1;
+}
+
 /** Allocate page numbers and memory for writing.  Maintain me_pglast,
  * me_pghead and mt_next_pgno.  Set #MDB_TXN_ERROR on failure.
  *
@@ -2196,15 +2432,33 @@ mdb_page_alloc(MDB_cursor *mc, int num, MDB_page **mp)
 		pgno_t *idl;
 
 		/* Seek a big enough contiguous page range. Prefer
-		 * pages at the tail, just truncating the list.
+		 * pages at the tail, just truncating the list. Ranges
+		 * of more than one page come from the free-run index,
+		 * falling back to a scan if it cannot be built. Overflow
+		 * pages of a DB with #mdb_set_ovzone() take the highest
+		 * range instead, away from the B-tree pages at the tail.
 		 */
 		if (mop_len > n2) {
-			i = mop_len;
-			do {
-				pgno = mop[i];
-				if (mop[i-n2] == pgno+n2)
+			int ovzone = txn->mt_dbxs[mc->mc_dbi].md_ovzone;
+			if (n2 && (rc = mdb_pgruns_find(txn, mop, num, ovzone, &i)) >= 0) {
+				if (rc) {
+					pgno = mop[i];
 					goto search_done;
-			} while (--i > n2);
+				}
+			} else if (n2 && ovzone) {
+				for (i = n2+1; i <= mop_len; i++) {
+					pgno = mop[i];
+					if (mop[i-n2] == pgno+n2)
+						goto search_done;
+				}
+			} else {
+				i = mop_len;
+				do {
+					pgno = mop[i];
+					if (mop[i-n2] == pgno+n2)
+						goto search_done;
+				} while (--i > n2);
+			}
 			if (--retry < 0)
 				break;
 		}
@@ -2229,8 +2483,7 @@ mdb_page_alloc(MDB_cursor *mc, int num, MDB_page **mp)
 		/* Do not fetch more if the record will be too recent */
 		if (oldest <= last) {
 			if (!found_old) {
-				oldest = mdb_find_oldest(txn);
-				env->me_pgoldest = oldest;
+				oldest = mdb_oldest_reader(txn);
 				found_old = 1;
 			}
 			if (oldest <= last)
@@ -2245,8 +2498,7 @@ mdb_page_alloc(MDB_cursor *mc, int num, MDB_page **mp)
 		last = *(txnid_t*)key.mv_data;
 		if (oldest <= last) {
 			if (!found_old) {
-				oldest = mdb_find_oldest(txn);
-				env->me_pgoldest = oldest;
+				oldest = mdb_oldest_reader(txn);
 				found_old = 1;
 			}
 			if (oldest <= last)
@@ -2300,6 +2552,8 @@ search_done:
 		}
 	}
 	if (i) {
+		if (MDB_PGRUNS_SYNCED(env, txn, mop))
+			env->me_pgruns_len -= num;
 		mop[0] = mop_len -= num;
 		/* Move any stragglers down */
 		for (j = i-num; j < mop_len; )
@@ -2700,12 +2954,51 @@ mdb_txn_renew0(MDB_txn *txn)
 				mdb_mutexref_t rmutex = env->me_rmutex;
 
 				if (!env->me_live_reader) {
-					rc = mdb_reader_pid(env, Pidset, pid);
+					/* Any slot still holding our pid was left by a dead
+					 * process which had it. Clear them under the mutex,
+					 * which also waits out a stale reader check that saw
+					 * this pid dead before our Pidset. Later checks see us
+					 * alive and leave our slots alone.
+					 */
+					if (LOCK_MUTEX(rc, env, rmutex))
+						return rc;
+					if (!env->me_live_reader) {
+						rc = mdb_reader_pid(env, Pidset, pid);
+						if (!rc) {
+							for (i=0; i<ti->mti_numreaders; i++)
+								if (ti->mti_readers[i].mr_pid == pid)
+									ti->mti_readers[i].mr_pid = 0;
+							env->me_live_reader = 1;
+						}
+					}
+					UNLOCK_MUTEX(rmutex);
 					if (rc)
 						return rc;
-					env->me_live_reader = 1;
 				}
 
+#if MDB_READER_CAS
+				/* Claim a free slot without the mutex. Slots past
+				 * mti_numreaders are zeroed when the lock file is set
+				 * up, so any slot with no pid is free. Publish it in
+				 * mti_numreaders before setting mr_txnid below, and
+				 * in me_close_readers for mdb_env_close().
+				 */
+				for (i=0; i<env->me_maxreaders; i++)
+					if (ti->mti_readers[i].mr_pid == 0 &&
+						MDB_CAS(&ti->mti_readers[i].mr_pid, 0, pid))
+						break;
+				if (i == env->me_maxreaders)
+					return MDB_READERS_FULL;
+				r = &ti->mti_readers[i];
+				r->mr_txnid = (txnid_t)-1;
+				r->mr_tid = tid;
+				while ((nr = ti->mti_numreaders) <= i &&
+					!MDB_CAS(&ti->mti_numreaders, nr, i+1))
+					;
+				while ((nr = env->me_close_readers) <= i &&
+					!MDB_CAS(&env->me_close_readers, (int)nr, (int)i+1))
+					;
+#else
 				if (LOCK_MUTEX(rc, env, rmutex))
 					return rc;
 				nr = ti->mti_numreaders;
@@ -2731,6 +3024,7 @@ mdb_txn_renew0(MDB_txn *txn)
 				env->me_close_readers = nr;
 				r->mr_pid = pid;
 				UNLOCK_MUTEX(rmutex);
+#endif
 
 				new_notls = (env->me_flags & MDB_NOTLS);
 				if (!new_notls && (rc=pthread_setspecific(env->me_txkey, r))) {
@@ -3018,6 +3312,7 @@ mdb_txn_end(MDB_txn *txn, unsigned mode)
 			/* me_pgstate: */
 			env->me_pghead = NULL;
 			env->me_pglast = 0;
+			env->me_pgruns_mop = NULL;
 
 			env->me_txn = NULL;
 			mode = 0;	/* txn == env->me_txn0, do not free() it */
@@ -3029,6 +3324,7 @@ mdb_txn_end(MDB_txn *txn, unsigned mode)
 			txn->mt_parent->mt_child = NULL;
 			txn->mt_parent->mt_flags &= ~MDB_TXN_HAS_CHILD;
 			env->me_pgstate = ((MDB_ntxn *)txn)->mnt_pgstate;
+			env->me_pgruns_mop = NULL;
 			mdb_midl_free(txn->mt_free_pgs);
 			free(txn->mt_u.dirty_list);
 		}
@@ -3326,6 +3622,8 @@ mdb_page_flush(MDB_txn *txn, int keep)
 				continue;
 			}
 			dp->mp_flags &= ~P_DIRTY;
+			if (env->me_tmap)
+				env->me_tmap[MDB_TXNS_HDR + dl[i].mid] = txn->mt_txnid;
 		}
 		goto done;
 	}
@@ -3343,6 +3641,8 @@ mdb_page_flush(MDB_txn *txn, int keep)
 			pgno = dl[i].mid;
 			/* clear dirty flag */
 			dp->mp_flags &= ~P_DIRTY;
+			if (env->me_tmap)
+				env->me_tmap[MDB_TXNS_HDR + pgno] = txn->mt_txnid;
 			pos = pgno * psize;
 			size = psize;
 			if (IS_OVERFLOW(dp)) size *= dp->mp_pages;
@@ -3441,6 +3741,32 @@ done:
 	return MDB_SUCCESS;
 }
 
+/** Finish the txnid file update of a commit, with #MDB_INCREMENTAL.
+ * The page txnids were set by #mdb_page_flush(). They must be on disk
+ * before the meta page, or an incremental copy could miss a page.
+ * @param[in] txn the transaction that's being committed
+ * @return 0 on success, non-zero on failure.
+ */
+static int
+mdb_env_txns_sync(MDB_txn *txn)
+{
+	MDB_env *env = txn->mt_env;
+	txnid_t *hdr = env->me_tmap;
+
+	if (!hdr)
+		return MDB_SUCCESS;
+	/* If someone committed without recording it, the page txnids
+	 * only hold from here on.
+	 */
+	if (hdr[MDB_TXNS_LAST] + 1 != txn->mt_txnid)
+		hdr[MDB_TXNS_START] = txn->mt_txnid - 1;
+	hdr[MDB_TXNS_LAST] = txn->mt_txnid;
+	if (!(env->me_flags & MDB_NOSYNC) && MDB_MSYNC((void *)hdr,
+		(MDB_TXNS_HDR + txn->mt_next_pgno) * sizeof(txnid_t), MS_SYNC))
+		return ErrCode();
+	return MDB_SUCCESS;
+}
+
 int
 mdb_txn_commit(MDB_txn *txn)
 {
@@ -3649,6 +3975,7 @@ mdb_txn_commit(MDB_txn *txn)
 
 	mdb_midl_free(env->me_pghead);
 	env->me_pghead = NULL;
+	env->me_pgruns_mop = NULL;
 	mdb_midl_shrink(&txn->mt_free_pgs);
 
 #if (MDB_DEBUG) > 2
@@ -3657,6 +3984,7 @@ mdb_txn_commit(MDB_txn *txn)
 
 	if ((rc = mdb_page_flush(txn, 0)) ||
 		(rc = mdb_env_sync(env, 0)) ||
+		(rc = mdb_env_txns_sync(txn)) ||
 		(rc = mdb_env_write_meta(txn)))
 		goto fail;
 	end_mode = MDB_END_COMMITTED|MDB_END_UPDATE;
@@ -3958,6 +4286,7 @@ mdb_env_create(MDB_env **env)
 	e->me_fd = INVALID_HANDLE_VALUE;
 	e->me_lfd = INVALID_HANDLE_VALUE;
 	e->me_mfd = INVALID_HANDLE_VALUE;
+	e->me_tfd = INVALID_HANDLE_VALUE;
 #ifdef MDB_USE_POSIX_SEM
 	e->me_rmutex = SEM_FAILED;
 	e->me_wmutex = SEM_FAILED;
@@ -4058,6 +4387,42 @@ mdb_env_map(MDB_env *env, void *addr)
 	return MDB_SUCCESS;
 }
 
+#ifndef _WIN32
+/** Map the txnid file of #MDB_INCREMENTAL, growing it to cover the
+ * data file map.
+ * @param[in] env the environment handle
+ * @return 0 on success, non-zero on failure.
+ */
+static int ESECT
+mdb_env_txns_map(MDB_env *env)
+{
+	struct stat st;
+	size_t size;
+
+	size = (MDB_TXNS_HDR + env->me_mapsize / env->me_psize) * sizeof(txnid_t);
+	if (fstat(env->me_tfd, &st))
+		return ErrCode();
+	/* New slots read as txnid 0. That is right for any page not
+	 * written since #MDB_TXNS_START, later ones get set on commit.
+	 */
+	if ((size_t)st.st_size < size && ftruncate(env->me_tfd, size) < 0)
+		return ErrCode();
+	env->me_tmap = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_SHARED,
+		env->me_tfd, 0);
+	if (env->me_tmap == MAP_FAILED) {
+		env->me_tmap = NULL;
+		return ErrCode();
+	}
+	env->me_tsize = size;
+	if (env->me_tmap[MDB_TXNS_ID] != MDB_TXNS_MAGIC) {
+		env->me_tmap[MDB_TXNS_START] = 0;
+		env->me_tmap[MDB_TXNS_LAST] = 0;
+		env->me_tmap[MDB_TXNS_ID] = MDB_TXNS_MAGIC;
+	}
+	return MDB_SUCCESS;
+}
+#endif
+
 int ESECT
 mdb_env_set_mapsize(MDB_env *env, size_t size)
 {
@@ -4085,6 +4450,15 @@ mdb_env_set_mapsize(MDB_env *env, size_t size)
 		rc = mdb_env_map(env, old);
 		if (rc)
 			return rc;
+#ifndef _WIN32
+		if (env->me_tmap) {
+			munmap((void *)env->me_tmap, env->me_tsize);
+			env->me_tmap = NULL;
+			rc = mdb_env_txns_map(env);
+			if (rc)
+				return rc;
+		}
+#endif
 	}
 	env->me_mapsize = size;
 	if (env->me_psize)
@@ -4159,10 +4533,11 @@ typedef struct MDB_name {
 	mdb_nchar_t	*mn_val;		/**< Contents */
 } MDB_name;
 
-/** Filename suffixes [datafile,lockfile][without,with MDB_NOSUBDIR] */
-static const mdb_nchar_t *const mdb_suffixes[2][2] = {
+/** Filename suffixes [datafile,lockfile,txnid file][without,with MDB_NOSUBDIR] */
+static const mdb_nchar_t *const mdb_suffixes[3][2] = {
 	{ MDB_NAME("/data.mdb"), MDB_NAME("")      },
-	{ MDB_NAME("/lock.mdb"), MDB_NAME("-lock") }
+	{ MDB_NAME("/lock.mdb"), MDB_NAME("-lock") },
+	{ MDB_NAME("/txns.mdb"), MDB_NAME("-txns") }
 };
 
 #define MDB_SUFFLEN 9	/**< Max string length in #mdb_suffixes[] */
@@ -4908,6 +5283,8 @@ mdb_env_setup_locks(MDB_env *env, MDB_name *fname, int mode, int *excl)
 		env->me_txns->mti_format = MDB_LOCK_FORMAT;
 		env->me_txns->mti_txnid = 0;
 		env->me_txns->mti_numreaders = 0;
+		memset(env->me_txns->mti_readers, 0,
+			env->me_maxreaders * sizeof(MDB_reader));
 
 	} else {
 		if (env->me_txns->mti_magic != MDB_MAGIC) {
@@ -4951,12 +5328,41 @@ fail:
 	 */
 #define	CHANGEABLE	(MDB_NOSYNC|MDB_NOMETASYNC|MDB_MAPASYNC|MDB_NOMEMINIT)
 #define	CHANGELESS	(MDB_FIXEDMAP|MDB_NOSUBDIR|MDB_RDONLY| \
-	MDB_WRITEMAP|MDB_NOTLS|MDB_NOLOCK|MDB_NORDAHEAD)
+	MDB_WRITEMAP|MDB_NOTLS|MDB_NOLOCK|MDB_NORDAHEAD|MDB_INCREMENTAL)
 
 #if VALID_FLAGS & PERSISTENT_FLAGS & (CHANGEABLE|CHANGELESS)
 # error "Persistent DB flags & env flags overlap, but both go in mm_flags"
 #endif
 
+#ifndef _WIN32
+/** Open the txnid file of #MDB_INCREMENTAL.
+ * @param[in] env the environment handle, with #me_path set
+ * @param[in] rdonly only for reading, the file must exist
+ * @param[in] mode the Unix permissions for the file, if we create it
+ * @param[out] res resulting file handle
+ * @return 0 on success, non-zero on failure.
+ */
+static int ESECT
+mdb_env_txns_open(MDB_env *env, int rdonly, mdb_mode_t mode, HANDLE *res)
+{
+	MDB_name fname;
+	int rc;
+
+	/* always leave room for the suffix */
+	rc = mdb_fname_init(env->me_path, env->me_flags & ~MDB_NOLOCK, &fname);
+	if (rc)
+		return rc;
+	mdb_name_cpy(fname.mn_val + fname.mn_len,
+		mdb_suffixes[2][F_ISSET(env->me_flags, MDB_NOSUBDIR)]);
+	*res = open(fname.mn_val, rdonly ? O_RDONLY|MDB_CLOEXEC :
+		O_RDWR|O_CREAT|MDB_CLOEXEC, mode);
+	if (*res == INVALID_HANDLE_VALUE)
+		rc = ErrCode();
+	mdb_fname_destroy(fname);
+	return rc;
+}
+#endif
+
 int ESECT
 mdb_env_open(MDB_env *env, const char *path, unsigned int flags, mdb_mode_t mode)
 {
@@ -4965,6 +5371,10 @@ mdb_env_open(MDB_env *env, const char *path, unsigned int flags, mdb_mode_t mode
 
 	if (env->me_fd!=INVALID_HANDLE_VALUE || (flags & ~(CHANGEABLE|CHANGELESS)))
 		return EINVAL;
+#ifdef _WIN32
+	if (flags & MDB_INCREMENTAL)
+		return EINVAL;
+#endif
 
 	flags |= env->me_flags;
 
@@ -5022,6 +5432,13 @@ mdb_env_open(MDB_env *env, const char *path, unsigned int flags, mdb_mode_t mode
 			if (rc)
 				goto leave;
 		}
+#ifndef _WIN32
+		if ((flags & (MDB_RDONLY|MDB_INCREMENTAL)) == MDB_INCREMENTAL) {
+			if ((rc = mdb_env_txns_open(env, 0, mode, &env->me_tfd)) ||
+				(rc = mdb_env_txns_map(env)))
+				goto leave;
+		}
+#endif
 		DPRINTF(("opened dbenv %p", (void *) env));
 		if (excl > 0) {
 			rc = mdb_env_share_locks(env, &excl);
@@ -5079,6 +5496,7 @@ mdb_env_close0(MDB_env *env, int excl)
 	free(env->me_path);
 	free(env->me_dirty_list);
 	free(env->me_txn0);
+	free(env->me_pgruns);
 	mdb_midl_free(env->me_free_pgs);
 
 	if (env->me_flags & MDB_ENV_TXKEY) {
@@ -5097,6 +5515,10 @@ mdb_env_close0(MDB_env *env, int excl)
 	if (env->me_map) {
 		munmap(env->me_map, env->me_mapsize);
 	}
+	if (env->me_tmap)
+		munmap((void *)env->me_tmap, env->me_tsize);
+	if (env->me_tfd != INVALID_HANDLE_VALUE)
+		(void) close(env->me_tfd);
 	if (env->me_mfd != INVALID_HANDLE_VALUE)
 		(void) close(env->me_mfd);
 	if (env->me_fd != INVALID_HANDLE_VALUE)
@@ -5596,6 +6018,39 @@ mdb_page_search_lowest(MDB_cursor *mc)
 	return mdb_page_search_root(mc, NULL, MDB_PS_FIRST);
 }
 
+/** Search for the page a key after the cursor's current page should be in.
+ * Rather than descending from the root, resume from the lowest branch
+ * page on the cursor stack whose range still covers the key, so that
+ * lookups of ascending keys only revisit the part of the path they
+ * don't share. The key must sort after every key on the current leaf.
+ * @param[in,out] mc the cursor for this operation.
+ * @param[in] key the key to search for.
+ * @return 0 on success, non-zero on failure.
+ */
+static int
+mdb_page_search_finger(MDB_cursor *mc, MDB_val *key)
+{
+	MDB_page	*mp;
+	MDB_node	*node;
+	MDB_val		 nodekey;
+	int i;
+
+	for (i = mc->mc_top - 1; i >= 0; i--) {
+		mp = mc->mc_pg[i];
+		if (mc->mc_ki[i] + 1U < NUMKEYS(mp)) {
+			node = NODEPTR(mp, mc->mc_ki[i] + 1);
+			nodekey.mv_size = NODEKSZ(node);
+			nodekey.mv_data = NODEKEY(node);
+			if (mc->mc_dbx->md_cmp(key, &nodekey) < 0)
+				break;
+		}
+	}
+	/* The child at level i+1 covers the key; the root covers any key */
+	mc->mc_top = i + 1;
+	mc->mc_snum = i + 2;
+	return mdb_page_search_root(mc, key, 0);
+}
+
 /** Search for the page a given key should be in.
  * Push it and its parent pages on the cursor stack.
  * @param[in,out] mc the cursor for this operation.
@@ -5709,8 +6164,9 @@ mdb_ovpage_free(MDB_cursor *mc, MDB_page *mp)
 		 (sl && (x = mdb_midl_search(sl, pn)) <= sl[0] && sl[x] == pn)))
 	{
 		unsigned i, j;
-		pgno_t *mop;
+		pgno_t *mop = env->me_pghead;
 		MDB_ID2 *dl, ix, iy;
+		int synced = MDB_PGRUNS_SYNCED(env, txn, mop);
 		rc = mdb_midl_need(&env->me_pghead, ovpages);
 		if (rc)
 			return rc;
@@ -5750,6 +6206,21 @@ release:
 		while (j>i)
 			mop[j--] = pg++;
 		mop[0] += ovpages;
+		/* Keep the free-run index in step, unmerged with neighbours */
+		if (synced) {
+			env->me_pgruns_mop = mop;
+			env->me_pgruns_len = mop[0];
+			if (ovpages > 1) {
+				if (mdb_pgruns_need(env, 1)) {
+					env->me_pgruns_mop = NULL;
+				} else {
+					j = env->me_pgruns_num++;
+					env->me_pgruns[j].mr_high = pg - 1;
+					env->me_pgruns[j].mr_len = ovpages;
+					mdb_pgruns_shrunk(env, j);
+				}
+			}
+		}
 	} else {
 		rc = mdb_midl_append_range(&txn->mt_free_pgs, pg, ovpages);
 		if (rc)
@@ -5869,6 +6340,86 @@ mdb_cursor_sibling(MDB_cursor *mc, int move_right)
 	return MDB_SUCCESS;
 }
 
+#if defined(MADV_WILLNEED) || defined(POSIX_MADV_WILLNEED)
+	/** Number of sibling leaves to read ahead of a cursor scan
+	 *	when the environment was opened with #MDB_NORDAHEAD.
+	 */
+#define MDB_PREFETCH	16
+
+	/** Ask the OS to start reading a run of pages. */
+static void
+mdb_page_prefetch(MDB_txn *txn, pgno_t pgno, pgno_t num)
+{
+	MDB_env *env = txn->mt_env;
+	char *addr;
+
+	if (pgno >= txn->mt_next_pgno || num > txn->mt_next_pgno - pgno)
+		return;
+	addr = env->me_map + env->me_psize * pgno;
+#ifdef MADV_WILLNEED
+	madvise(addr, env->me_psize * num, MADV_WILLNEED);
+#else
+	posix_madvise(addr, env->me_psize * num, POSIX_MADV_WILLNEED);
+#endif
+}
+
+/** Read ahead of a cursor that just stepped onto a sibling leaf.
+ * With #MDB_NORDAHEAD the OS only reads the pages that are touched,
+ * so a scan over cold data would wait for each leaf and each overflow
+ * page in turn. Request the overflow pages referenced from the new
+ * leaf, and every #MDB_PREFETCH leaves, the next #MDB_PREFETCH leaves
+ * in the direction of the scan under the same parent. Adjacent pages
+ * are requested together.
+ * @param[in] mc The cursor for this operation.
+ * @param[in] move_right Non-zero if the cursor is moving right.
+ */
+static void
+mdb_cursor_prefetch(MDB_cursor *mc, int move_right)
+{
+	MDB_txn *txn = mc->mc_txn;
+	MDB_page *mp = mc->mc_pg[mc->mc_top];
+	MDB_node *node;
+	pgno_t pgno, start = 0, num = 0;
+	indx_t i, n, ki;
+
+	if (!IS_LEAF2(mp)) {
+		n = NUMKEYS(mp);
+		for (i = 0; i < n; i++) {
+			node = NODEPTR(mp, i);
+			if (F_ISSET(node->mn_flags, F_BIGDATA)) {
+				memcpy(&pgno, NODEDATA(node), sizeof(pgno));
+				mdb_page_prefetch(txn, pgno,
+					OVPAGES(NODEDSZ(node), txn->mt_env->me_psize));
+			}
+		}
+	}
+
+	mp = mc->mc_pg[mc->mc_top-1];
+	ki = mc->mc_ki[mc->mc_top-1];
+	n = NUMKEYS(mp);
+	if ((move_right ? ki : n - 1 - ki) % MDB_PREFETCH)
+		return;
+	for (i = 1; i <= MDB_PREFETCH; i++) {
+		if (move_right ? ki + i >= n : ki < i)
+			break;
+		pgno = NODEPGNO(NODEPTR(mp, move_right ? ki + i : ki - i));
+		if (num && pgno == start + num) {
+			num++;
+		} else if (num && pgno + 1 == start) {
+			start = pgno;
+			num++;
+		} else {
+			if (num)
+				mdb_page_prefetch(txn, start, num);
+			start = pgno;
+			num = 1;
+		}
+	}
+	if (num)
+		mdb_page_prefetch(txn, start, num);
+}
+#endif
+
 /** Move the cursor to the next data item. */
 static int
 mdb_cursor_next(MDB_cursor *mc, MDB_val *key, MDB_val *data, MDB_cursor_op op)
@@ -5922,6 +6473,10 @@ mdb_cursor_next(MDB_cursor *mc, MDB_val *key, MDB_val *data, MDB_cursor_op op)
 			mc->mc_flags |= C_EOF;
 			return rc;
 		}
+#ifdef MDB_PREFETCH
+		if (mc->mc_txn->mt_env->me_flags & MDB_NORDAHEAD)
+			mdb_cursor_prefetch(mc, 1);
+#endif
 		mp = mc->mc_pg[mc->mc_top];
 		DPRINTF(("next page is %"Z"u, key index %u", mp->mp_pgno, mc->mc_ki[mc->mc_top]));
 	} else
@@ -6005,6 +6560,10 @@ mdb_cursor_prev(MDB_cursor *mc, MDB_val *key, MDB_val *data, MDB_cursor_op op)
 		if ((rc = mdb_cursor_sibling(mc, 0)) != MDB_SUCCESS) {
 			return rc;
 		}
+#ifdef MDB_PREFETCH
+		if (mc->mc_txn->mt_env->me_flags & MDB_NORDAHEAD)
+			mdb_cursor_prefetch(mc, 0);
+#endif
 		mp = mc->mc_pg[mc->mc_top];
 		mc->mc_ki[mc->mc_top] = NUMKEYS(mp) - 1;
 		DPRINTF(("prev page is %"Z"u, key index %u", mp->mp_pgno, mc->mc_ki[mc->mc_top]));
@@ -6137,6 +6696,10 @@ mdb_cursor_set(MDB_cursor *mc, MDB_val *key, MDB_val *data,
 				mc->mc_ki[mc->mc_top] = nkeys;
 				return MDB_NOTFOUND;
 			}
+			rc = mdb_page_search_finger(mc, key);
+			if (rc != MDB_SUCCESS)
+				return rc;
+			goto found;
 		}
 		if (!mc->mc_top) {
 			/* There are no other pages */
@@ -6155,6 +6718,7 @@ mdb_cursor_set(MDB_cursor *mc, MDB_val *key, MDB_val *data,
 	if (rc != MDB_SUCCESS)
 		return rc;
 
+found:
 	mp = mc->mc_pg[mc->mc_top];
 	mdb_cassert(mc, IS_LEAF(mp));
 
@@ -7732,32 +8296,422 @@ mdb_cursor_count(MDB_cursor *mc, size_t *countp)
 	return MDB_SUCCESS;
 }
 
-void
-mdb_cursor_close(MDB_cursor *mc)
+/** Merge every freeDB record that no reader still needs into me_pghead.
+ * Like the fetch loop of #mdb_page_alloc(), but does not stop at the
+ * first record that satisfies an allocation.
+ * @param[out] pending if not NULL, set to the number of free pages in
+ *	the records that are still too recent to use.
+ */
+static int
+mdb_freelist_load(MDB_txn *txn, pgno_t *pending)
 {
-	if (mc && !mc->mc_backup) {
-		/* remove from txn, if tracked */
-		if ((mc->mc_flags & C_UNTRACK) && mc->mc_txn->mt_cursors) {
-			MDB_cursor **prev = &mc->mc_txn->mt_cursors[mc->mc_dbi];
-			while (*prev && *prev != mc) prev = &(*prev)->mc_next;
-			if (*prev == mc)
-				*prev = mc->mc_next;
+	MDB_env *env = txn->mt_env;
+	MDB_cursor m2;
+	MDB_cursor_op op = MDB_FIRST;
+	MDB_val key, data;
+	MDB_page *np;
+	MDB_node *leaf;
+	txnid_t oldest, last = env->me_pglast;
+	pgno_t *idl;
+	int rc;
+
+	oldest = mdb_oldest_reader(txn);
+	mdb_cursor_init(&m2, txn, FREE_DBI, NULL);
+	if (last) {
+		op = MDB_SET_RANGE;
+		key.mv_data = &last; /* will look up last+1 */
+		key.mv_size = sizeof(last);
+	}
+	if (pending)
+		*pending = 0;
+	for (;; op = MDB_NEXT) {
+		last++;
+		if (oldest <= last && !pending)
+			break;
+		rc = mdb_cursor_get(&m2, &key, NULL, op);
+		if (rc)
+			return rc == MDB_NOTFOUND ? MDB_SUCCESS : rc;
+		last = *(txnid_t*)key.mv_data;
+		np = m2.mc_pg[m2.mc_top];
+		leaf = NODEPTR(np, m2.mc_ki[m2.mc_top]);
+		if ((rc = mdb_node_read(&m2, leaf, &data)) != MDB_SUCCESS)
+			return rc;
+		idl = (MDB_ID *) data.mv_data;
+		if (oldest <= last) {
+			/* Too recent to use, only count it */
+			if (!pending)
+				break;
+			*pending += idl[0];
+			continue;
 		}
-		free(mc);
+		if (!env->me_pghead) {
+			if (!(env->me_pghead = mdb_midl_alloc(idl[0])))
+				return ENOMEM;
+		} else if ((rc = mdb_midl_need(&env->me_pghead, idl[0])) != 0) {
+			return rc;
+		}
+		env->me_pglast = last;
+		mdb_midl_xmerge(env->me_pghead, idl);
 	}
+	return MDB_SUCCESS;
 }
 
-MDB_txn *
-mdb_cursor_txn(MDB_cursor *mc)
+	/** Dirty pages kept back for the named DB record and for
+	 *	#mdb_freelist_save() when compacting.
+	 */
+#define MDB_COMPACT_SLACK	32
+
+/** Tell if \b need more pages can be taken from below \b limit. */
+static int
+mdb_compact_room(MDB_txn *txn, pgno_t limit, unsigned need)
 {
-	if (!mc) return NULL;
-	return mc->mc_txn;
+	pgno_t *mop = txn->mt_env->me_pghead;
+	unsigned p;
+
+	if (txn->mt_dirty_room <= need + MDB_COMPACT_SLACK || !mop)
+		return 0;
+	/* mop is descending, count its entries below limit */
+	p = mdb_midl_search(mop, limit);
+	if (p <= mop[0] && mop[p] == limit)
+		p++;
+	return mop[0] + 1 - p >= need;
 }
 
-MDB_dbi
-mdb_cursor_dbi(MDB_cursor *mc)
+/** Count the pages on the cursor's path that touching would copy.
+ * @param[out] high set if any of them is at or above \b limit.
+ */
+static unsigned
+mdb_compact_path(MDB_cursor *mc, pgno_t limit, int *high)
 {
-	return mc->mc_dbi;
+	unsigned k, need = 0;
+
+	*high = 0;
+	for (k = 0; k < mc->mc_snum; k++) {
+		if (!(mc->mc_pg[k]->mp_flags & P_DIRTY)) {
+			need++;
+			if (mc->mc_pg[k]->mp_pgno >= limit)
+				*high = 1;
+		}
+	}
+	return need;
+}
+
+/** Move the overflow pages of \b leaf into free pages below \b limit.
+ * The leaf page must already be dirty. Does nothing if no free range
+ * of the right size is found there.
+ */
+static int
+mdb_ovpage_move(MDB_cursor *mc, MDB_node *leaf, pgno_t limit, size_t *moved)
+{
+	MDB_txn *txn = mc->mc_txn;
+	MDB_env *env = txn->mt_env;
+	MDB_page *omp, *np;
+	pgno_t pgno, *mop = env->me_pghead;
+	unsigned i, j, num, n2, mop_len = mop ? mop[0] : 0;
+	int rc;
+
+	memcpy(&pgno, NODEDATA(leaf), sizeof(pgno));
+	if ((rc = mdb_page_get(mc, pgno, &omp, NULL)) != 0)
+		return rc;
+	if (omp->mp_flags & P_DIRTY)
+		return MDB_SUCCESS;
+	num = omp->mp_pages;
+	n2 = num - 1;
+	if (txn->mt_dirty_room <= MDB_COMPACT_SLACK)
+		return MDB_SUCCESS;
+	/* Lowest fitting range, from the tail of mop */
+	for (i = mop_len; i > n2; i--) {
+		pgno = mop[i];
+		if (pgno + n2 >= limit)
+			return MDB_SUCCESS;
+		if (mop[i-n2] == pgno+n2)
+			break;
+	}
+	if (i <= n2)
+		return MDB_SUCCESS;
+
+	if (env->me_flags & MDB_WRITEMAP) {
+		np = (MDB_page *)(env->me_map + env->me_psize * pgno);
+	} else if (!(np = mdb_page_malloc(txn, num))) {
+		return ENOMEM;
+	}
+	memcpy(np, omp, (size_t)env->me_psize * num);
+	np->mp_pgno = pgno;
+	np->mp_flags |= P_DIRTY;
+	if (MDB_PGRUNS_SYNCED(env, txn, mop))
+		env->me_pgruns_len -= num;
+	mop[0] = mop_len -= num;
+	for (j = i-num; j < mop_len; )
+		mop[++j] = mop[++i];
+	mdb_page_dirty(txn, np);
+	memcpy(NODEDATA(leaf), &pgno, sizeof(pgno));
+
+	if ((rc = mdb_ovpage_free(mc, omp)) != 0)
+		return rc;
+	mc->mc_db->md_overflow_pages += num;
+	*moved += num;
+	return MDB_SUCCESS;
+}
+
+/** Move the tail pages of the sub-DB in node \b i of the cursor's leaf.
+ * The leaf is touched only once a page of the sub-DB has to move.
+ * @param[out] stop set if the walk ran out of room.
+ */
+static int
+mdb_compact_sub(MDB_cursor *mc, unsigned i, pgno_t limit, size_t *moved,
+	size_t *visited, int *stop)
+{
+	MDB_xcursor *mx = mc->mc_xcursor;
+	MDB_cursor *xc = &mx->mx_cursor;
+	MDB_val xkey;
+	unsigned need, mneed;
+	int rc, high, mhigh, touched = 0;
+
+	mc->mc_ki[mc->mc_top] = i;
+	mdb_xcursor_init1(mc, NODEPTR(mc->mc_pg[mc->mc_top], i));
+	rc = mdb_cursor_first(xc, &xkey, NULL);
+	while (!rc) {
+		need = mdb_compact_path(xc, limit, &high);
+		if (high) {
+			mneed = mdb_compact_path(mc, limit, &mhigh);
+			if (!mdb_compact_room(mc->mc_txn, limit, need + mneed)) {
+				*stop = 1;
+				break;
+			}
+			if (mneed && (rc = mdb_cursor_touch(mc)) != 0)
+				return rc;
+			if ((rc = mdb_cursor_touch(xc)) != 0)
+				return rc;
+			*moved += need + mneed;
+			touched = 1;
+		}
+		(*visited)++;
+		rc = mdb_cursor_sibling(xc, 1);
+	}
+	if (rc && rc != MDB_NOTFOUND)
+		return rc;
+	if (touched)
+		memcpy(NODEDATA(NODEPTR(mc->mc_pg[mc->mc_top], i)), &mx->mx_db,
+			sizeof(MDB_db));
+	return MDB_SUCCESS;
+}
+
+int
+mdb_cursor_compact(MDB_cursor *mc, MDB_val *key, size_t maxpages,
+	size_t *moved)
+{
+	MDB_txn *txn;
+	MDB_page *mp;
+	MDB_node *leaf;
+	pgno_t limit, pending, pg, *mop;
+	size_t visited = 0;
+	unsigned i, need;
+	int rc, high, stop = 0;
+
+	if (mc == NULL || key == NULL || moved == NULL || (mc->mc_flags & C_SUB))
+		return EINVAL;
+	txn = mc->mc_txn;
+	if (txn->mt_flags & (MDB_TXN_RDONLY|MDB_TXN_BLOCKED))
+		return (txn->mt_flags & MDB_TXN_RDONLY) ? EACCES : MDB_BAD_TXN;
+	if (txn->mt_parent || mc->mc_dbi == FREE_DBI)
+		return EINVAL;
+	*moved = 0;
+
+	if ((rc = mdb_freelist_load(txn, &pending)) != 0)
+		goto fail;
+	mop = txn->mt_env->me_pghead;
+	if (!mop || !mop[0])
+		return MDB_NOTFOUND;
+	/* Everything at or above limit would be free in a compact file.
+	 * Count all free pages, not just the usable ones, so that moving
+	 * pages does not move the limit. Leave some slack for the pages
+	 * each commit frees and takes back.
+	 */
+	limit = txn->mt_next_pgno - mop[0] - pending - txn->mt_free_pgs[0] +
+		MDB_COMPACT_SLACK;
+	if (limit >= txn->mt_next_pgno)
+		return MDB_NOTFOUND;
+
+	if (key->mv_size)
+		rc = mdb_cursor_set(mc, key, NULL, MDB_SET_RANGE, NULL);
+	else
+		rc = mdb_cursor_first(mc, NULL, NULL);
+	if (rc)
+		return rc;
+
+	for (;;) {
+		need = mdb_compact_path(mc, limit, &high);
+		if (high) {
+			if (!mdb_compact_room(txn, limit, need))
+				break;
+			if ((rc = mdb_cursor_touch(mc)) != 0)
+				goto fail;
+			*moved += need;
+		}
+		mp = mc->mc_pg[mc->mc_top];
+		for (i = 0; i < NUMKEYS(mp) && !stop; i++) {
+			leaf = NODEPTR(mp, i);
+			if (F_ISSET(leaf->mn_flags, F_DUPDATA|F_SUBDATA)) {
+				rc = mdb_compact_sub(mc, i, limit, moved, &visited, &stop);
+				if (rc)
+					goto fail;
+				mp = mc->mc_pg[mc->mc_top];
+				continue;
+			}
+			if (!F_ISSET(leaf->mn_flags, F_BIGDATA))
+				continue;
+			memcpy(&pg, NODEDATA(leaf), sizeof(pg));
+			if (pg < limit)
+				continue;
+			/* The node will point elsewhere, so its page must be dirty */
+			need = mdb_compact_path(mc, limit, &high);
+			if (need) {
+				if (!mdb_compact_room(txn, limit, need)) {
+					stop = 1;
+					break;
+				}
+				if ((rc = mdb_cursor_touch(mc)) != 0)
+					goto fail;
+				*moved += need;
+				mp = mc->mc_pg[mc->mc_top];
+				leaf = NODEPTR(mp, i);
+			}
+			if ((rc = mdb_ovpage_move(mc, leaf, limit, moved)) != 0)
+				goto fail;
+		}
+		if (stop)
+			break;
+		visited++;
+		if (visited >= maxpages || *moved >= maxpages) {
+			rc = mdb_cursor_sibling(mc, 1);
+			if (rc)
+				goto done;
+			break;
+		}
+		if ((rc = mdb_cursor_sibling(mc, 1)) != 0)
+			goto done;
+	}
+
+	/* Resume at the first key of the current leaf */
+	mp = mc->mc_pg[mc->mc_top];
+	mc->mc_ki[mc->mc_top] = 0;
+	leaf = NODEPTR(mp, 0);
+	MDB_GET_KEY(leaf, key);
+	return MDB_SUCCESS;
+
+done:
+	if (rc == MDB_NOTFOUND)
+		return rc;
+fail:
+	txn->mt_flags |= MDB_TXN_ERROR;
+	return rc;
+}
+
+int
+mdb_txn_shrink(MDB_txn *txn, size_t *pages)
+{
+	MDB_env *env;
+	pgno_t *mop, last;
+	unsigned n = 0;
+	int rc;
+
+	if (txn == NULL)
+		return EINVAL;
+	if (pages)
+		*pages = 0;
+	if (txn->mt_flags & (MDB_TXN_RDONLY|MDB_TXN_BLOCKED))
+		return (txn->mt_flags & MDB_TXN_RDONLY) ? EACCES : MDB_BAD_TXN;
+	if (txn->mt_parent)
+		return EINVAL;
+	env = txn->mt_env;
+
+	if ((rc = mdb_freelist_load(txn, NULL)) != 0) {
+		txn->mt_flags |= MDB_TXN_ERROR;
+		return rc;
+	}
+	/* mop is descending: the free tail of the file is at its head */
+	mop = env->me_pghead;
+	if (mop) {
+		while (n < mop[0] && mop[n+1] == txn->mt_next_pgno - 1 - n)
+			n++;
+		if (n) {
+			mop[0] -= n;
+			memmove(mop + 1, mop + 1 + n, mop[0] * sizeof(pgno_t));
+			txn->mt_next_pgno -= n;
+			/* The new end of file only persists if we commit */
+			txn->mt_flags |= MDB_TXN_DIRTY;
+		}
+	}
+	if (pages)
+		*pages = n;
+
+	/* Pages freed by the last commit only become usable after one more
+	 * commit. If no reader holds them, make sure this one happens.
+	 */
+	if (!(txn->mt_flags & MDB_TXN_DIRTY) &&
+		mdb_find_oldest(txn) == txn->mt_txnid - 1) {
+		MDB_cursor m2;
+		MDB_val key;
+		txnid_t prev = txn->mt_txnid - 1;
+
+		mdb_cursor_init(&m2, txn, FREE_DBI, NULL);
+		key.mv_data = &prev;
+		key.mv_size = sizeof(prev);
+		rc = mdb_cursor_set(&m2, &key, NULL, MDB_SET, NULL);
+		if (rc == MDB_SUCCESS)
+			txn->mt_flags |= MDB_TXN_DIRTY;
+		else if (rc != MDB_NOTFOUND)
+			return rc;
+	}
+
+#ifndef _WIN32
+	/* Readers may still be on either meta, and this txn may have
+	 * spilled pages past them; nothing above all of those is in use.
+	 */
+	if (!(env->me_flags & MDB_WRITEMAP)) {
+		struct stat st;
+		off_t size;
+
+		last = env->me_metas[0]->mm_last_pg;
+		if (last < env->me_metas[1]->mm_last_pg)
+			last = env->me_metas[1]->mm_last_pg;
+		if (last < txn->mt_next_pgno - 1)
+			last = txn->mt_next_pgno - 1;
+		size = (off_t)(last + 1) * env->me_psize;
+		if (fstat(env->me_fd, &st) == 0 && st.st_size > size &&
+			ftruncate(env->me_fd, size) < 0)
+			return ErrCode();
+	}
+#endif
+	return MDB_SUCCESS;
+}
+
+void
+mdb_cursor_close(MDB_cursor *mc)
+{
+	if (mc && !mc->mc_backup) {
+		/* remove from txn, if tracked */
+		if ((mc->mc_flags & C_UNTRACK) && mc->mc_txn->mt_cursors) {
+			MDB_cursor **prev = &mc->mc_txn->mt_cursors[mc->mc_dbi];
+			while (*prev && *prev != mc) prev = &(*prev)->mc_next;
+			if (*prev == mc)
+				*prev = mc->mc_next;
+		}
+		free(mc);
+	}
+}
+
+MDB_txn *
+mdb_cursor_txn(MDB_cursor *mc)
+{
+	if (!mc) return NULL;
+	return mc->mc_txn;
+}
+
+MDB_dbi
+mdb_cursor_dbi(MDB_cursor *mc)
+{
+	return mc->mc_dbi;
 }
 
 /** Replace the key for a branch node with a new key.
@@ -9048,6 +10002,14 @@ mdb_put(MDB_txn *txn, MDB_dbi dbi,
 #endif
 #define MDB_EOF		0x10	/**< #mdb_env_copyfd1() is done reading */
 
+	/** A named DB in a parallel compacting copy. */
+typedef struct mdb_cdb {
+	pgno_t cd_root;			/**< Root page in the environment */
+	pgno_t cd_new;			/**< Root page in the copy */
+	unsigned cd_unit;		/**< Its #mdb_cunit, or the first one under its root */
+	unsigned cd_split;		/**< Number of units under its root, 0 if not split */
+} mdb_cdb;
+
 	/** State needed for a double-buffering compacting copy. */
 typedef struct mdb_copy {
 	MDB_env *mc_env;
@@ -9062,6 +10024,9 @@ typedef struct mdb_copy {
 	HANDLE mc_fd;
 	int mc_toggle;			/**< Buffer number in provider */
 	int mc_new;				/**< (0-2 buffers to write) | (#MDB_EOF at end) */
+	int mc_pwrite;			/**< Write each buffer at the offset of its first page */
+	mdb_cdb *mc_dbs;		/**< Named DBs already copied, sorted by #cd_root */
+	unsigned mc_ndbs;
 	/** Error code.  Never cleared if set.  Both threads can set nonzero
 	 *	to fail the copy.  Not mutex-protected, LMDB expects atomic int.
 	 */
@@ -9080,7 +10045,9 @@ mdb_env_copythr(void *arg)
 #define DO_WRITE(rc, fd, ptr, w2, len)	rc = WriteFile(fd, ptr, w2, &len, NULL)
 #else
 	int len;
-#define DO_WRITE(rc, fd, ptr, w2, len)	len = write(fd, ptr, w2); rc = (len >= 0)
+	off_t off = 0;
+#define DO_WRITE(rc, fd, ptr, w2, len)	len = my->mc_pwrite ? \
+	pwrite(fd, ptr, w2, off) : write(fd, ptr, w2); rc = (len >= 0)
 #ifdef SIGPIPE
 	sigset_t set;
 	sigemptyset(&set);
@@ -9098,6 +10065,10 @@ mdb_env_copythr(void *arg)
 			break;
 		wsize = my->mc_wlen[toggle];
 		ptr = my->mc_wbuf[toggle];
+#ifndef _WIN32
+		if (wsize)
+			off = (off_t)((MDB_page *)ptr)->mp_pgno * my->mc_env->me_psize;
+#endif
 again:
 		rc = MDB_SUCCESS;
 		while (wsize > 0 && !my->mc_error) {
@@ -9118,6 +10089,9 @@ again:
 				rc = MDB_SUCCESS;
 				ptr += len;
 				wsize -= len;
+#ifndef _WIN32
+				off += len;
+#endif
 				continue;
 			} else {
 				rc = EIO;
@@ -9166,6 +10140,31 @@ mdb_env_cthr_toggle(mdb_copy *my, int adjust)
 	return my->mc_error;
 }
 
+	/** Find the root in the copy of a named DB copied beforehand.
+	 * @param[in] my control structure.
+	 * @param[in,out] pg root of the DB, in the environment and then in the copy.
+	 */
+static int ESECT
+mdb_env_cdb_root(mdb_copy *my, pgno_t *pg)
+{
+	unsigned base = 0, cursor, n = my->mc_ndbs;
+
+	while (n > 0) {
+		cursor = base + n/2;
+		if (my->mc_dbs[cursor].cd_root == *pg) {
+			*pg = my->mc_dbs[cursor].cd_new;
+			return MDB_SUCCESS;
+		}
+		if (my->mc_dbs[cursor].cd_root < *pg) {
+			base = cursor + 1;
+			n -= n/2 + 1;
+		} else {
+			n /= 2;
+		}
+	}
+	return MDB_CORRUPTED;	/* changed since the DBs were listed */
+}
+
 	/** Depth-first tree traversal for compacting copy.
 	 * @param[in] my control structure.
 	 * @param[in,out] pg database root.
@@ -9267,11 +10266,20 @@ mdb_env_cwalk(mdb_copy *my, pgno_t *pg, int flags)
 						}
 
 						memcpy(&db, NODEDATA(ni), sizeof(db));
-						my->mc_toggle = toggle;
-						rc = mdb_env_cwalk(my, &db.md_root, ni->mn_flags & F_DUPDATA);
-						if (rc)
-							goto done;
-						toggle = my->mc_toggle;
+						if (my->mc_dbs && !(ni->mn_flags & F_DUPDATA)) {
+							/* A named DB, already in the copy */
+							if (db.md_root != P_INVALID) {
+								rc = mdb_env_cdb_root(my, &db.md_root);
+								if (rc)
+									goto done;
+							}
+						} else {
+							my->mc_toggle = toggle;
+							rc = mdb_env_cwalk(my, &db.md_root, ni->mn_flags & F_DUPDATA);
+							if (rc)
+								goto done;
+							toggle = my->mc_toggle;
+						}
 						memcpy(NODEDATA(ni), &db, sizeof(db));
 					}
 				}
@@ -9326,12 +10334,73 @@ done:
 	return rc;
 }
 
-	/** Copy environment with compaction. */
+	/** Set up the meta pages of a compacting copy.
+	 * @param[in] txn the read-only transaction being copied.
+	 * @param[out] buf space for #NUM_METAS pages.
+	 * @param[out] new_root root of the main DB in the copy.
+	 */
 static int ESECT
-mdb_env_copyfd1(MDB_env *env, HANDLE fd)
+mdb_env_cmeta(MDB_txn *txn, char *buf, pgno_t *new_root)
 {
+	MDB_env *env = txn->mt_env;
 	MDB_meta *mm;
 	MDB_page *mp;
+	pgno_t root;
+	int rc = MDB_SUCCESS;
+
+	mp = (MDB_page *)buf;
+	memset(mp, 0, NUM_METAS * env->me_psize);
+	mp->mp_pgno = 0;
+	mp->mp_flags = P_META;
+	mm = (MDB_meta *)METADATA(mp);
+	mdb_env_init_meta0(env, mm);
+	mm->mm_address = env->me_metas[0]->mm_address;
+
+	mp = (MDB_page *)(buf + env->me_psize);
+	mp->mp_pgno = 1;
+	mp->mp_flags = P_META;
+	*(MDB_meta *)METADATA(mp) = *mm;
+	mm = (MDB_meta *)METADATA(mp);
+
+	/* Set metapage 1 with current main DB */
+	root = *new_root = txn->mt_dbs[MAIN_DBI].md_root;
+	if (root != P_INVALID) {
+		/* Count free pages + freeDB pages.  Subtract from last_pg
+		 * to find the new last_pg, which also becomes the new root.
+		 */
+		MDB_ID freecount = 0;
+		MDB_cursor mc;
+		MDB_val key, data;
+		mdb_cursor_init(&mc, txn, FREE_DBI, NULL);
+		while ((rc = mdb_cursor_get(&mc, &key, &data, MDB_NEXT)) == 0)
+			freecount += *(MDB_ID *)data.mv_data;
+		if (rc != MDB_NOTFOUND)
+			return rc;
+		rc = MDB_SUCCESS;
+		freecount += txn->mt_dbs[FREE_DBI].md_branch_pages +
+			txn->mt_dbs[FREE_DBI].md_leaf_pages +
+			txn->mt_dbs[FREE_DBI].md_overflow_pages;
+
+		*new_root = txn->mt_next_pgno - 1 - freecount;
+		mm->mm_last_pg = *new_root;
+		mm->mm_dbs[MAIN_DBI] = txn->mt_dbs[MAIN_DBI];
+		mm->mm_dbs[MAIN_DBI].md_root = *new_root;
+	} else {
+		/* When the DB is empty, handle it specially to
+		 * fix any breakage like page leaks from ITS#8174.
+		 */
+		mm->mm_dbs[MAIN_DBI].md_flags = txn->mt_dbs[MAIN_DBI].md_flags;
+	}
+	if (root != P_INVALID || mm->mm_dbs[MAIN_DBI].md_flags) {
+		mm->mm_txnid = 1;		/* use metapage 1 */
+	}
+	return rc;
+}
+
+	/** Copy environment with compaction. */
+static int ESECT
+mdb_env_copyfd1(MDB_env *env, HANDLE fd)
+{
 	mdb_copy my = {0};
 	MDB_txn *txn = NULL;
 	pthread_t thr;
@@ -9383,54 +10452,13 @@ mdb_env_copyfd1(MDB_env *env, HANDLE fd)
 	if (rc)
 		goto finish;
 
-	mp = (MDB_page *)my.mc_wbuf[0];
-	memset(mp, 0, NUM_METAS * env->me_psize);
-	mp->mp_pgno = 0;
-	mp->mp_flags = P_META;
-	mm = (MDB_meta *)METADATA(mp);
-	mdb_env_init_meta0(env, mm);
-	mm->mm_address = env->me_metas[0]->mm_address;
-
-	mp = (MDB_page *)(my.mc_wbuf[0] + env->me_psize);
-	mp->mp_pgno = 1;
-	mp->mp_flags = P_META;
-	*(MDB_meta *)METADATA(mp) = *mm;
-	mm = (MDB_meta *)METADATA(mp);
-
-	/* Set metapage 1 with current main DB */
-	root = new_root = txn->mt_dbs[MAIN_DBI].md_root;
-	if (root != P_INVALID) {
-		/* Count free pages + freeDB pages.  Subtract from last_pg
-		 * to find the new last_pg, which also becomes the new root.
-		 */
-		MDB_ID freecount = 0;
-		MDB_cursor mc;
-		MDB_val key, data;
-		mdb_cursor_init(&mc, txn, FREE_DBI, NULL);
-		while ((rc = mdb_cursor_get(&mc, &key, &data, MDB_NEXT)) == 0)
-			freecount += *(MDB_ID *)data.mv_data;
-		if (rc != MDB_NOTFOUND)
-			goto finish;
-		freecount += txn->mt_dbs[FREE_DBI].md_branch_pages +
-			txn->mt_dbs[FREE_DBI].md_leaf_pages +
-			txn->mt_dbs[FREE_DBI].md_overflow_pages;
-
-		new_root = txn->mt_next_pgno - 1 - freecount;
-		mm->mm_last_pg = new_root;
-		mm->mm_dbs[MAIN_DBI] = txn->mt_dbs[MAIN_DBI];
-		mm->mm_dbs[MAIN_DBI].md_root = new_root;
-	} else {
-		/* When the DB is empty, handle it specially to
-		 * fix any breakage like page leaks from ITS#8174.
-		 */
-		mm->mm_dbs[MAIN_DBI].md_flags = txn->mt_dbs[MAIN_DBI].md_flags;
-	}
-	if (root != P_INVALID || mm->mm_dbs[MAIN_DBI].md_flags) {
-		mm->mm_txnid = 1;		/* use metapage 1 */
-	}
+	rc = mdb_env_cmeta(txn, my.mc_wbuf[0], &new_root);
+	if (rc)
+		goto finish;
 
 	my.mc_wlen[0] = env->me_psize * NUM_METAS;
 	my.mc_txn = txn;
+	root = txn->mt_dbs[MAIN_DBI].md_root;
 	rc = mdb_env_cwalk(&my, &root, 0);
 	if (rc == MDB_SUCCESS && root != new_root) {
 		rc = MDB_INCOMPATIBLE;	/* page leak or corrupt DB */
@@ -9457,6 +10485,465 @@ done2:
 	return rc ? rc : my.mc_error;
 }
 
+#ifndef _WIN32
+	/** A named DB, or a subtree under the root of a large one,
+	 *	copied by one thread of a parallel compacting copy.
+	 */
+typedef struct mdb_cunit {
+	pgno_t cu_root;			/**< Root page, in the environment and then in the copy */
+	pgno_t cu_pages;		/**< Number of pages under #cu_root */
+	pgno_t cu_base;			/**< First page number in the copy */
+	unsigned short cu_depth;	/**< Height of the subtree */
+	unsigned char cu_count;		/**< #cu_pages must be counted */
+	unsigned char cu_leaves;	/**< Counting must look at the leaf pages */
+} mdb_cunit;
+
+	/** State shared by the threads of a parallel compacting copy. */
+typedef struct mdb_pcopy {
+	MDB_env *pc_env;
+	MDB_txn *pc_txn;
+	HANDLE pc_fd;
+	pthread_mutex_t pc_mutex;	/**< Protects #pc_next */
+	mdb_cunit *pc_units;
+	unsigned pc_nunits;
+	unsigned pc_next;		/**< Next unit for a thread to take */
+	int pc_copying;			/**< Copying the units, else counting their pages */
+	/** Error code.  Never cleared if set.  Any thread can set nonzero
+	 *	to fail the copy.
+	 */
+	volatile int pc_error;
+} mdb_pcopy;
+
+	/** Count the pages of a subtree for a parallel compacting copy.
+	 *	The last level of branch pages is enough, unless the leaves
+	 *	have overflow pages or sub-DBs, which the DB record doesn't
+	 *	locate.
+	 * @param[in] mc cursor of the read-only transaction.
+	 * @param[in] pg root of the subtree.
+	 * @param[in] depth height of the subtree.
+	 * @param[in] leaves nonzero if the leaf pages must be read.
+	 * @param[in,out] count incremented by the number of pages.
+	 */
+static int ESECT
+mdb_env_ccount(MDB_cursor *mc, pgno_t pg, int depth, int leaves, pgno_t *count)
+{
+	MDB_page *mp, *omp;
+	MDB_node *ni;
+	MDB_db db;
+	unsigned i, n;
+	int rc;
+
+	rc = mdb_page_get(mc, pg, &mp, NULL);
+	if (rc)
+		return rc;
+	(*count)++;
+	n = NUMKEYS(mp);
+	if (IS_BRANCH(mp)) {
+		if (depth == 2 && !leaves) {
+			*count += n;
+			return MDB_SUCCESS;
+		}
+		for (i=0; i<n; i++) {
+			rc = mdb_env_ccount(mc, NODEPGNO(NODEPTR(mp, i)), depth-1, leaves, count);
+			if (rc)
+				return rc;
+		}
+	} else if (!IS_LEAF2(mp)) {
+		for (i=0; i<n; i++) {
+			ni = NODEPTR(mp, i);
+			if (ni->mn_flags & F_BIGDATA) {
+				/* not OVPAGES(), a reused overflow page can be larger */
+				memcpy(&pg, NODEDATA(ni), sizeof(pg));
+				rc = mdb_page_get(mc, pg, &omp, NULL);
+				if (rc)
+					return rc;
+				*count += omp->mp_pages;
+			} else if (ni->mn_flags & F_SUBDATA) {
+				memcpy(&db, NODEDATA(ni), sizeof(db));
+				*count += db.md_branch_pages + db.md_leaf_pages +
+					db.md_overflow_pages;
+			}
+		}
+	}
+	return MDB_SUCCESS;
+}
+
+	/** Start the writer thread of a copy. With #mdb_copy.%mc_pwrite set,
+	 *	each buffer is written at the position of its first page.
+	 */
+static int ESECT
+mdb_env_cstart(mdb_copy *my, MDB_env *env, MDB_txn *txn, HANDLE fd, pthread_t *thr)
+{
+	int rc;
+
+	if ((rc = pthread_mutex_init(&my->mc_mutex, NULL)) != 0)
+		return rc;
+	if ((rc = pthread_cond_init(&my->mc_cond, NULL)) != 0)
+		goto fail2;
+#ifdef HAVE_MEMALIGN
+	my->mc_wbuf[0] = memalign(env->me_os_psize, MDB_WBUF*2);
+	if (my->mc_wbuf[0] == NULL) {
+		rc = errno;
+		goto fail1;
+	}
+#else
+	{
+		void *p;
+		if ((rc = posix_memalign(&p, env->me_os_psize, MDB_WBUF*2)) != 0)
+			goto fail1;
+		my->mc_wbuf[0] = p;
+	}
+#endif
+	memset(my->mc_wbuf[0], 0, MDB_WBUF*2);
+	my->mc_wbuf[1] = my->mc_wbuf[0] + MDB_WBUF;
+	my->mc_env = env;
+	my->mc_txn = txn;
+	my->mc_fd = fd;
+	rc = THREAD_CREATE(*thr, mdb_env_copythr, my);
+	if (rc == MDB_SUCCESS)
+		return rc;
+	free(my->mc_wbuf[0]);
+fail1:
+	pthread_cond_destroy(&my->mc_cond);
+fail2:
+	pthread_mutex_destroy(&my->mc_mutex);
+	return rc;
+}
+
+	/** Flush and stop the writer thread of a copy. */
+static int ESECT
+mdb_env_cstop(mdb_copy *my, pthread_t thr)
+{
+	int rc;
+
+	mdb_env_cthr_toggle(my, 1 | MDB_EOF);
+	rc = THREAD_FINISH(thr);
+	free(my->mc_wbuf[0]);
+	pthread_cond_destroy(&my->mc_cond);
+	pthread_mutex_destroy(&my->mc_mutex);
+	return rc ? rc : my->mc_error;
+}
+
+	/** Worker thread of a parallel compacting copy. Takes units
+	 *	until none are left, counting or copying them.
+	 */
+static THREAD_RET ESECT CALL_CONV
+mdb_env_cworker(void *arg)
+{
+	mdb_pcopy *pc = arg;
+	mdb_copy my = {0};
+	MDB_cursor mc = {0};
+	mdb_cunit *cu;
+	pthread_t thr;
+	int rc = MDB_SUCCESS;
+
+	if (pc->pc_copying) {
+		my.mc_pwrite = 1;
+		rc = mdb_env_cstart(&my, pc->pc_env, pc->pc_txn, pc->pc_fd, &thr);
+		if (rc) {
+			pc->pc_error = rc;
+			return (THREAD_RET)0;
+		}
+	}
+	mc.mc_txn = pc->pc_txn;
+	for (;;) {
+		pthread_mutex_lock(&pc->pc_mutex);
+		cu = NULL;
+		if (pc->pc_next < pc->pc_nunits && !pc->pc_error)
+			cu = &pc->pc_units[pc->pc_next++];
+		pthread_mutex_unlock(&pc->pc_mutex);
+		if (!cu)
+			break;
+		if (!pc->pc_copying) {
+			if (cu->cu_count)
+				rc = mdb_env_ccount(&mc, cu->cu_root, cu->cu_depth,
+					cu->cu_leaves, &cu->cu_pages);
+		} else {
+			my.mc_next_pgno = cu->cu_base;
+			rc = mdb_env_cwalk(&my, &cu->cu_root, 0);
+			if (rc == MDB_SUCCESS && my.mc_next_pgno != cu->cu_base + cu->cu_pages)
+				rc = MDB_INCOMPATIBLE;	/* page leak or corrupt DB */
+			/* The next unit goes elsewhere in the file */
+			if (rc == MDB_SUCCESS && my.mc_wlen[my.mc_toggle])
+				rc = mdb_env_cthr_toggle(&my, 1);
+		}
+		if (rc) {
+			pc->pc_error = rc;
+			break;
+		}
+	}
+	if (pc->pc_copying) {
+		if (rc)
+			my.mc_error = rc;
+		rc = mdb_env_cstop(&my, thr);
+		if (rc && !pc->pc_error)
+			pc->pc_error = rc;
+	}
+	return (THREAD_RET)0;
+}
+
+	/** Run the worker threads of a parallel compacting copy. */
+static int ESECT
+mdb_env_crun(mdb_pcopy *pc, unsigned threads, int copying)
+{
+	pthread_t *thr;
+	unsigned i, n;
+	int rc = MDB_SUCCESS;
+
+	thr = malloc(threads * sizeof(pthread_t));
+	if (!thr)
+		return ENOMEM;
+	pc->pc_next = 0;
+	pc->pc_copying = copying;
+	for (n=0; n<threads; n++) {
+		rc = THREAD_CREATE(thr[n], mdb_env_cworker, pc);
+		if (rc) {
+			pc->pc_error = rc;
+			break;
+		}
+	}
+	for (i=0; i<n; i++)
+		THREAD_FINISH(thr[i]);
+	free(thr);
+	return pc->pc_error;
+}
+
+static int
+mdb_cdb_cmp(const void *a, const void *b)
+{
+	pgno_t x = ((const mdb_cdb *)a)->cd_root, y = ((const mdb_cdb *)b)->cd_root;
+	return x < y ? -1 : x > y;
+}
+
+	/** Copy environment with compaction, on several threads.
+	 *
+	 *	Each named DB is copied by one thread, and a large one is split
+	 *	into the subtrees under its root. Each such unit gets a range of
+	 *	page numbers in the copy, so the size of every unit must be known
+	 *	first: the DB record gives it for a whole DB without sorted
+	 *	duplicates, the others are counted by the threads beforehand.
+	 *	The threads then write their units at their place in the file.
+	 *	The root pages of split DBs and the main DB follow on this thread,
+	 *	then the meta pages.
+	 *
+	 *	Falls back to #mdb_env_copyfd1() when the output can't be written
+	 *	out of order, or there are no named DBs to spread out.
+	 */
+static int ESECT
+mdb_env_copyfd3x(MDB_env *env, HANDLE fd, unsigned threads)
+{
+	mdb_pcopy pc = {0};
+	mdb_copy my = {0};
+	mdb_cdb *dbs = NULL, *cd;
+	mdb_cunit *cu;
+	MDB_txn *txn;
+	MDB_cursor mc;
+	MDB_page *mp, *mo = NULL;
+	MDB_node *ni;
+	MDB_db db;
+	pthread_t thr;
+	char *meta = NULL, *ptr;
+	pgno_t root, new_root, next, size, limit;
+	unsigned i, j, ndbs = 0, maxdbs = 0, maxunits = 0;
+	ssize_t len;
+	size_t wsize;
+	int rc;
+
+	if (lseek(fd, 0, SEEK_CUR) < 0)		/* a pipe or socket */
+		return mdb_env_copyfd1(env, fd);
+
+	rc = mdb_txn_begin(env, NULL, MDB_RDONLY, &txn);
+	if (rc)
+		return rc;
+	if (txn->mt_dbs[MAIN_DBI].md_root == P_INVALID ||
+		(txn->mt_dbs[MAIN_DBI].md_flags & MDB_DUPSORT)) {
+		mdb_txn_abort(txn);
+		return mdb_env_copyfd1(env, fd);
+	}
+	if ((rc = pthread_mutex_init(&pc.pc_mutex, NULL)) != 0) {
+		mdb_txn_abort(txn);
+		return rc;
+	}
+	pc.pc_env = env;
+	pc.pc_txn = txn;
+	pc.pc_fd = fd;
+
+#ifdef HAVE_MEMALIGN
+	meta = memalign(env->me_os_psize, env->me_psize * NUM_METAS);
+	if (!meta) {
+		rc = errno;
+		goto done;
+	}
+#else
+	{
+		void *p;
+		if ((rc = posix_memalign(&p, env->me_os_psize, env->me_psize * NUM_METAS)) != 0)
+			goto done;
+		meta = p;
+	}
+#endif
+	rc = mdb_env_cmeta(txn, meta, &new_root);
+	if (rc)
+		goto done;
+
+	/* List the named DBs and their units. A DB larger than its
+	 * share of the environment is split under its root.
+	 */
+	limit = (new_root - NUM_METAS) / (2 * threads);
+	mdb_cursor_init(&mc, txn, MAIN_DBI, NULL);
+	rc = mdb_page_search(&mc, NULL, MDB_PS_FIRST);
+	for (; rc == MDB_SUCCESS; rc = mdb_cursor_sibling(&mc, 1)) {
+		mp = mc.mc_pg[mc.mc_top];
+		for (i=0; i<NUMKEYS(mp); i++) {
+			ni = NODEPTR(mp, i);
+			if ((ni->mn_flags & (F_SUBDATA|F_DUPDATA)) != F_SUBDATA)
+				continue;
+			memcpy(&db, NODEDATA(ni), sizeof(db));
+			if (db.md_root == P_INVALID)
+				continue;
+			if (ndbs == maxdbs) {
+				maxdbs = maxdbs ? maxdbs * 2 : 16;
+				if (!(cd = realloc(dbs, maxdbs * sizeof(mdb_cdb)))) {
+					rc = ENOMEM;
+					goto done;
+				}
+				dbs = cd;
+			}
+			cd = &dbs[ndbs++];
+			cd->cd_root = db.md_root;
+			cd->cd_unit = pc.pc_nunits;
+			cd->cd_split = 0;
+			size = db.md_branch_pages + db.md_leaf_pages + db.md_overflow_pages;
+			if (size > limit && db.md_depth > 1) {
+				rc = mdb_page_get(&mc, db.md_root, &mo, NULL);
+				if (rc)
+					goto done;
+				cd->cd_split = NUMKEYS(mo);
+			}
+			if (pc.pc_nunits + cd->cd_split + 1 > maxunits) {
+				maxunits = maxunits * 2 + cd->cd_split + 1;
+				if (!(cu = realloc(pc.pc_units, maxunits * sizeof(mdb_cunit)))) {
+					rc = ENOMEM;
+					goto done;
+				}
+				pc.pc_units = cu;
+			}
+			cu = &pc.pc_units[pc.pc_nunits];
+			if (cd->cd_split) {
+				for (j=0; j<cd->cd_split; j++, cu++) {
+					cu->cu_root = NODEPGNO(NODEPTR(mo, j));
+					cu->cu_pages = 0;
+					cu->cu_depth = db.md_depth - 1;
+					cu->cu_count = 1;
+					cu->cu_leaves = (db.md_flags & MDB_DUPSORT) || db.md_overflow_pages;
+				}
+				pc.pc_nunits += cd->cd_split;
+			} else {
+				cu->cu_root = db.md_root;
+				cu->cu_pages = size;
+				cu->cu_depth = db.md_depth;
+				cu->cu_count = (db.md_flags & MDB_DUPSORT) != 0;
+				cu->cu_leaves = 1;
+				if (cu->cu_count)
+					cu->cu_pages = 0;
+				pc.pc_nunits++;
+			}
+		}
+	}
+	if (rc != MDB_NOTFOUND)
+		goto done;
+	if (!pc.pc_nunits) {
+		/* Nothing to share out */
+		rc = -1;
+		goto done;
+	}
+	if (threads > pc.pc_nunits)
+		threads = pc.pc_nunits;
+
+	for (i=0; i<pc.pc_nunits && !pc.pc_units[i].cu_count; i++) ;
+	if (i < pc.pc_nunits) {
+		rc = mdb_env_crun(&pc, threads, 0);
+		if (rc)
+			goto done;
+	}
+	next = NUM_METAS;
+	for (i=0; i<pc.pc_nunits; i++) {
+		pc.pc_units[i].cu_base = next;
+		next += pc.pc_units[i].cu_pages;
+	}
+	rc = mdb_env_crun(&pc, threads, 1);
+	if (rc)
+		goto done;
+
+	/* Root pages of the split DBs, then the main DB */
+	my.mc_pwrite = 1;
+	rc = mdb_env_cstart(&my, env, txn, fd, &thr);
+	if (rc)
+		goto done;
+	my.mc_next_pgno = next;
+	for (i=0; i<ndbs; i++) {
+		cd = &dbs[i];
+		if (!cd->cd_split) {
+			cd->cd_new = pc.pc_units[cd->cd_unit].cu_root;
+			continue;
+		}
+		if ((rc = mdb_page_get(&mc, cd->cd_root, &mp, NULL)) != 0)
+			break;
+		if (my.mc_wlen[my.mc_toggle] >= MDB_WBUF) {
+			if ((rc = mdb_env_cthr_toggle(&my, 1)) != 0)
+				break;
+		}
+		mo = (MDB_page *)(my.mc_wbuf[my.mc_toggle] + my.mc_wlen[my.mc_toggle]);
+		mdb_page_copy(mo, mp, env->me_psize);
+		for (j=0; j<cd->cd_split; j++)
+			SETPGNO(NODEPTR(mo, j), pc.pc_units[cd->cd_unit + j].cu_root);
+		mo->mp_pgno = my.mc_next_pgno++;
+		my.mc_wlen[my.mc_toggle] += env->me_psize;
+		cd->cd_new = mo->mp_pgno;
+	}
+	if (rc == MDB_SUCCESS) {
+		qsort(dbs, ndbs, sizeof(mdb_cdb), mdb_cdb_cmp);
+		my.mc_dbs = dbs;
+		my.mc_ndbs = ndbs;
+		root = txn->mt_dbs[MAIN_DBI].md_root;
+		rc = mdb_env_cwalk(&my, &root, 0);
+		if (rc == MDB_SUCCESS && root != new_root)
+			rc = MDB_INCOMPATIBLE;	/* page leak or corrupt DB */
+	}
+	if (rc)
+		my.mc_error = rc;
+	rc = mdb_env_cstop(&my, thr);
+	if (rc)
+		goto done;
+
+	/* The meta pages go last, the copy is unusable until then */
+	ptr = meta;
+	wsize = env->me_psize * NUM_METAS;
+	while (wsize > 0) {
+		len = pwrite(fd, ptr, wsize, ptr - meta);
+		if (len < 0) {
+			rc = ErrCode();
+			break;
+		} else if (len == 0) {
+			rc = EIO;
+			break;
+		}
+		ptr += len;
+		wsize -= len;
+	}
+
+done:
+	mdb_txn_abort(txn);
+	free(pc.pc_units);
+	free(dbs);
+	free(meta);
+	pthread_mutex_destroy(&pc.pc_mutex);
+	if (rc == -1)
+		rc = mdb_env_copyfd1(env, fd);
+	return rc;
+}
+#endif
+
 	/** Copy environment as-is. */
 static int ESECT
 mdb_env_copyfd0(MDB_env *env, HANDLE fd)
@@ -9566,6 +11053,18 @@ mdb_env_copyfd2(MDB_env *env, HANDLE fd, unsigned int flags)
 		return mdb_env_copyfd0(env, fd);
 }
 
+int ESECT
+mdb_env_copyfd3(MDB_env *env, HANDLE fd, unsigned int flags, unsigned int threads)
+{
+	if (!(flags & MDB_CP_COMPACT))
+		return mdb_env_copyfd0(env, fd);
+#ifndef _WIN32
+	if (threads > 1)
+		return mdb_env_copyfd3x(env, fd, threads);
+#endif
+	return mdb_env_copyfd1(env, fd);
+}
+
 int ESECT
 mdb_env_copyfd(MDB_env *env, HANDLE fd)
 {
@@ -9574,6 +11073,12 @@ mdb_env_copyfd(MDB_env *env, HANDLE fd)
 
 int ESECT
 mdb_env_copy2(MDB_env *env, const char *path, unsigned int flags)
+{
+	return mdb_env_copy3(env, path, flags, 1);
+}
+
+int ESECT
+mdb_env_copy3(MDB_env *env, const char *path, unsigned int flags, unsigned int threads)
 {
 	int rc;
 	MDB_name fname;
@@ -9585,7 +11090,7 @@ mdb_env_copy2(MDB_env *env, const char *path, unsigned int flags)
 		mdb_fname_destroy(fname);
 	}
 	if (rc == MDB_SUCCESS) {
-		rc = mdb_env_copyfd2(env, newfd, flags);
+		rc = mdb_env_copyfd3(env, newfd, flags, threads);
 		if (close(newfd) < 0 && rc == MDB_SUCCESS)
 			rc = ErrCode();
 	}
@@ -9598,6 +11103,374 @@ mdb_env_copy(MDB_env *env, const char *path)
 	return mdb_env_copy2(env, path, 0);
 }
 
+#ifndef _WIN32
+	/** Header page of an incremental copy. It is followed by the pages
+	 *	written after #mi_base, then the meta pages of #mi_txnid.
+	 */
+typedef struct MDB_ihead {
+	uint32_t	mi_magic;		/**< #MDB_INCR_MAGIC */
+	uint32_t	mi_version;		/**< #MDB_INCR_VERSION */
+	uint32_t	mi_psize;		/**< page size of the environment */
+	uint32_t	mi_pad;
+	txnid_t		mi_base;		/**< txn of the copy this applies to */
+	txnid_t		mi_txnid;		/**< txn this brings the copy to */
+} MDB_ihead;
+
+	/** State of an incremental copy. */
+typedef struct mdb_icopy {
+	mdb_copy	ic_copy;		/**< writer thread and buffers */
+	txnid_t		*ic_txns;		/**< page txnids, from the txnid file */
+	pgno_t		ic_ntxns;		/**< number of pages in #ic_txns */
+	txnid_t		ic_base;		/**< copy the pages written after this txn */
+} mdb_icopy;
+
+	/** True if page \b pg is unchanged since the base of \b ic */
+#define ICOPY_OLD(ic, pg) \
+	((pg) < (ic)->ic_ntxns && (ic)->ic_txns[pg] <= (ic)->ic_base)
+
+	/** Add a page, and its overflow pages if any, to an incremental copy. */
+static int ESECT
+mdb_env_iput(mdb_copy *my, MDB_page *mp)
+{
+	unsigned psize = my->mc_env->me_psize;
+	int rc, toggle = my->mc_toggle;
+
+	if (my->mc_wlen[toggle] >= MDB_WBUF) {
+		rc = mdb_env_cthr_toggle(my, 1);
+		if (rc)
+			return rc;
+		toggle = my->mc_toggle;
+	}
+	memcpy(my->mc_wbuf[toggle] + my->mc_wlen[toggle], mp, psize);
+	my->mc_wlen[toggle] += psize;
+	if (IS_OVERFLOW(mp) && mp->mp_pages > 1) {
+		my->mc_olen[toggle] = psize * (mp->mp_pages - 1);
+		my->mc_over[toggle] = (char *)mp + psize;
+		return mdb_env_cthr_toggle(my, 1);
+	}
+	return my->mc_error;
+}
+
+	/** Depth-first traversal for incremental copy. A page that wasn't
+	 *	written since the base txn is skipped with all the pages below
+	 *	it: a change to any page rewrites every page above it.
+	 * @param[in] ic control structure.
+	 * @param[in] pg database root.
+	 * @param[in] flags includes #F_DUPDATA if it is a sorted-duplicate sub-DB.
+	 */
+static int ESECT
+mdb_env_iwalk(mdb_icopy *ic, pgno_t pg, int flags)
+{
+	MDB_cursor mc = {0};
+	MDB_page *mp, *omp;
+	MDB_node *ni;
+	MDB_db db;
+	unsigned i, n;
+	int rc;
+
+	if (pg == P_INVALID || ICOPY_OLD(ic, pg))
+		return MDB_SUCCESS;
+	mc.mc_txn = ic->ic_copy.mc_txn;
+	if ((rc = mdb_page_get(&mc, pg, &mp, NULL)) != 0 ||
+		(rc = mdb_env_iput(&ic->ic_copy, mp)) != 0)
+		return rc;
+	n = NUMKEYS(mp);
+	if (IS_BRANCH(mp)) {
+		for (i=0; i<n; i++) {
+			rc = mdb_env_iwalk(ic, NODEPGNO(NODEPTR(mp, i)), flags);
+			if (rc)
+				return rc;
+		}
+	} else if (!IS_LEAF2(mp) && !(flags & F_DUPDATA)) {
+		for (i=0; i<n; i++) {
+			ni = NODEPTR(mp, i);
+			if (ni->mn_flags & F_BIGDATA) {
+				memcpy(&pg, NODEDATA(ni), sizeof(pg));
+				if (ICOPY_OLD(ic, pg))
+					continue;
+				if ((rc = mdb_page_get(&mc, pg, &omp, NULL)) != 0 ||
+					(rc = mdb_env_iput(&ic->ic_copy, omp)) != 0)
+					return rc;
+			} else if (ni->mn_flags & F_SUBDATA) {
+				memcpy(&db, NODEDATA(ni), sizeof(db));
+				rc = mdb_env_iwalk(ic, db.md_root, ni->mn_flags & F_DUPDATA);
+				if (rc)
+					return rc;
+			}
+		}
+	}
+	return MDB_SUCCESS;
+}
+
+	/** Read up to \b len bytes, stopping only at end of file.
+	 * @return the number of bytes read, or -1 on error.
+	 */
+static ssize_t ESECT
+mdb_fread(HANDLE fd, char *buf, size_t len)
+{
+	ssize_t n;
+	size_t got = 0;
+
+	while (got < len) {
+		n = read(fd, buf + got, len - got);
+		if (n < 0) {
+			if (ErrCode() == EINTR)
+				continue;
+			return -1;
+		}
+		if (n == 0)
+			break;
+		got += n;
+	}
+	return got;
+}
+
+	/** Write all of \b len bytes at \b off. */
+static int ESECT
+mdb_fwrite(HANDLE fd, char *buf, size_t len, off_t off)
+{
+	ssize_t n;
+
+	while (len > 0) {
+		n = pwrite(fd, buf, len, off);
+		if (n < 0) {
+			if (ErrCode() == EINTR)
+				continue;
+			return ErrCode();
+		}
+		if (n == 0)
+			return EIO;
+		buf += n;
+		len -= n;
+		off += n;
+	}
+	return MDB_SUCCESS;
+}
+#endif
+
+int ESECT
+mdb_env_copyfd_incr(MDB_env *env, HANDLE fd, size_t txnid)
+{
+#ifdef _WIN32
+	return EINVAL;
+#else
+	mdb_icopy ic;
+	mdb_copy *my = &ic.ic_copy;
+	MDB_txn *txn = NULL;
+	MDB_ihead *ih;
+	MDB_page *mp;
+	MDB_meta *mm;
+	HANDLE tfd;
+	txnid_t *hdr = MAP_FAILED;
+	struct stat st;
+	pthread_t thr;
+	char *meta = NULL;
+	unsigned i;
+	int rc;
+
+	memset(&ic, 0, sizeof(ic));
+	if ((rc = mdb_env_txns_open(env, 1, 0, &tfd)) != 0)
+		return rc == ENOENT ? MDB_INCOMPATIBLE : rc;
+	if (fstat(tfd, &st)) {
+		rc = ErrCode();
+		goto done;
+	}
+	if ((size_t)st.st_size < MDB_TXNS_HDR * sizeof(txnid_t)) {
+		rc = MDB_INCOMPATIBLE;
+		goto done;
+	}
+	hdr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, tfd, 0);
+	if (hdr == MAP_FAILED) {
+		rc = ErrCode();
+		goto done;
+	}
+	rc = mdb_txn_begin(env, NULL, MDB_RDONLY, &txn);
+	if (rc)
+		goto done;
+	/* The txnids must be recorded from the base txn up to ours */
+	if (hdr[MDB_TXNS_ID] != MDB_TXNS_MAGIC || txnid < hdr[MDB_TXNS_START] ||
+		hdr[MDB_TXNS_LAST] < txn->mt_txnid || txnid > txn->mt_txnid) {
+		rc = MDB_INCOMPATIBLE;
+		goto done;
+	}
+	ic.ic_txns = hdr + MDB_TXNS_HDR;
+	ic.ic_ntxns = st.st_size / sizeof(txnid_t) - MDB_TXNS_HDR;
+	ic.ic_base = txnid;
+
+	if (!(meta = malloc(NUM_METAS * env->me_psize))) {
+		rc = ENOMEM;
+		goto done;
+	}
+	rc = mdb_env_cstart(my, env, txn, fd, &thr);
+	if (rc)
+		goto done;
+
+	ih = (MDB_ihead *)my->mc_wbuf[0];
+	ih->mi_magic = MDB_INCR_MAGIC;
+	ih->mi_version = MDB_INCR_VERSION;
+	ih->mi_psize = env->me_psize;
+	ih->mi_base = txnid;
+	ih->mi_txnid = txn->mt_txnid;
+	my->mc_wlen[0] = env->me_psize;
+
+	rc = mdb_env_iwalk(&ic, txn->mt_dbs[FREE_DBI].md_root, 0);
+	if (rc == MDB_SUCCESS)
+		rc = mdb_env_iwalk(&ic, txn->mt_dbs[MAIN_DBI].md_root, 0);
+
+	/* Meta pages last, so a restore can put them last too */
+	memset(meta, 0, NUM_METAS * env->me_psize);
+	for (i=0; i<NUM_METAS && rc == MDB_SUCCESS; i++) {
+		mp = (MDB_page *)(meta + i * env->me_psize);
+		mp->mp_pgno = i;
+		mp->mp_flags = P_META;
+		mm = (MDB_meta *)METADATA(mp);
+		mdb_env_init_meta0(env, mm);
+		mm->mm_address = env->me_metas[0]->mm_address;
+		mm->mm_dbs[FREE_DBI] = txn->mt_dbs[FREE_DBI];
+		mm->mm_dbs[MAIN_DBI] = txn->mt_dbs[MAIN_DBI];
+		mm->mm_last_pg = txn->mt_next_pgno - 1;
+		mm->mm_txnid = txn->mt_txnid;
+		rc = mdb_env_iput(my, mp);
+	}
+	if (rc)
+		my->mc_error = rc;
+	rc = mdb_env_cstop(my, thr);
+
+done:
+	mdb_txn_abort(txn);
+	free(meta);
+	if (hdr != MAP_FAILED)
+		munmap((void *)hdr, st.st_size);
+	close(tfd);
+	return rc;
+#endif
+}
+
+int ESECT
+mdb_env_apply_incr(MDB_env *env, HANDLE fd)
+{
+#ifdef _WIN32
+	return EINVAL;
+#else
+	MDB_txn *txn;
+	MDB_ihead *ih;
+	MDB_page *mp;
+	char *buf, *meta;
+	size_t psize = env->me_psize, size, max = psize;
+	ssize_t len;
+	txnid_t target;
+	unsigned nmeta = 0;
+	int rc;
+
+	if (env->me_flags & MDB_RDONLY)
+		return EACCES;
+	/* Keep other writers out */
+	rc = mdb_txn_begin(env, NULL, 0, &txn);
+	if (rc)
+		return rc;
+	buf = malloc(max);
+	meta = malloc(NUM_METAS * psize);
+	if (!buf || !meta) {
+		rc = ENOMEM;
+		goto done;
+	}
+
+	len = mdb_fread(fd, buf, psize);
+	if (len < 0) {
+		rc = ErrCode();
+		goto done;
+	}
+	ih = (MDB_ihead *)buf;
+	if ((size_t)len < psize || ih->mi_magic != MDB_INCR_MAGIC ||
+		ih->mi_version != MDB_INCR_VERSION) {
+		rc = MDB_CORRUPTED;
+		goto done;
+	}
+	/* Our last commit must be in [base, target) */
+	if (ih->mi_psize != psize || txn->mt_txnid - 1 < ih->mi_base ||
+		txn->mt_txnid - 1 >= ih->mi_txnid) {
+		rc = MDB_INCOMPATIBLE;
+		goto done;
+	}
+	target = ih->mi_txnid;
+
+	for (;;) {
+		len = mdb_fread(fd, buf, psize);
+		if (len < 0) {
+			rc = ErrCode();
+			goto done;
+		}
+		if (len == 0)
+			break;
+		mp = (MDB_page *)buf;
+		if ((size_t)len < psize || nmeta == NUM_METAS) {
+			rc = MDB_CORRUPTED;
+			goto done;
+		}
+		if (F_ISSET(mp->mp_flags, P_META)) {
+			if (mp->mp_pgno != nmeta) {
+				rc = MDB_CORRUPTED;
+				goto done;
+			}
+			memcpy(meta + nmeta++ * psize, buf, psize);
+			continue;
+		}
+		if (nmeta || mp->mp_pgno < NUM_METAS) {
+			rc = MDB_CORRUPTED;
+			goto done;
+		}
+		size = psize;
+		if (IS_OVERFLOW(mp) && mp->mp_pages > 1) {
+			size *= mp->mp_pages;
+			if (size > max) {
+				char *nbuf = realloc(buf, size);
+				if (!nbuf) {
+					rc = ENOMEM;
+					goto done;
+				}
+				buf = nbuf;
+				max = size;
+				mp = (MDB_page *)buf;
+			}
+			len = mdb_fread(fd, buf + psize, size - psize);
+			if (len < 0) {
+				rc = ErrCode();
+				goto done;
+			}
+			if ((size_t)len < size - psize) {
+				rc = MDB_CORRUPTED;
+				goto done;
+			}
+		}
+		rc = mdb_fwrite(env->me_fd, buf, size, (off_t)mp->mp_pgno * psize);
+		if (rc)
+			goto done;
+	}
+	if (nmeta < NUM_METAS ||
+		((MDB_meta *)METADATA(meta))->mm_txnid != target) {
+		rc = MDB_CORRUPTED;
+		goto done;
+	}
+
+	/* The pages must be on disk before the meta pages point at them */
+	if (MDB_FDATASYNC(env->me_fd) ||
+		(rc = mdb_fwrite(env->me_fd, meta, NUM_METAS * psize, 0)) ||
+		MDB_FDATASYNC(env->me_fd)) {
+		if (!rc)
+			rc = ErrCode();
+		goto done;
+	}
+	if (env->me_txns)
+		env->me_txns->mti_txnid = target;
+
+done:
+	mdb_txn_abort(txn);
+	free(buf);
+	free(meta);
+	return rc;
+#endif
+}
+
 int ESECT
 mdb_env_set_flags(MDB_env *env, unsigned int flag, int onoff)
 {
@@ -9841,6 +11714,7 @@ int mdb_dbi_open(MDB_txn *txn, const char *name, unsigned int flags, MDB_dbi *db
 		txn->mt_dbxs[slot].md_name.mv_data = namedup;
 		txn->mt_dbxs[slot].md_name.mv_size = len;
 		txn->mt_dbxs[slot].md_rel = NULL;
+		txn->mt_dbxs[slot].md_ovzone = 0;
 		txn->mt_dbflags[slot] = dbflag;
 		/* txn-> and env-> are the same in read txns, use
 		 * tmp variable to avoid undefined assignment
@@ -10088,6 +11962,15 @@ int mdb_set_relctx(MDB_txn *txn, MDB_dbi dbi, void *ctx)
 	return MDB_SUCCESS;
 }
 
+int mdb_set_ovzone(MDB_txn *txn, MDB_dbi dbi, int onoff)
+{
+	if (!TXN_DBI_EXIST(txn, dbi, DB_USRVALID))
+		return EINVAL;
+
+	txn->mt_dbxs[dbi].md_ovzone = onoff != 0;
+	return MDB_SUCCESS;
+}
+
 int ESECT
 mdb_env_get_maxkeysize(MDB_env *env)
 {
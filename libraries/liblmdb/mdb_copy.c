@@ -14,11 +14,17 @@
 #ifdef _WIN32
 #include <windows.h>
 #define	MDB_STDOUT	GetStdHandle(STD_OUTPUT_HANDLE)
+#define	MDB_STDIN	GetStdHandle(STD_INPUT_HANDLE)
 #else
+#include <fcntl.h>
+#include <unistd.h>
 #define	MDB_STDOUT	1
+#define	MDB_STDIN	0
 #endif
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <errno.h>
 #include <signal.h>
 #include "lmdb.h"
 
@@ -33,13 +39,25 @@ int main(int argc,char * argv[])
 	MDB_env *env;
 	const char *progname = argv[0], *act;
 	unsigned flags = MDB_RDONLY;
-	unsigned cpflags = 0;
+	unsigned cpflags = 0, threads = 1;
+	int incr = 0, restore = 0;
+	size_t txnid = 0;
+	mdb_filehandle_t fd;
 
-	for (; argc > 1 && argv[1][0] == '-'; argc--, argv++) {
+	for (; argc > 1 && argv[1][0] == '-' && argv[1][1]; argc--, argv++) {
 		if (argv[1][1] == 'n' && argv[1][2] == '\0')
 			flags |= MDB_NOSUBDIR;
 		else if (argv[1][1] == 'c' && argv[1][2] == '\0')
 			cpflags |= MDB_CP_COMPACT;
+		else if (argv[1][1] == 't' && argv[1][2] == '\0' && argc > 2) {
+			threads = strtoul(argv[2], NULL, 0);
+			argc--, argv++;
+		} else if (argv[1][1] == 'i' && argv[1][2] == '\0' && argc > 2) {
+			txnid = strtoul(argv[2], NULL, 0);
+			incr = 1;
+			argc--, argv++;
+		} else if (argv[1][1] == 'r' && argv[1][2] == '\0')
+			restore = 1;
 		else if (argv[1][1] == 'V' && argv[1][2] == '\0') {
 			printf("%s\n", MDB_VERSION_STRING);
 			exit(0);
@@ -47,8 +65,9 @@ int main(int argc,char * argv[])
 			argc = 0;
 	}
 
-	if (argc<2 || argc>3) {
-		fprintf(stderr, "usage: %s [-V] [-c] [-n] srcpath [dstpath]\n", progname);
+	if (argc<2 || argc>3 || (restore && (argc<3 || incr))) {
+		fprintf(stderr, "usage: %s [-V] [-c] [-n] [-t threads] [-i txnid] srcpath [dstpath]\n"
+			"       %s -r [-n] srcfile dstpath\n", progname, progname);
 		exit(EXIT_FAILURE);
 	}
 
@@ -64,14 +83,44 @@ int main(int argc,char * argv[])
 	act = "opening environment";
 	rc = mdb_env_create(&env);
 	if (rc == MDB_SUCCESS) {
-		rc = mdb_env_open(env, argv[1], flags, 0600);
+		if (restore)
+			rc = mdb_env_open(env, argv[2], flags & ~MDB_RDONLY, 0600);
+		else
+			rc = mdb_env_open(env, argv[1], flags, 0600);
 	}
-	if (rc == MDB_SUCCESS) {
+	if (rc == MDB_SUCCESS && (incr || restore)) {
+		/* the other end of an incremental copy is a plain file */
+		fd = restore ? MDB_STDIN : MDB_STDOUT;
+		if (restore ? strcmp(argv[1], "-") : argc == 3) {
+			act = "opening file";
+#ifdef _WIN32
+			rc = EINVAL;
+#else
+			if (restore)
+				fd = open(argv[1], O_RDONLY);
+			else
+				fd = open(argv[2], O_WRONLY|O_CREAT|O_EXCL, 0666);
+			if (fd < 0)
+				rc = errno;
+#endif
+		}
+		if (rc == MDB_SUCCESS) {
+			act = restore ? "applying" : "copying";
+			if (restore)
+				rc = mdb_env_apply_incr(env, fd);
+			else
+				rc = mdb_env_copyfd_incr(env, fd, txnid);
+#ifndef _WIN32
+			if (fd != MDB_STDIN && fd != MDB_STDOUT && close(fd) < 0 && !rc)
+				rc = errno;
+#endif
+		}
+	} else if (rc == MDB_SUCCESS) {
 		act = "copying";
 		if (argc == 2)
-			rc = mdb_env_copyfd2(env, MDB_STDOUT, cpflags);
+			rc = mdb_env_copyfd3(env, MDB_STDOUT, cpflags, threads);
 		else
-			rc = mdb_env_copy2(env, argv[2], cpflags);
+			rc = mdb_env_copy3(env, argv[2], cpflags, threads);
 	}
 	if (rc)
 		fprintf(stderr, "%s: %s failed, error %d (%s)\n",
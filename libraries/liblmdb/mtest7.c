@@ -0,0 +1,116 @@
+/* mtest7.c - memory-mapped database tester/toy */
+/*
+ * Copyright 2011-2020 Howard Chu, Symas Corp.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+/* Tests for mdb_txn_shrink() */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lmdb.h"
+
+#define E(expr) CHECK((rc = (expr)) == MDB_SUCCESS, #expr)
+#define CHECK(test, msg) ((test) ? (void)0 : ((void)fprintf(stderr, \
+	"%s:%d: %s: %s\n", __FILE__, __LINE__, msg, mdb_strerror(rc)), abort()))
+
+#define NRECS	2000
+
+static size_t
+used_size(MDB_env *env)
+{
+	MDB_envinfo info;
+	MDB_stat st;
+	int rc;
+
+	E(mdb_env_info(env, &info));
+	E(mdb_env_stat(env, &st));
+	return (info.me_last_pgno + 1) * st.ms_psize;
+}
+
+static MDB_env *
+open_env(void)
+{
+	MDB_env *env;
+	int rc;
+
+	E(mdb_env_create(&env));
+	E(mdb_env_set_mapsize(env, 104857600));
+	E(mdb_env_open(env, "./testdb", MDB_NOSYNC, 0664));
+	return env;
+}
+
+int main(int argc,char * argv[])
+{
+	int i, k, rc;
+	MDB_env *env;
+	MDB_dbi dbi;
+	MDB_val key, data;
+	MDB_txn *txn, *rtxn;
+	size_t before, after, pages;
+	char sval[1000];
+
+	env = open_env();
+
+	/* Grow the file, then free everything but the first record */
+	E(mdb_txn_begin(env, NULL, 0, &txn));
+	E(mdb_dbi_open(txn, NULL, MDB_INTEGERKEY, &dbi));
+	memset(sval, 'x', sizeof(sval));
+	key.mv_size = sizeof(i);
+	key.mv_data = &i;
+	data.mv_size = sizeof(sval);
+	data.mv_data = sval;
+	for (i = 0; i < NRECS; i++)
+		E(mdb_put(txn, dbi, &key, &data, 0));
+	E(mdb_txn_commit(txn));
+
+	E(mdb_txn_begin(env, NULL, 0, &txn));
+	for (i = 1; i < NRECS; i++)
+		E(mdb_del(txn, dbi, &key, NULL));
+	E(mdb_txn_commit(txn));
+
+	/* Rewrite the survivor so it moves down into the freed pages
+	 * and leaves the tail of the file free
+	 */
+	k = 0;
+	key.mv_data = &k;
+	for (i = 0; i < 4; i++) {
+		E(mdb_txn_begin(env, NULL, 0, &txn));
+		E(mdb_put(txn, dbi, &key, &data, 0));
+		E(mdb_txn_commit(txn));
+	}
+
+	/* Keep a reader behind the last commit, so the shrink below
+	 * is the only thing that can make its txn dirty
+	 */
+	E(mdb_txn_begin(env, NULL, MDB_RDONLY, &rtxn));
+	E(mdb_txn_begin(env, NULL, 0, &txn));
+	E(mdb_put(txn, dbi, &key, &data, 0));
+	E(mdb_txn_commit(txn));
+	before = used_size(env);
+
+	E(mdb_txn_begin(env, NULL, 0, &txn));
+	E(mdb_txn_shrink(txn, &pages));
+	E(mdb_txn_commit(txn));
+	mdb_txn_abort(rtxn);
+	mdb_env_close(env);
+
+	env = open_env();
+	after = used_size(env);
+	mdb_env_close(env);
+
+	printf("shrunk %zu pages: %zu -> %zu bytes\n", pages, before, after);
+	if (!pages || after >= before) {
+		fprintf(stderr, "mdb_txn_shrink did not persist\n");
+		return 1;
+	}
+	return 0;
+}
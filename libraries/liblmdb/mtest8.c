@@ -0,0 +1,257 @@
+/* mtest8.c - memory-mapped database tester/toy */
+/*
+ * Copyright 2011-2020 Howard Chu, Symas Corp.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+/* Tests for mdb_cursor_compact() */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lmdb.h"
+
+#define E(expr) CHECK((rc = (expr)) == MDB_SUCCESS, #expr)
+#define CHECK(test, msg) ((test) ? (void)0 : ((void)fprintf(stderr, \
+	"%s:%d: %s: %s\n", __FILE__, __LINE__, msg, mdb_strerror(rc)), abort()))
+
+#define NKEYS	1000	/* keys of each DB */
+#define NDUPS	600		/* dups per key, enough for a sub-DB */
+#define KEEP	10		/* every KEEPth key survives */
+#define BIGSIZE	9000	/* a few overflow pages */
+#define MAXPAGES	50	/* pages per compaction txn */
+#define NDBS	3
+
+static const char *names[NDBS] = { "small", "dups", "big" };
+static MDB_dbi dbis[NDBS];
+
+static MDB_env *
+open_env(void)
+{
+	MDB_env *env;
+	int rc;
+
+	E(mdb_env_create(&env));
+	E(mdb_env_set_maxdbs(env, NDBS));
+	E(mdb_env_set_mapsize(env, 104857600));
+	E(mdb_env_open(env, "./testdb", MDB_NOSYNC, 0664));
+	return env;
+}
+
+static size_t
+used_pages(MDB_env *env)
+{
+	MDB_envinfo info;
+	int rc;
+
+	E(mdb_env_info(env, &info));
+	return info.me_last_pgno + 1;
+}
+
+/* The value of key k, or of its dup d, in DB db */
+static size_t
+make_data(int db, int k, int d, char *buf)
+{
+	size_t i, len;
+
+	switch (db) {
+	case 0:
+		len = sprintf(buf, "small %05d", k);
+		break;
+	case 1:
+		len = sprintf(buf, "dup %05d %05d", k, d);
+		break;
+	default:
+		len = BIGSIZE + k % 2000;
+		for (i = 0; i < len; i++)
+			buf[i] = (char)(k * 7 + i);
+		break;
+	}
+	return len;
+}
+
+/* Is dup d of a surviving key of the dups DB still there? */
+#define DUP_KEPT(d)	((d) % 3 != 0)
+
+static void
+page_counts(MDB_env *env, size_t *counts)
+{
+	MDB_txn *txn;
+	MDB_stat st;
+	int i, rc;
+
+	E(mdb_txn_begin(env, NULL, MDB_RDONLY, &txn));
+	for (i = 0; i < NDBS; i++) {
+		E(mdb_stat(txn, dbis[i], &st));
+		counts[3*i] = st.ms_branch_pages;
+		counts[3*i+1] = st.ms_leaf_pages;
+		counts[3*i+2] = st.ms_overflow_pages;
+	}
+	mdb_txn_abort(txn);
+}
+
+/* Compact every DB in small txns, the way back-mdb does,
+ * until a whole pass changes nothing.
+ */
+static void
+compact_all(MDB_env *env, size_t *total)
+{
+	MDB_txn *txn;
+	MDB_cursor *mc;
+	MDB_val key;
+	char kbuf[512];
+	size_t moved, trimmed, pass;
+	int i, rc, crc, passes = 0;
+
+	*total = 0;
+	do {
+		pass = 0;
+		for (i = 0; i < NDBS; i++) {
+			key.mv_size = 0;
+			do {
+				E(mdb_txn_begin(env, NULL, 0, &txn));
+				E(mdb_cursor_open(txn, dbis[i], &mc));
+				key.mv_data = kbuf;
+				crc = rc = mdb_cursor_compact(mc, &key, MAXPAGES, &moved);
+				CHECK(rc == MDB_SUCCESS || rc == MDB_NOTFOUND,
+					"mdb_cursor_compact");
+				if (crc == MDB_SUCCESS) {
+					memcpy(kbuf, key.mv_data, key.mv_size);
+					key.mv_data = kbuf;
+				}
+				mdb_cursor_close(mc);
+				E(mdb_txn_shrink(txn, &trimmed));
+				E(mdb_txn_commit(txn));
+				pass += moved + trimmed;
+			} while (crc == MDB_SUCCESS);
+		}
+		*total += pass;
+	} while (pass && ++passes < 50);
+	CHECK(!pass, "compaction did not settle");
+}
+
+static void
+verify(MDB_env *env)
+{
+	MDB_txn *txn;
+	MDB_cursor *mc;
+	MDB_val key, data;
+	char kbuf[16], buf[BIGSIZE + 2000];
+	size_t len, count;
+	int db, k, d, rc;
+
+	E(mdb_txn_begin(env, NULL, MDB_RDONLY, &txn));
+	for (db = 0; db < NDBS; db++) {
+		E(mdb_cursor_open(txn, dbis[db], &mc));
+		count = 0;
+		while ((rc = mdb_cursor_get(mc, &key, &data, MDB_NEXT)) == 0) {
+			count++;
+			CHECK(key.mv_size == 5, "key size");
+			memcpy(kbuf, key.mv_data, 5);
+			kbuf[5] = '\0';
+			k = atoi(kbuf);
+			CHECK(k % KEEP == 0, "deleted key found");
+			d = 0;
+			if (db == 1)
+				sscanf((char *)data.mv_data + 10, "%5d", &d);
+			len = make_data(db, k, d, buf);
+			CHECK(data.mv_size == len && !memcmp(data.mv_data, buf, len),
+				"data mismatch");
+			CHECK(db != 1 || DUP_KEPT(d), "deleted dup found");
+		}
+		CHECK(rc == MDB_NOTFOUND, "mdb_cursor_get");
+		len = NKEYS / KEEP;
+		if (db == 1)
+			len *= NDUPS - (NDUPS + 2) / 3;
+		CHECK(count == len, "records missing");
+		mdb_cursor_close(mc);
+	}
+	mdb_txn_abort(txn);
+}
+
+int main(int argc,char * argv[])
+{
+	int i, k, d, rc;
+	MDB_env *env;
+	MDB_val key, data;
+	MDB_txn *txn;
+	char kbuf[16], buf[BIGSIZE + 2000];
+	size_t before[3*NDBS], after[3*NDBS], used, total;
+
+	env = open_env();
+
+	E(mdb_txn_begin(env, NULL, 0, &txn));
+	for (i = 0; i < NDBS; i++)
+		E(mdb_dbi_open(txn, names[i], MDB_CREATE | (i == 1 ? MDB_DUPSORT : 0),
+			&dbis[i]));
+	key.mv_data = kbuf;
+	key.mv_size = 5;
+	for (k = 0; k < NKEYS; k++) {
+		sprintf(kbuf, "%05d", k);
+		for (i = 0; i < NDBS; i++) {
+			for (d = 0; d < (i == 1 ? NDUPS : 1); d++) {
+				data.mv_data = buf;
+				data.mv_size = make_data(i, k, d, buf);
+				E(mdb_put(txn, dbis[i], &key, &data, 0));
+			}
+		}
+	}
+	E(mdb_txn_commit(txn));
+
+	/* Delete most of it, leaving survivors all over the file */
+	E(mdb_txn_begin(env, NULL, 0, &txn));
+	for (k = 0; k < NKEYS; k++) {
+		sprintf(kbuf, "%05d", k);
+		if (k % KEEP) {
+			for (i = 0; i < NDBS; i++)
+				E(mdb_del(txn, dbis[i], &key, NULL));
+			continue;
+		}
+		for (d = 0; d < NDUPS; d += 3) {
+			data.mv_data = buf;
+			data.mv_size = make_data(1, k, d, buf);
+			E(mdb_del(txn, dbis[1], &key, &data));
+		}
+	}
+	E(mdb_txn_commit(txn));
+	verify(env);
+
+	page_counts(env, before);
+	used = used_pages(env);
+	compact_all(env, &total);
+	page_counts(env, after);
+	verify(env);
+
+	for (i = 0; i < 3*NDBS; i++) {
+		if (before[i] != after[i]) {
+			fprintf(stderr, "%s: %s pages changed: %zu -> %zu\n",
+				names[i/3], i%3 == 0 ? "branch" : i%3 == 1 ? "leaf" :
+				"overflow", before[i], after[i]);
+			return 1;
+		}
+	}
+
+	mdb_env_close(env);
+	env = open_env();
+	E(mdb_txn_begin(env, NULL, MDB_RDONLY, &txn));
+	for (i = 0; i < NDBS; i++)
+		E(mdb_dbi_open(txn, names[i], 0, &dbis[i]));
+	E(mdb_txn_commit(txn));
+	verify(env);
+
+	printf("compacted %zu pages: %zu -> %zu pages used\n", total, used,
+		used_pages(env));
+	if (used_pages(env) >= used / 2) {
+		fprintf(stderr, "mdb_cursor_compact did not shrink the file\n");
+		return 1;
+	}
+	mdb_env_close(env);
+	return 0;
+}
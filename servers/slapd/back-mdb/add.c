@@ -359,17 +359,20 @@ mdb_add(Operation *op, SlapReply *rs )
 		LDAP_SLIST_REMOVE( &op->o_extra, &opinfo.moi_oe, OpExtra, oe_next );
 		opinfo.moi_oe.oe_key = NULL;
 		if ( op->o_noop ) {
-			mdb->mi_numads = numads;
-			mdb_txn_abort( txn );
+			if ( !( opinfo.moi_flag & MOI_GROUP ))
+				mdb->mi_numads = numads;
+			mdb_opinfo_abort( mdb, moi );
 			rs->sr_err = LDAP_X_NO_OPERATION;
 			txn = NULL;
 			goto return_results;
 		}
 
-		rs->sr_err = mdb_txn_commit( txn );
+		rs->sr_err = mdb_opinfo_commit( mdb, moi );
 		txn = NULL;
 		if ( rs->sr_err != 0 ) {
-			mdb->mi_numads = numads;
+			/* a group undoes its own attribute descriptions */
+			if ( !( opinfo.moi_flag & MOI_GROUP ))
+				mdb->mi_numads = numads;
 			rs->sr_text = "txn_commit failed";
 			Debug( LDAP_DEBUG_ANY,
 				LDAP_XSTRING(mdb_add) ": %s : %s (%d)\n",
@@ -393,8 +396,9 @@ return_results:
 
 	if( moi == &opinfo ) {
 		if( txn != NULL ) {
-			mdb->mi_numads = numads;
-			mdb_txn_abort( txn );
+			if ( !( opinfo.moi_flag & MOI_GROUP ))
+				mdb->mi_numads = numads;
+			mdb_opinfo_abort( mdb, moi );
 		}
 		if ( opinfo.moi_oe.oe_key ) {
 			LDAP_SLIST_REMOVE( &op->o_extra, &opinfo.moi_oe, OpExtra, oe_next );
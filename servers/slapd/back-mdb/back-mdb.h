@@ -33,7 +33,8 @@ LDAP_BEGIN_DECL
 #define MDB_DN2ID		1
 #define MDB_ID2ENTRY	2
 #define MDB_ID2VAL		3
-#define MDB_NDB			4
+#define MDB_DICT		4
+#define MDB_NDB			5
 
 /* The default search IDL stack cache depth */
 #define DEFAULT_SEARCH_STACK_DEPTH	16
@@ -63,6 +64,21 @@ typedef struct mdb_monitor_t {
 /* From ldap_rq.h */
 struct re_s;
 
+/* ecache.c */
+struct mdb_ecache;
+
+/* compress.c */
+struct mdb_zinfo;
+
+/* group.c */
+struct mdb_group;
+
+/* id2entry records compressed by compress.c start with
+ * nattrs|MDB_ENC_ZIP, nvals, dictionary ID and plain size
+ */
+#define MDB_ENC_ZIP	(1U<<(sizeof(unsigned int)*CHAR_BIT-1))
+#define MDB_ENC_ZHDR	4
+
 struct mdb_info {
 	MDB_env		*mi_dbenv;
 
@@ -90,6 +106,19 @@ struct mdb_info {
 	struct re_s		*mi_txn_cp_task;
 	struct re_s		*mi_index_task;
 
+	/* background compaction, see compact.c */
+	unsigned	mi_compact_pages;
+	unsigned	mi_compact_interval;
+	struct re_s		*mi_compact_task;
+	int			mi_compact_db;		/* position of the walk */
+	struct berval	mi_compact_key;
+	int			mi_compact_idle;
+	size_t		mi_compact_txnid;	/* our last commit */
+	unsigned long	mi_compact_pass;	/* pages moved or trimmed this pass */
+	unsigned long	mi_compact_moved;
+	unsigned long	mi_compact_trimmed;
+	unsigned long	mi_compact_passes;
+
 	mdb_monitor_t	mi_monitor;
 
 #ifdef MDB_MONITOR_IDX
@@ -113,6 +142,30 @@ struct mdb_info {
 		/* less than this many values in an attr goes
 		 * back into main blob */
 
+	int		mi_idl_exact;
+		/* don't collapse large index slots into ranges */
+
+	unsigned	mi_ecache_max;
+	struct mdb_ecache	*mi_ecache;
+
+	unsigned	mi_search_threads;
+		/* threads evaluating the filter of a large search */
+
+	size_t		mi_compress_min;
+		/* smallest id2entry record to compress, 0 for none */
+	struct mdb_zinfo	*mi_zinfo;
+
+	unsigned	mi_group_max;
+		/* write ops sharing one commit, 0 for none */
+	unsigned	mi_group_delay;
+		/* usecs the first op of a group waits for others */
+	ldap_pvt_thread_mutex_t	mi_group_mutex;
+	ldap_pvt_thread_cond_t	mi_group_cond;
+	struct mdb_group	*mi_group;	/* the group ops can join */
+
+	int		mi_ovzone;
+		/* keep id2entry overflow pages apart, see mdb_set_ovzone() */
+
 	MDB_dbi	mi_dbis[MDB_NDB];
 	AttributeDescription *mi_ads[MDB_MAXADS];
 	int mi_adxs[MDB_MAXADS];
@@ -128,10 +181,14 @@ typedef struct mdb_op_info {
 	MDB_txn*	moi_txn;
 	int			moi_ref;
 	char		moi_flag;
+	struct mdb_group	*moi_group;
+	int			moi_numads;	/* mi_numads when a kept txn began */
 } mdb_op_info;
 #define MOI_READER	0x01
 #define MOI_FREEIT	0x02
 #define MOI_KEEPER	0x04
+#define MOI_GROUP	0x08	/* moi_txn is nested in moi_group's txn */
+#define MOI_LEADER	0x10	/* and this op commits that txn */
 
 LDAP_END_DECL
 
@@ -0,0 +1,161 @@
+/* compact.c - background compaction of the mdb data file */
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 2011-2020 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+#include <ac/string.h>
+
+#include "back-mdb.h"
+#include "ldap_rq.h"
+
+/* Each run of the task is one small write txn: it walks part of one
+ * DB with mdb_cursor_compact(), moving pages from the end of the file
+ * into free space, then gives back whatever is free at the end of the
+ * file with mdb_txn_shrink(). The walk goes through the DBs of this
+ * backend in turn and then starts over. After a pass that changed
+ * nothing it waits for some other writer before starting another.
+ */
+
+/* The DB at position pos of the walk, or 0 at the end of a pass */
+static MDB_dbi
+mdb_compact_dbi( struct mdb_info *mdb, MDB_txn *txn, int pos )
+{
+	MDB_dbi dbi = 0;
+
+	if ( pos < MDB_NDB )
+		return mdb->mi_dbis[pos];
+	pos -= MDB_NDB;
+	if ( pos < mdb->mi_nattrs )
+		return mdb->mi_attrs[pos]->ai_dbi;
+	/* the main DB, which holds the records of all the others */
+	if ( pos == mdb->mi_nattrs )
+		mdb_dbi_open( txn, NULL, 0, &dbi );
+	return dbi;
+}
+
+void *
+mdb_compact_task( void *ctx, void *arg )
+{
+	struct re_s *rtask = arg;
+	struct mdb_info *mdb = rtask->arg;
+	MDB_envinfo mei;
+	MDB_txn *txn;
+	MDB_cursor *mc;
+	MDB_val key;
+	MDB_dbi dbi;
+	size_t moved = 0, trimmed = 0;
+	int rc;
+
+	if ( !( mdb->mi_flags & MDB_IS_OPEN ) || slapd_shutdown )
+		goto leave;
+
+	mdb_env_info( mdb->mi_dbenv, &mei );
+	if ( mdb->mi_compact_idle ) {
+		if ( mei.me_last_txnid == mdb->mi_compact_txnid )
+			goto leave;
+		mdb->mi_compact_idle = 0;
+	}
+
+	rc = mdb_txn_begin( mdb->mi_dbenv, NULL, 0, &txn );
+	if ( rc )
+		goto fail;
+
+	/* skip DBs that are not open, e.g. unused indices */
+	while ( !( dbi = mdb_compact_dbi( mdb, txn, mdb->mi_compact_db )) &&
+		mdb->mi_compact_db < MDB_NDB + mdb->mi_nattrs )
+		mdb->mi_compact_db++;
+
+	if ( dbi ) {
+		rc = mdb_cursor_open( txn, dbi, &mc );
+		if ( rc ) {
+			mdb_txn_abort( txn );
+			goto fail;
+		}
+		key.mv_size = mdb->mi_compact_key.bv_len;
+		key.mv_data = mdb->mi_compact_key.bv_val;
+		rc = mdb_cursor_compact( mc, &key, mdb->mi_compact_pages, &moved );
+		if ( rc == 0 ) {
+			/* key points into the map, keep a copy */
+			mdb->mi_compact_key.bv_val = ch_realloc(
+				mdb->mi_compact_key.bv_val, key.mv_size );
+			AC_MEMCPY( mdb->mi_compact_key.bv_val, key.mv_data, key.mv_size );
+			mdb->mi_compact_key.bv_len = key.mv_size;
+		} else if ( rc == MDB_NOTFOUND ) {
+			mdb->mi_compact_db++;
+			mdb->mi_compact_key.bv_len = 0;
+			rc = 0;
+		}
+		mdb_cursor_close( mc );
+	} else {
+		/* end of a pass */
+		mdb->mi_compact_db = 0;
+		mdb->mi_compact_passes++;
+		if ( !mdb->mi_compact_pass )
+			mdb->mi_compact_idle = 1;
+		mdb->mi_compact_pass = 0;
+	}
+
+	if ( rc == 0 )
+		rc = mdb_txn_shrink( txn, &trimmed );
+	if ( rc == 0 ) {
+		rc = mdb_txn_commit( txn );
+	} else {
+		mdb_txn_abort( txn );
+	}
+	if ( rc )
+		goto fail;
+
+	mdb_env_info( mdb->mi_dbenv, &mei );
+	mdb->mi_compact_txnid = mei.me_last_txnid;
+	mdb->mi_compact_moved += moved;
+	mdb->mi_compact_trimmed += trimmed;
+	mdb->mi_compact_pass += moved + trimmed;
+	goto leave;
+
+fail:
+	Debug( LDAP_DEBUG_ANY,
+		LDAP_XSTRING(mdb_compact_task) ": database %s: "
+		"compaction failed: %s (%d)\n",
+		rtask->tspec, mdb_strerror(rc), rc );
+	/* start over on the next run */
+	mdb->mi_compact_db = 0;
+	mdb->mi_compact_key.bv_len = 0;
+
+leave:
+	ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
+	ldap_pvt_runqueue_stoptask( &slapd_rq, rtask );
+	ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
+	return NULL;
+}
+
+/* stop and remove the compaction task */
+void
+mdb_compact_stop( struct mdb_info *mdb )
+{
+	if ( mdb->mi_compact_task ) {
+		struct re_s *re = mdb->mi_compact_task;
+		mdb->mi_compact_task = NULL;
+		ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
+		if ( ldap_pvt_runqueue_isrunning( &slapd_rq, re ) )
+			ldap_pvt_runqueue_stoptask( &slapd_rq, re );
+		ldap_pvt_runqueue_remove( &slapd_rq, re );
+		ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
+	}
+	ch_free( mdb->mi_compact_key.bv_val );
+	BER_BVZERO( &mdb->mi_compact_key );
+	mdb->mi_compact_db = 0;
+}
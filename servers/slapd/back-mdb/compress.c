@@ -0,0 +1,659 @@
+/* compress.c - compression of id2entry records */
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 2011-2020 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+#include <ac/string.h>
+#include <ac/time.h>
+
+#include "back-mdb.h"
+
+/* Entries are compressed one record at a time with a small LZ77 coder
+ * (LZ4-like sequences of literals and 16-bit back references), so a
+ * record can be decoded on its own. Most entries are too small to
+ * compress well by themselves, so references may also point into a
+ * dictionary built from a sample of the entries of this database.
+ *
+ * While there is no dictionary, records are stored as they are and
+ * the first ones are kept as samples. Once there are enough of them
+ * a dictionary is trained from the samples and stored in the dict DB
+ * under the next free ID. It is only used for new records once a later
+ * write txn sees it committed, so a dictionary referenced by a record
+ * is always committed and never changes. Readers load dictionaries on
+ * first use and keep them until the database is closed.
+ *
+ * A dictionary on zi_dicts is never changed or freed while the database
+ * is open, and new ones are only pushed at the head, so readers walk the
+ * list without a lock. zi_mutex only serializes loading a dictionary
+ * that isn't there yet. Everything else but the statistics is only
+ * touched by the writer, which LMDB serializes for us.
+ */
+
+#define LZ_MINMATCH	4
+#define LZ_MAXOFF	65535
+#define LZ_HBITS	12
+#define LZ_HSIZE	(1<<LZ_HBITS)
+#define LZ_HASH(v)	(((v) * 2654435761U) >> (32-LZ_HBITS))
+
+#define DICT_SIZE	32768	/* must be less than LZ_MAXOFF */
+#define DICT_SAMPLES	1024
+#define DICT_SAMPLE_MAX	4096	/* only the start of a larger record */
+#define DICT_SAMPLE_BYTES	(16*DICT_SIZE)
+#define DICT_SEG	64	/* size of the pieces a dictionary is made of */
+#define DICT_KMER	8	/* what the trainer counts */
+#define DICT_KBITS	16
+
+typedef struct mdb_dict {
+	struct mdb_dict *md_next;
+	unsigned md_id;
+	unsigned md_len;
+	unsigned *md_hash;	/* match finder preloaded with md_data, writer only */
+	unsigned char *md_data;
+} mdb_dict;
+
+struct mdb_zinfo {
+	ldap_pvt_thread_mutex_t zi_mutex;
+	mdb_dict *zi_dicts;		/* committed dictionaries */
+	mdb_dict *zi_enc;		/* dictionary for new records */
+	size_t zi_enc_txnid;	/* txn that stored zi_enc, until it's seen committed */
+	int zi_loaded;
+	unsigned char *zi_samples;
+	unsigned zi_sampoff[DICT_SAMPLES+1];
+	unsigned zi_nsamples;
+	unsigned zi_htab[LZ_HSIZE];
+	/* statistics, updated atomically */
+	unsigned long zi_zin, zi_zout;
+	unsigned long zi_unzips;
+};
+
+static unsigned
+lz_read32( const unsigned char *p )
+{
+	unsigned v;
+	memcpy( &v, p, sizeof(v) );
+	return v;
+}
+
+static unsigned char *
+lz_putlen( unsigned char *op, size_t len )
+{
+	for ( ; len >= 255; len -= 255 )
+		*op++ = 255;
+	*op++ = len;
+	return op;
+}
+
+/* Append a sequence of llen literals and, if mlen is nonzero, a match.
+ * Returns NULL if it doesn't fit.
+ */
+static unsigned char *
+lz_emit( unsigned char *op, unsigned char *oend, const unsigned char *lit,
+	size_t llen, size_t off, size_t mlen )
+{
+	unsigned char *tok;
+	size_t need = 1 + llen/255 + 1 + llen;
+
+	if ( mlen )
+		need += 2 + (mlen-LZ_MINMATCH)/255 + 1;
+	if ( (size_t)( oend - op ) < need )
+		return NULL;
+
+	tok = op++;
+	*tok = ( llen < 15 ? llen : 15 ) << 4;
+	if ( llen >= 15 )
+		op = lz_putlen( op, llen - 15 );
+	memcpy( op, lit, llen );
+	op += llen;
+	if ( mlen ) {
+		mlen -= LZ_MINMATCH;
+		*op++ = off & 0xff;
+		*op++ = off >> 8;
+		*tok |= mlen < 15 ? mlen : 15;
+		if ( mlen >= 15 )
+			op = lz_putlen( op, mlen - 15 );
+	}
+	return op;
+}
+
+/* Positions are counted as if src followed the dictionary. Returns
+ * the compressed size, or 0 if it didn't fit in dcap bytes.
+ */
+static size_t
+lz_compress( mdb_dict *md, unsigned *htab, const unsigned char *src,
+	size_t slen, unsigned char *dst, size_t dcap )
+{
+	const unsigned char *dict = md ? md->md_data : NULL;
+	size_t dlen = md ? md->md_len : 0;
+	unsigned char *op = dst, *oend = dst + dcap;
+	size_t ip = 0, anchor = 0;
+
+	if ( md )
+		memcpy( htab, md->md_hash, LZ_HSIZE * sizeof(unsigned) );
+	else
+		memset( htab, 0, LZ_HSIZE * sizeof(unsigned) );
+
+	while ( ip + LZ_MINMATCH <= slen ) {
+		unsigned h = LZ_HASH( lz_read32( src + ip ));
+		size_t cand = htab[h], vpos = dlen + ip, mlen = 0;
+
+		htab[h] = vpos + 1;
+		if ( cand-- && vpos - cand <= LZ_MAXOFF ) {
+			const unsigned char *mp, *mend;
+			size_t max = slen - ip;
+
+			/* a match that starts in the dictionary ends there */
+			if ( cand < dlen ) {
+				mp = dict + cand;
+				mend = dict + dlen;
+			} else {
+				mp = src + cand - dlen;
+				mend = src + slen;
+			}
+			if ( (size_t)( mend - mp ) < max )
+				max = mend - mp;
+			while ( mlen < max && mp[mlen] == src[ip+mlen] )
+				mlen++;
+		}
+		if ( mlen < LZ_MINMATCH ) {
+			ip++;
+			continue;
+		}
+		op = lz_emit( op, oend, src + anchor, ip - anchor, vpos - cand, mlen );
+		if ( !op )
+			return 0;
+		ip += mlen;
+		anchor = ip;
+	}
+	op = lz_emit( op, oend, src + anchor, slen - anchor, 0, 0 );
+	if ( !op )
+		return 0;
+	return op - dst;
+}
+
+static int
+lz_getlen( const unsigned char *src, size_t slen, size_t *ip, size_t *len )
+{
+	unsigned char b;
+
+	do {
+		if ( *ip >= slen )
+			return -1;
+		b = src[(*ip)++];
+		*len += b;
+	} while ( b == 255 );
+	return 0;
+}
+
+static int
+lz_decompress( mdb_dict *md, const unsigned char *src, size_t slen,
+	unsigned char *dst, size_t rlen )
+{
+	const unsigned char *dict = md->md_data;
+	size_t dlen = md->md_len;
+	size_t ip = 0, o = 0;
+
+	while ( ip < slen ) {
+		unsigned tok = src[ip++];
+		size_t llen = tok >> 4, mlen = tok & 15, off, v;
+
+		if ( llen == 15 && lz_getlen( src, slen, &ip, &llen ))
+			return -1;
+		if ( llen > slen - ip || llen > rlen - o )
+			return -1;
+		memcpy( dst + o, src + ip, llen );
+		ip += llen;
+		o += llen;
+		if ( ip == slen )
+			break;
+
+		if ( slen - ip < 2 )
+			return -1;
+		off = src[ip] | src[ip+1] << 8;
+		ip += 2;
+		if ( mlen == 15 && lz_getlen( src, slen, &ip, &mlen ))
+			return -1;
+		mlen += LZ_MINMATCH;
+		if ( !off || off > dlen + o || mlen > rlen - o )
+			return -1;
+		/* byte by byte, the match may overlap its own output */
+		for ( v = dlen + o - off; mlen; mlen--, v++ )
+			dst[o++] = v < dlen ? dict[v] : dst[v - dlen];
+	}
+	return o == rlen ? 0 : -1;
+}
+
+static mdb_dict *
+mdb_dict_new( unsigned id, const void *data, unsigned len )
+{
+	mdb_dict *md = ch_malloc( sizeof(mdb_dict) + len );
+
+	md->md_next = NULL;
+	md->md_id = id;
+	md->md_len = len;
+	md->md_hash = NULL;
+	md->md_data = (unsigned char *)(md+1);
+	memcpy( md->md_data, data, len );
+	return md;
+}
+
+static void
+mdb_dict_free( mdb_dict *md )
+{
+	ch_free( md->md_hash );
+	ch_free( md );
+}
+
+/* Set up the match finder of the writer */
+static void
+mdb_dict_prepare( mdb_dict *md )
+{
+	unsigned i;
+
+	md->md_hash = ch_calloc( LZ_HSIZE, sizeof(unsigned) );
+	for ( i = 0; i + LZ_MINMATCH <= md->md_len; i++ )
+		md->md_hash[LZ_HASH( lz_read32( md->md_data + i ))] = i + 1;
+}
+
+static mdb_dict *
+mdb_dict_find( struct mdb_zinfo *zi, unsigned id )
+{
+	mdb_dict *md;
+
+	for ( md = __atomic_load_n( &zi->zi_dicts, __ATOMIC_ACQUIRE ); md;
+		md = md->md_next )
+		if ( md->md_id == id )
+			break;
+	return md;
+}
+
+/* Make a dictionary visible to readers, caller holds zi_mutex */
+static void
+mdb_dict_publish( struct mdb_zinfo *zi, mdb_dict *md )
+{
+	md->md_next = zi->zi_dicts;
+	__atomic_store_n( &zi->zi_dicts, md, __ATOMIC_RELEASE );
+}
+
+/* Find a committed dictionary, loading it if needed */
+static mdb_dict *
+mdb_dict_get( struct mdb_info *mdb, MDB_txn *txn, unsigned id )
+{
+	struct mdb_zinfo *zi = mdb->mi_zinfo;
+	mdb_dict *md;
+	MDB_val key, data;
+
+	md = mdb_dict_find( zi, id );
+	if ( md || !mdb->mi_dbis[MDB_DICT] )
+		return md;
+
+	ldap_pvt_thread_mutex_lock( &zi->zi_mutex );
+	/* someone else may have loaded it meanwhile */
+	md = mdb_dict_find( zi, id );
+	if ( !md ) {
+		key.mv_data = &id;
+		key.mv_size = sizeof(id);
+		if ( mdb_get( txn, mdb->mi_dbis[MDB_DICT], &key, &data ) == 0 ) {
+			md = mdb_dict_new( id, data.mv_data, data.mv_size );
+			mdb_dict_publish( zi, md );
+		}
+	}
+	ldap_pvt_thread_mutex_unlock( &zi->zi_mutex );
+	return md;
+}
+
+/* Pick up the newest stored dictionary for new records */
+static int
+mdb_dict_load( struct mdb_info *mdb, MDB_txn *txn )
+{
+	struct mdb_zinfo *zi = mdb->mi_zinfo;
+	MDB_cursor *mc;
+	MDB_val key, data;
+	int rc;
+
+	rc = mdb_cursor_open( txn, mdb->mi_dbis[MDB_DICT], &mc );
+	if ( rc )
+		return rc;
+	rc = mdb_cursor_get( mc, &key, &data, MDB_LAST );
+	mdb_cursor_close( mc );
+	if ( rc == 0 ) {
+		unsigned id;
+		memcpy( &id, key.mv_data, sizeof(id) );
+		zi->zi_enc = mdb_dict_get( mdb, txn, id );
+		if ( zi->zi_enc && !zi->zi_enc->md_hash )
+			mdb_dict_prepare( zi->zi_enc );
+	} else if ( rc != MDB_NOTFOUND ) {
+		return rc;
+	}
+	zi->zi_loaded = 1;
+	return 0;
+}
+
+/* See whether the txn that stored our new dictionary has committed */
+static int
+mdb_dict_confirm( struct mdb_info *mdb, MDB_txn *txn )
+{
+	struct mdb_zinfo *zi = mdb->mi_zinfo;
+	MDB_envinfo mei;
+	MDB_val key, data;
+	int rc;
+
+	key.mv_data = &zi->zi_enc->md_id;
+	key.mv_size = sizeof(unsigned);
+	rc = mdb_get( txn, mdb->mi_dbis[MDB_DICT], &key, &data );
+	if ( rc == MDB_NOTFOUND ) {
+		/* that txn was aborted, start over */
+		mdb_dict_free( zi->zi_enc );
+		zi->zi_enc = NULL;
+		return 0;
+	}
+	if ( rc )
+		return rc;
+	mdb_env_info( mdb->mi_dbenv, &mei );
+	if ( mei.me_last_txnid >= zi->zi_enc_txnid ) {
+		zi->zi_enc_txnid = 0;
+		ldap_pvt_thread_mutex_lock( &zi->zi_mutex );
+		mdb_dict_publish( zi, zi->zi_enc );
+		ldap_pvt_thread_mutex_unlock( &zi->zi_mutex );
+	}
+	return 0;
+}
+
+static unsigned
+mdb_dict_khash( const unsigned char *p )
+{
+	unsigned long long v;
+	memcpy( &v, p, sizeof(v) );
+	return ( v * 0x9E3779B97F4A7C15ULL ) >> ( 64 - DICT_KBITS );
+}
+
+/* Build a dictionary from pieces of the samples. Byte strings that turn
+ * up in many different samples are what a single record can't find in
+ * itself. The samples are cut into as many stretches as the dictionary
+ * has pieces, and from each stretch the DICT_SEG bytes holding the most
+ * such strings are taken. Returns the size of the dictionary.
+ */
+static unsigned
+mdb_dict_train( struct mdb_zinfo *zi, unsigned char *dict )
+{
+	unsigned char *buf = zi->zi_samples;
+	unsigned len = zi->zi_sampoff[zi->zi_nsamples];
+	unsigned *freq, *last, *score;
+	unsigned i, s, nseg, stretch, dpos = DICT_SIZE;
+
+	if ( len < DICT_SEG )
+		return 0;
+	freq = ch_calloc( 3 << DICT_KBITS, sizeof(unsigned) );
+	last = freq + ( 1 << DICT_KBITS );
+	score = last + ( 1 << DICT_KBITS );
+
+	/* in how many samples does each k-mer occur */
+	for ( s = 0; s < zi->zi_nsamples; s++ ) {
+		for ( i = zi->zi_sampoff[s]; i + DICT_KMER <= zi->zi_sampoff[s+1]; i++ ) {
+			unsigned h = mdb_dict_khash( buf + i );
+			if ( last[h] != s+1 ) {
+				last[h] = s+1;
+				freq[h]++;
+			}
+		}
+	}
+
+	nseg = DICT_SIZE / DICT_SEG;
+	if ( nseg > len / DICT_SEG )
+		nseg = len / DICT_SEG;
+	stretch = len / nseg;
+	for ( s = 0; s < nseg && dpos >= DICT_SEG; s++ ) {
+		unsigned start = s * stretch, end = start + stretch;
+		unsigned best = 0, bestpos = 0, sum = 0, j;
+
+		if ( end > len - DICT_KMER + 1 )
+			end = len - DICT_KMER + 1;
+		if ( end < start + DICT_SEG )
+			continue;
+		/* slide a window of DICT_SEG-DICT_KMER+1 k-mers over the stretch */
+		for ( i = start; i < end; i++ ) {
+			unsigned f = freq[mdb_dict_khash( buf + i )];
+			score[i & 0xffff] = f > 1 ? f : 0;
+			sum += score[i & 0xffff];
+			if ( i >= start + DICT_SEG - DICT_KMER + 1 )
+				sum -= score[( i - ( DICT_SEG - DICT_KMER + 1 )) & 0xffff];
+			if ( i + 1 >= start + DICT_SEG - DICT_KMER + 1 && sum > best ) {
+				best = sum;
+				bestpos = i + DICT_KMER - DICT_SEG;
+			}
+		}
+		if ( !best )
+			continue;
+		/* the most useful pieces end up nearest the data */
+		dpos -= DICT_SEG;
+		memcpy( dict + dpos, buf + bestpos, DICT_SEG );
+		for ( j = bestpos; j + DICT_KMER <= bestpos + DICT_SEG; j++ )
+			freq[mdb_dict_khash( buf + j )] = 0;
+	}
+	ch_free( freq );
+
+	memmove( dict, dict + dpos, DICT_SIZE - dpos );
+	return DICT_SIZE - dpos;
+}
+
+/* Keep the start of a record as a sample, and once there are enough
+ * samples store a new dictionary.
+ */
+static int
+mdb_dict_sample( struct mdb_info *mdb, MDB_txn *txn, MDB_val *data )
+{
+	struct mdb_zinfo *zi = mdb->mi_zinfo;
+	unsigned len = data->mv_size, off, id = 1;
+	unsigned char *dict;
+	MDB_cursor *mc;
+	MDB_val key, val;
+	int rc;
+
+	if ( !zi->zi_samples ) {
+		zi->zi_samples = ch_malloc( DICT_SAMPLE_BYTES );
+		zi->zi_nsamples = 0;
+		zi->zi_sampoff[0] = 0;
+	}
+	off = zi->zi_sampoff[zi->zi_nsamples];
+	if ( len > DICT_SAMPLE_MAX )
+		len = DICT_SAMPLE_MAX;
+	if ( len > DICT_SAMPLE_BYTES - off )
+		len = DICT_SAMPLE_BYTES - off;
+	memcpy( zi->zi_samples + off, data->mv_data, len );
+	zi->zi_sampoff[++zi->zi_nsamples] = off + len;
+	if ( zi->zi_nsamples < DICT_SAMPLES && off + len < DICT_SAMPLE_BYTES )
+		return 0;
+
+	dict = ch_malloc( DICT_SIZE );
+	len = mdb_dict_train( zi, dict );
+	ch_free( zi->zi_samples );
+	zi->zi_samples = NULL;
+
+	rc = mdb_cursor_open( txn, mdb->mi_dbis[MDB_DICT], &mc );
+	if ( rc == 0 ) {
+		rc = mdb_cursor_get( mc, &key, &val, MDB_LAST );
+		if ( rc == 0 ) {
+			memcpy( &id, key.mv_data, sizeof(id) );
+			id++;
+		}
+		mdb_cursor_close( mc );
+	}
+	if ( rc == 0 || rc == MDB_NOTFOUND ) {
+		key.mv_data = &id;
+		key.mv_size = sizeof(id);
+		val.mv_data = dict;
+		val.mv_size = len;
+		rc = mdb_put( txn, mdb->mi_dbis[MDB_DICT], &key, &val, MDB_NOOVERWRITE );
+	}
+	if ( rc == 0 ) {
+		zi->zi_enc = mdb_dict_new( id, dict, len );
+		zi->zi_enc_txnid = mdb_txn_id( txn );
+		mdb_dict_prepare( zi->zi_enc );
+		Debug( LDAP_DEBUG_STATS, "mdb_dict_sample: "
+			"new compression dictionary %u, %u bytes from %u samples\n",
+			id, len, zi->zi_nsamples );
+	}
+	ch_free( dict );
+	return rc;
+}
+
+/* Replace the encoded record in data by a compressed one if that is
+ * worth it. The record must have been allocated with op->o_tmpalloc.
+ * Compressed records start with nattrs|MDB_ENC_ZIP, nvals, the ID of
+ * the dictionary and the size of the plain record.
+ */
+int
+mdb_entry_compress( Operation *op, MDB_txn *txn, MDB_val *data )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	struct mdb_zinfo *zi = mdb->mi_zinfo;
+	unsigned int *lp = data->mv_data, *zp;
+	size_t hdr = MDB_ENC_ZHDR * sizeof(unsigned int), cap, clen;
+	int rc;
+
+	if ( !mdb->mi_dbis[MDB_DICT] || data->mv_size <= hdr )
+		return 0;
+
+	if ( !zi->zi_loaded ) {
+		rc = mdb_dict_load( mdb, txn );
+		if ( rc )
+			return rc;
+	}
+	if ( zi->zi_enc && zi->zi_enc_txnid ) {
+		rc = mdb_dict_confirm( mdb, txn );
+		if ( rc )
+			return rc;
+	}
+	if ( !zi->zi_enc )
+		return mdb_dict_sample( mdb, txn, data );
+	if ( zi->zi_enc_txnid )
+		return 0;
+
+	/* must save at least 1/16th */
+	cap = data->mv_size - data->mv_size / 16 - hdr;
+	zp = op->o_tmpalloc( hdr + cap, op->o_tmpmemctx );
+	clen = lz_compress( zi->zi_enc, zi->zi_htab, data->mv_data,
+		data->mv_size, (unsigned char *)zp + hdr, cap );
+	if ( !clen ) {
+		op->o_tmpfree( zp, op->o_tmpmemctx );
+		return 0;
+	}
+	zp[0] = lp[0] | MDB_ENC_ZIP;
+	zp[1] = lp[1];
+	zp[2] = zi->zi_enc->md_id;
+	zp[3] = data->mv_size;
+
+	__atomic_add_fetch( &zi->zi_zin, data->mv_size, __ATOMIC_RELAXED );
+	__atomic_add_fetch( &zi->zi_zout, hdr + clen, __ATOMIC_RELAXED );
+
+	op->o_tmpfree( data->mv_data, op->o_tmpmemctx );
+	data->mv_data = zp;
+	data->mv_size = hdr + clen;
+	return 0;
+}
+
+/* Uncompress a record into buf, which must hold the size given in
+ * its header. On success data is pointed at buf.
+ */
+int
+mdb_entry_decompress( Operation *op, MDB_txn *txn, MDB_val *data, void *buf )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	struct mdb_zinfo *zi = mdb->mi_zinfo;
+	unsigned int *lp = data->mv_data;
+	size_t hdr = MDB_ENC_ZHDR * sizeof(unsigned int);
+	mdb_dict *md;
+	int rc;
+
+	if ( data->mv_size < hdr )
+		return LDAP_OTHER;
+	md = mdb_dict_get( mdb, txn, lp[2] );
+	if ( !md ) {
+		Debug( LDAP_DEBUG_ANY, "mdb_entry_decompress: "
+			"compression dictionary %u not found\n", lp[2] );
+		return LDAP_OTHER;
+	}
+
+	rc = lz_decompress( md, (unsigned char *)data->mv_data + hdr,
+		data->mv_size - hdr, buf, lp[3] );
+	if ( rc ) {
+		Debug( LDAP_DEBUG_ANY, "mdb_entry_decompress: "
+			"corrupt record\n" );
+		return LDAP_OTHER;
+	}
+
+	__atomic_add_fetch( &zi->zi_unzips, 1, __ATOMIC_RELAXED );
+
+	data->mv_size = lp[3];
+	data->mv_data = buf;
+	return 0;
+}
+
+void
+mdb_dict_stats( struct mdb_info *mdb, unsigned long *zin, unsigned long *zout,
+	unsigned long *unzips )
+{
+	struct mdb_zinfo *zi = mdb->mi_zinfo;
+
+	*zin = __atomic_load_n( &zi->zi_zin, __ATOMIC_RELAXED );
+	*zout = __atomic_load_n( &zi->zi_zout, __ATOMIC_RELAXED );
+	*unzips = __atomic_load_n( &zi->zi_unzips, __ATOMIC_RELAXED );
+}
+
+int
+mdb_dict_init( struct mdb_info *mdb )
+{
+	struct mdb_zinfo *zi = ch_calloc( 1, sizeof(struct mdb_zinfo) );
+
+	ldap_pvt_thread_mutex_init( &zi->zi_mutex );
+	mdb->mi_zinfo = zi;
+	return 0;
+}
+
+/* Forget the dictionaries of the environment being closed */
+void
+mdb_dict_flush( struct mdb_info *mdb )
+{
+	struct mdb_zinfo *zi = mdb->mi_zinfo;
+	mdb_dict *md;
+
+	if ( !zi )
+		return;
+	if ( zi->zi_enc && zi->zi_enc_txnid )
+		mdb_dict_free( zi->zi_enc );
+	zi->zi_enc = NULL;
+	zi->zi_enc_txnid = 0;
+	zi->zi_loaded = 0;
+	while (( md = zi->zi_dicts )) {
+		zi->zi_dicts = md->md_next;
+		mdb_dict_free( md );
+	}
+	ch_free( zi->zi_samples );
+	zi->zi_samples = NULL;
+}
+
+void
+mdb_dict_destroy( struct mdb_info *mdb )
+{
+	struct mdb_zinfo *zi = mdb->mi_zinfo;
+
+	if ( !zi )
+		return;
+	mdb_dict_flush( mdb );
+	ldap_pvt_thread_mutex_destroy( &zi->zi_mutex );
+	ch_free( zi );
+	mdb->mi_zinfo = NULL;
+}
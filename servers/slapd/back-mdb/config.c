@@ -45,6 +45,10 @@ enum {
 	MDB_SSTACK,
 	MDB_MULTIVAL,
 	MDB_IDLEXP,
+	MDB_ECACHE,
+	MDB_COMPACT,
+	MDB_GROUPCOMMIT,
+	MDB_OVZONE,
 };
 
 static ConfigTable mdbcfg[] = {
@@ -63,16 +67,43 @@ static ConfigTable mdbcfg[] = {
 			"DESC 'Database checkpoint interval in kbytes and minutes' "
 			"EQUALITY caseIgnoreMatch "
 			"SYNTAX OMsDirectoryString SINGLE-VALUE )",NULL, NULL },
+	{ "compact", "pages> <seconds", 3, 3, 0, ARG_MAGIC|MDB_COMPACT,
+		mdb_cf_gen, "( OLcfgDbAt:12.10 NAME 'olcDbCompact' "
+			"DESC 'Pages to move toward the start of the file and interval in seconds' "
+			"EQUALITY caseIgnoreMatch "
+			"SYNTAX OMsDirectoryString SINGLE-VALUE )", NULL, NULL },
+	{ "compress", "size", 2, 2, 0, ARG_ULONG|ARG_OFFSET,
+		(void *)offsetof(struct mdb_info, mi_compress_min),
+		"( OLcfgDbAt:12.11 NAME 'olcDbCompress' "
+		"DESC 'Minimum size in bytes of an entry to store compressed' "
+		"EQUALITY integerMatch "
+		"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ "dbnosync", NULL, 1, 2, 0, ARG_ON_OFF|ARG_MAGIC|MDB_DBNOSYNC,
 		mdb_cf_gen, "( OLcfgDbAt:1.4 NAME 'olcDbNoSync' "
 			"DESC 'Disable synchronous database writes' "
 			"EQUALITY booleanMatch "
 			"SYNTAX OMsBoolean SINGLE-VALUE )", NULL, NULL },
+	{ "entrycache", "entries", 2, 2, 0, ARG_UINT|ARG_MAGIC|MDB_ECACHE,
+		mdb_cf_gen, "( OLcfgDbAt:12.8 NAME 'olcDbEntryCache' "
+			"DESC 'Number of decoded entries to cache' "
+			"EQUALITY integerMatch "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ "envflags", "flags", 2, 0, 0, ARG_MAGIC|MDB_ENVFLAGS,
 		mdb_cf_gen, "( OLcfgDbAt:12.3 NAME 'olcDbEnvFlags' "
 			"DESC 'Database environment flags' "
 			"EQUALITY caseIgnoreMatch "
 			"SYNTAX OMsDirectoryString )", NULL, NULL },
+	{ "groupcommit", "ops> <usec", 3, 3, 0, ARG_MAGIC|MDB_GROUPCOMMIT,
+		mdb_cf_gen, "( OLcfgDbAt:12.12 NAME 'olcDbGroupCommit' "
+			"DESC 'Most write ops to commit together and usecs to wait for them' "
+			"EQUALITY caseIgnoreMatch "
+			"SYNTAX OMsDirectoryString SINGLE-VALUE )", NULL, NULL },
+	{ "idlexact", NULL, 1, 2, 0, ARG_ON_OFF|ARG_OFFSET,
+		(void *)offsetof(struct mdb_info, mi_idl_exact),
+		"( OLcfgDbAt:12.7 NAME 'olcDbIdlExact' "
+		"DESC 'Keep large index slots exact instead of collapsing them into ranges' "
+		"EQUALITY booleanMatch "
+		"SYNTAX OMsBoolean SINGLE-VALUE )", NULL, NULL },
 	{ "index", "attr> <[pres,eq,approx,sub]", 2, 3, 0, ARG_MAGIC|MDB_INDEX,
 		mdb_cf_gen, "( OLcfgDbAt:0.2 NAME 'olcDbIndex' "
 		"DESC 'Attribute index parameters' "
@@ -105,12 +136,23 @@ static ConfigTable mdbcfg[] = {
 		"DESC 'Hi/Lo thresholds for splitting multivalued attr out of main blob' "
 		"EQUALITY caseIgnoreMatch "
 		"SYNTAX OMsDirectoryString )", NULL, NULL },
+	{ "overflowzone", NULL, 1, 2, 0, ARG_ON_OFF|ARG_MAGIC|MDB_OVZONE,
+		mdb_cf_gen, "( OLcfgDbAt:12.13 NAME 'olcDbOverflowZone' "
+		"DESC 'Keep the overflow pages of big entries apart from B-tree pages' "
+		"EQUALITY booleanMatch "
+		"SYNTAX OMsBoolean SINGLE-VALUE )", NULL, NULL },
 	{ "rtxnsize", "entries", 2, 2, 0, ARG_UINT|ARG_OFFSET,
 		(void *)offsetof(struct mdb_info, mi_rtxn_size),
 		"( OLcfgDbAt:12.5 NAME 'olcDbRtxnSize' "
 		"DESC 'Number of entries to process in one read transaction' "
 		"EQUALITY integerMatch "
 		"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "searchthreads", "threads", 2, 2, 0, ARG_UINT|ARG_OFFSET,
+		(void *)offsetof(struct mdb_info, mi_search_threads),
+		"( OLcfgDbAt:12.9 NAME 'olcDbSearchThreads' "
+		"DESC 'Number of threads evaluating the filter of a large search' "
+		"EQUALITY integerMatch "
+		"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ "searchstack", "depth", 2, 2, 0, ARG_INT|ARG_MAGIC|MDB_SSTACK,
 		mdb_cf_gen, "( OLcfgDbAt:1.9 NAME 'olcDbSearchStack' "
 		"DESC 'Depth of search stack in IDLs' "
@@ -137,7 +179,9 @@ static ConfigOCs mdbocs[] = {
 		"MAY ( olcDbCheckpoint $ olcDbEnvFlags $ "
 		"olcDbNoSync $ olcDbIndex $ olcDbMaxReaders $ olcDbMaxSize $ "
 		"olcDbMode $ olcDbSearchStack $ olcDbMaxEntrySize $ olcDbRtxnSize $ "
-		"olcDbMultival ) )",
+		"olcDbMultival $ olcDbIdlExact $ olcDbEntryCache $ olcDbSearchThreads $ "
+		"olcDbCompact $ olcDbCompress $ olcDbGroupCommit $ "
+		"olcDbOverflowZone ) )",
 			Cft_Database, mdbcfg+1 },
 	{ NULL, 0, NULL }
 };
@@ -148,6 +192,7 @@ static slap_verbmasks mdb_envflags[] = {
 	{ BER_BVC("writemap"),	MDB_WRITEMAP },
 	{ BER_BVC("mapasync"),	MDB_MAPASYNC },
 	{ BER_BVC("nordahead"),	MDB_NORDAHEAD },
+	{ BER_BVC("incremental"),	MDB_INCREMENTAL },
 	{ BER_BVNULL, 0 }
 };
 
@@ -331,6 +376,20 @@ mdb_cf_cleanup( ConfigArgs *c )
 	return rc;
 }
 
+/* Apply overflowzone to id2entry of an open database */
+static void
+mdb_ovzone_apply( struct mdb_info *mdb )
+{
+	MDB_txn *txn;
+
+	if ( !( mdb->mi_flags & MDB_IS_OPEN ))
+		return;
+	if ( mdb_txn_begin( mdb->mi_dbenv, NULL, MDB_RDONLY, &txn ) == 0 ) {
+		mdb_set_ovzone( txn, mdb->mi_id2entry, mdb->mi_ovzone );
+		mdb_txn_abort( txn );
+	}
+}
+
 static int
 mdb_cf_gen( ConfigArgs *c )
 {
@@ -369,6 +428,40 @@ mdb_cf_gen( ConfigArgs *c )
 			}
 			break;
 
+		case MDB_COMPACT:
+			if ( mdb->mi_compact_pages ) {
+				char buf[64];
+				struct berval bv;
+				bv.bv_len = snprintf( buf, sizeof(buf), "%u %u",
+					mdb->mi_compact_pages, mdb->mi_compact_interval );
+				if ( bv.bv_len > 0 && bv.bv_len < sizeof(buf) ) {
+					bv.bv_val = buf;
+					value_add_one( &c->rvalue_vals, &bv );
+				} else {
+					rc = 1;
+				}
+			} else {
+				rc = 1;
+			}
+			break;
+
+		case MDB_GROUPCOMMIT:
+			if ( mdb->mi_group_max ) {
+				char buf[64];
+				struct berval bv;
+				bv.bv_len = snprintf( buf, sizeof(buf), "%u %u",
+					mdb->mi_group_max, mdb->mi_group_delay );
+				if ( bv.bv_len > 0 && bv.bv_len < sizeof(buf) ) {
+					bv.bv_val = buf;
+					value_add_one( &c->rvalue_vals, &bv );
+				} else {
+					rc = 1;
+				}
+			} else {
+				rc = 1;
+			}
+			break;
+
 		case MDB_DIRECTORY:
 			if ( mdb->mi_dbenv_home ) {
 				c->value_string = ch_strdup( mdb->mi_dbenv_home );
@@ -382,6 +475,10 @@ mdb_cf_gen( ConfigArgs *c )
 				c->value_int = 1;
 			break;
 
+		case MDB_OVZONE:
+			c->value_int = mdb->mi_ovzone;
+			break;
+
 		case MDB_ENVFLAGS:
 			if ( mdb->mi_dbenv_flags ) {
 				mask_to_verbs( mdb_envflags, mdb->mi_dbenv_flags, &c->rvalue_vals );
@@ -406,6 +503,10 @@ mdb_cf_gen( ConfigArgs *c )
 			c->value_ulong = mdb->mi_mapsize;
 			break;
 
+		case MDB_ECACHE:
+			c->value_uint = mdb->mi_ecache_max;
+			break;
+
 		case MDB_MULTIVAL:
 			mdb_attr_multi_unparse( mdb, &c->rvalue_vals );
 			if ( !c->rvalue_vals ) rc = 1;
@@ -429,6 +530,11 @@ mdb_cf_gen( ConfigArgs *c )
 		case MDB_MAXSIZE:
 			break;
 
+		case MDB_ECACHE:
+			mdb->mi_ecache_max = 0;
+			mdb_ecache_trim( mdb );
+			break;
+
 		case MDB_CHKPT:
 			if ( mdb->mi_txn_cp_task ) {
 				struct re_s *re = mdb->mi_txn_cp_task;
@@ -441,6 +547,19 @@ mdb_cf_gen( ConfigArgs *c )
 			}
 			mdb->mi_txn_cp = 0;
 			break;
+		case MDB_COMPACT:
+			mdb_compact_stop( mdb );
+			mdb->mi_compact_pages = 0;
+			mdb->mi_compact_interval = 0;
+			break;
+		case MDB_GROUPCOMMIT:
+			mdb->mi_group_max = 0;
+			mdb->mi_group_delay = 0;
+			break;
+		case MDB_OVZONE:
+			mdb->mi_ovzone = 0;
+			mdb_ovzone_apply( mdb );
+			break;
 		case MDB_DIRECTORY:
 			mdb->mi_flags |= MDB_RE_OPEN;
 			ch_free( mdb->mi_dbenv_home );
@@ -683,6 +802,65 @@ mdb_cf_gen( ConfigArgs *c )
 		}
 		} break;
 
+	case MDB_COMPACT: {
+		unsigned pages, interval;
+		if ( lutil_atoux( &pages, c->argv[1], 0 ) != 0 || !pages ) {
+			fprintf( stderr, "%s: "
+				"invalid pages \"%s\" in \"compact\".\n",
+				c->log, c->argv[1] );
+			return 1;
+		}
+		if ( lutil_atoux( &interval, c->argv[2], 0 ) != 0 || !interval ) {
+			fprintf( stderr, "%s: "
+				"invalid seconds \"%s\" in \"compact\".\n",
+				c->log, c->argv[2] );
+			return 1;
+		}
+		mdb->mi_compact_pages = pages;
+		mdb->mi_compact_interval = interval;
+		if ( slapMode & SLAP_SERVER_MODE ) {
+			struct re_s *re = mdb->mi_compact_task;
+			if ( re ) {
+				re->interval.tv_sec = interval;
+			} else {
+				if ( c->be->be_suffix == NULL || BER_BVISNULL( &c->be->be_suffix[0] ) ) {
+					fprintf( stderr, "%s: "
+						"\"compact\" must occur after \"suffix\".\n",
+						c->log );
+					return 1;
+				}
+				ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
+				mdb->mi_compact_task = ldap_pvt_runqueue_insert( &slapd_rq,
+					interval, mdb_compact_task, mdb,
+					LDAP_XSTRING(mdb_compact_task), c->be->be_suffix[0].bv_val );
+				ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
+			}
+		}
+		} break;
+
+	case MDB_GROUPCOMMIT: {
+		unsigned ops, delay;
+		if ( lutil_atoux( &ops, c->argv[1], 0 ) != 0 || !ops ) {
+			fprintf( stderr, "%s: "
+				"invalid ops \"%s\" in \"groupcommit\".\n",
+				c->log, c->argv[1] );
+			return 1;
+		}
+		if ( lutil_atoux( &delay, c->argv[2], 0 ) != 0 ) {
+			fprintf( stderr, "%s: "
+				"invalid usec \"%s\" in \"groupcommit\".\n",
+				c->log, c->argv[2] );
+			return 1;
+		}
+		mdb->mi_group_max = ops;
+		mdb->mi_group_delay = delay;
+		} break;
+
+	case MDB_OVZONE:
+		mdb->mi_ovzone = c->value_int;
+		mdb_ovzone_apply( mdb );
+		break;
+
 	case MDB_DIRECTORY: {
 		FILE *f;
 		char *ptr, *testpath;
@@ -809,6 +987,11 @@ mdb_cf_gen( ConfigArgs *c )
 
 		if( rc != LDAP_SUCCESS ) return 1;
 		break;
+
+	case MDB_ECACHE:
+		mdb->mi_ecache_max = c->value_uint;
+		mdb_ecache_trim( mdb );
+		break;
 	}
 	return 0;
 }
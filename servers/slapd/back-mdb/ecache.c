@@ -0,0 +1,461 @@
+/* ecache.c - cache of decoded entries */
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 2000-2020 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+#include <ac/string.h>
+
+#include "back-mdb.h"
+
+/* A decoded entry normally points straight into the map, so it is
+ * only good for the life of its read txn. A cache node holds a private
+ * copy of the stored record along with the decoded Entry/Attribute/
+ * berval block pointing into that copy. A hit hands the caller its own
+ * copy of the block (one memcpy, no decode), and the node is pinned
+ * until that copy is returned through mdb_entry_return().
+ *
+ * Nodes are tagged with the txnid of the snapshot they were decoded
+ * from, and a reader may only use a node no newer than its own
+ * snapshot. Writers drop the node of every entry they modify or delete
+ * before they commit, and raise the shard's fence to their txnid so
+ * that readers on an older snapshot can't put a stale copy back.
+ * A write txn that aborts leaves the fence raised, which only means
+ * inserts into that shard wait for the next commit.
+ */
+
+#define ECACHE_SHARDS	16	/* must be a power of 2 */
+#define ECACHE_HASH_MIN	64
+
+typedef struct ec_node {
+	struct ec_node *en_hnext;		/* hash chain */
+	struct ec_node *en_prev, *en_next;	/* LRU list, newest first */
+	struct ec_shard *en_shard;
+	ID en_id;
+	size_t en_txnid;	/* snapshot this was decoded from */
+	int en_ref;			/* 1 while cached, plus one per copy out */
+	ber_len_t en_esize;	/* size of the Entry block */
+	/* followed by the Entry block and the record copy */
+} ec_node;
+
+#define EN_ENTRY(en)	((Entry *)((en)+1))
+
+typedef struct ec_shard {
+	ldap_pvt_thread_mutex_t es_mutex;
+	ec_node **es_hash;
+	unsigned es_hmask;
+	unsigned es_count;
+	ec_node *es_head, *es_tail;
+	size_t es_fence;	/* no inserts from snapshots older than this */
+	unsigned long es_hits;
+	unsigned long es_misses;
+	/* keep shards from sharing cache lines */
+	char es_pad[CACHELINE];
+} ec_shard;
+
+struct mdb_ecache {
+	ec_shard ec_shards[ECACHE_SHARDS];
+};
+
+#define EC_SHARD(ec, id)	(&(ec)->ec_shards[(id) & (ECACHE_SHARDS-1)])
+#define ES_BUCKET(es, id)	(&(es)->es_hash[((id) / ECACHE_SHARDS) & (es)->es_hmask])
+
+int
+mdb_ecache_init( struct mdb_info *mdb )
+{
+	struct mdb_ecache *ec;
+	int i;
+
+	ec = ch_calloc( 1, sizeof(struct mdb_ecache) );
+	for ( i = 0; i < ECACHE_SHARDS; i++ ) {
+		ec_shard *es = &ec->ec_shards[i];
+		ldap_pvt_thread_mutex_init( &es->es_mutex );
+		es->es_hmask = ECACHE_HASH_MIN - 1;
+		es->es_hash = ch_calloc( ECACHE_HASH_MIN, sizeof(ec_node *) );
+	}
+	mdb->mi_ecache = ec;
+	return 0;
+}
+
+/* Drop one reference, freeing the node on the last one.
+ * Shard must be locked.
+ */
+static void
+ec_node_unref( ec_node *en )
+{
+	if ( --en->en_ref == 0 )
+		ch_free( en );
+}
+
+/* Take the node out of the hash and LRU list. Shard must be locked. */
+static void
+ec_node_unlink( ec_shard *es, ec_node *en )
+{
+	ec_node **prev;
+
+	for ( prev = ES_BUCKET( es, en->en_id ); *prev != en;
+		prev = &(*prev)->en_hnext )
+		;
+	*prev = en->en_hnext;
+
+	if ( en->en_prev )
+		en->en_prev->en_next = en->en_next;
+	else
+		es->es_head = en->en_next;
+	if ( en->en_next )
+		en->en_next->en_prev = en->en_prev;
+	else
+		es->es_tail = en->en_prev;
+	es->es_count--;
+	ec_node_unref( en );
+}
+
+static ec_node *
+ec_node_find( ec_shard *es, ID id )
+{
+	ec_node *en;
+
+	for ( en = *ES_BUCKET( es, id ); en; en = en->en_hnext )
+		if ( en->en_id == id )
+			break;
+	return en;
+}
+
+static void
+ec_node_lru_head( ec_shard *es, ec_node *en )
+{
+	if ( es->es_head == en )
+		return;
+	en->en_prev->en_next = en->en_next;
+	if ( en->en_next )
+		en->en_next->en_prev = en->en_prev;
+	else
+		es->es_tail = en->en_prev;
+	en->en_prev = NULL;
+	en->en_next = es->es_head;
+	es->es_head->en_prev = en;
+	es->es_head = en;
+}
+
+/* Double the hash table. Shard must be locked. */
+static void
+ec_shard_grow( ec_shard *es )
+{
+	unsigned i, omask = es->es_hmask;
+	ec_node **ohash = es->es_hash, *en, *next;
+
+	es->es_hash = ch_calloc( ( omask + 1 ) * 2, sizeof(ec_node *) );
+	es->es_hmask = omask * 2 + 1;
+	for ( i = 0; i <= omask; i++ ) {
+		for ( en = ohash[i]; en; en = next ) {
+			ec_node **bucket = ES_BUCKET( es, en->en_id );
+			next = en->en_hnext;
+			en->en_hnext = *bucket;
+			*bucket = en;
+		}
+	}
+	ch_free( ohash );
+}
+
+static void
+ec_shard_trim( ec_shard *es, unsigned max )
+{
+	while ( es->es_count > max )
+		ec_node_unlink( es, es->es_tail );
+}
+
+/* Evict down to the configured size, or empty the cache if max is 0 */
+void
+mdb_ecache_trim( struct mdb_info *mdb )
+{
+	struct mdb_ecache *ec = mdb->mi_ecache;
+	unsigned max;
+	int i;
+
+	if ( !ec )
+		return;
+	max = ( mdb->mi_ecache_max + ECACHE_SHARDS - 1 ) / ECACHE_SHARDS;
+	for ( i = 0; i < ECACHE_SHARDS; i++ ) {
+		ec_shard *es = &ec->ec_shards[i];
+		ldap_pvt_thread_mutex_lock( &es->es_mutex );
+		ec_shard_trim( es, max );
+		ldap_pvt_thread_mutex_unlock( &es->es_mutex );
+	}
+}
+
+void
+mdb_ecache_flush( struct mdb_info *mdb )
+{
+	struct mdb_ecache *ec = mdb->mi_ecache;
+	int i;
+
+	if ( !ec )
+		return;
+	for ( i = 0; i < ECACHE_SHARDS; i++ ) {
+		ec_shard *es = &ec->ec_shards[i];
+		ldap_pvt_thread_mutex_lock( &es->es_mutex );
+		ec_shard_trim( es, 0 );
+		es->es_fence = 0;
+		ldap_pvt_thread_mutex_unlock( &es->es_mutex );
+	}
+}
+
+void
+mdb_ecache_destroy( struct mdb_info *mdb )
+{
+	struct mdb_ecache *ec = mdb->mi_ecache;
+	int i;
+
+	if ( !ec )
+		return;
+	mdb_ecache_flush( mdb );
+	for ( i = 0; i < ECACHE_SHARDS; i++ ) {
+		ec_shard *es = &ec->ec_shards[i];
+		ldap_pvt_thread_mutex_destroy( &es->es_mutex );
+		ch_free( es->es_hash );
+	}
+	ch_free( ec );
+	mdb->mi_ecache = NULL;
+}
+
+/* The cache is only used by read txns of live server operations;
+ * a write txn must always see its own uncommitted changes.
+ */
+static int
+ec_usable( Operation *op, struct mdb_info *mdb, MDB_txn *txn )
+{
+	OpExtra *oex;
+
+	if ( !mdb->mi_ecache_max || !mdb->mi_ecache ||
+		!( slapMode & SLAP_SERVER_MODE ))
+		return 0;
+	LDAP_SLIST_FOREACH( oex, &op->o_extra, oe_next ) {
+		if ( oex->oe_key == mdb ) {
+			mdb_op_info *moi = (mdb_op_info *)oex;
+			return ( moi->moi_flag & MOI_READER ) && moi->moi_txn == txn;
+		}
+	}
+	return 0;
+}
+
+/* Move every pointer of an Entry block that points within the block */
+static void
+ec_entry_relocate( Entry *e, char *from )
+{
+	ptrdiff_t delta = (char *)e - from;
+	Attribute *a;
+
+	if ( !e->e_attrs )
+		return;
+	e->e_attrs = (Attribute *)((char *)e->e_attrs + delta);
+	for ( a = e->e_attrs; a; a = a->a_next ) {
+		if ( a->a_nvals == a->a_vals ) {
+			a->a_vals = (BerVarray)((char *)a->a_vals + delta);
+			a->a_nvals = a->a_vals;
+		} else {
+			a->a_vals = (BerVarray)((char *)a->a_vals + delta);
+			a->a_nvals = (BerVarray)((char *)a->a_nvals + delta);
+		}
+		if ( a->a_next )
+			a->a_next = (Attribute *)((char *)a->a_next + delta);
+	}
+}
+
+/* Move the values of an Entry block from one copy of its record
+ * to another.
+ */
+static void
+ec_values_relocate( Entry *e, char *from, char *to )
+{
+	Attribute *a;
+	int i;
+
+	for ( a = e->e_attrs; a; a = a->a_next ) {
+		for ( i = 0; i < a->a_numvals; i++ )
+			a->a_vals[i].bv_val = to + ( a->a_vals[i].bv_val - from );
+		if ( a->a_nvals != a->a_vals ) {
+			for ( i = 0; i < a->a_numvals; i++ )
+				a->a_nvals[i].bv_val = to + ( a->a_nvals[i].bv_val - from );
+		}
+	}
+}
+
+/* Look up a decoded entry. Returns 0 and a private copy of the entry
+ * on a hit, MDB_NOTFOUND otherwise.
+ */
+int
+mdb_ecache_get( Operation *op, MDB_txn *txn, ID id, Entry **e )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	ec_shard *es;
+	ec_node *en;
+	Entry *x;
+
+	if ( !ec_usable( op, mdb, txn ))
+		return MDB_NOTFOUND;
+
+	es = EC_SHARD( mdb->mi_ecache, id );
+	ldap_pvt_thread_mutex_lock( &es->es_mutex );
+	en = ec_node_find( es, id );
+	if ( !en || en->en_txnid > mdb_txn_id( txn )) {
+		es->es_misses++;
+		ldap_pvt_thread_mutex_unlock( &es->es_mutex );
+		return MDB_NOTFOUND;
+	}
+	en->en_ref++;
+	es->es_hits++;
+	ec_node_lru_head( es, en );
+	ldap_pvt_thread_mutex_unlock( &es->es_mutex );
+
+	x = op->o_tmpalloc( en->en_esize, op->o_tmpmemctx );
+	AC_MEMCPY( x, EN_ENTRY( en ), en->en_esize );
+	ec_entry_relocate( x, (char *)EN_ENTRY( en ));
+	x->e_private = en;
+	*e = x;
+	return 0;
+}
+
+/* Remember an entry just decoded from data by this txn */
+void
+mdb_ecache_put( Operation *op, MDB_txn *txn, MDB_val *data, Entry *e )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	unsigned int *lp = data->mv_data;
+	ec_shard *es;
+	ec_node *en, *old;
+	Attribute *a;
+	Entry *x;
+	ber_len_t esize;
+	unsigned max;
+	char *rec;
+
+	/* already a copy from the cache */
+	if ( e->e_private != e )
+		return;
+
+	if ( !ec_usable( op, mdb, txn ))
+		return;
+
+	/* values of split-out attributes don't live in the record */
+	for ( a = e->e_attrs; a; a = a->a_next )
+		if ( a->a_flags & SLAP_ATTR_BIG_MULTI )
+			return;
+
+	/* same layout as mdb_entry_alloc() */
+	esize = sizeof(Entry) + lp[0] * sizeof(Attribute) +
+		lp[1] * sizeof(struct berval);
+	en = ch_malloc( sizeof(ec_node) + esize + data->mv_size );
+	en->en_id = e->e_id;
+	en->en_txnid = mdb_txn_id( txn );
+	en->en_ref = 1;
+	en->en_esize = esize;
+
+	x = EN_ENTRY( en );
+	rec = (char *)x + esize;
+	AC_MEMCPY( x, e, esize );
+	AC_MEMCPY( rec, data->mv_data, data->mv_size );
+	ec_entry_relocate( x, (char *)e );
+	ec_values_relocate( x, data->mv_data, rec );
+	BER_BVZERO( &x->e_name );
+	BER_BVZERO( &x->e_nname );
+	x->e_private = NULL;
+
+	es = EC_SHARD( mdb->mi_ecache, e->e_id );
+	en->en_shard = es;
+	max = ( mdb->mi_ecache_max + ECACHE_SHARDS - 1 ) / ECACHE_SHARDS;
+
+	ldap_pvt_thread_mutex_lock( &es->es_mutex );
+	if ( en->en_txnid < es->es_fence ) {
+		ldap_pvt_thread_mutex_unlock( &es->es_mutex );
+		ch_free( en );
+		return;
+	}
+	old = ec_node_find( es, e->e_id );
+	if ( old ) {
+		if ( old->en_txnid >= en->en_txnid ) {
+			ldap_pvt_thread_mutex_unlock( &es->es_mutex );
+			ch_free( en );
+			return;
+		}
+		ec_node_unlink( es, old );
+	}
+	if ( es->es_count > 2 * es->es_hmask )
+		ec_shard_grow( es );
+
+	en->en_hnext = *ES_BUCKET( es, en->en_id );
+	*ES_BUCKET( es, en->en_id ) = en;
+	en->en_prev = NULL;
+	en->en_next = es->es_head;
+	if ( es->es_head )
+		es->es_head->en_prev = en;
+	else
+		es->es_tail = en;
+	es->es_head = en;
+	es->es_count++;
+	ec_shard_trim( es, max );
+	ldap_pvt_thread_mutex_unlock( &es->es_mutex );
+}
+
+/* Return a copy handed out by mdb_ecache_get */
+void
+mdb_ecache_release( Entry *e )
+{
+	ec_node *en = e->e_private;
+	ec_shard *es = en->en_shard;
+
+	ldap_pvt_thread_mutex_lock( &es->es_mutex );
+	ec_node_unref( en );
+	ldap_pvt_thread_mutex_unlock( &es->es_mutex );
+}
+
+/* Called by a write txn before it changes or deletes an entry */
+void
+mdb_ecache_invalidate( struct mdb_info *mdb, MDB_txn *txn, ID id )
+{
+	ec_shard *es;
+	ec_node *en;
+
+	if ( !mdb->mi_ecache )
+		return;
+
+	es = EC_SHARD( mdb->mi_ecache, id );
+	ldap_pvt_thread_mutex_lock( &es->es_mutex );
+	es->es_fence = mdb_txn_id( txn );
+	en = ec_node_find( es, id );
+	if ( en )
+		ec_node_unlink( es, en );
+	ldap_pvt_thread_mutex_unlock( &es->es_mutex );
+}
+
+void
+mdb_ecache_stats( struct mdb_info *mdb, unsigned long *hits,
+	unsigned long *misses, unsigned long *count )
+{
+	struct mdb_ecache *ec = mdb->mi_ecache;
+	int i;
+
+	*hits = *misses = *count = 0;
+	if ( !ec )
+		return;
+	for ( i = 0; i < ECACHE_SHARDS; i++ ) {
+		ec_shard *es = &ec->ec_shards[i];
+		ldap_pvt_thread_mutex_lock( &es->es_mutex );
+		*hits += es->es_hits;
+		*misses += es->es_misses;
+		*count += es->es_count;
+		ldap_pvt_thread_mutex_unlock( &es->es_mutex );
+	}
+}
@@ -0,0 +1,247 @@
+/* group.c - concurrent write ops sharing one commit */
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 2011-2020 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+#include <ac/string.h>
+#include <ac/socket.h>
+#include <ac/time.h>
+
+#include "back-mdb.h"
+
+/* With groupcommit set, an add, delete, modify or modrdn that finds a
+ * group open joins it instead of beginning a write txn of its own. The
+ * op that opened the group, the leader, begins the shared txn and is
+ * the only one to commit it, since the LMDB writer lock belongs to its
+ * thread. Every op, the leader included, works in a nested txn of the
+ * shared one, so a failed op only throws away its own changes. The ops
+ * take turns in the shared txn as they would otherwise take turns for
+ * the writer lock.
+ *
+ * When its own op is done the leader waits up to the configured delay
+ * for more ops to join, closes the group, waits for the ops in it to
+ * finish and commits. The ops only send their results after that, so
+ * a burst of writes waits for one sync instead of one sync each.
+ */
+
+typedef struct mdb_group {
+	MDB_txn	*mg_txn;	/* the shared txn */
+	unsigned	mg_ops;		/* ops admitted */
+	int		mg_running;	/* admitted ops that haven't finished */
+	int		mg_refs;	/* ops still using this struct */
+	int		mg_busy;	/* an op has its nested txn open */
+	int		mg_closed;	/* no more ops admitted */
+	int		mg_done;	/* mg_rc holds the result of the commit */
+	int		mg_rc;
+	int		mg_numads;	/* mi_numads before the group */
+	int		mg_opads;	/* mi_numads before the current op */
+} mdb_group;
+
+int
+mdb_group_init( struct mdb_info *mdb )
+{
+	ldap_pvt_thread_mutex_init( &mdb->mi_group_mutex );
+	ldap_pvt_thread_cond_init( &mdb->mi_group_cond );
+	return 0;
+}
+
+void
+mdb_group_destroy( struct mdb_info *mdb )
+{
+	ldap_pvt_thread_cond_destroy( &mdb->mi_group_cond );
+	ldap_pvt_thread_mutex_destroy( &mdb->mi_group_mutex );
+}
+
+static void
+mdb_group_delay( unsigned usec )
+{
+#ifdef _WIN32
+	Sleep( ( usec + 999 ) / 1000 );
+#else
+	struct timeval tv;
+
+	tv.tv_sec = usec / 1000000;
+	tv.tv_usec = usec % 1000000;
+	select( 0, NULL, NULL, NULL, &tv );
+#endif
+}
+
+/* The op holding mg_busy is finished with its nested txn, which was
+ * committed if rc is zero. A follower whose op succeeded waits for the
+ * leader's commit; the leader does the commit. Called with the group
+ * mutex locked, returns with it unlocked.
+ */
+static int
+mdb_group_done( struct mdb_info *mdb, mdb_group *mg, int leader, int rc )
+{
+	int crc;
+
+	if ( rc )
+		mdb_ad_unwind( mdb, mg->mg_opads );
+	mg->mg_busy = 0;
+	mg->mg_running--;
+	ldap_pvt_thread_cond_broadcast( &mdb->mi_group_cond );
+
+	if ( leader ) {
+		if ( !mg->mg_closed && mdb->mi_group_delay ) {
+			ldap_pvt_thread_mutex_unlock( &mdb->mi_group_mutex );
+			mdb_group_delay( mdb->mi_group_delay );
+			ldap_pvt_thread_mutex_lock( &mdb->mi_group_mutex );
+		}
+		mg->mg_closed = 1;
+		if ( mdb->mi_group == mg )
+			mdb->mi_group = NULL;
+		while ( mg->mg_running )
+			ldap_pvt_thread_cond_wait( &mdb->mi_group_cond,
+				&mdb->mi_group_mutex );
+		ldap_pvt_thread_mutex_unlock( &mdb->mi_group_mutex );
+
+		crc = mdb_txn_commit( mg->mg_txn );
+		mg->mg_txn = NULL;
+
+		ldap_pvt_thread_mutex_lock( &mdb->mi_group_mutex );
+		if ( crc ) {
+			Debug( LDAP_DEBUG_ANY, "mdb_group_done: "
+				"commit of %u ops failed: %s (%d)\n",
+				mg->mg_ops, mdb_strerror( crc ), crc );
+			mdb_ad_unwind( mdb, mg->mg_numads );
+		} else {
+			Debug( LDAP_DEBUG_TRACE, "mdb_group_done: "
+				"committed %u ops\n", mg->mg_ops );
+		}
+		mg->mg_rc = crc;
+		mg->mg_done = 1;
+		ldap_pvt_thread_cond_broadcast( &mdb->mi_group_cond );
+	} else if ( !rc ) {
+		while ( !mg->mg_done )
+			ldap_pvt_thread_cond_wait( &mdb->mi_group_cond,
+				&mdb->mi_group_mutex );
+	}
+	if ( !rc )
+		rc = mg->mg_rc;
+	if ( --mg->mg_refs == 0 )
+		ch_free( mg );
+	ldap_pvt_thread_mutex_unlock( &mdb->mi_group_mutex );
+	return rc;
+}
+
+/* Join the open group, or open one, and begin a nested txn for the op */
+int
+mdb_group_begin( struct mdb_info *mdb, mdb_op_info *moi )
+{
+	mdb_group *mg;
+	int rc, leader = 0;
+
+	ldap_pvt_thread_mutex_lock( &mdb->mi_group_mutex );
+	mg = mdb->mi_group;
+	if ( !mg ) {
+		mg = ch_calloc( 1, sizeof( mdb_group ));
+		/* followers wait until the shared txn exists */
+		mg->mg_busy = 1;
+		mdb->mi_group = mg;
+		leader = 1;
+	}
+	mg->mg_ops++;
+	mg->mg_running++;
+	mg->mg_refs++;
+	if ( mg->mg_ops >= mdb->mi_group_max ) {
+		mg->mg_closed = 1;
+		mdb->mi_group = NULL;
+	}
+
+	if ( leader ) {
+		ldap_pvt_thread_mutex_unlock( &mdb->mi_group_mutex );
+		rc = mdb_txn_begin( mdb->mi_dbenv, NULL, 0, &mg->mg_txn );
+		ldap_pvt_thread_mutex_lock( &mdb->mi_group_mutex );
+		if ( rc ) {
+			mg->mg_closed = 1;
+			if ( mdb->mi_group == mg )
+				mdb->mi_group = NULL;
+			mg->mg_done = 1;
+			mg->mg_rc = rc;
+			mg->mg_busy = 0;
+			mg->mg_running--;
+			ldap_pvt_thread_cond_broadcast( &mdb->mi_group_cond );
+			goto fail;
+		}
+		mg->mg_numads = mdb->mi_numads;
+	} else {
+		while ( mg->mg_busy )
+			ldap_pvt_thread_cond_wait( &mdb->mi_group_cond,
+				&mdb->mi_group_mutex );
+		if ( mg->mg_done ) {
+			/* the leader couldn't begin the shared txn */
+			rc = mg->mg_rc;
+			mg->mg_running--;
+			goto fail;
+		}
+		mg->mg_busy = 1;
+	}
+	mg->mg_opads = mdb->mi_numads;
+	ldap_pvt_thread_mutex_unlock( &mdb->mi_group_mutex );
+
+	rc = mdb_txn_begin( mdb->mi_dbenv, mg->mg_txn, 0, &moi->moi_txn );
+	if ( rc ) {
+		moi->moi_txn = NULL;
+		ldap_pvt_thread_mutex_lock( &mdb->mi_group_mutex );
+		mdb_group_done( mdb, mg, leader, rc );
+		return rc;
+	}
+	moi->moi_group = mg;
+	moi->moi_flag |= MOI_GROUP;
+	if ( leader )
+		moi->moi_flag |= MOI_LEADER;
+	return 0;
+
+fail:
+	if ( --mg->mg_refs == 0 )
+		ch_free( mg );
+	ldap_pvt_thread_mutex_unlock( &mdb->mi_group_mutex );
+	Debug( LDAP_DEBUG_ANY, "mdb_group_begin: err %s(%d)\n",
+		mdb_strerror( rc ), rc );
+	return rc;
+}
+
+/* Commit the write txn of an op, waiting for its group if it has one */
+int
+mdb_opinfo_commit( struct mdb_info *mdb, mdb_op_info *moi )
+{
+	int rc;
+
+	rc = mdb_txn_commit( moi->moi_txn );
+	moi->moi_txn = NULL;
+	if ( moi->moi_flag & MOI_GROUP ) {
+		ldap_pvt_thread_mutex_lock( &mdb->mi_group_mutex );
+		rc = mdb_group_done( mdb, moi->moi_group,
+			moi->moi_flag & MOI_LEADER, rc );
+		moi->moi_group = NULL;
+	}
+	return rc;
+}
+
+void
+mdb_opinfo_abort( struct mdb_info *mdb, mdb_op_info *moi )
+{
+	mdb_txn_abort( moi->moi_txn );
+	moi->moi_txn = NULL;
+	if ( moi->moi_flag & MOI_GROUP ) {
+		ldap_pvt_thread_mutex_lock( &mdb->mi_group_mutex );
+		mdb_group_done( mdb, moi->moi_group,
+			moi->moi_flag & MOI_LEADER, -1 );
+		moi->moi_group = NULL;
+	}
+}
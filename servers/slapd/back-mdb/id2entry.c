@@ -35,7 +35,8 @@ static int mdb_entry_partsize(struct mdb_info *mdb, MDB_txn *txn, Entry *e,
 	Ecount *eh);
 static int mdb_entry_encode(Operation *op, Entry *e, MDB_val *data,
 	Ecount *ec);
-static Entry *mdb_entry_alloc( Operation *op, int nattrs, int nvals );
+static Entry *mdb_entry_alloc( Operation *op, int nattrs, int nvals,
+	ber_len_t rlen );
 
 #define ID2VKSZ	(sizeof(ID)+2)
 
@@ -271,7 +272,7 @@ static int mdb_id2entry_put(
 {
 	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
 	Ecount ec;
-	MDB_val key, data;
+	MDB_val key, data, zdata = { 0, NULL };
 	int rc, adding = flag, prev_ads = mdb->mi_numads;
 
 	/* We only store rdns, and they go in the dn2id database. */
@@ -295,16 +296,39 @@ static int mdb_id2entry_put(
 		goto fail;
 	}
 
+	if ( !adding )
+		mdb_ecache_invalidate( mdb, txn, e->e_id );
+
+	/* a compressed record must be encoded before we know its size */
+	if ( mdb->mi_compress_min && ec.dlen >= mdb->mi_compress_min ) {
+		zdata.mv_size = ec.dlen;
+		zdata.mv_data = op->o_tmpalloc( ec.dlen, op->o_tmpmemctx );
+		rc = mdb_entry_encode( op, e, &zdata, &ec );
+		if ( rc == LDAP_SUCCESS ) {
+			rc = mdb_entry_compress( op, txn, &zdata );
+			if ( rc )
+				rc = LDAP_OTHER;
+		}
+		if ( rc != LDAP_SUCCESS )
+			goto fail;
+		flag &= ~MDB_RESERVE;
+	}
+
 again:
-	data.mv_size = ec.dlen;
+	if ( zdata.mv_data )
+		data = zdata;
+	else
+		data.mv_size = ec.dlen;
 	if ( mc )
 		rc = mdb_cursor_put( mc, &key, &data, flag );
 	else
 		rc = mdb_put( txn, mdb->mi_id2entry, &key, &data, flag );
 	if (rc == MDB_SUCCESS) {
-		rc = mdb_entry_encode( op, e, &data, &ec );
-		if( rc != LDAP_SUCCESS )
-			goto fail;
+		if ( !zdata.mv_data ) {
+			rc = mdb_entry_encode( op, e, &data, &ec );
+			if( rc != LDAP_SUCCESS )
+				goto fail;
+		}
 		/* Handle adds of large multi-valued attrs here.
 		 * Modifies handle them directly.
 		 */
@@ -346,6 +370,8 @@ again:
 			rc = LDAP_OTHER;
 	}
 fail:
+	if ( zdata.mv_data )
+		op->o_tmpfree( zdata.mv_data, op->o_tmpmemctx );
 	if (rc) {
 		mdb_ad_unwind( mdb, prev_ads );
 	}
@@ -404,6 +430,9 @@ int mdb_id2entry(
 
 	*e = NULL;
 
+	if ( mdb_ecache_get( op, mdb_cursor_txn( mc ), id, e ) == 0 )
+		goto got;
+
 	key.mv_data = &id;
 	key.mv_size = sizeof(ID);
 
@@ -413,7 +442,7 @@ int mdb_id2entry(
 		/* Looking for root entry on an empty-dn suffix? */
 		if ( !id && BER_BVISEMPTY( &op->o_bd->be_nsuffix[0] )) {
 			struct berval gluebv = BER_BVC("glue");
-			Entry *r = mdb_entry_alloc(op, 2, 4);
+			Entry *r = mdb_entry_alloc(op, 2, 4, 0);
 			Attribute *a = r->e_attrs;
 			struct berval *bptr;
 
@@ -450,6 +479,8 @@ int mdb_id2entry(
 	if ( rc ) return rc;
 
 	(*e)->e_id = id;
+	mdb_ecache_put( op, mdb_cursor_txn( mc ), &data, *e );
+got:
 	(*e)->e_name.bv_val = NULL;
 	(*e)->e_nname.bv_val = NULL;
 
@@ -470,6 +501,8 @@ int mdb_id2entry_delete(
 	key.mv_data = &e->e_id;
 	key.mv_size = sizeof(ID);
 
+	mdb_ecache_invalidate( mdb, tid, e->e_id );
+
 	/* delete from database */
 	rc = mdb_del( tid, dbi, &key, NULL );
 	if (rc)
@@ -498,14 +531,16 @@ int mdb_id2entry_delete(
 	return rc;
 }
 
+/* rlen bytes for a record are left after the values */
 static Entry * mdb_entry_alloc(
 	Operation *op,
 	int nattrs,
-	int nvals )
+	int nvals,
+	ber_len_t rlen )
 {
 	Entry *e = op->o_tmpalloc( sizeof(Entry) +
 		nattrs * sizeof(Attribute) +
-		nvals * sizeof(struct berval), op->o_tmpmemctx );
+		nvals * sizeof(struct berval) + rlen, op->o_tmpmemctx );
 	BER_BVZERO(&e->e_bv);
 	e->e_private = e;
 	if (nattrs) {
@@ -526,6 +561,9 @@ int mdb_entry_return(
 	if ( !e )
 		return 0;
 	if ( e->e_private ) {
+		/* a copy out of the entry cache */
+		if ( e->e_private != e )
+			mdb_ecache_release( e );
 		if ( op->o_hdr && op->o_tmpmfuncs ) {
 			op->o_tmpfree( e->e_nname.bv_val, op->o_tmpmemctx );
 			op->o_tmpfree( e->e_name.bv_val, op->o_tmpmemctx );
@@ -748,6 +786,13 @@ mdb_opinfo_get( Operation *op, struct mdb_info *mdb, int rdonly, mdb_op_info **m
 				if ( get_lazyCommit( op ))
 					flag |= MDB_NOMETASYNC;
 #endif
+				/* Only the update ops bring their own opinfo. Nested
+				 * txns aren't possible with writemap.
+				 */
+				if ( mdb->mi_group_max && !flag &&
+					!( moi->moi_flag & MOI_FREEIT ) &&
+					!( mdb->mi_dbenv_flags & MDB_WRITEMAP ))
+					return mdb_group_begin( mdb, moi );
 				rc = mdb_txn_begin( mdb->mi_dbenv, NULL, flag, &moi->moi_txn );
 				if (rc) {
 					Debug( LDAP_DEBUG_ANY, "mdb_opinfo_get: err %s(%d)\n",
@@ -823,16 +868,17 @@ int mdb_txn( Operation *op, int txnop, OpExtra **ptr )
 		if ( !rc ) {
 			moi = *moip;
 			moi->moi_flag |= MOI_KEEPER;
+			moi->moi_numads = mdb->mi_numads;
 		}
 		return rc;
 	case SLAP_TXN_COMMIT:
 		rc = mdb_txn_commit( moi->moi_txn );
 		if ( rc )
-			mdb->mi_numads = 0;
+			mdb_ad_unwind( mdb, moi->moi_numads );
 		op->o_tmpfree( moi, op->o_tmpmemctx );
 		return rc;
 	case SLAP_TXN_ABORT:
-		mdb->mi_numads = 0;
+		mdb_ad_unwind( mdb, moi->moi_numads );
 		mdb_txn_abort( moi->moi_txn );
 		op->o_tmpfree( moi, op->o_tmpmemctx );
 		return 0;
@@ -1007,6 +1053,9 @@ static int mdb_entry_encode(Operation *op, Entry *e, MDB_val *data, Ecount *eh)
  * Note: everything is stored in a single contiguous block, so
  * you can not free individual attributes or names from this
  * structure. Attempting to do so will likely corrupt memory.
+ *
+ * A compressed record is uncompressed into the end of that block,
+ * and data is then pointed at the plain record.
  */
 
 int mdb_entry_decode(Operation *op, MDB_txn *txn, MDB_val *data, ID id, Entry **e)
@@ -1025,9 +1074,22 @@ int mdb_entry_decode(Operation *op, MDB_txn *txn, MDB_val *data, ID id, Entry **
 	Debug( LDAP_DEBUG_TRACE,
 		"=> mdb_entry_decode:\n" );
 
-	nattrs = *lp++;
-	nvals = *lp++;
-	x = mdb_entry_alloc(op, nattrs, nvals);
+	if ( lp[0] & MDB_ENC_ZIP ) {
+		nattrs = lp[0] ^ MDB_ENC_ZIP;
+		nvals = lp[1];
+		x = mdb_entry_alloc(op, nattrs, nvals, lp[3]);
+		rc = mdb_entry_decompress( op, txn, data, (char *)(x+1) +
+			nattrs * sizeof(Attribute) + nvals * sizeof(struct berval) );
+		if ( rc ) {
+			op->o_tmpfree( x, op->o_tmpmemctx );
+			return rc;
+		}
+		lp = (unsigned int *)data->mv_data + 2;
+	} else {
+		nattrs = *lp++;
+		nvals = *lp++;
+		x = mdb_entry_alloc(op, nattrs, nvals, 0);
+	}
 	x->e_ocflags = *lp++;
 	if (!nvals) {
 		goto done;
@@ -154,6 +154,8 @@ int mdb_idl_insert( ID *ids, ID id )
 #endif
 
 	if (MDB_IDL_IS_RANGE( ids )) {
+		/* an update turns a compressed IDL into a plain range */
+		ids[0] = NOID;
 		/* if already in range, treat as a dup */
 		if (id >= MDB_IDL_RANGE_FIRST(ids) && id <= MDB_IDL_RANGE_LAST(ids))
 			return -1;
@@ -215,6 +217,7 @@ static int mdb_idl_delete( ID *ids, ID id )
 #endif
 
 	if (MDB_IDL_IS_RANGE( ids )) {
+		ids[0] = NOID;
 		/* If deleting a range boundary, adjust */
 		if ( ids[1] == id )
 			ids[1]++;
@@ -260,6 +263,398 @@ static int mdb_idl_delete( ID *ids, ID id )
 	return 0;
 }
 
+/* Compressed IDLs
+ *
+ * Layout, in units of ID:
+ *	[0] MDB_IDL_CMARK
+ *	[1] first ID
+ *	[2] last ID
+ *	[3] number of IDs
+ *	[4] number of words used, including this header
+ *	[5] number of containers
+ *	[6] offset of the container directory
+ * followed by the containers, in ascending key order, and then the
+ * directory, which holds the offset of each container. A container
+ * is [key][info][payload], where key is the ID shifted right by 16
+ * and info gives the encoding and its element count. The payload
+ * holds the low 16 bits of the IDs: a sorted array of them, a 2^16
+ * bit bitmap, or a sorted array of (start, length-1) runs.
+ */
+#define CIDL_FIRST	1
+#define CIDL_LAST	2
+#define CIDL_COUNT	3
+#define CIDL_SIZE	4
+#define CIDL_NCONT	5
+#define CIDL_DIR	6
+#define CIDL_HDR	7
+
+#define CIDL_SHIFT	16
+#define CIDL_LOW(id)	((id) & ((1 << CIDL_SHIFT) - 1))
+#define CIDL_WBITS	(sizeof(ID) * CHAR_BIT)
+#define CIDL_BWORDS	((1 << CIDL_SHIFT) / CIDL_WBITS)
+
+#define CIDL_ARRAY	0
+#define CIDL_BITMAP	1
+#define CIDL_RUN	2
+#define CIDL_INFO(type, n)	(((ID)(n) << 2) | (type))
+#define CIDL_TYPE(info)	((info) & 3)
+#define CIDL_NUM(info)	((info) >> 2)
+
+#define CIDL_SWORDS(n)	(((n) * sizeof(unsigned short) + sizeof(ID) - 1) / sizeof(ID))
+
+typedef struct cidl_build {
+	ID *cb_ids;
+	ID cb_max;		/* capacity of cb_ids */
+	ID cb_key;		/* key of the open container, or NOID */
+	ID cb_last;
+	unsigned cb_card;
+	unsigned cb_nruns;
+	unsigned cb_lo, cb_hi;	/* range of bitmap words in use */
+	int cb_full;
+	ID cb_bits[CIDL_BWORDS];
+} cidl_build;
+
+static int
+cidl_ctz( ID w )
+{
+#ifdef __GNUC__
+	return __builtin_ctzl( w );
+#else
+	int n = 0;
+	while ( !( w & 1 )) {
+		w >>= 1;
+		n++;
+	}
+	return n;
+#endif
+}
+
+static ID
+cidl_words( ID info )
+{
+	switch( CIDL_TYPE( info )) {
+	case CIDL_ARRAY:
+		return CIDL_SWORDS( CIDL_NUM( info ));
+	case CIDL_RUN:
+		return CIDL_SWORDS( CIDL_NUM( info ) * 2 );
+	default:
+		return CIDL_BWORDS;
+	}
+}
+
+static void
+cidl_build_init( cidl_build *cb, ID *ids, ID max )
+{
+	cb->cb_ids = ids;
+	cb->cb_max = max;
+	cb->cb_key = NOID;
+	cb->cb_last = 0;
+	cb->cb_full = 0;
+	memset( cb->cb_bits, 0, sizeof( cb->cb_bits ));
+	ids[0] = MDB_IDL_CMARK;
+	ids[CIDL_FIRST] = 0;
+	ids[CIDL_LAST] = 0;
+	ids[CIDL_COUNT] = 0;
+	ids[CIDL_SIZE] = CIDL_HDR;
+	ids[CIDL_NCONT] = 0;
+	ids[CIDL_DIR] = 0;
+}
+
+/* Write out the open container in its smallest encoding */
+static void
+cidl_build_flush( cidl_build *cb )
+{
+	ID *ids = cb->cb_ids, *p;
+	ID words, info, w;
+	unsigned short *s;
+	unsigned i, n = 0;
+	int run = -1;
+
+	if ( cb->cb_card * sizeof(unsigned short) <= cb->cb_nruns * 2 * sizeof(unsigned short) &&
+		cb->cb_card * sizeof(unsigned short) < CIDL_BWORDS * sizeof(ID) ) {
+		info = CIDL_INFO( CIDL_ARRAY, cb->cb_card );
+	} else if ( cb->cb_nruns * 2 * sizeof(unsigned short) < CIDL_BWORDS * sizeof(ID) ) {
+		info = CIDL_INFO( CIDL_RUN, cb->cb_nruns );
+	} else {
+		info = CIDL_INFO( CIDL_BITMAP, cb->cb_card );
+	}
+	words = cidl_words( info );
+
+	if ( ids[CIDL_SIZE] + 2 + words > cb->cb_max ) {
+		cb->cb_full = 1;
+		goto clear;
+	}
+	p = ids + ids[CIDL_SIZE];
+	p[0] = cb->cb_key;
+	p[1] = info;
+	s = (unsigned short *)(p+2);
+
+	switch( CIDL_TYPE( info )) {
+	case CIDL_BITMAP:
+		memcpy( p+2, cb->cb_bits, sizeof( cb->cb_bits ));
+		break;
+	case CIDL_ARRAY:
+	case CIDL_RUN:
+		for ( i = cb->cb_lo; i <= cb->cb_hi; i++ ) {
+			for ( w = cb->cb_bits[i]; w; w &= w - 1 ) {
+				int v = i * CIDL_WBITS + cidl_ctz( w );
+				if ( CIDL_TYPE( info ) == CIDL_ARRAY ) {
+					s[n++] = v;
+				} else if ( v == run + 1 && n ) {
+					s[n-1]++;
+					run = v;
+				} else {
+					s[n++] = v;
+					s[n++] = 0;
+					run = v;
+				}
+			}
+		}
+		break;
+	}
+	ids[CIDL_SIZE] += 2 + words;
+	ids[CIDL_NCONT]++;
+
+clear:
+	for ( i = cb->cb_lo; i <= cb->cb_hi; i++ )
+		cb->cb_bits[i] = 0;
+}
+
+/* Add an ID to a compressed IDL under construction. IDs must be
+ * added in ascending order; duplicates are ignored.
+ */
+static void
+cidl_build_add( cidl_build *cb, ID id )
+{
+	ID *ids = cb->cb_ids;
+	ID key;
+	unsigned low, w;
+
+	if ( ids[CIDL_COUNT] ) {
+		if ( id <= cb->cb_last )
+			return;
+	} else {
+		ids[CIDL_FIRST] = id;
+	}
+	ids[CIDL_COUNT]++;
+	if ( cb->cb_full ) {
+		cb->cb_last = id;
+		return;
+	}
+
+	key = id >> CIDL_SHIFT;
+	low = CIDL_LOW( id );
+	w = low / CIDL_WBITS;
+	if ( key != cb->cb_key ) {
+		if ( cb->cb_key != NOID )
+			cidl_build_flush( cb );
+		cb->cb_key = key;
+		cb->cb_card = 0;
+		cb->cb_nruns = 0;
+		cb->cb_lo = w;
+	}
+	if ( !cb->cb_card || low != CIDL_LOW( cb->cb_last ) + 1 )
+		cb->cb_nruns++;
+	cb->cb_bits[w] |= (ID)1 << ( low % CIDL_WBITS );
+	cb->cb_hi = w;
+	cb->cb_card++;
+	cb->cb_last = id;
+}
+
+/* Finish construction. Returns -1 if the set didn't fit, in which
+ * case only the first and last IDs in the header are valid.
+ */
+static int
+cidl_build_done( cidl_build *cb )
+{
+	ID *ids = cb->cb_ids, *dir;
+	ID i, off;
+
+	ids[CIDL_LAST] = cb->cb_last;
+	if ( cb->cb_full )
+		return -1;
+	if ( cb->cb_key != NOID )
+		cidl_build_flush( cb );
+	if ( cb->cb_full || ids[CIDL_SIZE] + ids[CIDL_NCONT] > cb->cb_max ) {
+		cb->cb_full = 1;
+		return -1;
+	}
+	ids[CIDL_DIR] = ids[CIDL_SIZE];
+	dir = ids + ids[CIDL_DIR];
+	off = CIDL_HDR;
+	for ( i = 0; i < ids[CIDL_NCONT]; i++ ) {
+		dir[i] = off;
+		off += 2 + cidl_words( ids[off+1] );
+	}
+	ids[CIDL_SIZE] += ids[CIDL_NCONT];
+	return 0;
+}
+
+/* Find the smallest low value >= low in a container */
+static ID
+cidl_cont_next( ID *p, ID low )
+{
+	unsigned short *s = (unsigned short *)(p+2);
+	ID n = CIDL_NUM( p[1] ), lo, hi, mid;
+
+	switch( CIDL_TYPE( p[1] )) {
+	case CIDL_ARRAY:
+		lo = 0;
+		hi = n;
+		while ( lo < hi ) {
+			mid = ( lo + hi ) >> 1;
+			if ( s[mid] < low )
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		return lo < n ? s[lo] : NOID;
+
+	case CIDL_RUN:
+		/* find the last run starting at or before low */
+		lo = 0;
+		hi = n;
+		while ( lo < hi ) {
+			mid = ( lo + hi ) >> 1;
+			if ( s[mid*2] <= low )
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		if ( lo && low <= (ID)s[(lo-1)*2] + s[(lo-1)*2+1] )
+			return low;
+		return lo < n ? s[lo*2] : NOID;
+
+	default: {
+		ID *bits = p+2, w;
+		ID i = low / CIDL_WBITS;
+
+		w = bits[i] & ( NOID << ( low % CIDL_WBITS ));
+		while ( !w ) {
+			if ( ++i >= CIDL_BWORDS )
+				return NOID;
+			w = bits[i];
+		}
+		return i * CIDL_WBITS + cidl_ctz( w );
+		}
+	}
+}
+
+/* Find the smallest ID >= id in a compressed IDL. If hint is
+ * given it remembers the last container visited, to speed up
+ * ascending sequences of lookups.
+ */
+static ID
+cidl_next( ID *ids, ID id, ID *hint )
+{
+	ID *dir = ids + ids[CIDL_DIR];
+	ID n = ids[CIDL_NCONT], lo = 0, hi = n, mid, key, r;
+
+	if ( id > ids[CIDL_LAST] )
+		return NOID;
+	if ( id < ids[CIDL_FIRST] )
+		id = ids[CIDL_FIRST];
+	key = id >> CIDL_SHIFT;
+
+	if ( hint && *hint < n && ids[dir[*hint]] <= key )
+		lo = *hint;
+	while ( lo < hi ) {
+		mid = ( lo + hi ) >> 1;
+		if ( ids[dir[mid]] < key )
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	for ( ; lo < n; lo++ ) {
+		ID *p = ids + dir[lo];
+		r = cidl_cont_next( p, p[0] == key ? CIDL_LOW( id ) : 0 );
+		if ( r != NOID ) {
+			if ( hint )
+				*hint = lo;
+			return ( p[0] << CIDL_SHIFT ) | r;
+		}
+	}
+	return NOID;
+}
+
+/* Iterate over any kind of IDL */
+typedef struct idl_iter {
+	ID *ii_ids;
+	ID ii_pos;
+} idl_iter;
+
+#define IDL_ITER_INIT( it, ids ) \
+	do { \
+		(it)->ii_ids = (ids); \
+		(it)->ii_pos = MDB_IDL_IS_CMP(ids) ? 0 : 1; \
+	} while(0)
+
+/* Return the smallest ID >= id, advancing the iterator. The
+ * iterator only moves forward.
+ */
+static ID
+idl_iter_seek( idl_iter *it, ID id )
+{
+	ID *ids = it->ii_ids;
+	ID n, pos, step, lo, hi, mid;
+
+	if ( MDB_IDL_IS_CMP( ids ))
+		return cidl_next( ids, id, &it->ii_pos );
+
+	if ( MDB_IDL_IS_RANGE( ids )) {
+		if ( id > MDB_IDL_RANGE_LAST( ids ))
+			return NOID;
+		return id < MDB_IDL_RANGE_FIRST( ids ) ? MDB_IDL_RANGE_FIRST( ids ) : id;
+	}
+
+	n = ids[0];
+	pos = it->ii_pos;
+	if ( pos > n )
+		return NOID;
+	if ( ids[pos] >= id )
+		return ids[pos];
+
+	/* gallop forward, then binary search */
+	for ( step = 1; pos + step <= n && ids[pos+step] < id; step <<= 1 )
+		pos += step;
+	lo = pos + 1;
+	hi = IDL_MIN( pos + step, n + 1 );
+	while ( lo < hi ) {
+		mid = ( lo + hi ) >> 1;
+		if ( ids[mid] < id )
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	it->ii_pos = lo;
+	return lo <= n ? ids[lo] : NOID;
+}
+
+/* Copy a built compressed IDL into its final place, converting
+ * it to a plain list if it's small enough or to a range if it
+ * couldn't be built.
+ */
+static void
+cidl_store( ID *dst, cidl_build *cb, int rc )
+{
+	ID *src = cb->cb_ids;
+
+	if ( rc ) {
+		MDB_IDL_RANGE( dst, src[CIDL_FIRST], src[CIDL_LAST] );
+	} else if ( !src[CIDL_COUNT] ) {
+		MDB_IDL_ZERO( dst );
+	} else if ( src[CIDL_COUNT] <= MDB_idl_db_max ) {
+		ID id, i = 0, hint = 0;
+
+		for ( id = cidl_next( src, 0, &hint ); id != NOID;
+			id = cidl_next( src, id + 1, &hint ))
+			dst[++i] = id;
+		dst[0] = i;
+	} else {
+		AC_MEMCPY( dst, src, MDB_IDL_SIZEOF( src ));
+	}
+}
+
 static char *
 mdb_show_key(
 	char		*buf,
@@ -349,6 +744,33 @@ mdb_idl_fetch_key(
 		rc = MDB_NOTFOUND;
 	}
 	if (rc == 0) {
+		size_t count;
+		rc = mdb_cursor_count( cursor, &count );
+		if ( rc == 0 && count > MDB_idl_db_max ) {
+			/* Too many to list, compress them */
+			cidl_build cb;
+			char *ptr, *end;
+			ID id;
+
+			cidl_build_init( &cb, ids, MDB_idl_db_size );
+			rc = mdb_cursor_get( cursor, key, &data, MDB_GET_MULTIPLE );
+			while (rc == 0) {
+				end = (char *)data.mv_data + data.mv_size;
+				for ( ptr = data.mv_data; ptr < end; ptr += sizeof(ID) ) {
+					memcpy( &id, ptr, sizeof(ID) );
+					cidl_build_add( &cb, id );
+				}
+				rc = mdb_cursor_get( cursor, key, &data, MDB_NEXT_MULTIPLE );
+			}
+			if ( rc == MDB_NOTFOUND ) rc = 0;
+			if ( cidl_build_done( &cb )) {
+				Debug( LDAP_DEBUG_TRACE, "=> mdb_idl_fetch_key: "
+					"%ld IDs do not fit, using range\n", (long) count );
+				MDB_IDL_RANGE( ids, ids[CIDL_FIRST], ids[CIDL_LAST] );
+			}
+			data.mv_size = MDB_IDL_SIZEOF(ids);
+			goto fetched;
+		}
 		i = ids+1;
 		rc = mdb_cursor_get( cursor, key, &data, MDB_GET_MULTIPLE );
 		while (rc == 0) {
@@ -372,6 +794,7 @@ mdb_idl_fetch_key(
 		data.mv_size = MDB_IDL_SIZEOF(ids);
 	}
 
+fetched:
 	if ( saved_cursor && rc == 0 ) {
 		if ( !*saved_cursor )
 			*saved_cursor = cursor;
@@ -406,6 +829,32 @@ mdb_idl_fetch_key(
 	return rc;
 }
 
+/* Keys are compared the way LMDB's default key compare does. Handing
+ * them to the cursor in this order lets each lookup resume from the
+ * branch pages it shares with the previous key instead of the root.
+ */
+static int
+mdb_idl_key_cmp( const void *v1, const void *v2 )
+{
+	const struct berval *k1 = v1, *k2 = v2;
+	int rc;
+
+	rc = memcmp( k1->bv_val, k2->bv_val, IDL_MIN( k1->bv_len, k2->bv_len ));
+	if ( !rc )
+		rc = IDL_CMP( k1->bv_len, k2->bv_len );
+	return rc;
+}
+
+static void
+mdb_idl_sort_keys( struct berval *keys )
+{
+	int n;
+
+	for ( n=0; keys[n].bv_val; n++ ) ;
+	if ( n > 1 )
+		qsort( keys, n, sizeof(struct berval), mdb_idl_key_cmp );
+}
+
 int
 mdb_idl_insert_keys(
 	BackendDB	*be,
@@ -430,6 +879,8 @@ mdb_idl_insert_keys(
 			(long) id, mdb_show_key( buf, keys->bv_val, keys->bv_len ) );
 	}
 
+	mdb_idl_sort_keys( keys );
+
 	assert( id != NOID );
 
 #ifndef MISALIGNED_OK
@@ -464,7 +915,7 @@ mdb_idl_insert_keys(
 				err = "c_count";
 				goto fail;
 			}
-			if ( count >= MDB_idl_db_max ) {
+			if ( count >= MDB_idl_db_max && !mdb->mi_idl_exact ) {
 			/* No room, convert to a range */
 				lo = *i;
 				rc = mdb_cursor_get( cursor, &key, &data, MDB_LAST_DUP );
@@ -588,6 +1039,7 @@ mdb_idl_delete_keys(
 			"mdb_idl_delete_keys: %lx %s\n", 
 			(long) id, mdb_show_key( buf, keys->bv_val, keys->bv_len ) );
 	}
+	mdb_idl_sort_keys( keys );
 	assert( id != NOID );
 
 #ifndef MISALIGNED_OK
@@ -704,6 +1156,54 @@ fail:
 }
 
 
+/* Intersection or union involving compressed IDLs: merge them into
+ * a scratch compressed IDL and store the result in a.
+ */
+static int
+cidl_merge( ID *a, ID *b, int isand, ID idmin, ID idmax )
+{
+	cidl_build *cb;
+	idl_iter ia, ib;
+	ID ida, idb;
+
+	cb = ch_malloc( sizeof( cidl_build ) + MDB_idl_db_size * sizeof( ID ));
+	cidl_build_init( cb, (ID *)(cb+1), MDB_idl_db_size );
+
+	IDL_ITER_INIT( &ia, a );
+	IDL_ITER_INIT( &ib, b );
+	if ( isand ) {
+		ida = idl_iter_seek( &ia, idmin );
+		while ( ida != NOID && ida <= idmax ) {
+			idb = idl_iter_seek( &ib, ida );
+			if ( idb > idmax )
+				break;
+			if ( ida == idb ) {
+				cidl_build_add( cb, ida );
+				ida = idl_iter_seek( &ia, ida + 1 );
+			} else {
+				ida = idl_iter_seek( &ia, idb );
+			}
+		}
+	} else {
+		ida = idl_iter_seek( &ia, 0 );
+		idb = idl_iter_seek( &ib, 0 );
+		while ( ida != NOID || idb != NOID ) {
+			if ( ida <= idb ) {
+				cidl_build_add( cb, ida );
+				if ( ida == idb )
+					idb = idl_iter_seek( &ib, idb + 1 );
+				ida = idl_iter_seek( &ia, ida + 1 );
+			} else {
+				cidl_build_add( cb, idb );
+				idb = idl_iter_seek( &ib, idb + 1 );
+			}
+		}
+	}
+	cidl_store( a, cb, cidl_build_done( cb ));
+	ch_free( cb );
+	return 0;
+}
+
 /*
  * idl_intersection - return a = a intersection b
  */
@@ -733,6 +1233,21 @@ mdb_idl_intersection(
 		return 0;
 	}
 
+	if ( MDB_IDL_IS_CMP( a ) || MDB_IDL_IS_CMP( b ) ) {
+		/* A range covering a compressed IDL leaves it unchanged */
+		if ( !MDB_IDL_IS_CMP( b ) && MDB_IDL_IS_RANGE( b ) &&
+			MDB_IDL_RANGE_FIRST( b ) <= MDB_IDL_FIRST( a ) &&
+			MDB_IDL_RANGE_LAST( b ) >= MDB_IDL_LAST( a ) )
+			return 0;
+		if ( !MDB_IDL_IS_CMP( a ) && MDB_IDL_IS_RANGE( a ) &&
+			MDB_IDL_RANGE_FIRST( a ) <= MDB_IDL_FIRST( b ) &&
+			MDB_IDL_RANGE_LAST( a ) >= MDB_IDL_LAST( b ) ) {
+			MDB_IDL_CPY( a, b );
+			return 0;
+		}
+		return cidl_merge( a, b, 1, idmin, idmax );
+	}
+
 	if ( MDB_IDL_IS_RANGE( a ) ) {
 		if ( MDB_IDL_IS_RANGE(b) ) {
 		/* If both are ranges, just shrink the boundaries */
@@ -757,6 +1272,17 @@ mdb_idl_intersection(
 		goto done;
 	}
 
+	/* If both are lists, advance to idmin in both and let the
+	 * array kernel do the rest.
+	 */
+	if ( !MDB_IDL_IS_RANGE( b ) ) {
+		cursora = mdb_idl_search( a, idmin );
+		cursorb = mdb_idl_search( b, idmin );
+		a[0] = mdb_ids_intersect( a+1, a+cursora, a[0]-cursora+1,
+			b+cursorb, b[0]-cursorb+1 );
+		goto done;
+	}
+
 	/* Fine, do the intersection one element at a time.
 	 * First advance to idmin in both IDLs.
 	 */
@@ -794,7 +1320,7 @@ mdb_idl_union(
 	ID	*b )
 {
 	ID ida, idb;
-	ID cursora = 0, cursorb = 0, cursorc;
+	ID cursorc;
 
 	if ( MDB_IDL_IS_ZERO( b ) ) {
 		return 0;
@@ -805,8 +1331,15 @@ mdb_idl_union(
 		return 0;
 	}
 
+	/* Keep the result exact unless a real range is involved */
+	if ( !( a[0] == NOID || b[0] == NOID ) &&
+		( MDB_IDL_IS_CMP( a ) || MDB_IDL_IS_CMP( b ) ||
+		a[0] + b[0] > MDB_idl_um_max )) {
+		return cidl_merge( a, b, 0, 0, NOID );
+	}
+
 	if ( MDB_IDL_IS_RANGE( a ) || MDB_IDL_IS_RANGE(b) ) {
-over:		ida = IDL_MIN( MDB_IDL_FIRST(a), MDB_IDL_FIRST(b) );
+		ida = IDL_MIN( MDB_IDL_FIRST(a), MDB_IDL_FIRST(b) );
 		idb = IDL_MAX( MDB_IDL_LAST(a), MDB_IDL_LAST(b) );
 		a[0] = NOID;
 		a[1] = ida;
@@ -814,44 +1347,11 @@ over:		ida = IDL_MIN( MDB_IDL_FIRST(a), MDB_IDL_FIRST(b) );
 		return 0;
 	}
 
-	ida = mdb_idl_first( a, &cursora );
-	idb = mdb_idl_first( b, &cursorb );
-
-	cursorc = b[0];
-
 	/* The distinct elements of a are cat'd to b */
-	while( ida != NOID || idb != NOID ) {
-		if ( ida < idb ) {
-			if( ++cursorc > MDB_idl_um_max ) {
-				goto over;
-			}
-			b[cursorc] = ida;
-			ida = mdb_idl_next( a, &cursora );
+	cursorc = mdb_ids_difference( b+b[0]+1, a+1, a[0], b+1, b[0] );
 
-		} else {
-			if ( ida == idb )
-				ida = mdb_idl_next( a, &cursora );
-			idb = mdb_idl_next( b, &cursorb );
-		}
-	}
-
-	/* b is copied back to a in sorted order */
-	a[0] = cursorc;
-	cursora = 1;
-	cursorb = 1;
-	cursorc = b[0]+1;
-	while (cursorb <= b[0] || cursorc <= a[0]) {
-		if (cursorc > a[0])
-			idb = NOID;
-		else
-			idb = b[cursorc];
-		if (cursorb <= b[0] && b[cursorb] < idb)
-			a[cursora++] = b[cursorb++];
-		else {
-			a[cursora++] = idb;
-			cursorc++;
-		}
-	}
+	/* b is merged back to a in sorted order */
+	a[0] = mdb_ids_merge( a+1, b+1, b[0], b+b[0]+1, cursorc );
 
 	return 0;
 }
@@ -920,6 +1420,12 @@ ID mdb_idl_first( ID *ids, ID *cursor )
 		return NOID;
 	}
 
+	if ( MDB_IDL_IS_CMP( ids ) ) {
+		/* the cursor is the current ID, as for a range */
+		*cursor = cidl_next( ids, *cursor, NULL );
+		return *cursor;
+	}
+
 	if ( MDB_IDL_IS_RANGE( ids ) ) {
 		if( *cursor < ids[1] ) {
 			*cursor = ids[1];
@@ -942,6 +1448,16 @@ ID mdb_idl_first( ID *ids, ID *cursor )
 
 ID mdb_idl_next( ID *ids, ID *cursor )
 {
+	if ( MDB_IDL_IS_CMP( ids ) ) {
+		ID id;
+		if ( *cursor == NOID )
+			return NOID;
+		id = cidl_next( ids, *cursor + 1, NULL );
+		if ( id != NOID )
+			*cursor = id;
+		return id;
+	}
+
 	if ( MDB_IDL_IS_RANGE( ids ) ) {
 		if( ids[2] < ++(*cursor) ) {
 			return NOID;
@@ -963,6 +1479,8 @@ ID mdb_idl_next( ID *ids, ID *cursor )
 int mdb_idl_append_one( ID *ids, ID id )
 {
 	if (MDB_IDL_IS_RANGE( ids )) {
+		/* an update turns a compressed IDL into a plain range */
+		ids[0] = NOID;
 		/* if already in range, treat as a dup */
 		if (id >= MDB_IDL_RANGE_FIRST(ids) && id <= MDB_IDL_RANGE_LAST(ids))
 			return -1;
@@ -27,10 +27,23 @@ extern unsigned int MDB_idl_um_size;
 extern unsigned int MDB_idl_db_max;
 extern unsigned int MDB_idl_um_max;
 
-#define MDB_IDL_IS_RANGE(ids)	((ids)[0] == NOID)
+/* A compressed IDL stores a large sorted set exactly, as a sequence
+ * of containers of 2^16 IDs each, using an array, bitmap or run
+ * encoding per container, whichever is smallest. It keeps its first
+ * and last IDs in the same slots as a range does, so code that only
+ * knows about ranges may safely treat it as one; setting ids[0] to
+ * NOID turns it into the equivalent (lossy) range.
+ */
+#define MDB_IDL_CMARK	(NOID-1)
+#define MDB_IDL_IS_CMP(ids)	((ids)[0] == MDB_IDL_CMARK)
+#define MDB_IDL_CMP_COUNT(ids)	((ids)[3])
+#define MDB_IDL_CMP_SIZE(ids)	((ids)[4])
+
+#define MDB_IDL_IS_RANGE(ids)	((ids)[0] >= MDB_IDL_CMARK)
 #define MDB_IDL_RANGE_SIZE		(3)
 #define MDB_IDL_RANGE_SIZEOF	(MDB_IDL_RANGE_SIZE * sizeof(ID))
-#define MDB_IDL_SIZEOF(ids)		((MDB_IDL_IS_RANGE(ids) \
+#define MDB_IDL_SIZEOF(ids)		((MDB_IDL_IS_CMP(ids) \
+	? MDB_IDL_CMP_SIZE(ids) : MDB_IDL_IS_RANGE(ids) \
 	? MDB_IDL_RANGE_SIZE : ((ids)[0]+1)) * sizeof(ID))
 
 #define MDB_IDL_RANGE_FIRST(ids)	((ids)[1])
@@ -64,7 +77,8 @@ extern unsigned int MDB_idl_um_max;
 #define MDB_IDL_LAST( ids )		( MDB_IDL_IS_RANGE(ids) \
 	? (ids)[2] : (ids)[(ids)[0]] )
 
-#define MDB_IDL_N( ids )		( MDB_IDL_IS_RANGE(ids) \
+#define MDB_IDL_N( ids )		( MDB_IDL_IS_CMP(ids) \
+	? MDB_IDL_CMP_COUNT(ids) : MDB_IDL_IS_RANGE(ids) \
 	? ((ids)[2]-(ids)[1])+1 : (ids)[0] )
 
 	/** An ID2 is an ID/value pair.
@@ -113,6 +127,26 @@ unsigned mdb_id2l_search( ID2L ids, ID id );
 	 * @return	0 on success, -1 if the ID was already present in the MIDL2.
 	 */
 int mdb_id2l_insert( ID2L ids, ID2 *id );
+
+	/** Kernels for sorted ID arrays, see idlmerge.c
+	 */
+typedef size_t (mdb_ids_func)( ID *out, const ID *a, size_t na,
+	const ID *b, size_t nb );
+
+typedef struct mdb_ids_kernels {
+	const char *ik_name;
+	mdb_ids_func *ik_isect;
+	mdb_ids_func *ik_diff;
+} mdb_ids_kernels;
+
+extern const mdb_ids_kernels mdb_ids_kernel_list[];
+
+	/** Select kernels by name, or the best available if NULL */
+const mdb_ids_kernels *mdb_ids_kernel_select( const char *name );
+
+mdb_ids_func mdb_ids_intersect;
+mdb_ids_func mdb_ids_difference;
+mdb_ids_func mdb_ids_merge;
 LDAP_END_DECL
 
 #endif
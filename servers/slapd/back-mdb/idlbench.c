@@ -0,0 +1,201 @@
+/* idlbench.c - microbenchmark for the IDL merge kernels */
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 2000-2020 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+/* Runs intersection and union of sorted ID lists through each of
+ * the available kernels, checks them against the scalar kernel, and
+ * prints the time per operation. Build with "make idlbench".
+ *
+ *	idlbench [-n size] [-i iterations] [-k kernel]
+ */
+
+#include "portable.h"
+
+/* plain libc free, this is not linked with slapd */
+#define CH_FREE	1
+
+#include <stdio.h>
+#include <ac/stdlib.h>
+#include <ac/string.h>
+#include <ac/time.h>
+#include <ac/unistd.h>
+
+#include "back-mdb.h"
+#include "idl.h"
+
+/* Ratios of the long list to the short one */
+static const int ratios[] = { 1, 8, 64, 1024 };
+
+/* Average gap between IDs, i.e. one in this many entries matches */
+static const int gaps[] = { 2, 16, 256 };
+
+#define NELEM(a)	(sizeof(a) / sizeof((a)[0]))
+
+static unsigned long seed = 1;
+
+static ID
+rnd( ID max )
+{
+	seed = seed * 6364136223846793005UL + 1442695040888963407UL;
+	return ( seed >> 17 ) % max;
+}
+
+/* Fill ids with n sorted, distinct IDs at the given average gap */
+static void
+gen( ID *ids, size_t n, int gap )
+{
+	ID id = 1;
+	size_t i;
+
+	for ( i = 0; i < n; i++ ) {
+		id += 1 + rnd( 2 * gap - 1 );
+		ids[i] = id;
+	}
+}
+
+static double
+now( void )
+{
+	struct timeval tv;
+
+	gettimeofday( &tv, NULL );
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/* Union as done by mdb_idl_union: the distinct part of a is
+ * collected behind b, then both are merged into out.
+ */
+static size_t
+ids_union( ID *out, const ID *a, size_t na, ID *b, size_t nb )
+{
+	size_t n = mdb_ids_difference( b + nb, a, na, b, nb );
+	return mdb_ids_merge( out, b, nb, b + nb, n );
+}
+
+static void
+usage( const char *prog )
+{
+	fprintf( stderr, "usage: %s [-n size] [-i iterations] [-k kernel]\n",
+		prog );
+	exit( EXIT_FAILURE );
+}
+
+int
+main( int argc, char **argv )
+{
+	const mdb_ids_kernels *k, *best;
+	const char *only = NULL;
+	size_t size = 1 << 20, iters = 0;
+	ID *a, *b, *bb, *out, *ref;
+	int c, r, g, rc = 0;
+
+	while (( c = getopt( argc, argv, "n:i:k:" )) != EOF ) {
+		switch ( c ) {
+		case 'n':
+			size = strtoul( optarg, NULL, 0 );
+			break;
+		case 'i':
+			iters = strtoul( optarg, NULL, 0 );
+			break;
+		case 'k':
+			only = optarg;
+			break;
+		default:
+			usage( argv[0] );
+		}
+	}
+	if ( size < ratios[NELEM(ratios)-1] )
+		usage( argv[0] );
+
+	a = malloc( size * sizeof(ID) );
+	b = malloc( size * sizeof(ID) );
+	bb = malloc( 2 * size * sizeof(ID) );
+	out = malloc( 2 * size * sizeof(ID) );
+	ref = malloc( 2 * size * sizeof(ID) );
+	if ( !a || !b || !bb || !out || !ref ) {
+		perror( "malloc" );
+		return EXIT_FAILURE;
+	}
+
+	best = mdb_ids_kernel_select( NULL );
+	printf( "best kernel: %s\n", best->ik_name );
+	printf( "%-8s %6s %4s %10s %10s %12s %12s\n", "kernel", "ratio", "gap",
+		"na", "nb", "isect ns", "union ns" );
+
+	for ( r = 0; r < NELEM(ratios); r++ ) {
+		for ( g = 0; g < NELEM(gaps); g++ ) {
+			size_t na = size / ratios[r], nb = size, nr, nu, n, i, it;
+
+			/* Spread the short list over the same ID range */
+			gen( b, nb, gaps[g] );
+			gen( a, na, gaps[g] * ratios[r] );
+
+			mdb_ids_kernel_select( "scalar" );
+			nr = mdb_ids_intersect( ref, a, na, b, nb );
+			AC_MEMCPY( bb, b, nb * sizeof(ID) );
+			nu = ids_union( ref + nr, a, na, bb, nb );
+
+			it = iters ? iters : ( 64 << 20 ) / ( na + nb ) + 1;
+
+			for ( k = mdb_ids_kernel_list; k->ik_name; k++ ) {
+				double t0, ti, tu;
+
+				if ( only && strcmp( only, k->ik_name ))
+					continue;
+				/* Don't run kernels this CPU can't handle */
+				if ( k < best )
+					continue;
+				mdb_ids_kernel_select( k->ik_name );
+
+				n = mdb_ids_intersect( out, a, na, b, nb );
+				if ( n != nr || memcmp( out, ref, n * sizeof(ID) )) {
+					fprintf( stderr, "%s: intersection mismatch, "
+						"ratio %d gap %d\n", k->ik_name, ratios[r], gaps[g] );
+					rc = EXIT_FAILURE;
+				}
+				AC_MEMCPY( bb, b, nb * sizeof(ID) );
+				n = ids_union( out, a, na, bb, nb );
+				if ( n != nu || memcmp( out, ref + nr, n * sizeof(ID) )) {
+					fprintf( stderr, "%s: union mismatch, "
+						"ratio %d gap %d\n", k->ik_name, ratios[r], gaps[g] );
+					rc = EXIT_FAILURE;
+				}
+
+				t0 = now();
+				for ( i = 0; i < it; i++ )
+					mdb_ids_intersect( out, a, na, b, nb );
+				ti = now() - t0;
+
+				t0 = now();
+				for ( i = 0; i < it; i++ ) {
+					AC_MEMCPY( bb, b, nb * sizeof(ID) );
+					ids_union( out, a, na, bb, nb );
+				}
+				tu = now() - t0;
+
+				printf( "%-8s %6d %4d %10lu %10lu %12.0f %12.0f\n",
+					k->ik_name, ratios[r], gaps[g], (unsigned long)na,
+					(unsigned long)nb, ti * 1e9 / it, tu * 1e9 / it );
+			}
+		}
+	}
+
+	free( a );
+	free( b );
+	free( bb );
+	free( out );
+	free( ref );
+	return rc;
+}
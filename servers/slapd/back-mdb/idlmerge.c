@@ -0,0 +1,347 @@
+/* idlmerge.c - sorted ID array kernels for IDL intersection and union */
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 2000-2020 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+/* These routines work on plain sorted arrays of IDs, without the
+ * leading count of an IDL, and must not depend on anything else in
+ * slapd so that idlbench can link them on their own.
+ *
+ * In every routine the output may be the same array as the first
+ * input, since an output slot is never written before the matching
+ * input slot has been read.
+ */
+
+#include "portable.h"
+
+#include <ac/string.h>
+
+#include "back-mdb.h"
+#include "idl.h"
+
+#if defined(__x86_64__) && defined(__GNUC__) && \
+	( __GNUC__ >= 5 || defined(__clang__) )
+#define IDS_X86_SIMD	1
+#include <immintrin.h>
+#endif
+
+/* Switch to galloping when one list is this much longer */
+#define IDS_GALLOP_RATIO	32
+
+/* Find the first element >= id in ids[lo..n), galloping from lo */
+static size_t
+ids_gallop( const ID *ids, size_t lo, size_t n, ID id )
+{
+	size_t step, hi, mid;
+
+	if ( lo >= n || ids[lo] >= id )
+		return lo;
+	for ( step = 1; lo + step < n && ids[lo + step] < id; step <<= 1 )
+		lo += step;
+	hi = lo + step < n ? lo + step : n;
+	lo++;
+	while ( lo < hi ) {
+		mid = ( lo + hi ) >> 1;
+		if ( ids[mid] < id )
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/* Intersection of a short list with a much longer one */
+static size_t
+ids_isect_gallop( ID *out, const ID *a, size_t na, const ID *b, size_t nb )
+{
+	size_t i = 0, j = 0, k = 0;
+
+	if ( na <= nb ) {
+		for ( ; i < na; i++ ) {
+			j = ids_gallop( b, j, nb, a[i] );
+			if ( j == nb )
+				break;
+			if ( b[j] == a[i] )
+				out[k++] = a[i];
+		}
+	} else {
+		for ( ; j < nb; j++ ) {
+			i = ids_gallop( a, i, na, b[j] );
+			if ( i == na )
+				break;
+			if ( a[i] == b[j] )
+				out[k++] = b[j];
+		}
+	}
+	return k;
+}
+
+static size_t
+ids_isect_scalar( ID *out, const ID *a, size_t na, const ID *b, size_t nb )
+{
+	size_t i = 0, j = 0, k = 0;
+
+	while ( i < na && j < nb ) {
+		ID x = a[i], y = b[j];
+		out[k] = x;
+		k += x == y;
+		i += x <= y;
+		j += y <= x;
+	}
+	return k;
+}
+
+static size_t
+ids_diff_scalar( ID *out, const ID *a, size_t na, const ID *b, size_t nb )
+{
+	size_t i = 0, j = 0, k = 0;
+
+	while ( i < na && j < nb ) {
+		ID x = a[i], y = b[j];
+		out[k] = x;
+		k += x < y;
+		i += x <= y;
+		j += y <= x;
+	}
+	while ( i < na )
+		out[k++] = a[i++];
+	return k;
+}
+
+/* Finish a block-wise intersection or difference: lanes of the
+ * current block of a flagged in mask already matched an earlier
+ * block of b, the others still have to be looked up in b[j..nb).
+ */
+static size_t
+ids_block_tail( ID *out, size_t k, const ID *a, size_t i, size_t na,
+	const ID *b, size_t j, size_t nb, unsigned mask, int lanes, int diff )
+{
+	int l;
+
+	for ( l = 0; l < lanes && i < na; l++, i++ ) {
+		int hit = mask & ( 1U << l );
+		if ( !hit ) {
+			while ( j < nb && b[j] < a[i] )
+				j++;
+			hit = j < nb && b[j] == a[i];
+		}
+		if ( !hit == !!diff )
+			out[k++] = a[i];
+	}
+	if ( diff )
+		return k + ids_diff_scalar( out + k, a + i, na - i, b + j, nb - j );
+	else
+		return k + ids_isect_scalar( out + k, a + i, na - i, b + j, nb - j );
+}
+
+#ifdef IDS_X86_SIMD
+/* Compare a block of a against a block of b, all lanes against all
+ * lanes. A block of a is retired (its matched or unmatched lanes
+ * emitted) once b has moved past its last element.
+ */
+#define IDS_EMIT( mask, lanes ) \
+	do { \
+		unsigned m_ = diff ? ~(mask) & ((1U << (lanes)) - 1) : (mask); \
+		while ( m_ ) { \
+			int l_ = __builtin_ctz( m_ ); \
+			out[k++] = a[i + l_]; \
+			m_ &= m_ - 1; \
+		} \
+	} while (0)
+
+__attribute__((target("sse4.2")))
+static size_t
+ids_block_sse42( ID *out, const ID *a, size_t na, const ID *b, size_t nb, int diff )
+{
+	size_t i = 0, j = 0, k = 0;
+	unsigned mask = 0;
+
+	while ( i + 2 <= na && j + 2 <= nb ) {
+		__m128i va = _mm_loadu_si128( (const __m128i *)( a + i ));
+		__m128i vb = _mm_loadu_si128( (const __m128i *)( b + j ));
+		__m128i eq = _mm_or_si128( _mm_cmpeq_epi64( va, vb ),
+			_mm_cmpeq_epi64( va, _mm_shuffle_epi32( vb, 0x4e )));
+		ID amax = a[i + 1], bmax = b[j + 1];
+
+		mask |= _mm_movemask_pd( _mm_castsi128_pd( eq ));
+		if ( amax <= bmax ) {
+			IDS_EMIT( mask, 2 );
+			mask = 0;
+			i += 2;
+			if ( amax == bmax )
+				j += 2;
+		} else {
+			j += 2;
+		}
+	}
+	return ids_block_tail( out, k, a, i, na, b, j, nb, mask, 2, diff );
+}
+
+__attribute__((target("avx2")))
+static size_t
+ids_block_avx2( ID *out, const ID *a, size_t na, const ID *b, size_t nb, int diff )
+{
+	size_t i = 0, j = 0, k = 0;
+	unsigned mask = 0;
+
+	while ( i + 4 <= na && j + 4 <= nb ) {
+		__m256i va = _mm256_loadu_si256( (const __m256i *)( a + i ));
+		__m256i vb = _mm256_loadu_si256( (const __m256i *)( b + j ));
+		__m256i eq = _mm256_or_si256(
+			_mm256_or_si256( _mm256_cmpeq_epi64( va, vb ),
+				_mm256_cmpeq_epi64( va, _mm256_permute4x64_epi64( vb, 0x39 ))),
+			_mm256_or_si256(
+				_mm256_cmpeq_epi64( va, _mm256_permute4x64_epi64( vb, 0x4e )),
+				_mm256_cmpeq_epi64( va, _mm256_permute4x64_epi64( vb, 0x93 ))));
+		ID amax = a[i + 3], bmax = b[j + 3];
+
+		mask |= _mm256_movemask_pd( _mm256_castsi256_pd( eq ));
+		if ( amax <= bmax ) {
+			IDS_EMIT( mask, 4 );
+			mask = 0;
+			i += 4;
+			if ( amax == bmax )
+				j += 4;
+		} else {
+			j += 4;
+		}
+	}
+	return ids_block_tail( out, k, a, i, na, b, j, nb, mask, 4, diff );
+}
+
+static size_t
+ids_isect_sse42( ID *out, const ID *a, size_t na, const ID *b, size_t nb )
+{
+	return ids_block_sse42( out, a, na, b, nb, 0 );
+}
+
+static size_t
+ids_diff_sse42( ID *out, const ID *a, size_t na, const ID *b, size_t nb )
+{
+	return ids_block_sse42( out, a, na, b, nb, 1 );
+}
+
+static size_t
+ids_isect_avx2( ID *out, const ID *a, size_t na, const ID *b, size_t nb )
+{
+	return ids_block_avx2( out, a, na, b, nb, 0 );
+}
+
+static size_t
+ids_diff_avx2( ID *out, const ID *a, size_t na, const ID *b, size_t nb )
+{
+	return ids_block_avx2( out, a, na, b, nb, 1 );
+}
+#endif /* IDS_X86_SIMD */
+
+const mdb_ids_kernels mdb_ids_kernel_list[] = {
+#ifdef IDS_X86_SIMD
+	{ "avx2", ids_isect_avx2, ids_diff_avx2 },
+	{ "sse4.2", ids_isect_sse42, ids_diff_sse42 },
+#endif
+	{ "scalar", ids_isect_scalar, ids_diff_scalar },
+	{ NULL, NULL, NULL }
+};
+
+static const mdb_ids_kernels *mdb_ids_kernel = &mdb_ids_kernel_list[
+	sizeof(mdb_ids_kernel_list) / sizeof(mdb_ids_kernel_list[0]) - 2 ];
+
+/* Pick the best kernels this CPU supports, or the named ones */
+const mdb_ids_kernels *
+mdb_ids_kernel_select( const char *name )
+{
+	const mdb_ids_kernels *k;
+
+	for ( k = mdb_ids_kernel_list; k->ik_name; k++ ) {
+		if ( name ) {
+			if ( !strcmp( name, k->ik_name ))
+				break;
+			continue;
+		}
+#ifdef IDS_X86_SIMD
+		if ( !strcmp( k->ik_name, "avx2" ) &&
+			( sizeof(ID) != 8 || !__builtin_cpu_supports( "avx2" )))
+			continue;
+		if ( !strcmp( k->ik_name, "sse4.2" ) &&
+			( sizeof(ID) != 8 || !__builtin_cpu_supports( "sse4.2" )))
+			continue;
+#endif
+		break;
+	}
+	if ( k->ik_name )
+		mdb_ids_kernel = k;
+	return k->ik_name ? k : NULL;
+}
+
+size_t
+mdb_ids_intersect( ID *out, const ID *a, size_t na, const ID *b, size_t nb )
+{
+	if ( !na || !nb )
+		return 0;
+	if ( na / IDS_GALLOP_RATIO > nb || nb / IDS_GALLOP_RATIO > na )
+		return ids_isect_gallop( out, a, na, b, nb );
+	return mdb_ids_kernel->ik_isect( out, a, na, b, nb );
+}
+
+size_t
+mdb_ids_difference( ID *out, const ID *a, size_t na, const ID *b, size_t nb )
+{
+	if ( !nb ) {
+		AC_MEMCPY( out, a, na * sizeof(ID) );
+		return na;
+	}
+	return mdb_ids_kernel->ik_diff( out, a, na, b, nb );
+}
+
+/* Merge two disjoint sorted lists. The output must not overlap
+ * either input. Runs of a block's length from one side are copied
+ * at once, which is the common case for clustered IDs.
+ */
+size_t
+mdb_ids_merge( ID *out, const ID *a, size_t na, const ID *b, size_t nb )
+{
+	size_t i = 0, j = 0, k = 0;
+
+	while ( i + 4 <= na && j + 4 <= nb ) {
+		if ( a[i + 3] < b[j] ) {
+			AC_MEMCPY( out + k, a + i, 4 * sizeof(ID) );
+			i += 4;
+			k += 4;
+		} else if ( b[j + 3] < a[i] ) {
+			AC_MEMCPY( out + k, b + j, 4 * sizeof(ID) );
+			j += 4;
+			k += 4;
+		} else {
+			int t = a[i] < b[j];
+			out[k++] = t ? a[i] : b[j];
+			i += t;
+			j += !t;
+		}
+	}
+	while ( i < na && j < nb ) {
+		int t = a[i] < b[j];
+		out[k++] = t ? a[i] : b[j];
+		i += t;
+		j += !t;
+	}
+	if ( i < na ) {
+		AC_MEMCPY( out + k, a + i, ( na - i ) * sizeof(ID) );
+		k += na - i;
+	}
+	if ( j < nb ) {
+		AC_MEMCPY( out + k, b + j, ( nb - j ) * sizeof(ID) );
+		k += nb - j;
+	}
+	return k;
+}
@@ -23,6 +23,7 @@
 #include <ac/errno.h>
 #include <sys/stat.h>
 #include "back-mdb.h"
+#include "idl.h"
 #include <lutil.h>
 #include <ldap_rq.h>
 #include "config.h"
@@ -32,6 +33,7 @@ static const struct berval mdmi_databases[] = {
 	BER_BVC("dn2i"),
 	BER_BVC("id2e"),
 	BER_BVC("id2v"),
+	BER_BVC("dict"),
 	BER_BVNULL
 };
 
@@ -66,6 +68,10 @@ mdb_db_init( BackendDB *be, ConfigReply *cr )
 	mdb->mi_multi_hi = UINT_MAX;
 	mdb->mi_multi_lo = UINT_MAX;
 
+	mdb_ecache_init( mdb );
+	mdb_dict_init( mdb );
+	mdb_group_init( mdb );
+
 	be->be_private = mdb;
 	be->be_cf_ocs = be->bd_info->bi_cf_ocs+1;
 
@@ -213,6 +219,12 @@ mdb_db_open( BackendDB *be, ConfigReply *cr )
 			flags,
 			&mdb->mi_dbis[i] );
 
+		/* no compressed records without it */
+		if ( rc == MDB_NOTFOUND && i == MDB_DICT ) {
+			mdb->mi_dbis[i] = 0;
+			continue;
+		}
+
 		if ( rc != 0 ) {
 			snprintf( cr->msg, sizeof(cr->msg), "database \"%s\": "
 				"mdb_dbi_open(%s/%s) failed: %s (%d).", 
@@ -225,9 +237,11 @@ mdb_db_open( BackendDB *be, ConfigReply *cr )
 			goto fail;
 		}
 
-		if ( i == MDB_ID2ENTRY )
+		if ( i == MDB_ID2ENTRY ) {
 			mdb_set_compare( txn, mdb->mi_dbis[i], mdb_id_compare );
-		else if ( i == MDB_ID2VAL ) {
+			if ( mdb->mi_ovzone )
+				mdb_set_ovzone( txn, mdb->mi_dbis[i], 1 );
+		} else if ( i == MDB_ID2VAL ) {
 			mdb_set_compare( txn, mdb->mi_dbis[i], mdb_id2v_compare );
 			mdb_set_dupsort( txn, mdb->mi_dbis[i], mdb_id2v_dupsort );
 		} else if ( i == MDB_DN2ID ) {
@@ -317,6 +331,9 @@ mdb_db_close( BackendDB *be, ConfigReply *cr )
 
 	mdb->mi_flags &= ~MDB_IS_OPEN;
 
+	mdb_ecache_flush( mdb );
+	mdb_dict_flush( mdb );
+
 	if( mdb->mi_dbenv ) {
 		mdb_reader_flush( mdb->mi_dbenv );
 	}
@@ -366,12 +383,17 @@ mdb_db_destroy( BackendDB *be, ConfigReply *cr )
 		ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
 	}
 
+	mdb_compact_stop( mdb );
+
 	/* monitor handling */
 	(void)mdb_monitor_db_destroy( be );
 
 	if( mdb->mi_dbenv_home ) ch_free( mdb->mi_dbenv_home );
 
 	mdb_attr_index_destroy( mdb );
+	mdb_ecache_destroy( mdb );
+	mdb_dict_destroy( mdb );
+	mdb_group_destroy( mdb );
 
 	ch_free( mdb );
 	be->be_private = NULL;
@@ -440,6 +462,12 @@ mdb_back_initialize(
 			": %s\n", version );
 	}
 
+	{	/* pick the IDL merge kernels for this CPU */
+		const mdb_ids_kernels *k = mdb_ids_kernel_select( NULL );
+		Debug( LDAP_DEBUG_TRACE, LDAP_XSTRING(mdb_back_initialize)
+			": using %s IDL kernels\n", k->ik_name );
+	}
+
 	bi->bi_open = 0;
 	bi->bi_close = 0;
 	bi->bi_config = 0;
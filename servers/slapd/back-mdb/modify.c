@@ -759,14 +759,16 @@ mdb_modify( Operation *op, SlapReply *rs )
 		LDAP_SLIST_REMOVE( &op->o_extra, &opinfo.moi_oe, OpExtra, oe_next );
 		opinfo.moi_oe.oe_key = NULL;
 		if( op->o_noop ) {
-			mdb->mi_numads = numads;
-			mdb_txn_abort( txn );
+			if ( !( opinfo.moi_flag & MOI_GROUP ))
+				mdb->mi_numads = numads;
+			mdb_opinfo_abort( mdb, moi );
 			rs->sr_err = LDAP_X_NO_OPERATION;
 			txn = NULL;
 			goto return_results;
 		} else {
-			rs->sr_err = mdb_txn_commit( txn );
-			if ( rs->sr_err )
+			rs->sr_err = mdb_opinfo_commit( mdb, moi );
+			/* a group undoes its own attribute descriptions */
+			if ( rs->sr_err && !( opinfo.moi_flag & MOI_GROUP ))
 				mdb->mi_numads = numads;
 			txn = NULL;
 		}
@@ -810,8 +812,9 @@ done:
 
 	if( moi == &opinfo ) {
 		if( txn != NULL ) {
-			mdb->mi_numads = numads;
-			mdb_txn_abort( txn );
+			if ( !( opinfo.moi_flag & MOI_GROUP ))
+				mdb->mi_numads = numads;
+			mdb_opinfo_abort( mdb, moi );
 		}
 		if ( opinfo.moi_oe.oe_key ) {
 			LDAP_SLIST_REMOVE( &op->o_extra, &opinfo.moi_oe, OpExtra, oe_next );
@@ -50,6 +50,15 @@ static AttributeDescription *ad_olmMDBReadersMax,
 
 static AttributeDescription *ad_olmMDBEntries;
 
+static AttributeDescription *ad_olmMDBEntryCacheHits,
+	*ad_olmMDBEntryCacheMisses, *ad_olmMDBEntryCacheSize;
+
+static AttributeDescription *ad_olmMDBCompactMoved,
+	*ad_olmMDBCompactTrimmed, *ad_olmMDBCompactPasses;
+
+static AttributeDescription *ad_olmMDBCompressIn,
+	*ad_olmMDBCompressOut, *ad_olmMDBDecompressed;
+
 /*
  * NOTE: there's some confusion in monitor OID arc;
  * by now, let's consider:
@@ -143,6 +152,79 @@ static struct {
 		"NO-USER-MODIFICATION "
 		"USAGE dSAOperation )",
 		&ad_olmMDBEntries },
+
+	{ "( olmMDBAttributes:7 "
+		"NAME ( 'olmMDBEntryCacheHits' ) "
+		"DESC 'Number of entries found in the entry cache' "
+		"SUP monitorCounter "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmMDBEntryCacheHits },
+
+	{ "( olmMDBAttributes:8 "
+		"NAME ( 'olmMDBEntryCacheMisses' ) "
+		"DESC 'Number of entries not found in the entry cache' "
+		"SUP monitorCounter "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmMDBEntryCacheMisses },
+
+	{ "( olmMDBAttributes:9 "
+		"NAME ( 'olmMDBEntryCacheSize' ) "
+		"DESC 'Number of entries in the entry cache' "
+		"SUP monitorCounter "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmMDBEntryCacheSize },
+
+	{ "( olmMDBAttributes:10 "
+		"NAME ( 'olmMDBCompactMoved' ) "
+		"DESC 'Number of pages moved toward the start of the file' "
+		"SUP monitorCounter "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmMDBCompactMoved },
+
+	{ "( olmMDBAttributes:11 "
+		"NAME ( 'olmMDBCompactTrimmed' ) "
+		"DESC 'Number of pages given back from the end of the file' "
+		"SUP monitorCounter "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmMDBCompactTrimmed },
+
+	{ "( olmMDBAttributes:12 "
+		"NAME ( 'olmMDBCompactPasses' ) "
+		"DESC 'Number of compaction passes over the database' "
+		"SUP monitorCounter "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmMDBCompactPasses },
+
+	{ "( olmMDBAttributes:13 "
+		"NAME ( 'olmMDBCompressIn' ) "
+		"DESC 'Size in bytes of the entries written compressed' "
+		"SUP monitorCounter "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmMDBCompressIn },
+
+	{ "( olmMDBAttributes:14 "
+		"NAME ( 'olmMDBCompressOut' ) "
+		"DESC 'Size in bytes of those entries after compression' "
+		"SUP monitorCounter "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmMDBCompressOut },
+
+	{ "( olmMDBAttributes:15 "
+		"NAME ( 'olmMDBDecompressed' ) "
+		"DESC 'Number of compressed entries read' "
+		"SUP monitorCounter "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmMDBDecompressed },
+
 	{ NULL }
 };
 
@@ -162,6 +244,12 @@ static struct {
 #endif /* MDB_MONITOR_IDX */
 			"$ olmMDBPagesMax $ olmMDBPagesUsed $ olmMDBPagesFree "
 			"$ olmMDBReadersMax $ olmMDBReadersUsed $ olmMDBEntries "
+			"$ olmMDBEntryCacheHits $ olmMDBEntryCacheMisses "
+			"$ olmMDBEntryCacheSize "
+			"$ olmMDBCompactMoved $ olmMDBCompactTrimmed "
+			"$ olmMDBCompactPasses "
+			"$ olmMDBCompressIn $ olmMDBCompressOut "
+			"$ olmMDBDecompressed "
 			") )",
 		&oc_olmMDBDatabase },
 
@@ -182,6 +270,8 @@ mdb_monitor_update(
 	MDB_stat mst;
 	MDB_envinfo mei;
 	MDB_txn *txn;
+	unsigned long hits, misses, count;
+	unsigned long zin, zout, unzips;
 	int rc;
 
 #ifdef MDB_MONITOR_IDX
@@ -216,6 +306,64 @@ mdb_monitor_update(
 	bv.bv_len = snprintf( buf, sizeof( buf ), "%u", mei.me_numreaders );
 	ber_bvreplace( &a->a_vals[ 0 ], &bv );
 
+	mdb_ecache_stats( mdb, &hits, &misses, &count );
+
+	a = attr_find( e->e_attrs, ad_olmMDBEntryCacheHits );
+	assert( a != NULL );
+	bv.bv_val = buf;
+	bv.bv_len = snprintf( buf, sizeof( buf ), "%lu", hits );
+	ber_bvreplace( &a->a_vals[ 0 ], &bv );
+
+	a = attr_find( e->e_attrs, ad_olmMDBEntryCacheMisses );
+	assert( a != NULL );
+	bv.bv_val = buf;
+	bv.bv_len = snprintf( buf, sizeof( buf ), "%lu", misses );
+	ber_bvreplace( &a->a_vals[ 0 ], &bv );
+
+	a = attr_find( e->e_attrs, ad_olmMDBEntryCacheSize );
+	assert( a != NULL );
+	bv.bv_val = buf;
+	bv.bv_len = snprintf( buf, sizeof( buf ), "%lu", count );
+	ber_bvreplace( &a->a_vals[ 0 ], &bv );
+
+	a = attr_find( e->e_attrs, ad_olmMDBCompactMoved );
+	assert( a != NULL );
+	bv.bv_val = buf;
+	bv.bv_len = snprintf( buf, sizeof( buf ), "%lu", mdb->mi_compact_moved );
+	ber_bvreplace( &a->a_vals[ 0 ], &bv );
+
+	a = attr_find( e->e_attrs, ad_olmMDBCompactTrimmed );
+	assert( a != NULL );
+	bv.bv_val = buf;
+	bv.bv_len = snprintf( buf, sizeof( buf ), "%lu", mdb->mi_compact_trimmed );
+	ber_bvreplace( &a->a_vals[ 0 ], &bv );
+
+	a = attr_find( e->e_attrs, ad_olmMDBCompactPasses );
+	assert( a != NULL );
+	bv.bv_val = buf;
+	bv.bv_len = snprintf( buf, sizeof( buf ), "%lu", mdb->mi_compact_passes );
+	ber_bvreplace( &a->a_vals[ 0 ], &bv );
+
+	mdb_dict_stats( mdb, &zin, &zout, &unzips );
+
+	a = attr_find( e->e_attrs, ad_olmMDBCompressIn );
+	assert( a != NULL );
+	bv.bv_val = buf;
+	bv.bv_len = snprintf( buf, sizeof( buf ), "%lu", zin );
+	ber_bvreplace( &a->a_vals[ 0 ], &bv );
+
+	a = attr_find( e->e_attrs, ad_olmMDBCompressOut );
+	assert( a != NULL );
+	bv.bv_val = buf;
+	bv.bv_len = snprintf( buf, sizeof( buf ), "%lu", zout );
+	ber_bvreplace( &a->a_vals[ 0 ], &bv );
+
+	a = attr_find( e->e_attrs, ad_olmMDBDecompressed );
+	assert( a != NULL );
+	bv.bv_val = buf;
+	bv.bv_len = snprintf( buf, sizeof( buf ), "%lu", unzips );
+	ber_bvreplace( &a->a_vals[ 0 ], &bv );
+
 	rc = mdb_txn_begin( mdb->mi_dbenv, NULL, MDB_RDONLY, &txn );
 	if ( !rc ) {
 		MDB_cursor *cursor;
@@ -436,7 +584,7 @@ mdb_monitor_db_open( BackendDB *be )
 	}
 
 	/* alloc as many as required (plus 1 for objectClass) */
-	a = attrs_alloc( 1 + 7 );
+	a = attrs_alloc( 1 + 16 );
 	if ( a == NULL ) {
 		rc = 1;
 		goto cleanup;
@@ -472,6 +620,42 @@ mdb_monitor_db_open( BackendDB *be )
 		next->a_desc = ad_olmMDBEntries;
 		attr_valadd( next, &bv, NULL, 1 );
 		next = next->a_next;
+
+		next->a_desc = ad_olmMDBEntryCacheHits;
+		attr_valadd( next, &bv, NULL, 1 );
+		next = next->a_next;
+
+		next->a_desc = ad_olmMDBEntryCacheMisses;
+		attr_valadd( next, &bv, NULL, 1 );
+		next = next->a_next;
+
+		next->a_desc = ad_olmMDBEntryCacheSize;
+		attr_valadd( next, &bv, NULL, 1 );
+		next = next->a_next;
+
+		next->a_desc = ad_olmMDBCompactMoved;
+		attr_valadd( next, &bv, NULL, 1 );
+		next = next->a_next;
+
+		next->a_desc = ad_olmMDBCompactTrimmed;
+		attr_valadd( next, &bv, NULL, 1 );
+		next = next->a_next;
+
+		next->a_desc = ad_olmMDBCompactPasses;
+		attr_valadd( next, &bv, NULL, 1 );
+		next = next->a_next;
+
+		next->a_desc = ad_olmMDBCompressIn;
+		attr_valadd( next, &bv, NULL, 1 );
+		next = next->a_next;
+
+		next->a_desc = ad_olmMDBCompressOut;
+		attr_valadd( next, &bv, NULL, 1 );
+		next = next->a_next;
+
+		next->a_desc = ad_olmMDBDecompressed;
+		attr_valadd( next, &bv, NULL, 1 );
+		next = next->a_next;
 	}
 
 	{
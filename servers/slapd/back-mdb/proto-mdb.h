@@ -59,6 +59,36 @@ int mdb_ad_read( struct mdb_info *mdb, MDB_txn *txn );
 int mdb_ad_get( struct mdb_info *mdb, MDB_txn *txn, AttributeDescription *ad );
 void mdb_ad_unwind( struct mdb_info *mdb, int prev_ads );
 
+/*
+ * compact.c
+ */
+
+void *mdb_compact_task( void *ctx, void *arg );
+void mdb_compact_stop( struct mdb_info *mdb );
+
+/*
+ * group.c
+ */
+
+int mdb_group_init( struct mdb_info *mdb );
+void mdb_group_destroy( struct mdb_info *mdb );
+int mdb_group_begin( struct mdb_info *mdb, mdb_op_info *moi );
+int mdb_opinfo_commit( struct mdb_info *mdb, mdb_op_info *moi );
+void mdb_opinfo_abort( struct mdb_info *mdb, mdb_op_info *moi );
+
+/*
+ * compress.c
+ */
+
+int mdb_dict_init( struct mdb_info *mdb );
+void mdb_dict_flush( struct mdb_info *mdb );
+void mdb_dict_destroy( struct mdb_info *mdb );
+int mdb_entry_compress( Operation *op, MDB_txn *txn, MDB_val *data );
+int mdb_entry_decompress( Operation *op, MDB_txn *txn, MDB_val *data,
+	void *buf );
+void mdb_dict_stats( struct mdb_info *mdb, unsigned long *zin,
+	unsigned long *zout, unsigned long *unzips );
+
 /*
  * config.c
  */
@@ -162,6 +192,21 @@ void mdb_dn2id_wrestore(
 
 MDB_cmp_func mdb_dup_compare;
 
+/*
+ * ecache.c
+ */
+
+int mdb_ecache_init( struct mdb_info *mdb );
+void mdb_ecache_destroy( struct mdb_info *mdb );
+void mdb_ecache_flush( struct mdb_info *mdb );
+void mdb_ecache_trim( struct mdb_info *mdb );
+int mdb_ecache_get( Operation *op, MDB_txn *txn, ID id, Entry **e );
+void mdb_ecache_put( Operation *op, MDB_txn *txn, MDB_val *data, Entry *e );
+void mdb_ecache_release( Entry *e );
+void mdb_ecache_invalidate( struct mdb_info *mdb, MDB_txn *txn, ID id );
+void mdb_ecache_stats( struct mdb_info *mdb, unsigned long *hits,
+	unsigned long *misses, unsigned long *count );
+
 /*
  * filterentry.c
  */
@@ -416,6 +416,312 @@ mdb_waitfixup( Operation *op, ww_ctx *ww, MDB_cursor *mci, MDB_cursor *mcd, IdSc
 	return rc;
 }
 
+/* Parallel filter evaluation. With searchthreads > 1, a search with
+ * many candidates looks ahead at the next PS_WINDOW of them and runs
+ * them through test_filter() in chunks, on the search thread and on
+ * up to searchthreads-1 helpers from the connection pool. The main
+ * loop then drops the candidates that failed the filter without
+ * fetching them again, and sends the rest in the usual order.
+ *
+ * Read txns belong to their thread, so a helper opens its own and
+ * only helps if it got the same snapshot as the search. Chunks are
+ * handed out on demand and the search thread takes whatever is left,
+ * so it never waits for a helper that hasn't started yet.
+ */
+#define PS_WINDOW	1024
+#define PS_CHUNK	64
+
+/* verdicts */
+#define PS_UNKNOWN	0	/* main loop must evaluate it */
+#define PS_SKIP	1
+#define PS_MATCH	2
+#define PS_TODO	3
+
+typedef struct ps_ctx {
+	ldap_pvt_thread_mutex_t ps_mutex;
+	ldap_pvt_thread_cond_t ps_cond;
+	int ps_ref;
+	int ps_done;
+	int ps_helpers;
+	int ps_refchk;		/* referrals are returned regardless of filter */
+	ID ps_base;
+	size_t ps_txnid;	/* snapshot the window was evaluated in */
+	int ps_n;		/* IDs in the window */
+	int ps_pos;		/* next one the main loop will look at */
+	int ps_nchunks;
+	int ps_next;		/* next chunk to hand out */
+	int ps_pending;		/* chunks being evaluated by helpers */
+	Operation ps_op;	/* template for helpers */
+	Opheader ps_hdr;
+	IdScopes ps_isc;	/* lookahead copy of the scope walk */
+	ID2 ps_scopes[MAXRDNS+1];
+	ID ps_ids[PS_WINDOW];
+	unsigned char ps_verdict[PS_WINDOW];
+} ps_ctx;
+
+static ps_ctx *
+ps_new( Operation *op, int helpers, ID base, int refchk )
+{
+	ps_ctx *ps = ch_calloc( 1, sizeof( ps_ctx ));
+
+	ldap_pvt_thread_mutex_init( &ps->ps_mutex );
+	ldap_pvt_thread_cond_init( &ps->ps_cond );
+	ps->ps_ref = 1;
+	ps->ps_helpers = helpers;
+	ps->ps_refchk = refchk;
+	ps->ps_base = base;
+	ps->ps_op = *op;
+	ps->ps_hdr = *op->o_hdr;
+	ps->ps_op.o_hdr = &ps->ps_hdr;
+	LDAP_SLIST_INIT( &ps->ps_op.o_extra );
+	return ps;
+}
+
+/* Drop a reference, the mutex must be held */
+static void
+ps_unref( ps_ctx *ps )
+{
+	if ( --ps->ps_ref ) {
+		ldap_pvt_thread_mutex_unlock( &ps->ps_mutex );
+		return;
+	}
+	ldap_pvt_thread_mutex_unlock( &ps->ps_mutex );
+	ldap_pvt_thread_cond_destroy( &ps->ps_cond );
+	ldap_pvt_thread_mutex_destroy( &ps->ps_mutex );
+	ch_free( ps );
+}
+
+/* Called by the search when it's done. Helpers may still hold a
+ * reference, but none of them is looking at the operation anymore
+ * once this returns.
+ */
+static void
+ps_free( ps_ctx *ps )
+{
+	ldap_pvt_thread_mutex_lock( &ps->ps_mutex );
+	ps->ps_done = 1;
+	while ( ps->ps_pending )
+		ldap_pvt_thread_cond_wait( &ps->ps_cond, &ps->ps_mutex );
+	ps_unref( ps );
+}
+
+/* Is this entry in the candidate list? */
+static int
+search_incand( ID *candidates, ID id )
+{
+	unsigned i;
+
+	if ( MDB_IDL_IS_CMP( candidates )) {
+		ID cid = id;
+		return mdb_idl_first( candidates, &cid ) == id;
+	} else if ( MDB_IDL_IS_RANGE( candidates )) {
+		return id >= MDB_IDL_RANGE_FIRST( candidates ) &&
+			id <= MDB_IDL_RANGE_LAST( candidates );
+	}
+	i = mdb_idl_search( candidates, id );
+	return i <= candidates[0] && candidates[i] == id;
+}
+
+/* Evaluate one chunk of the window */
+static void
+ps_eval( Operation *op, ps_ctx *ps, MDB_txn *txn, MDB_cursor *mci, int chunk )
+{
+	MDB_cursor *mcd = NULL;
+	MDB_val edata;
+	Entry *e;
+	int i, end, cached, v;
+
+	end = ( chunk + 1 ) * PS_CHUNK;
+	if ( end > ps->ps_n )
+		end = ps->ps_n;
+	for ( i = chunk * PS_CHUNK; i < end; i++ ) {
+		ID id = ps->ps_ids[i];
+
+		if ( ps->ps_verdict[i] != PS_TODO )
+			continue;
+		v = PS_UNKNOWN;
+		if ( id == ps->ps_base )
+			goto next;
+		cached = mdb_ecache_get( op, txn, id, &e ) == 0;
+		if ( !cached ) {
+			if ( mdb_id2edata( op, mci, id, &edata ) ||
+				mdb_entry_decode( op, txn, &edata, id, &e ))
+				goto next;
+			e->e_id = id;
+		}
+		e->e_name.bv_val = NULL;
+		e->e_nname.bv_val = NULL;
+		if ( mdb_id2name( op, txn, &mcd, id, &e->e_name, &e->e_nname ) == 0 &&
+			!( ps->ps_refchk && is_entry_referral( e )))
+		{
+			if ( test_filter( op, e, op->oq_search.rs_filter ) == LDAP_COMPARE_TRUE ) {
+				v = PS_MATCH;
+				if ( !cached )
+					mdb_ecache_put( op, txn, &edata, e );
+			} else {
+				v = PS_SKIP;
+			}
+		}
+		mdb_entry_return( op, e );
+next:
+		ps->ps_verdict[i] = v;
+	}
+	if ( mcd )
+		mdb_cursor_close( mcd );
+}
+
+static void *
+ps_helper( void *ctx, void *arg )
+{
+	ps_ctx *ps = arg;
+	struct mdb_info *mdb = (struct mdb_info *) ps->ps_op.o_bd->be_private;
+	mdb_op_info opinfo = {{{0}}}, *moi = &opinfo;
+	MDB_cursor *mci = NULL;
+	Operation op;
+	Opheader ohdr;
+
+	ldap_pvt_thread_mutex_lock( &ps->ps_mutex );
+	if ( ps->ps_done || ps->ps_next >= ps->ps_nchunks )
+		goto out;
+	op = ps->ps_op;
+	ohdr = ps->ps_hdr;
+	op.o_hdr = &ohdr;
+	op.o_threadctx = ctx;
+	op.o_tmpmemctx = slap_sl_mem_create( SLAP_SLAB_SIZE, SLAP_SLAB_STACK,
+		ctx, 1 );
+	op.o_tmpmfuncs = &slap_sl_mfuncs;
+	ldap_pvt_thread_mutex_unlock( &ps->ps_mutex );
+
+	if ( mdb_opinfo_get( &op, mdb, 1, &moi ) == 0 ) {
+		ldap_pvt_thread_mutex_lock( &ps->ps_mutex );
+		if ( mdb_cursor_open( moi->moi_txn, mdb->mi_id2entry, &mci ) == 0 ) {
+			while ( !ps->ps_done && ps->ps_next < ps->ps_nchunks &&
+				mdb_txn_id( moi->moi_txn ) == ps->ps_txnid )
+			{
+				int chunk = ps->ps_next++;
+				ps->ps_pending++;
+				ldap_pvt_thread_mutex_unlock( &ps->ps_mutex );
+				ps_eval( &op, ps, moi->moi_txn, mci, chunk );
+				ldap_pvt_thread_mutex_lock( &ps->ps_mutex );
+				if ( !--ps->ps_pending )
+					ldap_pvt_thread_cond_signal( &ps->ps_cond );
+			}
+			mdb_cursor_close( mci );
+		}
+		ldap_pvt_thread_mutex_unlock( &ps->ps_mutex );
+		mdb_txn_reset( moi->moi_txn );
+		LDAP_SLIST_REMOVE( &op.o_extra, &moi->moi_oe, OpExtra, oe_next );
+	}
+	ldap_pvt_thread_mutex_lock( &ps->ps_mutex );
+out:
+	ps_unref( ps );
+	return NULL;
+}
+
+/* Fill the window with the candidates from id on, following the
+ * same order the main loop will: the candidate IDL from cursor, or
+ * a copy of the scope walk in isc.
+ */
+static void
+ps_fill( Operation *op, ps_ctx *ps, MDB_txn *txn, ID id,
+	ID *candidates, ID cursor, IdScopes *isc )
+{
+	int n = 0;
+
+	ps->ps_ids[n] = id;
+	ps->ps_verdict[n++] = ( !isc || search_incand( candidates, id ))
+		? PS_TODO : PS_SKIP;
+
+	if ( isc ) {
+		IdScopes *w = &ps->ps_isc;
+		MDB_val key, data;
+
+		*w = *isc;
+		w->scopes = ps->ps_scopes;
+		AC_MEMCPY( w->scopes, isc->scopes, ( isc->numrdns + 1 ) * sizeof(ID2));
+		w->mc = NULL;
+		if ( mdb_cursor_get( isc->mc, &key, &data, MDB_GET_CURRENT ) == 0 &&
+			mdb_cursor_open( txn, mdb_cursor_dbi( isc->mc ), &w->mc ) == 0 &&
+			mdb_cursor_get( w->mc, &key, &data, MDB_GET_BOTH ) == 0 )
+		{
+			while ( n < PS_WINDOW && mdb_dn2id_walk( op, w ) == 0 ) {
+				ps->ps_ids[n] = w->id;
+				ps->ps_verdict[n++] = search_incand( candidates, w->id )
+					? PS_TODO : PS_SKIP;
+			}
+		}
+		if ( w->mc )
+			mdb_cursor_close( w->mc );
+	} else {
+		while ( n < PS_WINDOW &&
+			( id = mdb_idl_next( candidates, &cursor )) != NOID )
+		{
+			ps->ps_ids[n] = id;
+			ps->ps_verdict[n++] = PS_TODO;
+		}
+	}
+	ps->ps_n = n;
+	ps->ps_pos = 0;
+}
+
+/* Evaluate the window, with help if there's enough of it */
+static void
+ps_run( Operation *op, ps_ctx *ps, MDB_txn *txn, MDB_cursor *mci )
+{
+	int i, helpers;
+
+	ldap_pvt_thread_mutex_lock( &ps->ps_mutex );
+	ps->ps_txnid = mdb_txn_id( txn );
+	ps->ps_nchunks = ( ps->ps_n + PS_CHUNK - 1 ) / PS_CHUNK;
+	ps->ps_next = 0;
+	helpers = ps->ps_nchunks - 1;
+	if ( helpers > ps->ps_helpers )
+		helpers = ps->ps_helpers;
+	ps->ps_ref += helpers;
+	ldap_pvt_thread_mutex_unlock( &ps->ps_mutex );
+
+	for ( i = 0; i < helpers; i++ ) {
+		if ( ldap_pvt_thread_pool_submit( &connection_pool, ps_helper, ps )) {
+			ldap_pvt_thread_mutex_lock( &ps->ps_mutex );
+			ps->ps_ref -= helpers - i;
+			ldap_pvt_thread_mutex_unlock( &ps->ps_mutex );
+			break;
+		}
+	}
+
+	ldap_pvt_thread_mutex_lock( &ps->ps_mutex );
+	while ( ps->ps_next < ps->ps_nchunks ) {
+		int chunk = ps->ps_next++;
+		ldap_pvt_thread_mutex_unlock( &ps->ps_mutex );
+		ps_eval( op, ps, txn, mci, chunk );
+		ldap_pvt_thread_mutex_lock( &ps->ps_mutex );
+	}
+	while ( ps->ps_pending )
+		ldap_pvt_thread_cond_wait( &ps->ps_cond, &ps->ps_mutex );
+	ldap_pvt_thread_mutex_unlock( &ps->ps_mutex );
+}
+
+/* Return the verdict for the candidate the main loop is at,
+ * evaluating a new window if it's not in the current one.
+ */
+static int
+ps_verdict( Operation *op, ps_ctx *ps, MDB_txn *txn, MDB_cursor *mci,
+	ID id, ID *candidates, ID cursor, IdScopes *isc )
+{
+	if ( ps->ps_txnid != mdb_txn_id( txn )) {
+		ps->ps_pos = ps->ps_n;
+	} else if ( !isc ) {
+		/* candidates can be skipped, e.g. by mdb_get_nextid */
+		while ( ps->ps_pos < ps->ps_n && ps->ps_ids[ps->ps_pos] < id )
+			ps->ps_pos++;
+	}
+	if ( ps->ps_pos >= ps->ps_n || ps->ps_ids[ps->ps_pos] != id ) {
+		ps_fill( op, ps, txn, id, candidates, cursor, isc );
+		ps_run( op, ps, txn, mci );
+	}
+	return ps->ps_verdict[ps->ps_pos++];
+}
+
 int
 mdb_search( Operation *op, SlapReply *rs )
 {
@@ -436,6 +742,8 @@ mdb_search( Operation *op, SlapReply *rs )
 	MDB_cursor	*mci, *mcd;
 	ww_ctx wwctx;
 	slap_callback cb = { 0 };
+	ps_ctx *psc = NULL;
+	int prematch;
 
 	mdb_op_info	opinfo = {{{0}}}, *moi = &opinfo;
 	MDB_txn			*ltid = NULL;
@@ -734,6 +1042,15 @@ adminlimit:
 		op->o_callback = &cb;
 	}
 
+	/* spread the filter evaluation over several threads */
+	if ( mdb->mi_search_threads > 1 && moi == &opinfo &&
+		op->ors_scope != LDAP_SCOPE_BASE &&
+		( nsubs < ncand ? nsubs : ncand ) > PS_WINDOW )
+	{
+		psc = ps_new( op, mdb->mi_search_threads - 1, base->e_id,
+			!manageDSAit );
+	}
+
 	if ( get_pagedresults( op ) > SLAP_CONTROL_IGNORED ) {
 		PagedResultsState *ps = op->o_pagedresults_state;
 		/* deferred cookie parsing */
@@ -831,20 +1148,21 @@ loop_begin:
 		}
 
 
+		prematch = 0;
+		if ( psc ) {
+			switch ( ps_verdict( op, psc, ltid, mci, id, candidates, cursor,
+				nsubs < ncand ? &isc : NULL )) {
+			case PS_SKIP:
+				goto loop_continue;
+			case PS_MATCH:
+				prematch = 1;
+				break;
+			}
+		}
+
 		if ( nsubs < ncand ) {
-			unsigned i;
 			/* Is this entry in the candidate list? */
-			scopeok = 0;
-			if (MDB_IDL_IS_RANGE( candidates )) {
-				if ( id >= MDB_IDL_RANGE_FIRST( candidates ) &&
-					id <= MDB_IDL_RANGE_LAST( candidates ))
-					scopeok = 1;
-			} else {
-				i = mdb_idl_search( candidates, id );
-				if (i <= candidates[0] && candidates[i] == id )
-					scopeok = 1;
-			}
-			if ( scopeok )
+			if ( search_incand( candidates, id ))
 				goto scopeok;
 			goto loop_continue;
 		}
@@ -898,6 +1216,10 @@ loop_begin:
 scopeok:
 		if ( id == base->e_id ) {
 			e = base;
+		} else if ( mdb_ecache_get( op, ltid, id, &e ) == 0 ) {
+			e->e_name.bv_val = NULL;
+			e->e_nname.bv_val = NULL;
+
 		} else {
 
 			/* get the entry */
@@ -1073,9 +1395,18 @@ notfound:
 		}
 
 		/* if it matches the filter and scope, send it */
-		rs->sr_err = test_filter( op, e, op->oq_search.rs_filter );
+		if ( prematch )
+			rs->sr_err = LDAP_COMPARE_TRUE;
+		else
+			rs->sr_err = test_filter( op, e, op->oq_search.rs_filter );
 
 		if ( rs->sr_err == LDAP_COMPARE_TRUE ) {
+			/* only cache entries that get returned, not every
+			 * candidate a filter scan looks at.
+			 */
+			if ( e != base )
+				mdb_ecache_put( op, ltid, &edata, e );
+
 			/* check size limit */
 			if ( get_pagedresults(op) > SLAP_CONTROL_IGNORED ) {
 				if ( rs->sr_nentries >= ((PagedResultsState *)op->o_pagedresults_state)->ps_size ) {
@@ -1217,6 +1548,8 @@ done:
 			}
 		}
 	}
+	if ( psc )
+		ps_free( psc );
 	mdb_cursor_close( mcd );
 	mdb_cursor_close( mci );
 	if ( moi == &opinfo ) {
@@ -312,6 +312,9 @@ next:;
 		if ( rc == LDAP_NO_SUCH_OBJECT ) {
 			goto next;
 		}
+		/* leave it to entry_get to report */
+		if ( rc != LDAP_SUCCESS )
+			return id;
 
 		assert( tool_next_entry != NULL );
 
@@ -414,6 +417,17 @@ mdb_tool_entry_get_int( BackendDB *be, ID id, Entry **ep )
 		}
 	}
 	rc = mdb_entry_decode( &op, mdb_tool_txn, &data, id, &e );
+	if ( rc ) {
+		Debug( LDAP_DEBUG_ANY,
+			"mdb_tool_entry_get: cannot decode entry id=%08lx: %d\n",
+			(long) id, rc );
+		if ( !BER_BVISNULL( &dn )) {
+			ch_free( dn.bv_val );
+			ch_free( ndn.bv_val );
+		}
+		rc = LDAP_OTHER;
+		goto done;
+	}
 	e->e_id = id;
 	if ( !BER_BVISNULL( &dn )) {
 		e->e_name = dn;
@@ -27,6 +27,12 @@
 #include "slap.h"
 #include "back-monitor.h"
 
+static int
+monitor_subsys_listener_update(
+	Operation		*op,
+	SlapReply		*rs,
+	Entry 			*e );
+
 int
 monitor_subsys_listener_init(
 	BackendDB		*be,
@@ -41,6 +47,8 @@ monitor_subsys_listener_init(
 
 	assert( be != NULL );
 
+	ms->mss_update = monitor_subsys_listener_update;
+
 	if ( ( l = slapd_get_listeners() ) == NULL ) {
 		if ( slapMode & SLAP_TOOL_MODE ) {
 			return 0;
@@ -91,6 +99,9 @@ monitor_subsys_listener_init(
 		attr_merge_normalize_one( e, slap_schema.si_ad_labeledURI,
 				&l[ i ]->sl_url, NULL );
 
+		BER_BVSTR( &bv, "0" );
+		attr_merge_one( e, mi->mi_ad_monitorCounter, &bv, NULL );
+
 #ifdef HAVE_TLS
 		if ( l[ i ]->sl_is_tls ) {
 			struct berval bv;
@@ -130,9 +141,129 @@ monitor_subsys_listener_init(
 		*ep = e;
 		ep = &mp->mp_next;
 	}
+
+	/* One entry per listener thread */
+	for ( i = 0; i < slapd_daemon_threads; i++ ) {
+		char 		buf[ BACKMONITOR_BUFSIZE ];
+		Entry		*e;
+		struct berval bv;
+
+		bv.bv_len = snprintf( buf, sizeof( buf ),
+				"cn=Thread %d", i );
+		bv.bv_val = buf;
+		e = monitor_entry_stub( &ms->mss_dn, &ms->mss_ndn, &bv,
+			mi->mi_oc_monitorCounterObject, NULL, NULL );
+
+		if ( e == NULL ) {
+			Debug( LDAP_DEBUG_ANY,
+				"monitor_subsys_listener_init: "
+				"unable to create entry \"cn=Thread %d,%s\"\n",
+				i, ms->mss_ndn.bv_val );
+			return( -1 );
+		}
+
+		BER_BVSTR( &bv, "0" );
+		attr_merge_one( e, mi->mi_ad_monitorCounter, &bv, NULL );
+
+		mp = monitor_entrypriv_create();
+		if ( mp == NULL ) {
+			return -1;
+		}
+		e->e_private = ( void * )mp;
+		mp->mp_info = ms;
+		mp->mp_flags = ms->mss_flags
+			| MONITOR_F_SUB;
+
+		if ( monitor_cache_add( mi, e ) ) {
+			Debug( LDAP_DEBUG_ANY,
+				"monitor_subsys_listener_init: "
+				"unable to add entry \"cn=Thread %d,%s\"\n",
+				i, ms->mss_ndn.bv_val );
+			return( -1 );
+		}
+
+		*ep = e;
+		ep = &mp->mp_next;
+	}
 	
 	monitor_cache_release( mi, e_listener );
 
 	return( 0 );
 }
 
+static void
+monitor_listener_counter( Entry *e, AttributeDescription *ad,
+	unsigned long n )
+{
+	Attribute	*a;
+	char		buf[ LDAP_PVT_INTTYPE_CHARS(unsigned long) ];
+	struct berval	bv;
+
+	a = attr_find( e->e_attrs, ad );
+	if ( a == NULL ) {
+		return;
+	}
+	bv.bv_val = buf;
+	bv.bv_len = snprintf( buf, sizeof( buf ), "%lu", n );
+	ber_bvreplace( &a->a_vals[ 0 ], &bv );
+}
+
+static int
+monitor_subsys_listener_update(
+	Operation		*op,
+	SlapReply		*rs,
+	Entry 			*e )
+{
+	monitor_info_t	*mi = ( monitor_info_t * )op->o_bd->be_private;
+	struct berval	rdn;
+	Listener	**l;
+	int		i, n;
+
+	assert( mi != NULL );
+
+	dnRdn( &e->e_nname, &rdn );
+
+	if ( sscanf( rdn.bv_val, "cn=listener %d", &i ) == 1 ) {
+		l = slapd_get_listeners();
+		for ( n = 0; l && l[ n ]; n++ )
+			/* count */ ;
+		if ( i >= 0 && i < n ) {
+			monitor_listener_counter( e, mi->mi_ad_monitorCounter,
+				l[ i ]->sl_accepts );
+		}
+
+	} else if ( sscanf( rdn.bv_val, "cn=thread %d", &i ) == 1 ) {
+		slap_daemon_stats	st;
+		BerVarray		vals = NULL;
+		char			buf[ BACKMONITOR_BUFSIZE ];
+		struct berval		bv;
+
+		attr_delete( &e->e_attrs, mi->mi_ad_monitoredInfo );
+		if ( slapd_daemon_stats( i, &st ) ) {
+			/* thread went away after listener-threads was lowered */
+			monitor_listener_counter( e, mi->mi_ad_monitorCounter, 0 );
+			return SLAP_CB_CONTINUE;
+		}
+		monitor_listener_counter( e, mi->mi_ad_monitorCounter,
+			st.sds_accepts );
+
+		bv.bv_val = buf;
+		bv.bv_len = snprintf( buf, sizeof( buf ), "waits=%lu", st.sds_waits );
+		value_add_one( &vals, &bv );
+		bv.bv_len = snprintf( buf, sizeof( buf ), "events=%lu", st.sds_events );
+		value_add_one( &vals, &bv );
+		bv.bv_len = snprintf( buf, sizeof( buf ), "connections=%ld", st.sds_conns );
+		value_add_one( &vals, &bv );
+		if ( st.sds_cpu >= 0 ) {
+			bv.bv_len = snprintf( buf, sizeof( buf ), "cpu=%d", st.sds_cpu );
+			value_add_one( &vals, &bv );
+		}
+		attr_merge_normalize( e, mi->mi_ad_monitoredInfo, vals, NULL );
+		ber_bvarray_free( vals );
+	}
+
+	/* FIXME: touch modifyTimestamp? */
+
+	return SLAP_CB_CONTINUE;
+}
+
@@ -33,6 +33,7 @@ typedef enum {
 	MT_UNKNOWN,
 	MT_RUNQUEUE,
 	MT_TASKLIST,
+	MT_OBJCACHE,
 
 	MT_LAST
 } monitor_thread_t;
@@ -86,6 +87,9 @@ static struct {
 	{ BER_BVC( "cn=Tasklist" ),
 		BER_BVC("List of running plus standby threads - besides those handling operations"),
 		BER_BVNULL,	LDAP_PVT_THREAD_POOL_PARAM_UNKNOWN,	MT_TASKLIST },
+	{ BER_BVC( "cn=Object Caches" ),
+		BER_BVC("Per-thread caches of Operations and request BerElements"),
+		BER_BVNULL,	LDAP_PVT_THREAD_POOL_PARAM_UNKNOWN,	MT_OBJCACHE },
 
 	{ BER_BVNULL }
 };
@@ -225,6 +229,9 @@ monitor_subsys_thread_update(
 	struct re_s		*re;
 	int			count = -1;
 	char			*state = NULL;
+	slap_objcache_stats_t	stats[SLAP_OBJ_LAST];
+	static const char	*objnames[SLAP_OBJ_LAST] = {
+		"operation", "berelement" };
 
 	assert( mi != NULL );
 
@@ -312,6 +319,32 @@ monitor_subsys_thread_update(
 			}
 			break;
 
+		case MT_OBJCACHE:
+			if ( a != NULL ) {
+				if ( a->a_nvals != a->a_vals ) {
+					ber_bvarray_free( a->a_nvals );
+				}
+				ber_bvarray_free( a->a_vals );
+				a->a_vals = NULL;
+				a->a_nvals = NULL;
+				a->a_numvals = 0;
+			}
+
+			slap_objcache_stats( stats );
+			bv.bv_val = buf;
+			for ( i = 0; i < SLAP_OBJ_LAST; i++ ) {
+				bv.bv_len = snprintf( buf, sizeof( buf ),
+					"{%d}%s hits=%lu misses=%lu drops=%lu cached=%lu",
+					i, objnames[i], stats[i].os_hits, stats[i].os_misses,
+					stats[i].os_drops, stats[i].os_cached );
+				if ( bv.bv_len < sizeof( buf ) ) {
+					value_add_one( &vals, &bv );
+				}
+			}
+			attr_merge_normalize( e, mi->mi_ad_monitoredInfo, vals, NULL );
+			ber_bvarray_free( vals );
+			break;
+
 		default:
 			assert( 0 );
 		}
@@ -201,6 +201,7 @@ enum {
 	CFG_TLS_CACERT,
 	CFG_TLS_CERT,
 	CFG_TLS_KEY,
+	CFG_LCPUS,
 
 	CFG_LAST
 };
@@ -452,6 +453,11 @@ static ConfigTable config_back_cf_table[] = {
 		&config_generic, "( OLcfgDbAt:0.5 NAME 'olcLimits' "
 			"EQUALITY caseIgnoreMatch "
 			"SYNTAX OMsDirectoryString X-ORDERED 'VALUES' )", NULL, NULL },
+	{ "listener-cpus", "cpus", 2, 2, 0,
+		ARG_STRING|ARG_MAGIC|CFG_LCPUS, &config_generic,
+		"( OLcfgGlAt:101 NAME 'olcListenerCpus' "
+			"EQUALITY caseIgnoreMatch "
+			"SYNTAX OMsDirectoryString SINGLE-VALUE )", NULL, NULL },
 	{ "listener-threads", "count", 2, 0, 0,
 		ARG_UINT|ARG_MAGIC|CFG_LTHREADS, &config_generic,
 		"( OLcfgGlAt:93 NAME 'olcListenerThreads' "
@@ -888,6 +894,14 @@ static ConfigTable config_back_cf_table[] = {
 		&config_updateref, "( OLcfgDbAt:0.13 NAME 'olcUpdateRef' "
 			"EQUALITY caseIgnoreMatch "
 			"SUP labeledURI )", NULL, NULL },
+	{ "writebatch-delay", "msec", 2, 2, 0, ARG_UINT,
+		&global_writebatch_delay, "( OLcfgGlAt:103 NAME 'olcWriteBatchDelay' "
+			"EQUALITY integerMatch "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "writebatch-size", "bytes", 2, 2, 0, ARG_UINT,
+		&global_writebatch_size, "( OLcfgGlAt:102 NAME 'olcWriteBatchSize' "
+			"EQUALITY integerMatch "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ "writetimeout", "timeout", 2, 2, 0, ARG_INT,
 		&global_writetimeout, "( OLcfgGlAt:88 NAME 'olcWriteTimeout' "
 			"EQUALITY integerMatch "
@@ -942,7 +956,7 @@ static ConfigOCs cf_ocs[] = {
 		 "olcIndexSubstrIfMaxLen $ olcIndexSubstrIfMinLen $ "
 		 "olcIndexSubstrAnyLen $ olcIndexSubstrAnyStep $ olcIndexHash64 $ "
 		 "olcIndexIntLen $ "
-		 "olcListenerThreads $ olcLocalSSF $ olcLogFile $ olcLogLevel $ "
+		 "olcListenerCpus $ olcListenerThreads $ olcLocalSSF $ olcLogFile $ olcLogLevel $ "
 		 "olcPasswordCryptSaltFormat $ olcPasswordHash $ olcPidFile $ "
 		 "olcPluginLogFile $ olcReadOnly $ olcReferral $ "
 		 "olcReplogFile $ olcRequires $ olcRestrict $ olcReverseLookup $ "
@@ -958,7 +972,7 @@ static ConfigOCs cf_ocs[] = {
 		 "olcTLSCertificateKeyFile $ olcTLSCipherSuite $ olcTLSCRLCheck $ "
 		 "olcTLSCACertificate $ olcTLSCertificate $ olcTLSCertificateKey $ "
 		 "olcTLSRandFile $ olcTLSVerifyClient $ olcTLSDHParamFile $ olcTLSECName $ "
-		 "olcTLSCRLFile $ olcTLSProtocolMin $ olcToolThreads $ olcWriteTimeout $ "
+		 "olcTLSCRLFile $ olcTLSProtocolMin $ olcToolThreads $ olcWriteBatchDelay $ olcWriteBatchSize $ olcWriteTimeout $ "
 		 "olcObjectIdentifier $ olcAttributeTypes $ olcObjectClasses $ "
 		 "olcDitContentRules $ olcLdapSyntaxes ) )", Cft_Global },
 	{ "( OLcfgGlOc:2 "
@@ -1044,6 +1058,7 @@ typedef struct ADlist {
 static ADlist *sortVals;
 
 static int new_daemon_threads;
+static char *listener_cpus;
 
 static int
 config_resize_lthreads(ConfigArgs *c)
@@ -1073,6 +1088,12 @@ config_generic(ConfigArgs *c) {
 		case CFG_LTHREADS:
 			c->value_uint = slapd_daemon_threads;
 			break;
+		case CFG_LCPUS:
+			if ( listener_cpus )
+				c->value_string = ch_strdup( listener_cpus );
+			else
+				rc = 1;
+			break;
 		case CFG_SALT:
 			if ( passwd_salt )
 				c->value_string = ch_strdup( passwd_salt );
@@ -1484,6 +1505,12 @@ config_generic(ConfigArgs *c) {
 			rc = slap_sasl_rewrite_delete( c->valx );
 			break;
 
+		case CFG_LCPUS:
+			slapd_daemon_set_cpus( NULL );
+			ch_free( listener_cpus );
+			listener_cpus = NULL;
+			break;
+
 		case CFG_SALT:
 			ch_free( passwd_salt );
 			passwd_salt = NULL;
@@ -1852,6 +1879,19 @@ config_generic(ConfigArgs *c) {
 			}
 			break;
 
+		case CFG_LCPUS:
+			if ( slapd_daemon_set_cpus( c->value_string )) {
+				snprintf( c->cr_msg, sizeof( c->cr_msg ),
+					"invalid CPU list \"%s\"", c->value_string );
+				Debug(LDAP_DEBUG_ANY, "%s: %s.\n",
+					c->log, c->cr_msg );
+				ch_free( c->value_string );
+				return 1;
+			}
+			ch_free( listener_cpus );
+			listener_cpus = c->value_string;
+			break;
+
 		case CFG_SALT:
 			if ( passwd_salt ) ch_free( passwd_salt );
 			passwd_salt = c->value_string;
@@ -69,6 +69,8 @@ slap_mask_t		global_disallows = 0;
 int		global_gentlehup = 0;
 int		global_idletimeout = 0;
 int		global_writetimeout = 0;
+unsigned	global_writebatch_size = 0;
+unsigned	global_writebatch_delay = 10;
 char	*global_host = NULL;
 struct berval global_host_bv = BER_BVNULL;
 char	*global_realm = NULL;
@@ -397,6 +397,7 @@ Connection * connection_init(
 		}
 
 		c->c_currentber = NULL;
+		c->c_batch = NULL;
 
 #ifdef LDAP_SLAPI
 		if ( slapi_plugins_used ) {
@@ -659,6 +660,10 @@ connection_destroy( Connection *c )
 		c->c_currentber = NULL;
 	}
 
+	if ( c->c_batch != NULL ) {
+		ber_free( c->c_batch, 1 );
+		c->c_batch = NULL;
+	}
 
 #ifdef LDAP_SLAPI
 	/* call destructors, then constructors; avoids unnecessary allocation */
@@ -1530,7 +1535,7 @@ connection_input( Connection *conn , conn_readinfo *cri )
 	void *ctx;
 
 	if ( conn->c_currentber == NULL &&
-		( conn->c_currentber = ber_alloc()) == NULL )
+		( conn->c_currentber = slap_ber_alloc( cri->ctx )) == NULL )
 	{
 		Debug( LDAP_DEBUG_ANY, "ber_alloc failed\n" );
 		return -1;
@@ -24,6 +24,7 @@
  * is provided ``as is'' without express or implied warranty.
  */
 
+#define _GNU_SOURCE 1			/* Needed for glibc CPU_SET */
 #include "portable.h"
 
 #include <stdio.h>
@@ -45,12 +46,31 @@
 #include <poll.h>
 #endif
 
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+
+#if defined(HAVE_SCHED_H) && defined(__linux__)
+#include <sched.h>
+#ifdef CPU_SET
+#define SLAPD_CPU_AFFINITY	1
+#endif
+#endif
+
 #ifdef HAVE_KQUEUE
 # include <sys/types.h>
 # include <sys/event.h>
 # include <sys/time.h>
 #elif defined(HAVE_SYS_EPOLL_H) && defined(HAVE_EPOLL)
 # include <sys/epoll.h>
+# if defined(HAVE_LINUX_IO_URING_H) && defined(__linux__)
+#  include <sys/mman.h>
+#  include <sys/syscall.h>
+#  include <linux/io_uring.h>
+#  if defined(__NR_io_uring_setup) && defined(IORING_FEAT_EXT_ARG)
+#   define SLAP_IO_URING	1
+#  endif
+# endif
 #elif defined(SLAP_X_DEVPOLL) && defined(HAVE_SYS_DEVPOLL_H) && defined(HAVE_DEVPOLL)
 # include <sys/types.h>
 # include <sys/stat.h>
@@ -84,6 +104,22 @@ struct runqueue_s slapd_rq;
 int slapd_daemon_threads = 1;
 int slapd_daemon_mask;
 
+/* number of SO_REUSEPORT sockets to open for each TCP listener address */
+int slapd_reuseport;
+
+/* use io_uring instead of epoll for the listener threads if possible */
+int slapd_io_uring;
+
+/* CPUs to bind the listener threads to, thread i gets cpus[i % ncpus] */
+#define SLAPD_MAX_CPUS	64
+static int slapd_daemon_cpus[SLAPD_MAX_CPUS];
+static int slapd_daemon_ncpus;
+static volatile int slapd_daemon_cpugen;
+#ifdef SLAPD_CPU_AFFINITY
+/* the CPUs slapd was started on, restored when the list is cleared */
+static cpu_set_t slapd_daemon_cpuset;
+#endif /* SLAPD_CPU_AFFINITY */
+
 #ifdef LDAP_TCP_BUFFER
 int slapd_tcp_rmem;
 int slapd_tcp_wmem;
@@ -136,6 +172,10 @@ typedef struct slap_daemon_st {
 	int			sd_nfds;
 	ldap_pvt_thread_t	sd_tid;
 
+	/* only written by the listener thread itself */
+	unsigned long		sd_nwaits;	/* calls to SLAP_EVENT_WAIT */
+	unsigned long		sd_nevents;	/* descriptors it returned */
+
 #if defined(HAVE_KQUEUE)
 	uint8_t*        sd_fdmodes; /* indexed by fd */
 	Listener**      sd_l;       /* indexed by fd */
@@ -154,6 +194,9 @@ typedef struct slap_daemon_st {
 	struct epoll_event	*sd_epolls;
 	int			*sd_index;
 	int			sd_epfd;
+#ifdef SLAP_IO_URING
+	struct slap_uring	*sd_uring;	/* NULL when using epoll */
+#endif
 #elif defined(SLAP_X_DEVPOLL) && defined(HAVE_DEVPOLL)
 	/* eXperimental */
 	struct pollfd		*sd_pollfd;
@@ -418,19 +461,30 @@ static slap_daemon_st *slap_daemon;
 # define SLAP_SOCK_IS_READ(t,s)		SLAP_EPOLL_SOCK_IS_SET(t,(s), EPOLLIN)
 # define SLAP_SOCK_IS_WRITE(t,s)		SLAP_EPOLL_SOCK_IS_SET(t,(s), EPOLLOUT)
 
+/* With io_uring the interest set is kept here as for epoll, and
+ * changes to it are queued on the ring instead of calling epoll_ctl.
+ */
+# ifdef SLAP_IO_URING
+#  define SLAP_EPOLL_CTL(t, op, s)	( slap_daemon[t].sd_uring ? \
+	slap_uring_ctl( (t), (op), (s) ) : \
+	epoll_ctl( slap_daemon[t].sd_epfd, (op), (s), \
+		&SLAP_EPOLL_SOCK_EP(t,s) ))
+# else
+#  define SLAP_EPOLL_CTL(t, op, s) \
+	epoll_ctl( slap_daemon[t].sd_epfd, (op), (s), &SLAP_EPOLL_SOCK_EP(t,s) )
+# endif
+
 # define SLAP_EPOLL_SOCK_SET(t,s, mode)	do { \
 	if ( (SLAP_EPOLL_SOCK_EV(t,s) & (mode)) != (mode) ) {	\
 		SLAP_EPOLL_SOCK_EV(t,s) |= (mode); \
-		epoll_ctl( slap_daemon[t].sd_epfd, EPOLL_CTL_MOD, (s), \
-			&SLAP_EPOLL_SOCK_EP(t,s) ); \
+		SLAP_EPOLL_CTL( t, EPOLL_CTL_MOD, (s) ); \
 	} \
 } while (0)
 
 # define SLAP_EPOLL_SOCK_CLR(t,s, mode)	do { \
 	if ( (SLAP_EPOLL_SOCK_EV(t,s) & (mode)) ) { \
 		SLAP_EPOLL_SOCK_EV(t,s) &= ~(mode);	\
-		epoll_ctl( slap_daemon[t].sd_epfd, EPOLL_CTL_MOD, s, \
-			&SLAP_EPOLL_SOCK_EP(t,s) ); \
+		SLAP_EPOLL_CTL( t, EPOLL_CTL_MOD, (s) ); \
 	} \
 } while (0)
 
@@ -461,8 +515,7 @@ static slap_daemon_st *slap_daemon;
 	SLAP_EPOLL_SOCK_IX(t,(s)) = slap_daemon[t].sd_nfds; \
 	SLAP_EPOLL_SOCK_EP(t,(s)).data.ptr = (l) ? (l) : (void *)(&SLAP_EPOLL_SOCK_IX(t,s)); \
 	SLAP_EPOLL_SOCK_EV(t,(s)) = EPOLLIN; \
-	rc = epoll_ctl(slap_daemon[t].sd_epfd, EPOLL_CTL_ADD, \
-		(s), &SLAP_EPOLL_SOCK_EP(t,(s))); \
+	rc = SLAP_EPOLL_CTL( t, EPOLL_CTL_ADD, (s) ); \
 	if ( rc == 0 ) { \
 		slap_daemon[t].sd_nfds++; \
 	} else { \
@@ -484,8 +537,7 @@ static slap_daemon_st *slap_daemon;
 # define SLAP_SOCK_DEL(t,s)		do { \
 	int fd, rc, index = SLAP_EPOLL_SOCK_IX(t,(s)); \
 	if ( index < 0 ) break; \
-	rc = epoll_ctl(slap_daemon[t].sd_epfd, EPOLL_CTL_DEL, \
-		(s), &SLAP_EPOLL_SOCK_EP(t,(s))); \
+	rc = SLAP_EPOLL_CTL( t, EPOLL_CTL_DEL, (s) ); \
 	slap_daemon[t].sd_epolls[index] = \
 		slap_daemon[t].sd_epolls[slap_daemon[t].sd_nfds-1]; \
 	fd = SLAP_EPOLL_EV_PTRFD(t,slap_daemon[t].sd_epolls[index].data.ptr); \
@@ -506,6 +558,404 @@ static slap_daemon_st *slap_daemon;
 
 # define SLAP_EVENT_FD(t,i)		SLAP_EPOLL_EV_PTRFD(t,revents[(i)].data.ptr)
 
+# ifdef SLAP_IO_URING
+/*****************************************************************
+ * Optionally use io_uring(7) in place of the epoll descriptor.  *
+ * Each descriptor with a non-empty interest set has a one-shot  *
+ * poll request outstanding. Interest changes are queued on the  *
+ * submission ring and reach the kernel with the next wait, so a *
+ * loop iteration costs a single io_uring_enter() call however   *
+ * many connections were turned on and off in between.           *
+ *****************************************************************/
+
+# define SLAP_URING_ENTRIES	1024
+
+/* user_data of a poll is the descriptor and its generation, which is
+ * bumped whenever a poll on it is cancelled so late completions from
+ * the old one can be told apart. Cancellations themselves are tagged.
+ */
+# define SLAP_URING_REMOVE	((__u64)1 << 63)
+# define SLAP_URING_GENMASK	0x7fffffffU
+# define SLAP_URING_UD(su, s)	(((__u64)(su)->su_gen[(s)] << 32) | (unsigned)(s))
+
+typedef struct slap_uring {
+	int		su_fd;
+	unsigned	su_sqmask;
+	unsigned	su_sqtail;	/* our copy, published to *su_sqktail */
+	unsigned	*su_sqhead;
+	unsigned	*su_sqktail;
+	unsigned	su_cqmask;
+	unsigned	*su_cqhead;
+	unsigned	*su_cqtail;
+	struct io_uring_sqe	*su_sqes;
+	struct io_uring_cqe	*su_cqes;
+	void		*su_sqring;
+	void		*su_cqring;
+	size_t		su_sqsize;
+	size_t		su_cqsize;
+	size_t		su_sqesize;
+
+	/* indexed by descriptor */
+	unsigned char	*su_armed;	/* events of the outstanding poll */
+	unsigned char	*su_last;	/* events of the last poll submitted */
+	unsigned	*su_gen;
+
+	/* descriptors returned by the last wait, to be polled again */
+	int		*su_fired;
+	int		su_nfired;
+} slap_uring;
+
+static void
+slap_uring_close( slap_uring *su )
+{
+	if ( su->su_sqes && su->su_sqes != MAP_FAILED )
+		munmap( su->su_sqes, su->su_sqesize );
+	if ( su->su_cqring && su->su_cqring != MAP_FAILED &&
+		su->su_cqring != su->su_sqring )
+		munmap( su->su_cqring, su->su_cqsize );
+	if ( su->su_sqring && su->su_sqring != MAP_FAILED )
+		munmap( su->su_sqring, su->su_sqsize );
+	close( su->su_fd );
+	su->su_sqes = NULL;
+	su->su_sqring = su->su_cqring = NULL;
+}
+
+/* Set up the ring. Returns -1 with errno set if the kernel doesn't
+ * have io_uring, or lacks what we need (5.11 and later will do).
+ */
+static int
+slap_uring_open( slap_uring *su )
+{
+	struct io_uring_params p;
+	unsigned *array, i;
+	char *sq, *cq;
+
+	memset( &p, 0, sizeof(p) );
+	p.flags = IORING_SETUP_CQSIZE | IORING_SETUP_CLAMP;
+	p.cq_entries = 4 * SLAP_URING_ENTRIES;
+	su->su_fd = syscall( __NR_io_uring_setup, SLAP_URING_ENTRIES, &p );
+	if ( su->su_fd < 0 )
+		return -1;
+	if ( !( p.features & IORING_FEAT_EXT_ARG ) ||
+		!( p.features & IORING_FEAT_NODROP )) {
+		close( su->su_fd );
+		errno = ENOSYS;
+		return -1;
+	}
+
+	su->su_sqsize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	su->su_cqsize = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if ( p.features & IORING_FEAT_SINGLE_MMAP ) {
+		if ( su->su_cqsize > su->su_sqsize )
+			su->su_sqsize = su->su_cqsize;
+		su->su_cqsize = su->su_sqsize;
+	}
+	su->su_sqesize = p.sq_entries * sizeof(struct io_uring_sqe);
+
+	su->su_sqring = mmap( NULL, su->su_sqsize, PROT_READ|PROT_WRITE,
+		MAP_SHARED|MAP_POPULATE, su->su_fd, IORING_OFF_SQ_RING );
+	if ( su->su_sqring == MAP_FAILED )
+		goto fail;
+	if ( p.features & IORING_FEAT_SINGLE_MMAP ) {
+		su->su_cqring = su->su_sqring;
+	} else {
+		su->su_cqring = mmap( NULL, su->su_cqsize, PROT_READ|PROT_WRITE,
+			MAP_SHARED|MAP_POPULATE, su->su_fd, IORING_OFF_CQ_RING );
+		if ( su->su_cqring == MAP_FAILED )
+			goto fail;
+	}
+	su->su_sqes = mmap( NULL, su->su_sqesize, PROT_READ|PROT_WRITE,
+		MAP_SHARED|MAP_POPULATE, su->su_fd, IORING_OFF_SQES );
+	if ( su->su_sqes == MAP_FAILED )
+		goto fail;
+
+	sq = su->su_sqring;
+	cq = su->su_cqring;
+	su->su_sqhead = (unsigned *)( sq + p.sq_off.head );
+	su->su_sqktail = (unsigned *)( sq + p.sq_off.tail );
+	su->su_sqmask = *(unsigned *)( sq + p.sq_off.ring_mask );
+	su->su_sqtail = *su->su_sqktail;
+	array = (unsigned *)( sq + p.sq_off.array );
+	for ( i = 0; i < p.sq_entries; i++ )
+		array[i] = i;
+	su->su_cqhead = (unsigned *)( cq + p.cq_off.head );
+	su->su_cqtail = (unsigned *)( cq + p.cq_off.tail );
+	su->su_cqmask = *(unsigned *)( cq + p.cq_off.ring_mask );
+	su->su_cqes = (struct io_uring_cqe *)( cq + p.cq_off.cqes );
+	return 0;
+
+fail:
+	i = errno;
+	slap_uring_close( su );
+	errno = i;
+	return -1;
+}
+
+/* Hand the queued SQEs to the kernel, and wait for at least one
+ * completion if asked to.
+ */
+static int
+slap_uring_enter( slap_uring *su, unsigned n, int wait, struct timeval *tvp )
+{
+	struct io_uring_getevents_arg arg;
+	struct __kernel_timespec ts;
+
+	if ( !wait )
+		return n ? syscall( __NR_io_uring_enter, su->su_fd, n, 0, 0,
+			NULL, 0 ) : 0;
+
+	memset( &arg, 0, sizeof(arg) );
+	if ( tvp ) {
+		ts.tv_sec = tvp->tv_sec;
+		ts.tv_nsec = tvp->tv_usec * 1000;
+		arg.ts = (__u64)(uintptr_t)&ts;
+	}
+	return syscall( __NR_io_uring_enter, su->su_fd, n, 1,
+		IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg) );
+}
+
+/* Number of SQEs not yet consumed by the kernel */
+# define SLAP_URING_PENDING(su) \
+	((su)->su_sqtail - __atomic_load_n( (su)->su_sqhead, __ATOMIC_ACQUIRE ))
+
+/* Get a free SQE, call with sd_mutex held */
+static struct io_uring_sqe *
+slap_uring_sqe( slap_uring *su )
+{
+	struct io_uring_sqe *sqe;
+
+	if ( SLAP_URING_PENDING( su ) > su->su_sqmask ) {
+		/* Full, flush it. The listener thread may be waiting
+		 * in the kernel, but it is fine for us to submit.
+		 */
+		slap_uring_enter( su, SLAP_URING_PENDING( su ), 0, NULL );
+		if ( SLAP_URING_PENDING( su ) > su->su_sqmask ) {
+			Debug( LDAP_DEBUG_ANY,
+				"daemon: io_uring submission queue full, errno=%d, "
+				"shutting down\n", errno );
+			slapd_shutdown = 2;
+			return NULL;
+		}
+	}
+	sqe = &su->su_sqes[ su->su_sqtail & su->su_sqmask ];
+	memset( sqe, 0, sizeof(*sqe) );
+	return sqe;
+}
+
+static void
+slap_uring_push( slap_uring *su )
+{
+	su->su_sqtail++;
+	__atomic_store_n( su->su_sqktail, su->su_sqtail, __ATOMIC_RELEASE );
+}
+
+static void
+slap_uring_cancel( slap_uring *su, ber_socket_t s )
+{
+	struct io_uring_sqe *sqe = slap_uring_sqe( su );
+
+	if ( sqe ) {
+		sqe->opcode = IORING_OP_POLL_REMOVE;
+		sqe->fd = -1;
+		sqe->addr = SLAP_URING_UD( su, s );
+		sqe->user_data = SLAP_URING_REMOVE;
+		slap_uring_push( su );
+	}
+	su->su_armed[s] = 0;
+	su->su_gen[s] = ( su->su_gen[s] + 1 ) & SLAP_URING_GENMASK;
+}
+
+/* Bring the poll on s in line with its interest set. With EPOLLET
+ * set, i.e. after a hangup nobody was interested in, don't poll again
+ * for the same events so the hangup is reported only once, as epoll
+ * would.
+ */
+static void
+slap_uring_arm( int t, ber_socket_t s )
+{
+	slap_uring *su = slap_daemon[t].sd_uring;
+	struct io_uring_sqe *sqe;
+	unsigned want = 0;
+
+	if ( SLAP_SOCK_IS_ACTIVE( t, s ))
+		want = SLAP_EPOLL_SOCK_EV( t, s ) & ( EPOLLIN | EPOLLOUT );
+	if ( want == su->su_armed[s] )
+		return;
+	if ( su->su_armed[s] )
+		slap_uring_cancel( su, s );
+	if ( !want || (( SLAP_EPOLL_SOCK_EV( t, s ) & EPOLLET ) &&
+		want == su->su_last[s] ))
+		return;
+
+	sqe = slap_uring_sqe( su );
+	if ( !sqe )
+		return;
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = s;
+	/* poll(2) and epoll(7) use the same bit values on Linux */
+# ifdef WORDS_BIGENDIAN
+	sqe->poll32_events = ( want << 16 ) | ( want >> 16 );
+# else
+	sqe->poll32_events = want;
+# endif
+	sqe->user_data = SLAP_URING_UD( su, s );
+	slap_uring_push( su );
+	su->su_armed[s] = su->su_last[s] = want;
+}
+
+/* Stands in for epoll_ctl(), called with sd_mutex held */
+static int
+slap_uring_ctl( int t, int op, ber_socket_t s )
+{
+	slap_uring *su = slap_daemon[t].sd_uring;
+
+	switch ( op ) {
+	case EPOLL_CTL_ADD:
+		su->su_last[s] = 0;
+		break;
+	case EPOLL_CTL_DEL:
+		/* A pending poll holds a reference on the socket, get rid
+		 * of it now so that the connection really goes away when
+		 * the caller closes it.
+		 */
+		if ( su->su_armed[s] ) {
+			slap_uring_cancel( su, s );
+			slap_uring_enter( su, SLAP_URING_PENDING( su ), 0, NULL );
+		}
+		su->su_last[s] = 0;
+		return 0;
+	}
+	slap_uring_arm( t, s );
+	return 0;
+}
+
+/* Stands in for epoll_wait() */
+static int
+slap_uring_wait( int t, struct epoll_event *revents, struct timeval *tvp )
+{
+	slap_uring *su = slap_daemon[t].sd_uring;
+	unsigned head, tail;
+	int i, n = 0, rc, err;
+
+	ldap_pvt_thread_mutex_lock( &slap_daemon[t].sd_mutex );
+	for ( i = 0; i < su->su_nfired; i++ )
+		slap_uring_arm( t, su->su_fired[i] );
+	su->su_nfired = 0;
+	n = SLAP_URING_PENDING( su );
+	ldap_pvt_thread_mutex_unlock( &slap_daemon[t].sd_mutex );
+
+	rc = slap_uring_enter( su, n, 1, tvp );
+	err = errno;
+
+	n = 0;
+	ldap_pvt_thread_mutex_lock( &slap_daemon[t].sd_mutex );
+	head = *su->su_cqhead;
+	tail = __atomic_load_n( su->su_cqtail, __ATOMIC_ACQUIRE );
+	for ( ; head != tail && n < dtblsize; head++ ) {
+		struct io_uring_cqe *cqe = &su->su_cqes[ head & su->su_cqmask ];
+		ber_socket_t s = (unsigned)cqe->user_data;
+
+		if (( cqe->user_data & SLAP_URING_REMOVE ) ||
+			( cqe->user_data >> 32 ) != su->su_gen[s] )
+			continue;
+		su->su_armed[s] = 0;
+		if ( cqe->res < 0 ) {
+			Debug( LDAP_DEBUG_ANY,
+				"daemon: io_uring poll on %ld failed, errno=%d\n",
+				(long) s, -cqe->res );
+			continue;
+		}
+		if ( SLAP_SOCK_NOT_ACTIVE( t, s ))
+			continue;
+		revents[n].events = cqe->res;
+		revents[n].data.ptr = SLAP_EPOLL_SOCK_EP( t, s ).data.ptr;
+		su->su_fired[su->su_nfired++] = s;
+		n++;
+	}
+	__atomic_store_n( su->su_cqhead, head, __ATOMIC_RELEASE );
+	ldap_pvt_thread_mutex_unlock( &slap_daemon[t].sd_mutex );
+
+	if ( !n && rc < 0 && err != ETIME ) {
+		errno = err;
+		return -1;
+	}
+	return n;
+}
+
+static slap_uring *
+slap_uring_init( void )
+{
+	slap_uring *su = ch_calloc( 1, sizeof( slap_uring ));
+
+	if ( slap_uring_open( su ) < 0 ) {
+		Debug( LDAP_DEBUG_ANY,
+			"daemon: io_uring not available, errno=%d, using epoll\n",
+			errno );
+		ch_free( su );
+		return NULL;
+	}
+	su->su_armed = ch_calloc( dtblsize, 2 * sizeof(unsigned char) );
+	su->su_last = su->su_armed + dtblsize;
+	su->su_gen = ch_calloc( dtblsize, sizeof(unsigned) );
+	su->su_fired = ch_malloc( dtblsize * sizeof(int) );
+	return su;
+}
+
+static void
+slap_uring_destroy( slap_uring *su )
+{
+	slap_uring_close( su );
+	ch_free( su->su_armed );
+	ch_free( su->su_gen );
+	ch_free( su->su_fired );
+	ch_free( su );
+}
+
+/* The ring was set up before we forked, get a fresh one and poll
+ * everything again. If that fails, go back to epoll.
+ */
+static void
+slap_uring_reinit( int t )
+{
+	slap_uring *su = slap_daemon[t].sd_uring;
+	int i;
+
+	slap_uring_close( su );
+	if ( slap_uring_open( su ) < 0 ) {
+		Debug( LDAP_DEBUG_ANY,
+			"daemon: io_uring not available, errno=%d, using epoll\n",
+			errno );
+		slap_uring_destroy( su );
+		slap_daemon[t].sd_uring = NULL;
+	} else {
+		memset( su->su_armed, 0, dtblsize * 2 * sizeof(unsigned char) );
+		su->su_nfired = 0;
+	}
+	for ( i = 0; i < slap_daemon[t].sd_nfds; i++ ) {
+		struct epoll_event *ep = &slap_daemon[t].sd_epolls[i];
+		ber_socket_t s = SLAP_EPOLL_EV_PTRFD( t, ep->data.ptr );
+
+		(void)SLAP_EPOLL_CTL( t, EPOLL_CTL_ADD, s );
+	}
+}
+
+#  define SLAP_URING_INIT(t) \
+	( slap_daemon[t].sd_uring = slapd_io_uring ? slap_uring_init() : NULL )
+#  define SLAP_URING_INIT2() do { \
+	if ( slap_daemon[0].sd_uring ) slap_uring_reinit( 0 ); \
+} while (0)
+#  define SLAP_URING_DESTROY(t) do { \
+	if ( slap_daemon[t].sd_uring ) { \
+		slap_uring_destroy( slap_daemon[t].sd_uring ); \
+		slap_daemon[t].sd_uring = NULL; \
+	} \
+} while (0)
+# else /* ! SLAP_IO_URING */
+#  define SLAP_URING_INIT(t)
+#  define SLAP_URING_INIT2()
+#  define SLAP_URING_DESTROY(t)
+# endif /* ! SLAP_IO_URING */
+
 # define SLAP_SOCK_INIT(t)		do { \
 	int j; \
 	slap_daemon[t].sd_epolls = ch_calloc(1, \
@@ -514,12 +964,15 @@ static slap_daemon_st *slap_daemon;
 	slap_daemon[t].sd_index = (int *)&slap_daemon[t].sd_epolls[ 2 * dtblsize ]; \
 	slap_daemon[t].sd_epfd = epoll_create( dtblsize / slapd_daemon_threads ); \
 	for ( j = 0; j < dtblsize; j++ ) slap_daemon[t].sd_index[j] = -1; \
+	SLAP_URING_INIT(t); \
 } while (0)
 
-# define SLAP_SOCK_INIT2()
+/* an io_uring set up before a fork is replaced, like kqueue's */
+# define SLAP_SOCK_INIT2()		SLAP_URING_INIT2()
 
 # define SLAP_SOCK_DESTROY(t)		do { \
 	if ( slap_daemon[t].sd_epolls != NULL ) { \
+		SLAP_URING_DESTROY(t); \
 		ch_free( slap_daemon[t].sd_epolls ); \
 		slap_daemon[t].sd_epolls = NULL; \
 		slap_daemon[t].sd_index = NULL; \
@@ -533,10 +986,20 @@ static slap_daemon_st *slap_daemon;
 	revents = slap_daemon[t].sd_epolls + dtblsize; \
 } while (0)
 
-# define SLAP_EVENT_WAIT(t, tvp, nsp)	do { \
-	*(nsp) = epoll_wait( slap_daemon[t].sd_epfd, revents, \
-		dtblsize, (tvp) ? ((tvp)->tv_sec * 1000 + (tvp)->tv_usec / 1000) : -1 ); \
+# define SLAP_EPOLL_WAIT(t, tvp) \
+	epoll_wait( slap_daemon[t].sd_epfd, revents, \
+		dtblsize, (tvp) ? ((tvp)->tv_sec * 1000 + (tvp)->tv_usec / 1000) : -1 )
+
+# ifdef SLAP_IO_URING
+#  define SLAP_EVENT_WAIT(t, tvp, nsp)	do { \
+	*(nsp) = slap_daemon[t].sd_uring ? \
+		slap_uring_wait( (t), revents, (tvp) ) : SLAP_EPOLL_WAIT(t, tvp); \
+} while (0)
+# else /* ! SLAP_IO_URING */
+#  define SLAP_EVENT_WAIT(t, tvp, nsp)	do { \
+	*(nsp) = SLAP_EPOLL_WAIT(t, tvp); \
 } while (0)
+# endif /* ! SLAP_IO_URING */
 
 #elif defined(SLAP_X_DEVPOLL) && defined(HAVE_DEVPOLL)
 
@@ -1545,6 +2008,70 @@ errexit:
 	return -1;
 }
 
+#ifdef SO_REUSEPORT
+/* Open another socket on the address of listener l. All of them
+ * have SO_REUSEPORT set, so the kernel spreads the incoming
+ * connections over them and each listener thread can accept on
+ * its own socket.
+ */
+static Listener *
+slap_open_shard(
+	Listener *l,
+	int shard,
+	int addrlen )
+{
+	Listener *li;
+	ber_socket_t s;
+	int tmp, rc, err;
+
+	s = socket( l->sl_sa.sa_addr.sa_family, SOCK_STREAM, 0 );
+	if ( s == AC_SOCKET_INVALID ) {
+		err = sock_errno();
+		Debug( LDAP_DEBUG_ANY,
+			"daemon: %s shard %d socket() failed errno=%d (%s)\n",
+			l->sl_name.bv_val, shard, err, sock_errstr(err) );
+		return NULL;
+	}
+	if ( SLAP_SOCKNEW( s ) >= dtblsize ) {
+		Debug( LDAP_DEBUG_ANY,
+			"daemon: listener descriptor %ld is too great %ld\n",
+			(long) SLAP_SOCKNEW( s ), (long) dtblsize );
+		tcp_close( s );
+		return NULL;
+	}
+
+	tmp = 1;
+	(void) setsockopt( s, SOL_SOCKET, SO_REUSEADDR,
+		(char *) &tmp, sizeof(tmp) );
+	rc = setsockopt( s, SOL_SOCKET, SO_REUSEPORT,
+		(char *) &tmp, sizeof(tmp) );
+#if defined(LDAP_PF_INET6) && defined(IPV6_V6ONLY)
+	if ( rc == 0 && l->sl_sa.sa_addr.sa_family == AF_INET6 ) {
+		rc = setsockopt( s, IPPROTO_IPV6, IPV6_V6ONLY,
+			(char *) &tmp, sizeof(tmp) );
+	}
+#endif /* LDAP_PF_INET6 && IPV6_V6ONLY */
+	if ( rc == 0 )
+		rc = bind( s, &l->sl_sa.sa_addr, addrlen );
+	if ( rc ) {
+		err = sock_errno();
+		Debug( LDAP_DEBUG_ANY,
+			"daemon: %s shard %d bind failed errno=%d (%s)\n",
+			l->sl_name.bv_val, shard, err, sock_errstr(err) );
+		tcp_close( s );
+		return NULL;
+	}
+
+	li = ch_malloc( sizeof( Listener ) );
+	*li = *l;
+	li->sl_sd = SLAP_SOCKNEW( s );
+	li->sl_shard = shard;
+	ber_dupbv( &li->sl_url, &l->sl_url );
+	ber_dupbv( &li->sl_name, &l->sl_name );
+	return li;
+}
+#endif /* SO_REUSEPORT */
+
 static int
 slap_open_listener(
 	const char* url,
@@ -1580,6 +2107,8 @@ slap_open_listener(
 	l.sl_url.bv_val = NULL;
 	l.sl_mute = 0;
 	l.sl_busy = 0;
+	l.sl_shard = 0;
+	l.sl_accepts = 0;
 
 #ifndef HAVE_TLS
 	if( ldap_pvt_url_scheme2tls( lud->lud_scheme ) ) {
@@ -1662,6 +2191,7 @@ slap_open_listener(
 	psal = sal;
 	while ( *sal != NULL ) {
 		char *af;
+		int reuseport = 0;
 		switch( (*sal)->sa_family ) {
 		case AF_INET:
 			af = "IPv4";
@@ -1723,6 +2253,21 @@ slap_open_listener(
 					(long) l.sl_sd, err, sock_errstr(err) );
 			}
 #endif /* SO_REUSEADDR */
+#ifdef SO_REUSEPORT
+			if ( slapd_reuseport > 1 && socktype == SOCK_STREAM ) {
+				tmp = 1;
+				rc = setsockopt( s, SOL_SOCKET, SO_REUSEPORT,
+					(char *) &tmp, sizeof(tmp) );
+				if ( rc == AC_SOCKET_ERROR ) {
+					int err = sock_errno();
+					Debug( LDAP_DEBUG_ANY, "slapd(%ld): "
+						"setsockopt(SO_REUSEPORT) failed errno=%d (%s)\n",
+						(long) l.sl_sd, err, sock_errstr(err) );
+				} else {
+					reuseport = 1;
+				}
+			}
+#endif /* SO_REUSEPORT */
 		}
 
 		switch( (*sal)->sa_family ) {
@@ -1850,6 +2395,18 @@ slap_open_listener(
 		*li = l;
 		slap_listeners[*cur] = li;
 		(*cur)++;
+#ifdef SO_REUSEPORT
+		for ( tmp = 1; reuseport && tmp < slapd_reuseport; tmp++ ) {
+			Listener *ls = slap_open_shard( li, tmp, addrlen );
+			if ( ls == NULL )
+				break;
+			*listeners += 1;
+			slap_listeners = ch_realloc( slap_listeners,
+				(*listeners + 1) * sizeof(Listener *) );
+			slap_listeners[*cur] = ls;
+			(*cur)++;
+		}
+#endif /* SO_REUSEPORT */
 		sal++;
 	}
 
@@ -1888,6 +2445,15 @@ slapd_daemon_init( const char *urls )
 
 	slap_daemon = ch_calloc( slapd_daemon_threads, sizeof( slap_daemon_st ));
 	ldap_pvt_thread_mutex_init( &slap_daemon[0].sd_mutex );
+#ifdef SLAPD_CPU_AFFINITY
+	if ( sched_getaffinity( 0, sizeof( slapd_daemon_cpuset ),
+		&slapd_daemon_cpuset ) )
+	{
+		CPU_ZERO( &slapd_daemon_cpuset );
+		for ( i = 0; i < CPU_SETSIZE; i++ )
+			CPU_SET( i, &slapd_daemon_cpuset );
+	}
+#endif /* SLAPD_CPU_AFFINITY */
 #ifdef HAVE_TCPD
 	ldap_pvt_thread_mutex_init( &sd_tcpd_mutex );
 #endif /* TCP Wrappers */
@@ -2239,6 +2805,8 @@ slap_listener(
 	s = accept( SLAP_FD2SOCK( sl->sl_sd ), (struct sockaddr *) &from, &len );
 	if ( s != AC_SOCKET_INVALID ) {
 		SET_CLOSE(s);
+		/* still serialized by sl_busy */
+		sl->sl_accepts++;
 	}
 	Debug( LDAP_DEBUG_CONNS,
 		"daemon: accept() = %d\n", s );
@@ -2494,6 +3062,116 @@ slap_listener_activate(
 	return rc;
 }
 
+/* Bind the calling listener thread to its CPU, or to the CPUs
+ * slapd was started on when no list is configured.
+ */
+static void
+slapd_daemon_setcpu( int tid )
+{
+#ifdef SLAPD_CPU_AFFINITY
+	cpu_set_t set;
+	int n = slapd_daemon_ncpus;
+
+	if ( n ) {
+		CPU_ZERO( &set );
+		CPU_SET( slapd_daemon_cpus[tid % n], &set );
+	} else {
+		set = slapd_daemon_cpuset;
+	}
+	if ( sched_setaffinity( 0, sizeof( set ), &set ) ) {
+		int err = errno;
+		Debug( LDAP_DEBUG_ANY,
+			"daemon: listener thread %d: sched_setaffinity failed "
+			"errno=%d (%s)\n", tid, err, sock_errstr( err ) );
+	}
+#endif /* SLAPD_CPU_AFFINITY */
+}
+
+/* Set the CPUs for the listener threads from a list like "0,2,4-7".
+ * NULL or an empty list removes the binding.
+ */
+int
+slapd_daemon_set_cpus( const char *list )
+{
+	int cpus[SLAPD_MAX_CPUS];
+	int i, n = 0;
+	const char *p = list;
+	char *next;
+
+	while ( p && *p ) {
+		long lo, hi;
+
+		lo = hi = strtol( p, &next, 10 );
+		if ( next == p || lo < 0 )
+			return -1;
+		if ( *next == '-' ) {
+			p = next + 1;
+			hi = strtol( p, &next, 10 );
+			if ( next == p || hi < lo )
+				return -1;
+		}
+		for ( ; lo <= hi; lo++ ) {
+			if ( n == SLAPD_MAX_CPUS )
+				return -1;
+			cpus[n++] = lo;
+		}
+		p = next;
+		if ( *p == ',' )
+			p++;
+		else if ( *p )
+			return -1;
+	}
+#ifdef SLAPD_CPU_AFFINITY
+	for ( i = 0; i < n; i++ ) {
+		if ( cpus[i] >= CPU_SETSIZE )
+			return -1;
+	}
+#else
+	if ( n ) {
+		Debug( LDAP_DEBUG_ANY, "daemon: listener thread CPU binding "
+			"is not supported on this platform\n" );
+	}
+#endif /* SLAPD_CPU_AFFINITY */
+
+	for ( i = 0; i < n; i++ )
+		slapd_daemon_cpus[i] = cpus[i];
+	slapd_daemon_ncpus = n;
+	slapd_daemon_cpugen++;
+
+	/* let running listener threads pick up the change */
+	if ( slapMode & SLAP_SERVER_RUNNING ) {
+		for ( i = 0; i < slapd_daemon_threads; i++ )
+			WAKE_LISTENER( i, 1 );
+	}
+	return 0;
+}
+
+int
+slapd_daemon_stats( int tid, slap_daemon_stats *st )
+{
+	int l;
+
+	if ( tid < 0 || tid >= slapd_daemon_threads )
+		return -1;
+
+	st->sds_accepts = 0;
+	if ( listening ) {
+		for ( l = 0; slap_listeners[l] != NULL; l++ ) {
+			if ( slap_listeners[l]->sl_sd == AC_SOCKET_INVALID ) continue;
+			if ( DAEMON_ID( slap_listeners[l]->sl_sd ) != tid ) continue;
+			st->sds_accepts += slap_listeners[l]->sl_accepts;
+		}
+	}
+	st->sds_waits = slap_daemon[tid].sd_nwaits;
+	st->sds_events = slap_daemon[tid].sd_nevents;
+	ldap_pvt_thread_mutex_lock( &slap_daemon[tid].sd_mutex );
+	st->sds_conns = slap_daemon[tid].sd_nactives;
+	ldap_pvt_thread_mutex_unlock( &slap_daemon[tid].sd_mutex );
+	st->sds_cpu = slapd_daemon_ncpus ?
+		slapd_daemon_cpus[tid % slapd_daemon_ncpus] : -1;
+	return 0;
+}
+
 static void *
 slapd_daemon_task(
 	void *ptr )
@@ -2503,6 +3181,7 @@ slapd_daemon_task(
 	int ebadf = 0;
 	int tid = (slap_daemon_st *) ptr - slap_daemon;
 	int old_threads = slapd_daemon_threads;
+	int cpugen = 0;
 
 #define SLAPD_IDLE_CHECK_LIMIT 4
 
@@ -2732,6 +3411,11 @@ loop:
 		time_t			tdelta = 1;
 		struct re_s*		rtask;
 
+		if ( cpugen != slapd_daemon_cpugen ) {
+			cpugen = slapd_daemon_cpugen;
+			slapd_daemon_setcpu( tid );
+		}
+
 		now = slap_get_time();
 
 		if ( !tid && ( global_idletimeout > 0 )) {
@@ -2901,6 +3585,7 @@ loop:
 		}
 
 		SLAP_EVENT_WAIT( tid, tvp, &ns );
+		slap_daemon[tid].sd_nwaits++;
 		switch ( ns ) {
 		case -1: {	/* failure - try again */
 				int err = sock_errno();
@@ -2939,6 +3624,7 @@ loop:
 			if ( slapd_shutdown ) continue;
 
 			ebadf = 0;
+			slap_daemon[tid].sd_nevents += ns;
 			Debug( LDAP_DEBUG_CONNS,
 				"daemon: activity on %d descriptor%s\n",
 				ns, ns != 1 ? "s" : "" );
@@ -3258,6 +3944,64 @@ slapd_daemon_tid_cleanup(
 	return NULL;
 }
 
+/* The listener thread that handles a socket is picked by its
+ * descriptor number. Renumber the SO_REUSEPORT sockets of each
+ * address so that they go to consecutive threads, starting from
+ * the one handling the first socket. Once the listener threads
+ * are running, a moved socket is handed over to its new thread.
+ */
+static void
+slap_listener_place( int running )
+{
+#if defined(SO_REUSEPORT) && !defined(HAVE_WINSOCK)
+	ber_socket_t base = 0, fd, nfd = AC_SOCKET_INVALID, want;
+	int l;
+
+	if ( slapd_reuseport < 2 || slapd_daemon_threads < 2 )
+		return;
+
+	for ( l = 0; slap_listeners[l] != NULL; l++ ) {
+		Listener *lr = slap_listeners[l];
+
+		if ( lr->sl_sd == AC_SOCKET_INVALID ) continue;
+		if ( !lr->sl_shard ) {
+			base = DAEMON_ID( lr->sl_sd );
+			continue;
+		}
+		want = ( base + lr->sl_shard ) & slapd_daemon_mask;
+		if ( DAEMON_ID( lr->sl_sd ) == want ) continue;
+
+		/* find a free descriptor in the right slot. Unlike dup2,
+		 * F_DUPFD never takes one that was opened meanwhile.
+		 */
+		for ( fd = want; fd < dtblsize; fd += slapd_daemon_threads ) {
+			if ( fd <= 2 ) continue;
+			nfd = fcntl( lr->sl_sd, F_DUPFD, fd );
+			if ( nfd == fd || nfd < 0 ) break;
+			close( nfd );
+		}
+		if ( fd >= dtblsize || nfd != fd ) {
+			Debug( LDAP_DEBUG_ANY, "daemon: could not move listener "
+				"%ld to thread %ld\n", (long) lr->sl_sd, (long) want );
+			continue;
+		}
+		if ( running ) {
+			int oldid = DAEMON_ID( lr->sl_sd );
+
+			if ( SLAP_SOCK_IS_ACTIVE( oldid, lr->sl_sd )) {
+				SLAP_SOCK_ADD( want, fd, lr );
+				if ( SLAP_SOCK_IS_READ( oldid, lr->sl_sd ))
+					SLAP_SOCK_SET_READ( want, fd );
+				SLAP_SOCK_DEL( oldid, lr->sl_sd );
+				WAKE_LISTENER( want, 1 );
+			}
+		}
+		close( lr->sl_sd );
+		lr->sl_sd = fd;
+	}
+#endif /* SO_REUSEPORT && ! HAVE_WINSOCK */
+}
+
 int
 slapd_daemon_resize( int newnum )
 {
@@ -3338,6 +4082,9 @@ slapd_daemon_resize( int newnum )
 	}
 	slapd_daemon_threads = newnum;
 	slapd_daemon_mask = newnum - 1;
+
+	/* keep the shards of each address on consecutive threads */
+	slap_listener_place( 1 );
 	return 0;
 }
 
@@ -3381,6 +4128,8 @@ slapd_daemon( void )
 	connectionless_init();
 #endif /* LDAP_CONNECTIONLESS */
 
+	slap_listener_place( 0 );
+
 	SLAP_SOCK_INIT2();
 
 	/* daemon_init only inits element 0 */
@@ -139,6 +139,44 @@ slapd_opt_slp( const char *val, void *arg )
 #endif
 }
 
+static int
+slapd_opt_reuseport( const char *val, void *arg )
+{
+#ifdef SO_REUSEPORT
+	char *next;
+	long n;
+
+	n = val ? strtol( val, &next, 10 ) : 0;
+	if ( val == NULL || *next != '\0' || n < 0 || n > 1024 ) {
+		fprintf( stderr, "invalid value \"%s\" for reuseport option\n",
+			val ? val : "" );
+		return -1;
+	}
+	slapd_reuseport = n;
+	return 0;
+#else
+	fputs( "slapd: SO_REUSEPORT is not available\n", stderr );
+	return 0;
+#endif
+}
+
+static int
+slapd_opt_iouring( const char *val, void *arg )
+{
+	if ( val == NULL || strcasecmp( val, "on" ) == 0 ) {
+		slapd_io_uring = 1;
+
+	} else if ( strcasecmp( val, "off" ) == 0 ) {
+		slapd_io_uring = 0;
+
+	} else {
+		fprintf( stderr, "unrecognized value \"%s\" for iouring option\n",
+			val );
+		return -1;
+	}
+	return 0;
+}
+
 /*
  * Option helper structure:
  * 
@@ -159,6 +197,8 @@ struct option_helper {
 	const char	*oh_usage;
 } option_helpers[] = {
 	{ BER_BVC("slp"),	slapd_opt_slp,	NULL, "slp[={on|off|(attrs)}] enable/disable SLP using (attrs)" },
+	{ BER_BVC("reuseport"),	slapd_opt_reuseport,	NULL, "reuseport=<n> open <n> SO_REUSEPORT sockets for each TCP listener" },
+	{ BER_BVC("iouring"),	slapd_opt_iouring,	NULL, "iouring[={on|off}] use io_uring instead of epoll, if the kernel supports it" },
 	{ BER_BVNULL, 0, NULL, NULL }
 };
 
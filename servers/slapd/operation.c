@@ -41,6 +41,25 @@ static ldap_pvt_thread_mutex_t	slap_op_mutex;
 static time_t last_time;
 static int last_incr;
 
+/* Freed Operations and request BerElements are kept in a cache in
+ * the thread pool context of the thread that freed them, like the
+ * slab allocator, so allocating them again needs no lock.
+ */
+#define SLAP_OBJCACHE_MAX	10	/* objects of each kind per thread */
+
+typedef struct slap_objcache {
+	struct slap_objcache	*oc_next;	/* all caches, for statistics */
+	Operation	*oc_ops;
+	int		oc_nops;
+	int		oc_nbers;
+	BerElement	*oc_bers[SLAP_OBJCACHE_MAX];
+	slap_objcache_stats_t	oc_stats[SLAP_OBJ_LAST];
+} slap_objcache;
+
+static slap_objcache	*slap_objcaches;
+/* of the caches of exited threads */
+static slap_objcache_stats_t	slap_objcache_gone[SLAP_OBJ_LAST];
+
 void slap_op_init(void)
 {
 	ldap_pvt_thread_mutex_init( &slap_op_mutex );
@@ -52,13 +71,123 @@ void slap_op_destroy(void)
 }
 
 static void
-slap_op_q_destroy( void *key, void *data )
+slap_objcache_destroy( void *key, void *data )
 {
+	slap_objcache *oc = data, **prev;
 	Operation *op, *op2;
-	for ( op = data; op; op = op2 ) {
+	int i;
+
+	for ( op = oc->oc_ops; op; op = op2 ) {
 		op2 = LDAP_STAILQ_NEXT( op, o_next );
 		ber_memfree_x( op, NULL );
 	}
+	for ( i = 0; i < oc->oc_nbers; i++ ) {
+		ber_free( oc->oc_bers[i], 0 );
+	}
+
+	ldap_pvt_thread_mutex_lock( &slap_op_mutex );
+	for ( prev = &slap_objcaches; *prev; prev = &(*prev)->oc_next ) {
+		if ( *prev == oc ) {
+			*prev = oc->oc_next;
+			break;
+		}
+	}
+	for ( i = 0; i < SLAP_OBJ_LAST; i++ ) {
+		slap_objcache_gone[i].os_hits += oc->oc_stats[i].os_hits;
+		slap_objcache_gone[i].os_misses += oc->oc_stats[i].os_misses;
+		slap_objcache_gone[i].os_drops += oc->oc_stats[i].os_drops;
+	}
+	ldap_pvt_thread_mutex_unlock( &slap_op_mutex );
+
+	ch_free( oc );
+}
+
+static slap_objcache *
+slap_objcache_get( void *ctx )
+{
+	void *data = NULL;
+	slap_objcache *oc;
+
+	if ( ldap_pvt_thread_pool_getkey( ctx, (void *)slap_objcache_get,
+			&data, NULL ) == 0 && data != NULL )
+		return data;
+
+	oc = ch_calloc( 1, sizeof( slap_objcache ));
+	if ( ldap_pvt_thread_pool_setkey( ctx, (void *)slap_objcache_get,
+			oc, slap_objcache_destroy, NULL, NULL ) ) {
+		ch_free( oc );
+		return NULL;
+	}
+
+	ldap_pvt_thread_mutex_lock( &slap_op_mutex );
+	oc->oc_next = slap_objcaches;
+	slap_objcaches = oc;
+	ldap_pvt_thread_mutex_unlock( &slap_op_mutex );
+
+	return oc;
+}
+
+/* Sum of the statistics of all threads. The counters of running
+ * threads are read without locking, so they may lag a little.
+ */
+void
+slap_objcache_stats( slap_objcache_stats_t *stats )
+{
+	slap_objcache *oc;
+	int i;
+
+	ldap_pvt_thread_mutex_lock( &slap_op_mutex );
+	for ( i = 0; i < SLAP_OBJ_LAST; i++ ) {
+		stats[i] = slap_objcache_gone[i];
+		stats[i].os_cached = 0;
+	}
+	for ( oc = slap_objcaches; oc; oc = oc->oc_next ) {
+		for ( i = 0; i < SLAP_OBJ_LAST; i++ ) {
+			stats[i].os_hits += oc->oc_stats[i].os_hits;
+			stats[i].os_misses += oc->oc_stats[i].os_misses;
+			stats[i].os_drops += oc->oc_stats[i].os_drops;
+		}
+		stats[SLAP_OBJ_OPERATION].os_cached += oc->oc_nops;
+		stats[SLAP_OBJ_BER].os_cached += oc->oc_nbers;
+	}
+	ldap_pvt_thread_mutex_unlock( &slap_op_mutex );
+}
+
+/* A BerElement to read a request into */
+BerElement *
+slap_ber_alloc( void *ctx )
+{
+	slap_objcache *oc;
+	BerElement *ber;
+
+	if ( ctx && ( oc = slap_objcache_get( ctx )) != NULL ) {
+		if ( oc->oc_nbers ) {
+			oc->oc_stats[SLAP_OBJ_BER].os_hits++;
+			ber = oc->oc_bers[--oc->oc_nbers];
+			ber_init2( ber, NULL, 0 );
+			return ber;
+		}
+		oc->oc_stats[SLAP_OBJ_BER].os_misses++;
+	}
+
+	return ber_alloc();
+}
+
+void
+slap_ber_free( BerElement *ber, void *ctx )
+{
+	slap_objcache *oc;
+
+	if ( ctx && ( oc = slap_objcache_get( ctx )) != NULL ) {
+		if ( oc->oc_nbers < SLAP_OBJCACHE_MAX ) {
+			ber_free_buf( ber );
+			oc->oc_bers[oc->oc_nbers++] = ber;
+			return;
+		}
+		oc->oc_stats[SLAP_OBJ_BER].os_drops++;
+	}
+
+	ber_free( ber, 1 );
 }
 
 void
@@ -76,6 +205,7 @@ void
 slap_op_free( Operation *op, void *ctx )
 {
 	OperationBuffer *opbuf;
+	slap_objcache *oc;
 
 	assert( LDAP_STAILQ_NEXT(op, o_next) == NULL );
 
@@ -83,7 +213,7 @@ slap_op_free( Operation *op, void *ctx )
 	op->o_abandon = 1;
 
 	if ( op->o_ber != NULL ) {
-		ber_free( op->o_ber, 1 );
+		slap_ber_free( op->o_ber, ctx );
 	}
 	if ( !BER_BVISNULL( &op->o_dn ) ) {
 		ch_free( op->o_dn.bv_val );
@@ -135,25 +265,17 @@ slap_op_free( Operation *op, void *ctx )
 	memset( opbuf->ob_controls, 0, sizeof( opbuf->ob_controls ));
 	op->o_controls = opbuf->ob_controls;
 
-	if ( ctx ) {
-		Operation *op2 = NULL;
-		ldap_pvt_thread_pool_setkey( ctx, (void *)slap_op_free,
-			op, slap_op_q_destroy, (void **)&op2, NULL );
-		LDAP_STAILQ_NEXT( op, o_next ) = op2;
-		if ( op2 ) {
-			op->o_tincr = op2->o_tincr + 1;
-			/* No more than 10 ops on per-thread free list */
-			if ( op->o_tincr > 10 ) {
-				ldap_pvt_thread_pool_setkey( ctx, (void *)slap_op_free,
-					op2, slap_op_q_destroy, NULL, NULL );
-				ber_memfree_x( op, NULL );
-			}
-		} else {
-			op->o_tincr = 1;
+	if ( ctx && ( oc = slap_objcache_get( ctx )) != NULL ) {
+		if ( oc->oc_nops < SLAP_OBJCACHE_MAX ) {
+			LDAP_STAILQ_NEXT( op, o_next ) = oc->oc_ops;
+			oc->oc_ops = op;
+			oc->oc_nops++;
+			return;
 		}
-	} else {
-		ber_memfree_x( op, NULL );
+		oc->oc_stats[SLAP_OBJ_OPERATION].os_drops++;
 	}
+
+	ber_memfree_x( op, NULL );
 }
 
 void
@@ -183,17 +305,19 @@ slap_op_alloc(
 	void *ctx )
 {
 	Operation	*op = NULL;
+	slap_objcache	*oc;
 
-	if ( ctx ) {
-		void *otmp = NULL;
-		ldap_pvt_thread_pool_getkey( ctx, (void *)slap_op_free, &otmp, NULL );
-		if ( otmp ) {
-			op = otmp;
-			otmp = LDAP_STAILQ_NEXT( op, o_next );
-			ldap_pvt_thread_pool_setkey( ctx, (void *)slap_op_free,
-				otmp, slap_op_q_destroy, NULL, NULL );
+	if ( ctx && ( oc = slap_objcache_get( ctx )) != NULL ) {
+		if ( oc->oc_ops ) {
+			oc->oc_stats[SLAP_OBJ_OPERATION].os_hits++;
+			op = oc->oc_ops;
+			oc->oc_ops = LDAP_STAILQ_NEXT( op, o_next );
+			oc->oc_nops--;
+			LDAP_STAILQ_NEXT( op, o_next ) = NULL;
 			op->o_abandon = 0;
 			op->o_cancel = 0;
+		} else {
+			oc->oc_stats[SLAP_OBJ_OPERATION].os_misses++;
 		}
 	}
 	if (!op) {
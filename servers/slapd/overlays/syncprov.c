@@ -28,6 +28,14 @@
 #include "config.h"
 #include "ldap_rq.h"
 
+/* The persistent sessionlog needs liblmdb, which is only linked into
+ * slapd along with a static back-mdb; the dynamic module carries its own.
+ */
+#if SLAPD_OVER_SYNCPROV == SLAPD_MOD_DYNAMIC || SLAPD_MDB == SLAPD_MOD_STATIC
+#define SYNCPROV_SLOG_MDB	1
+#include "lmdb.h"
+#endif
+
 #ifdef LDAP_DEVEL
 #define	CHECK_CSN	1
 #endif
@@ -68,6 +76,14 @@ typedef struct syncres {
 	char s_mode;
 } syncres;
 
+/* An attribute, and optionally a value of it, that an entry must have
+ * to match a persistent search filter. See syncprov_fkeys().
+ */
+typedef struct syncfkey {
+	AttributeDescription *fk_desc;
+	struct berval	fk_val;		/* BER_BVNULL for any value */
+} syncfkey;
+
 /* Record of a persistent search */
 typedef struct syncops {
 	struct syncops *s_next;
@@ -87,6 +103,8 @@ typedef struct syncops {
 #define	PS_TASK_QUEUED		0x20
 
 	int		s_inuse;	/* reference count */
+	syncfkey	*s_keys;	/* an entry matching the filter has one of these */
+	int		s_nkeys;	/* -1 if the filter has no keys */
 	struct syncres *s_res;
 	struct syncres *s_restail;
 	void *s_pool_cookie;
@@ -134,9 +152,22 @@ typedef struct sessionlog {
 	int		sl_playing;
 	slog_entry *sl_head;
 	slog_entry *sl_tail;
+#ifdef SYNCPROV_SLOG_MDB
+	MDB_env	*sl_env;	/* persistent log, replaces the list when set */
+	MDB_dbi	sl_dbi;		/* CSN -> tag, UUID */
+	MDB_dbi	sl_meta;	/* mincsn and clean shutdown marker */
+#endif
 	ldap_pvt_thread_mutex_t sl_mutex;
 } sessionlog;
 
+#ifdef SYNCPROV_SLOG_MDB
+/* A persistent record is the op tag followed by the entryUUID */
+#define SLOG_RECLEN		(1 + UUID_LEN)
+/* Map size per logged op, generous enough for B-tree slack */
+#define SLOG_MDB_OPSIZE	256
+#define SLOG_MDB_MINSIZE	(16 * 1048576)
+#endif
+
 /* Accesslog callback data */
 typedef struct syncprov_accesslog_deletes {
 	Operation *op;
@@ -169,6 +200,8 @@ typedef struct syncprov_info_t {
 	time_t	si_chklast;	/* time of last checkpoint */
 	Avlnode	*si_mods;	/* entries being modified */
 	sessionlog	*si_logs;
+	char	*si_logdir;	/* directory of the persistent sessionlog */
+	int		si_logage;	/* max age of sessionlog entries in seconds */
 	ldap_pvt_thread_rdwr_t	si_csn_rwlock;
 	ldap_pvt_thread_mutex_t	si_ops_mutex;
 	ldap_pvt_thread_mutex_t	si_mods_mutex;
@@ -885,6 +918,7 @@ syncprov_free_syncop( syncops *so, int flags )
 		ch_free( so->s_op );
 	}
 	ch_free( so->s_base.bv_val );
+	ch_free( so->s_keys );
 	for ( sr=so->s_res; sr; sr=srnext ) {
 		srnext = sr->s_next;
 		free_resinfo( sr );
@@ -1256,6 +1290,170 @@ syncprov_op_abandon( Operation *op, SlapReply *rs )
 	return SLAP_CB_CONTINUE;
 }
 
+/* An equality value can be a key if at and all its subtypes use the
+ * same equality rule, the one the filter value was normalized for.
+ * syncprov_fkeys_test() then matches it just like test_ava_filter().
+ */
+static int
+syncprov_fkey_exact( AttributeType *at )
+{
+	int i;
+
+	if ( !at->sat_equality ||
+		( at->sat_flags & SLAP_AT_ORDERED ))
+		return 0;
+	if ( at->sat_subtypes ) {
+		for ( i = 0; at->sat_subtypes[i]; i++ ) {
+			if ( at->sat_subtypes[i]->sat_equality != at->sat_equality ||
+				!syncprov_fkey_exact( at->sat_subtypes[i] ))
+				return 0;
+		}
+	}
+	return 1;
+}
+
+/* Collect keys for a filter: an entry that matches it has an attribute
+ * (or a subtype of it) named by at least one key, with the key's value
+ * if it has one. Returns the number of keys, or -1 if the filter has
+ * none, e.g. for NOT or for attributes that are not stored in entries.
+ * For an AND the keys of one term are enough; prefer terms with values.
+ * Values point into the filter.
+ */
+static int
+syncprov_fkeys( Filter *f, syncfkey **keys )
+{
+	AttributeDescription *ad;
+	syncfkey *k2;
+	Filter *f2;
+	int n, n2, v, v2;
+
+	*keys = NULL;
+	switch ( f->f_choice ) {
+	case LDAP_FILTER_EQUALITY:
+	case LDAP_FILTER_APPROX:
+	case LDAP_FILTER_GE:
+	case LDAP_FILTER_LE:
+		ad = f->f_av_desc;
+		break;
+	case LDAP_FILTER_SUBSTRINGS:
+		ad = f->f_sub_desc;
+		break;
+	case LDAP_FILTER_PRESENT:
+		ad = f->f_desc;
+		break;
+
+	case LDAP_FILTER_AND:
+		n = -1;
+		v = 0;
+		for ( f2 = f->f_and; f2; f2 = f2->f_next ) {
+			n2 = syncprov_fkeys( f2, &k2 );
+			if ( n2 < 0 )
+				continue;
+			for ( v2 = 0; v2 < n2 && !BER_BVISNULL( &k2[v2].fk_val ); v2++ ) ;
+			v2 = ( v2 == n2 );
+			if ( n < 0 || v2 > v || ( v2 == v && n2 < n )) {
+				ch_free( *keys );
+				*keys = k2;
+				n = n2;
+				v = v2;
+			} else {
+				ch_free( k2 );
+			}
+		}
+		return n;
+
+	case LDAP_FILTER_OR:
+		n = 0;
+		for ( f2 = f->f_or; f2; f2 = f2->f_next ) {
+			n2 = syncprov_fkeys( f2, &k2 );
+			if ( n2 < 0 ) {
+				ch_free( *keys );
+				*keys = NULL;
+				return -1;
+			}
+			if ( n2 ) {
+				*keys = ch_realloc( *keys, ( n + n2 ) * sizeof( syncfkey ));
+				AC_MEMCPY( *keys + n, k2, n2 * sizeof( syncfkey ));
+				n += n2;
+				ch_free( k2 );
+			}
+		}
+		return n;
+
+	default:
+		return -1;
+	}
+
+	if ( ad == slap_schema.si_ad_entryDN ||
+		ad == slap_schema.si_ad_subschemaSubentry ||
+		ad == slap_schema.si_ad_hasSubordinates )
+		return -1;
+
+	*keys = ch_malloc( sizeof( syncfkey ));
+	(*keys)->fk_desc = ad->ad_type->sat_ad;
+	if ( f->f_choice == LDAP_FILTER_EQUALITY &&
+#ifdef LDAP_COMP_MATCH
+		!f->f_ava->aa_cf &&
+#endif
+		syncprov_fkey_exact( ad->ad_type ))
+		(*keys)->fk_val = f->f_av_value;
+	else
+		BER_BVZERO( &(*keys)->fk_val );
+	return 1;
+}
+
+/* Set up the keys of a new psearch, with its own copy of the values */
+static void
+syncprov_fkeys_init( syncops *so, Filter *f )
+{
+	syncfkey *keys;
+	ber_len_t len = 0;
+	char *ptr;
+	int i;
+
+	so->s_keys = NULL;
+	so->s_nkeys = syncprov_fkeys( f, &keys );
+	if ( so->s_nkeys <= 0 )
+		return;
+	for ( i = 0; i < so->s_nkeys; i++ )
+		len += keys[i].fk_val.bv_len;
+	so->s_keys = ch_malloc( so->s_nkeys * sizeof( syncfkey ) + len );
+	ptr = (char *)( so->s_keys + so->s_nkeys );
+	for ( i = 0; i < so->s_nkeys; i++ ) {
+		so->s_keys[i] = keys[i];
+		if ( !BER_BVISNULL( &keys[i].fk_val )) {
+			so->s_keys[i].fk_val.bv_val = ptr;
+			AC_MEMCPY( ptr, keys[i].fk_val.bv_val, keys[i].fk_val.bv_len );
+			ptr += keys[i].fk_val.bv_len;
+		}
+	}
+	ch_free( keys );
+}
+
+/* Could e match the filter of so? Only a cheap check of its keys */
+static int
+syncprov_fkeys_test( syncops *so, Entry *e )
+{
+	Attribute *a;
+	int i;
+
+	if ( so->s_nkeys < 0 )
+		return 1;
+	for ( i = 0; i < so->s_nkeys; i++ ) {
+		syncfkey *fk = &so->s_keys[i];
+		for ( a = attrs_find( e->e_attrs, fk->fk_desc ); a;
+			a = attrs_find( a->a_next, fk->fk_desc )) {
+			if ( BER_BVISNULL( &fk->fk_val ) ||
+				attr_valfind( a, SLAP_MR_EQUALITY |
+					SLAP_MR_ASSERTED_VALUE_NORMALIZED_MATCH |
+					SLAP_MR_ATTRIBUTE_VALUE_NORMALIZED_MATCH,
+					&fk->fk_val, NULL, NULL ) == LDAP_SUCCESS )
+				return 1;
+		}
+	}
+	return 0;
+}
+
 /* Find which persistent searches are affected by this operation */
 static void
 syncprov_matchops( Operation *op, opcookie *opc, int saveit )
@@ -1270,6 +1468,7 @@ syncprov_matchops( Operation *op, opcookie *opc, int saveit )
 	int rc, gonext;
 	struct berval newdn;
 	int freefdn = 0;
+	int nops = 0, ntests = 0, nskips = 0;
 	BackendDB *b0 = op->o_bd, db;
 
 	fc.fdn = &op->o_req_ndn;
@@ -1338,6 +1537,7 @@ syncprov_matchops( Operation *op, opcookie *opc, int saveit )
 		syncops *snext, *ss = *pss;
 
 		gonext = 1;
+		nops++;
 		if ( ss->s_op->o_abandon )
 			continue;
 
@@ -1397,7 +1597,12 @@ syncprov_matchops( Operation *op, opcookie *opc, int saveit )
 			}
 		}
 
-		if ( fc.fscope ) {
+		if ( fc.fscope && !syncprov_fkeys_test( ss, e )) {
+			/* the filter can't match, don't bother testing it */
+			rc = LDAP_COMPARE_FALSE;
+			nskips++;
+		} else if ( fc.fscope ) {
+			ntests++;
 			ldap_pvt_thread_mutex_lock( &ss->s_mutex );
 			op2 = *ss->s_op;
 			oh = *op->o_hdr;
@@ -1455,6 +1660,11 @@ syncprov_matchops( Operation *op, opcookie *opc, int saveit )
 	}
 	ldap_pvt_thread_mutex_unlock( &si->si_ops_mutex );
 
+	Debug( LDAP_DEBUG_SYNC, "%s syncprov_matchops: %s check, "
+		"%d psearches, %d filters tested, %d ruled out by keys\n",
+		op->o_log_prefix, saveit ? "initial" : "final",
+		nops, ntests, nskips );
+
 	if ( op->o_tag != LDAP_REQ_ADD && e ) {
 		if ( !SLAP_ISOVERLAY( op->o_bd )) {
 			op->o_bd = &db;
@@ -1610,6 +1820,292 @@ syncprov_checkpoint( Operation *op, slap_overinst *on )
 #endif
 }
 
+/* Length of the "YYYYmmddHHMMSS" timestamp that leads every CSN */
+#define SLOG_TSLEN	14
+
+/* Is this log entry older than the sessionlog's max age? */
+static int
+syncprov_slog_tooold( struct berval *csn, struct berval *cutoff )
+{
+	return !BER_BVISNULL( cutoff ) && csn->bv_len >= SLOG_TSLEN &&
+		memcmp( csn->bv_val, cutoff->bv_val, SLOG_TSLEN ) < 0;
+}
+
+/* Remember the newest CSN we dropped for this SID, consumers whose
+ * state is older than that can no longer be served from the log.
+ */
+static void
+syncprov_slog_expire( Operation *op, sessionlog *sl, struct berval *csn,
+	int sid )
+{
+	int i;
+
+	for ( i=0; i<sl->sl_numcsns; i++ )
+		if ( sl->sl_sids[i] >= sid )
+			break;
+	if  ( i == sl->sl_numcsns || sl->sl_sids[i] != sid ) {
+		Debug( LDAP_DEBUG_SYNC, "%s syncprov_add_slog: "
+			"adding csn=%s to mincsn\n",
+			op->o_log_prefix, csn->bv_val );
+		slap_insert_csn_sids( (struct sync_cookie *)sl,
+			i, sid, csn );
+	} else {
+		Debug( LDAP_DEBUG_SYNC, "%s syncprov_add_slog: "
+			"updating mincsn for sid=%d csn=%s to %s\n",
+			op->o_log_prefix, sid, sl->sl_mincsn[i].bv_val, csn->bv_val );
+		ber_bvreplace( &sl->sl_mincsn[i], csn );
+	}
+}
+
+#ifdef SYNCPROV_SLOG_MDB
+/* Keys of the sessionlog meta database */
+static struct berval slog_mincsn_key = BER_BVC("mincsn");
+static struct berval slog_clean_key = BER_BVC("contextCSN");
+
+/* Store a CSN set as a sequence of NUL terminated strings */
+static int
+syncprov_slog_putcsns( MDB_txn *txn, MDB_dbi dbi, struct berval *name,
+	BerVarray csns, int num )
+{
+	MDB_val key, data;
+	char *ptr;
+	int i, rc;
+
+	key.mv_data = name->bv_val;
+	key.mv_size = name->bv_len;
+	if ( !num ) {
+		rc = mdb_del( txn, dbi, &key, NULL );
+		return rc == MDB_NOTFOUND ? 0 : rc;
+	}
+	data.mv_size = 0;
+	for ( i=0; i<num; i++ )
+		data.mv_size += csns[i].bv_len + 1;
+	rc = mdb_put( txn, dbi, &key, &data, MDB_RESERVE );
+	if ( rc )
+		return rc;
+	ptr = data.mv_data;
+	for ( i=0; i<num; i++ ) {
+		AC_MEMCPY( ptr, csns[i].bv_val, csns[i].bv_len );
+		ptr += csns[i].bv_len;
+		*ptr++ = '\0';
+	}
+	return 0;
+}
+
+static int
+syncprov_slog_getcsns( MDB_txn *txn, MDB_dbi dbi, struct berval *name,
+	BerVarray *csns )
+{
+	MDB_val key, data;
+	struct berval bv;
+	char *ptr, *end;
+	int rc;
+
+	*csns = NULL;
+	key.mv_data = name->bv_val;
+	key.mv_size = name->bv_len;
+	rc = mdb_get( txn, dbi, &key, &data );
+	if ( rc )
+		return rc;
+	ptr = data.mv_data;
+	end = ptr + data.mv_size;
+	while ( ptr < end ) {
+		bv.bv_val = ptr;
+		bv.bv_len = strlen( ptr );
+		value_add_one( csns, &bv );
+		ptr += bv.bv_len + 1;
+	}
+	return 0;
+}
+
+/* Something went wrong: forget the logged changes and start over from
+ * the current contextCSN. If even that fails, fall back to the in-memory
+ * log. Must be called with sl_mutex held.
+ */
+static void
+syncprov_slog_reset( syncprov_info_t *si )
+{
+	sessionlog *sl = si->si_logs;
+	MDB_txn *txn;
+	int i, rc;
+
+	if ( sl->sl_mincsn ) {
+		ber_bvarray_free( sl->sl_mincsn );
+		sl->sl_mincsn = NULL;
+	}
+	if ( sl->sl_sids ) {
+		ch_free( sl->sl_sids );
+		sl->sl_sids = NULL;
+	}
+	sl->sl_numcsns = 0;
+	sl->sl_num = 0;
+
+	ldap_pvt_thread_rdwr_rlock( &si->si_csn_rwlock );
+	if ( si->si_numcsns ) {
+		ber_bvarray_dup_x( &sl->sl_mincsn, si->si_ctxcsn, NULL );
+		sl->sl_numcsns = si->si_numcsns;
+		sl->sl_sids = ch_malloc( si->si_numcsns * sizeof(int) );
+		for ( i=0; i < si->si_numcsns; i++ )
+			sl->sl_sids[i] = si->si_sids[i];
+	}
+	ldap_pvt_thread_rdwr_runlock( &si->si_csn_rwlock );
+
+	rc = mdb_txn_begin( sl->sl_env, NULL, 0, &txn );
+	if ( rc == 0 ) {
+		rc = mdb_drop( txn, sl->sl_dbi, 0 );
+		if ( rc == 0 )
+			rc = mdb_drop( txn, sl->sl_meta, 0 );
+		if ( rc == 0 )
+			rc = syncprov_slog_putcsns( txn, sl->sl_meta, &slog_mincsn_key,
+				sl->sl_mincsn, sl->sl_numcsns );
+		if ( rc == 0 )
+			rc = mdb_txn_commit( txn );
+		else
+			mdb_txn_abort( txn );
+	}
+	if ( rc ) {
+		Debug( LDAP_DEBUG_ANY, "syncprov_slog_reset: "
+			"cannot reset sessionlog in \"%s\": %s (%d), "
+			"keeping it in memory instead\n",
+			si->si_logdir, mdb_strerror( rc ), rc );
+		mdb_env_close( sl->sl_env );
+		sl->sl_env = NULL;
+	}
+}
+
+static void
+syncprov_add_mdblog( Operation *op, syncprov_info_t *si, struct berval *uuid )
+{
+	sessionlog *sl = si->si_logs;
+	MDB_txn *txn = NULL;
+	MDB_cursor *mc;
+	MDB_val key, data;
+	struct berval cutoff = BER_BVNULL, csn;
+	char rec[SLOG_RECLEN], csnbuf[LDAP_PVT_CSNSTR_BUFSIZE],
+		 cutbuf[LDAP_LUTIL_GENTIME_BUFSIZE];
+	int rc, expired = 0;
+
+	ldap_pvt_thread_mutex_lock( &sl->sl_mutex );
+	rc = mdb_txn_begin( sl->sl_env, NULL, 0, &txn );
+	if ( rc )
+		goto fail;
+
+	if ( BER_BVISEMPTY( &op->o_csn ) ) {
+		/* See syncprov_add_slog, readers have their own snapshot
+		 * so there's no need to wait for them.
+		 */
+		rc = mdb_drop( txn, sl->sl_dbi, 0 );
+		if ( rc )
+			goto fail;
+		sl->sl_num = 0;
+		goto commit;
+	}
+
+	if ( LogTest( LDAP_DEBUG_SYNC ) ) {
+		char uuidstr[40] = {};
+		if ( !BER_BVISEMPTY( uuid ) ) {
+			lutil_uuidstr_from_normalized( uuid->bv_val, uuid->bv_len,
+				uuidstr, 40 );
+		}
+
+		Debug( LDAP_DEBUG_SYNC, "%s syncprov_add_slog: "
+			"adding csn=%s to sessionlog, uuid=%s\n",
+			op->o_log_prefix, op->o_csn.bv_val, uuidstr );
+	}
+
+	/* CSNs sort in time order, so the key order is the log order */
+	rec[0] = op->o_tag;
+	memset( rec + 1, 0, UUID_LEN );
+	AC_MEMCPY( rec + 1, uuid->bv_val,
+		uuid->bv_len < UUID_LEN ? uuid->bv_len : UUID_LEN );
+	key.mv_data = op->o_csn.bv_val;
+	key.mv_size = op->o_csn.bv_len;
+	data.mv_data = rec;
+	data.mv_size = SLOG_RECLEN;
+	rc = mdb_put( txn, sl->sl_dbi, &key, &data, MDB_NODUPDATA );
+	if ( rc == MDB_KEYEXIST ) {
+		mdb_txn_abort( txn );
+		ldap_pvt_thread_mutex_unlock( &sl->sl_mutex );
+		return;
+	}
+	if ( rc )
+		goto fail;
+
+	if ( !sl->sl_mincsn ) {
+		sl->sl_numcsns = 1;
+		sl->sl_mincsn = ch_malloc( 2*sizeof( struct berval ));
+		sl->sl_sids = ch_malloc( sizeof( int ));
+		sl->sl_sids[0] = slap_parse_csn_sid( &op->o_csn );
+		ber_dupbv( sl->sl_mincsn, &op->o_csn );
+		BER_BVZERO( &sl->sl_mincsn[1] );
+		expired = 1;
+	}
+	sl->sl_num++;
+
+	if ( si->si_logage ) {
+		time_t oldest = op->o_time - si->si_logage;
+
+		cutoff.bv_val = cutbuf;
+		cutoff.bv_len = sizeof( cutbuf );
+		slap_timestamp( &oldest, &cutoff );
+	}
+
+	rc = mdb_cursor_open( txn, sl->sl_dbi, &mc );
+	if ( rc )
+		goto fail;
+	while ( (rc = mdb_cursor_get( mc, &key, &data, MDB_FIRST )) == 0 ) {
+		if ( key.mv_size >= sizeof( csnbuf ) || data.mv_size != SLOG_RECLEN ) {
+			rc = MDB_CORRUPTED;
+			break;
+		}
+		csn.bv_val = csnbuf;
+		csn.bv_len = key.mv_size;
+		AC_MEMCPY( csnbuf, key.mv_data, key.mv_size );
+		csnbuf[key.mv_size] = '\0';
+
+		if ( sl->sl_num <= sl->sl_size && !syncprov_slog_tooold( &csn, &cutoff ) )
+			break;
+
+		Debug( LDAP_DEBUG_SYNC, "%s syncprov_add_slog: "
+			"expiring csn=%s from sessionlog (sessionlog size=%d)\n",
+			op->o_log_prefix, csn.bv_val, sl->sl_num );
+		syncprov_slog_expire( op, sl, &csn, slap_parse_csn_sid( &csn ) );
+		rc = mdb_cursor_del( mc, 0 );
+		if ( rc )
+			break;
+		sl->sl_num--;
+		expired = 1;
+	}
+	mdb_cursor_close( mc );
+	if ( rc && rc != MDB_NOTFOUND )
+		goto fail;
+
+	if ( expired ) {
+		rc = syncprov_slog_putcsns( txn, sl->sl_meta, &slog_mincsn_key,
+			sl->sl_mincsn, sl->sl_numcsns );
+		if ( rc )
+			goto fail;
+	}
+
+commit:
+	rc = mdb_txn_commit( txn );
+	txn = NULL;
+	if ( rc )
+		goto fail;
+	ldap_pvt_thread_mutex_unlock( &sl->sl_mutex );
+	return;
+
+fail:
+	Debug( LDAP_DEBUG_ANY, "%s syncprov_add_slog: "
+		"sessionlog update failed: %s (%d), resetting it\n",
+		op->o_log_prefix, mdb_strerror( rc ), rc );
+	if ( txn )
+		mdb_txn_abort( txn );
+	syncprov_slog_reset( si );
+	ldap_pvt_thread_mutex_unlock( &sl->sl_mutex );
+}
+#endif /* SYNCPROV_SLOG_MDB */
+
 static void
 syncprov_add_slog( Operation *op )
 {
@@ -1618,8 +2114,16 @@ syncprov_add_slog( Operation *op )
 	syncprov_info_t		*si = on->on_bi.bi_private;
 	sessionlog *sl;
 	slog_entry *se;
+	struct berval cutoff = BER_BVNULL;
+	char cutbuf[LDAP_LUTIL_GENTIME_BUFSIZE];
 
 	sl = si->si_logs;
+#ifdef SYNCPROV_SLOG_MDB
+	if ( sl->sl_env ) {
+		syncprov_add_mdblog( op, si, &opc->suuid );
+		return;
+	}
+#endif
 	{
 		if ( BER_BVISEMPTY( &op->o_csn ) ) {
 			/* During the syncrepl refresh phase we can receive operations
@@ -1698,31 +2202,28 @@ syncprov_add_slog( Operation *op )
 			}
 		}
 		sl->sl_num++;
+		if ( si->si_logage ) {
+			time_t oldest = op->o_time - si->si_logage;
+
+			cutoff.bv_val = cutbuf;
+			cutoff.bv_len = sizeof( cutbuf );
+			slap_timestamp( &oldest, &cutoff );
+		}
 		if (!sl->sl_playing) {
-		while ( sl->sl_num > sl->sl_size ) {
-			int i;
+		while ( sl->sl_num > sl->sl_size ||
+				syncprov_slog_tooold( &sl->sl_head->se_csn, &cutoff )) {
 			se = sl->sl_head;
 			sl->sl_head = se->se_next;
 			Debug( LDAP_DEBUG_SYNC, "%s syncprov_add_slog: "
 				"expiring csn=%s from sessionlog (sessionlog size=%d)\n",
 				op->o_log_prefix, se->se_csn.bv_val, sl->sl_num );
-			for ( i=0; i<sl->sl_numcsns; i++ )
-				if ( sl->sl_sids[i] >= se->se_sid )
-					break;
-			if  ( i == sl->sl_numcsns || sl->sl_sids[i] != se->se_sid ) {
-				Debug( LDAP_DEBUG_SYNC, "%s syncprov_add_slog: "
-					"adding csn=%s to mincsn\n",
-					op->o_log_prefix, se->se_csn.bv_val );
-				slap_insert_csn_sids( (struct sync_cookie *)sl,
-					i, se->se_sid, &se->se_csn );
-			} else {
-				Debug( LDAP_DEBUG_SYNC, "%s syncprov_add_slog: "
-					"updating mincsn for sid=%d csn=%s to %s\n",
-					op->o_log_prefix, se->se_sid, sl->sl_mincsn[i].bv_val, se->se_csn.bv_val );
-				ber_bvreplace( &sl->sl_mincsn[i], &se->se_csn );
-			}
+			syncprov_slog_expire( op, sl, &se->se_csn, se->se_sid );
 			ch_free( se );
 			sl->sl_num--;
+			if ( !sl->sl_head ) {
+				sl->sl_tail = NULL;
+				break;
+			}
 		}
 		}
 		ldap_pvt_thread_mutex_unlock( &sl->sl_mutex );
@@ -1945,6 +2446,221 @@ syncprov_accesslog_uuid_cb( Operation *op, SlapReply *rs )
 	return rs->sr_err;
 }
 
+/* Duplicate stripping, see syncprov_slog_dedup */
+typedef struct slog_dup {
+	struct berval *sd_uuid;
+	int sd_mod;		/* deletes sort before mods */
+	int sd_seq;		/* CSN order within deletes and mods */
+} slog_dup;
+
+static int
+slog_dup_cmp( const void *a, const void *b )
+{
+	const slog_dup *da = a, *db = b;
+	int rc;
+
+	rc = memcmp( da->sd_uuid->bv_val, db->sd_uuid->bv_val, UUID_LEN );
+	if ( !rc )
+		rc = da->sd_mod - db->sd_mod;
+	if ( !rc )
+		rc = da->sd_seq - db->sd_seq;
+	return rc;
+}
+
+/*
+ * Deletes are at the start of the uuids list and mods at the end in
+ * reverse. Blank out any mod whose entry was also deleted, and all but
+ * the oldest mod of each entry. Returns the number of mods left.
+ */
+static int
+syncprov_slog_dedup(
+		Operation *op,
+		BerVarray uuids,
+		int num,
+		int ndel,
+		int nmods )
+{
+	slog_dup *dups;
+	int i, j, n = ndel + nmods, mmods = nmods;
+
+	if ( !nmods )
+		return 0;
+
+	dups = op->o_tmpalloc( n * sizeof( slog_dup ), op->o_tmpmemctx );
+	for ( i=0; i<ndel; i++ ) {
+		dups[i].sd_uuid = &uuids[i];
+		dups[i].sd_mod = 0;
+		dups[i].sd_seq = i;
+	}
+	for ( i=0; i<nmods; i++ ) {
+		dups[ndel + i].sd_uuid = &uuids[num - 1 - i];
+		dups[ndel + i].sd_mod = 1;
+		dups[ndel + i].sd_seq = i;
+	}
+	qsort( dups, n, sizeof( slog_dup ), slog_dup_cmp );
+
+	/* The first of each run of equal UUIDs is either a delete or the
+	 * oldest mod, every mod after it is redundant.
+	 */
+	for ( i=0; i<n; i=j ) {
+		for ( j=i+1; j<n && !memcmp( dups[i].sd_uuid->bv_val,
+				dups[j].sd_uuid->bv_val, UUID_LEN ); j++ ) {
+			if ( dups[j].sd_mod ) {
+				dups[j].sd_uuid->bv_len = 0;
+				mmods--;
+			}
+		}
+	}
+	op->o_tmpfree( dups, op->o_tmpmemctx );
+
+	return mmods;
+}
+
+#ifdef SYNCPROV_SLOG_MDB
+/*
+ * Copy the relevant part of the persistent log into the same layout
+ * syncprov_play_sessionlog builds from the in-memory one: deletes up
+ * front, everything else at the end in reverse. The caller begins txn
+ * under sl_mutex, so the snapshot matches the sl_mincsn it checked
+ * the consumer against; txn is always released here.
+ */
+static int
+syncprov_collect_mdblog( Operation *op, sessionlog *sl, MDB_txn *txn,
+		sync_control *srs, BerVarray ctxcsn, int numcsns, int *sids,
+		struct berval *mincsn, BerVarray *uuidsp, BerVarray *csnsp,
+		int *nump, int *ndelp, int *nmodsp )
+{
+	MDB_cursor *mc;
+	MDB_val key, data;
+	BerVarray uuids = NULL, csns = NULL;
+	struct berval csn;
+	char csnbuf[LDAP_PVT_CSNSTR_BUFSIZE];
+	int pass, num = 0, ndel = 0, nmods = 0, rc;
+
+	rc = mdb_cursor_open( txn, sl->sl_dbi, &mc );
+	if ( rc ) {
+		mdb_txn_abort( txn );
+		goto fail;
+	}
+
+	/* Count the changes first, then copy them out of the same snapshot.
+	 * mincsn is the oldest state the consumer has that differs from ours,
+	 * nothing logged before it can be new to the consumer.
+	 */
+	for ( pass = 0; pass < 2; pass++ ) {
+		if ( pass ) {
+			num = ndel + nmods;
+			if ( !num )
+				break;
+			uuids = op->o_tmpalloc( (num) * sizeof( struct berval ) +
+					num * UUID_LEN, op->o_tmpmemctx );
+			uuids[0].bv_val = (char *)(uuids + num);
+			csns = op->o_tmpalloc( (num) * sizeof( struct berval ) +
+					num * LDAP_PVT_CSNSTR_BUFSIZE, op->o_tmpmemctx );
+			csns[0].bv_val = (char *)(csns + num);
+			ndel = nmods = 0;
+		}
+
+		key.mv_data = mincsn->bv_val;
+		key.mv_size = mincsn->bv_len;
+		for ( rc = mdb_cursor_get( mc, &key, &data,
+					key.mv_size ? MDB_SET_RANGE : MDB_FIRST ); rc == 0;
+				rc = mdb_cursor_get( mc, &key, &data, MDB_NEXT )) {
+			unsigned char *rec = data.mv_data;
+			int j, k, sid, cmp;
+
+			if ( key.mv_size >= sizeof( csnbuf ) || data.mv_size != SLOG_RECLEN ) {
+				rc = MDB_CORRUPTED;
+				break;
+			}
+			csn.bv_val = csnbuf;
+			csn.bv_len = key.mv_size;
+			AC_MEMCPY( csnbuf, key.mv_data, key.mv_size );
+			csnbuf[key.mv_size] = '\0';
+			sid = slap_parse_csn_sid( &csn );
+
+			cmp = 1;
+			for ( k=0; k<srs->sr_state.numcsns; k++ ) {
+				if ( sid == srs->sr_state.sids[k] ) {
+					cmp = ber_bvcmp( &csn, &srs->sr_state.ctxcsn[k] );
+					break;
+				}
+			}
+			if ( cmp <= 0 ) {
+				continue;
+			}
+			cmp = 0;
+			for ( k=0; k<numcsns; k++ ) {
+				if ( sid == sids[k] ) {
+					cmp = ber_bvcmp( &csn, &ctxcsn[k] );
+					break;
+				}
+			}
+			if ( cmp > 0 ) {
+				if ( pass ) {
+					Debug( LDAP_DEBUG_SYNC, "%s syncprov_play_sessionlog: "
+						"cmp %d, csn %s too new, we're finished\n",
+						op->o_log_prefix, cmp, csn.bv_val );
+				}
+				break;
+			}
+			if ( rec[0] == LDAP_REQ_DELETE ) {
+				j = ndel++;
+			} else {
+				if ( rec[0] == LDAP_REQ_ADD )
+					continue;
+				nmods++;
+				j = num - nmods;
+			}
+			if ( !pass )
+				continue;
+
+			uuids[j].bv_val = uuids[0].bv_val + (j * UUID_LEN);
+			AC_MEMCPY(uuids[j].bv_val, rec + 1, UUID_LEN);
+			uuids[j].bv_len = UUID_LEN;
+
+			csns[j].bv_val = csns[0].bv_val + (j * LDAP_PVT_CSNSTR_BUFSIZE);
+			AC_MEMCPY(csns[j].bv_val, csn.bv_val, csn.bv_len + 1);
+			csns[j].bv_len = csn.bv_len;
+
+			if ( LogTest( LDAP_DEBUG_SYNC ) ) {
+				char uuidstr[40];
+				lutil_uuidstr_from_normalized( uuids[j].bv_val, UUID_LEN,
+					uuidstr, 40 );
+				Debug( LDAP_DEBUG_SYNC, "%s syncprov_play_sessionlog: "
+					"picking a %s entry uuid=%s cookie=%s\n",
+					op->o_log_prefix, rec[0] == LDAP_REQ_DELETE ? "deleted" : "modified",
+					uuidstr, csns[j].bv_val );
+			}
+		}
+		if ( rc == MDB_NOTFOUND )
+			rc = 0;
+		if ( rc )
+			break;
+	}
+	mdb_cursor_close( mc );
+	mdb_txn_abort( txn );
+	if ( rc ) {
+		op->o_tmpfree( uuids, op->o_tmpmemctx );
+		op->o_tmpfree( csns, op->o_tmpmemctx );
+		goto fail;
+	}
+
+	*uuidsp = uuids;
+	*csnsp = csns;
+	*nump = num;
+	*ndelp = ndel;
+	*nmodsp = nmods;
+	return LDAP_SUCCESS;
+
+fail:
+	Debug( LDAP_DEBUG_ANY, "%s syncprov_play_sessionlog: "
+		"cannot read sessionlog: %s (%d)\n",
+		op->o_log_prefix, mdb_strerror( rc ), rc );
+	return -1;
+}
+#endif /* SYNCPROV_SLOG_MDB */
+
 static int
 syncprov_play_sessionlog( Operation *op, SlapReply *rs, sync_control *srs,
 		BerVarray ctxcsn, int numcsns, int *sids,
@@ -1992,6 +2708,29 @@ syncprov_play_sessionlog( Operation *op, SlapReply *rs, sync_control *srs,
 		return rc;
 	}
 
+#ifdef SYNCPROV_SLOG_MDB
+	if ( sl->sl_env ) {
+		MDB_txn *txn;
+
+		/* Writers hold sl_mutex until they commit, take the snapshot
+		 * before anyone can expire what we just checked against
+		 */
+		rc = mdb_txn_begin( sl->sl_env, NULL, MDB_RDONLY, &txn );
+		ldap_pvt_thread_mutex_unlock( &sl->sl_mutex );
+		if ( rc ) {
+			Debug( LDAP_DEBUG_ANY, "%s syncprov_play_sessionlog: "
+				"cannot read sessionlog: %s (%d)\n",
+				op->o_log_prefix, mdb_strerror( rc ), rc );
+			return -1;
+		}
+		rc = syncprov_collect_mdblog( op, sl, txn, srs, ctxcsn, numcsns,
+			sids, mincsn, &uuids, &csns, &num, &ndel, &nmods );
+		if ( rc )
+			return rc;
+		goto collected;
+	}
+#endif
+
 	num = sl->sl_num;
 	i = 0;
 	nmods = 0;
@@ -2069,6 +2808,9 @@ syncprov_play_sessionlog( Operation *op, SlapReply *rs, sync_control *srs,
 
 	ndel = i;
 
+#ifdef SYNCPROV_SLOG_MDB
+collected:
+#endif
 	/* Zero out unused slots */
 	for ( i=ndel; i < num - nmods; i++ )
 		uuids[i].bv_len = 0;
@@ -2076,25 +2818,8 @@ syncprov_play_sessionlog( Operation *op, SlapReply *rs, sync_control *srs,
 	/* Mods must be validated to see if they belong in this delete set.
 	 */
 
-	mmods = nmods;
 	/* Strip any duplicates */
-	for ( i=0; i<nmods; i++ ) {
-		for ( j=0; j<ndel; j++ ) {
-			if ( bvmatch( &uuids[j], &uuids[num - 1 - i] )) {
-				uuids[num - 1 - i].bv_len = 0;
-				mmods --;
-				break;
-			}
-		}
-		if ( uuids[num - 1 - i].bv_len == 0 ) continue;
-		for ( j=0; j<i; j++ ) {
-			if ( bvmatch( &uuids[num - 1 - j], &uuids[num - 1 - i] )) {
-				uuids[num - 1 - i].bv_len = 0;
-				mmods --;
-				break;
-			}
-		}
-	}
+	mmods = syncprov_slog_dedup( op, uuids, num, ndel, nmods );
 
 	/* Check mods now */
 	if ( mmods ) {
@@ -3026,6 +3751,7 @@ syncprov_op_search( Operation *op, SlapReply *rs )
 		}
 		sop = ch_malloc( sizeof( syncops ));
 		*sop = so;
+		syncprov_fkeys_init( sop, op->ors_filter );
 		sop->s_rid = srs->sr_state.rid;
 		sop->s_sid = srs->sr_state.sid;
 		/* set refcount=2 to prevent being freed out from under us
@@ -3043,6 +3769,7 @@ syncprov_op_search( Operation *op, SlapReply *rs )
 			 */
 			ldap_pvt_thread_mutex_unlock( &si->si_ops_mutex );
 			if ( slapd_shutdown ) {
+				ch_free( sop->s_keys );
 				ch_free( sop );
 				return SLAPD_ABANDON;
 			}
@@ -3052,6 +3779,7 @@ syncprov_op_search( Operation *op, SlapReply *rs )
 		}
 		if ( op->o_abandon ) {
 			ldap_pvt_thread_mutex_unlock( &si->si_ops_mutex );
+			ch_free( sop->s_keys );
 			ch_free( sop );
 			return SLAPD_ABANDON;
 		}
@@ -3175,6 +3903,7 @@ bailout:
 						sp = &(*sp)->s_next;
 					*sp = sop->s_next;
 					ldap_pvt_thread_mutex_unlock( &si->si_ops_mutex );
+					ch_free( sop->s_keys );
 					ch_free( sop );
 				}
 				rs->sr_ctrls = NULL;
@@ -3463,7 +4192,9 @@ enum {
 	SP_SESSL,
 	SP_NOPRES,
 	SP_USEHINT,
-	SP_LOGDB
+	SP_LOGDB,
+	SP_LOGDIR,
+	SP_LOGAGE
 };
 
 static ConfigDriver sp_cf_gen;
@@ -3493,6 +4224,16 @@ static ConfigTable spcfg[] = {
 		sp_cf_gen, "( OLcfgOvAt:1.5 NAME 'olcSpSessionlogSource' "
 			"DESC 'On startup, try loading sessionlog from this subtree' "
 			"SYNTAX OMsDN SINGLE-VALUE )", NULL, NULL },
+	{ "syncprov-sessionlog-dir", "directory", 2, 2, 0, ARG_STRING|ARG_MAGIC|SP_LOGDIR,
+		sp_cf_gen, "( OLcfgOvAt:1.6 NAME 'olcSpSessionlogDir' "
+			"DESC 'Directory for keeping the sessionlog across restarts' "
+			"EQUALITY caseExactMatch "
+			"SYNTAX OMsDirectoryString SINGLE-VALUE )", NULL, NULL },
+	{ "syncprov-sessionlog-maxage", "seconds", 2, 2, 0, ARG_INT|ARG_MAGIC|SP_LOGAGE,
+		sp_cf_gen, "( OLcfgOvAt:1.7 NAME 'olcSpSessionlogMaxAge' "
+			"DESC 'Session log max age in seconds' "
+			"EQUALITY integerMatch "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ NULL, NULL, 0, 0, 0, ARG_IGNORED }
 };
 
@@ -3506,6 +4247,8 @@ static ConfigOCs spocs[] = {
 			"$ olcSpNoPresent "
 			"$ olcSpReloadHint "
 			"$ olcSpSessionlogSource "
+			"$ olcSpSessionlogDir "
+			"$ olcSpSessionlogMaxAge "
 		") )",
 			Cft_Overlay, spcfg },
 	{ NULL, 0, NULL }
@@ -3567,6 +4310,20 @@ sp_cf_gen(ConfigArgs *c)
 				value_add_one( &c->rvalue_nvals, &si->si_logbase );
 			}
 			break;
+		case SP_LOGDIR:
+			if ( si->si_logdir ) {
+				c->value_string = ch_strdup( si->si_logdir );
+			} else {
+				rc = 1;
+			}
+			break;
+		case SP_LOGAGE:
+			if ( si->si_logage ) {
+				c->value_int = si->si_logage;
+			} else {
+				rc = 1;
+			}
+			break;
 		}
 		return rc;
 	} else if ( c->op == LDAP_MOD_DELETE ) {
@@ -3590,6 +4347,15 @@ sp_cf_gen(ConfigArgs *c)
 				BER_BVZERO( &si->si_logbase );
 			}
 			break;
+		case SP_LOGDIR:
+			if ( si->si_logdir ) {
+				ch_free( si->si_logdir );
+				si->si_logdir = NULL;
+			}
+			break;
+		case SP_LOGAGE:
+			si->si_logage = 0;
+			break;
 		}
 		return rc;
 	}
@@ -3679,6 +4445,31 @@ sp_cf_gen(ConfigArgs *c)
 		rc = syncprov_setup_accesslog();
 		ch_free( c->value_dn.bv_val );
 		break;
+	case SP_LOGDIR:
+#ifdef SYNCPROV_SLOG_MDB
+		if ( si->si_logdir )
+			ch_free( si->si_logdir );
+		si->si_logdir = c->value_string;
+#else
+		snprintf( c->cr_msg, sizeof( c->cr_msg ), "%s requires "
+			"syncprov to be built as a module or with back-mdb built in",
+			c->argv[0] );
+		Debug( LDAP_DEBUG_CONFIG|LDAP_DEBUG_NONE,
+			"%s: %s\n", c->log, c->cr_msg );
+		ch_free( c->value_string );
+		rc = ARG_BAD_CONF;
+#endif
+		break;
+	case SP_LOGAGE:
+		if ( c->value_int < 0 ) {
+			snprintf( c->cr_msg, sizeof( c->cr_msg ), "%s age %d is negative",
+				c->argv[0], c->value_int );
+			Debug( LDAP_DEBUG_CONFIG|LDAP_DEBUG_NONE,
+				"%s: %s\n", c->log, c->cr_msg );
+			return ARG_BAD_CONF;
+		}
+		si->si_logage = c->value_int;
+		break;
 	}
 	return rc;
 }
@@ -3739,6 +4530,144 @@ syncprov_db_otask2(
 	return NULL;
 }
 
+#ifdef SYNCPROV_SLOG_MDB
+/* Open the persistent sessionlog. Its contents are only trusted if it
+ * was closed cleanly at the contextCSN we just read from the database,
+ * otherwise changes may have been made that it never saw.
+ */
+static int
+syncprov_slog_open( syncprov_info_t *si )
+{
+	sessionlog *sl = si->si_logs;
+	MDB_txn *txn = NULL;
+	MDB_stat st;
+	BerVarray clean = NULL, mincsn = NULL;
+	MDB_val mkey;
+	int i, rc, valid = 0;
+
+	rc = mdb_env_create( &sl->sl_env );
+	if ( rc ) {
+		sl->sl_env = NULL;
+		goto fail;
+	}
+	rc = mdb_env_set_maxdbs( sl->sl_env, 2 );
+	if ( rc == 0 )
+		rc = mdb_env_set_mapsize( sl->sl_env,
+			(size_t)sl->sl_size * SLOG_MDB_OPSIZE + SLOG_MDB_MINSIZE );
+	/* Syncing is left to the clean shutdown, a crash throws the log away */
+	if ( rc == 0 )
+		rc = mdb_env_open( sl->sl_env, si->si_logdir,
+			MDB_NOSYNC|MDB_NOTLS, SLAPD_DEFAULT_DB_MODE );
+	if ( rc == 0 )
+		rc = mdb_txn_begin( sl->sl_env, NULL, 0, &txn );
+	if ( rc == 0 )
+		rc = mdb_dbi_open( txn, "sessionlog",
+			MDB_CREATE|MDB_DUPSORT|MDB_DUPFIXED, &sl->sl_dbi );
+	if ( rc == 0 )
+		rc = mdb_dbi_open( txn, "meta", MDB_CREATE, &sl->sl_meta );
+	if ( rc )
+		goto fail;
+
+	if ( syncprov_slog_getcsns( txn, sl->sl_meta, &slog_clean_key, &clean ) == 0 ) {
+		for ( i=0; clean[i].bv_val && i < si->si_numcsns; i++ ) {
+			if ( !bvmatch( &clean[i], &si->si_ctxcsn[i] ))
+				break;
+		}
+		valid = ( i == si->si_numcsns && !clean[i].bv_val );
+		ber_bvarray_free( clean );
+	}
+	if ( valid ) {
+		rc = syncprov_slog_getcsns( txn, sl->sl_meta, &slog_mincsn_key, &mincsn );
+		if ( rc == 0 ) {
+			if ( sl->sl_mincsn )
+				ber_bvarray_free( sl->sl_mincsn );
+			if ( sl->sl_sids )
+				ch_free( sl->sl_sids );
+			sl->sl_mincsn = mincsn;
+			for ( i=0; mincsn[i].bv_val; i++ ) ;
+			sl->sl_numcsns = i;
+			sl->sl_sids = slap_parse_csn_sids( mincsn, i, NULL );
+			slap_sort_csn_sids( mincsn, sl->sl_sids, i, NULL );
+		} else if ( rc != MDB_NOTFOUND ) {
+			goto fail;
+		}
+		rc = mdb_stat( txn, sl->sl_dbi, &st );
+		if ( rc )
+			goto fail;
+		sl->sl_num = st.ms_entries;
+		Debug( LDAP_DEBUG_SYNC, "syncprov_db_open: "
+			"loaded %d sessionlog entries from \"%s\"\n",
+			sl->sl_num, si->si_logdir );
+	} else {
+		rc = mdb_drop( txn, sl->sl_dbi, 0 );
+		if ( rc == 0 )
+			rc = syncprov_slog_putcsns( txn, sl->sl_meta, &slog_mincsn_key,
+				sl->sl_mincsn, sl->sl_numcsns );
+		if ( rc )
+			goto fail;
+		sl->sl_num = 0;
+		Debug( LDAP_DEBUG_SYNC, "syncprov_db_open: "
+			"sessionlog in \"%s\" does not match contextCSN, discarded\n",
+			si->si_logdir );
+	}
+
+	/* Until it is closed cleanly again, the log can't be trusted */
+	mkey.mv_data = slog_clean_key.bv_val;
+	mkey.mv_size = slog_clean_key.bv_len;
+	rc = mdb_del( txn, sl->sl_meta, &mkey, NULL );
+	if ( rc == 0 || rc == MDB_NOTFOUND )
+		rc = mdb_txn_commit( txn );
+	else
+		mdb_txn_abort( txn );
+	txn = NULL;
+	if ( rc == 0 )
+		rc = mdb_env_sync( sl->sl_env, 1 );
+	if ( rc )
+		goto fail;
+	return 0;
+
+fail:
+	Debug( LDAP_DEBUG_ANY, "syncprov_db_open: "
+		"cannot open sessionlog in \"%s\": %s (%d)\n",
+		si->si_logdir, mdb_strerror( rc ), rc );
+	if ( txn )
+		mdb_txn_abort( txn );
+	if ( sl->sl_env ) {
+		mdb_env_close( sl->sl_env );
+		sl->sl_env = NULL;
+	}
+	return -1;
+}
+
+/* Record the contextCSN the log is consistent with and close it */
+static void
+syncprov_slog_close( syncprov_info_t *si )
+{
+	sessionlog *sl = si->si_logs;
+	MDB_txn *txn;
+	int rc;
+
+	rc = mdb_txn_begin( sl->sl_env, NULL, 0, &txn );
+	if ( rc == 0 ) {
+		rc = syncprov_slog_putcsns( txn, sl->sl_meta, &slog_clean_key,
+			si->si_ctxcsn, si->si_numcsns );
+		if ( rc == 0 )
+			rc = mdb_txn_commit( txn );
+		else
+			mdb_txn_abort( txn );
+	}
+	if ( rc == 0 )
+		rc = mdb_env_sync( sl->sl_env, 1 );
+	if ( rc ) {
+		Debug( LDAP_DEBUG_ANY, "syncprov_db_close: "
+			"cannot save sessionlog in \"%s\": %s (%d)\n",
+			si->si_logdir, mdb_strerror( rc ), rc );
+	}
+	mdb_env_close( sl->sl_env );
+	sl->sl_env = NULL;
+}
+#endif /* SYNCPROV_SLOG_MDB */
+
 /* Read any existing contextCSN from the underlying db.
  * Then search for any entries newer than that. If no value exists,
  * just generate it. Cache whatever result.
@@ -3882,6 +4811,11 @@ syncprov_db_open(
 
 out:
 	op->o_bd->bd_info = (BackendInfo *)on;
+#ifdef SYNCPROV_SLOG_MDB
+	if ( si->si_logs && si->si_logdir ) {
+		return syncprov_slog_open( si );
+	}
+#endif
 	return 0;
 }
 
@@ -3916,6 +4850,11 @@ syncprov_db_close(
 		op->o_ndn = be->be_rootndn;
 		syncprov_checkpoint( op, on );
 	}
+#ifdef SYNCPROV_SLOG_MDB
+	if ( si->si_logs && si->si_logs->sl_env ) {
+		syncprov_slog_close( si );
+	}
+#endif
 
 #ifdef SLAP_CONFIG_DELETE
 	if ( !slapd_shutdown ) {
@@ -3996,9 +4935,16 @@ syncprov_db_destroy(
 			if ( sl->sl_sids )
 				ch_free( sl->sl_sids );
 
+#ifdef SYNCPROV_SLOG_MDB
+			if ( sl->sl_env )
+				mdb_env_close( sl->sl_env );
+#endif
+
 			ldap_pvt_thread_mutex_destroy(&si->si_logs->sl_mutex);
 			ch_free( si->si_logs );
 		}
+		if ( si->si_logdir )
+			ch_free( si->si_logdir );
 		if ( si->si_ctxcsn )
 			ber_bvarray_free( si->si_ctxcsn );
 		if ( si->si_sids )
@@ -331,18 +331,113 @@ slap_writewait_play(
 	}
 }
 
-static long send_ldap_ber(
+static int
+slap_writewait_any(
+	Operation *op )
+{
+	slap_callback	*sc = op->o_callback;
+
+	for ( ; sc; sc = sc->sc_next ) {
+		if ( sc->sc_writewait )
+			return 1;
+	}
+	return 0;
+}
+
+/* Values at least this long are not copied into search entry PDUs,
+ * they are written directly from the entry.
+ */
+#define SLAP_VALUE_REF_MIN	1024
+
+static int
+slap_put_value(
 	Operation *op,
+	BerElement *ber,
+	struct berval *bv )
+{
+	if ( bv->bv_len >= SLAP_VALUE_REF_MIN && op->o_res_ber == NULL )
+		return ber_pvt_put_ref( ber, bv, LBER_DEFAULT );
+
+	return ber_printf( ber, "O", bv );
+}
+
+/* Append a copy of the PDU in ber to the connection's batch.
+ * Must be called with c_write1_mutex held.
+ */
+static int
+slap_batch_add(
+	Connection *conn,
 	BerElement *ber )
+{
+	struct berval bv;
+
+	if ( conn->c_batch == NULL ) {
+		conn->c_batch = ber_alloc_t( LBER_USE_DER );
+		if ( conn->c_batch == NULL )
+			return -1;
+		gettimeofday( &conn->c_batch_start, NULL );
+	}
+
+	if ( ber_flatten2( ber, &bv, 0 ) != 0 ||
+		ber_write( conn->c_batch, bv.bv_val, bv.bv_len, 0 ) < 0 )
+		return -1;
+
+	return 0;
+}
+
+/* True if the batch is due to be written. There is no timer, this
+ * is only checked when another PDU is sent on the connection.
+ */
+static int
+slap_batch_due(
+	Connection *conn )
+{
+	struct timeval now;
+	ber_len_t len;
+	long msec;
+
+	ber_get_option( conn->c_batch, LBER_OPT_BER_BYTES_TO_WRITE, &len );
+	if ( len >= (ber_len_t) global_writebatch_size )
+		return 1;
+
+	gettimeofday( &now, NULL );
+	msec = ( now.tv_sec - conn->c_batch_start.tv_sec ) * 1000 +
+		( now.tv_usec - conn->c_batch_start.tv_usec ) / 1000;
+	return msec >= (long) global_writebatch_delay;
+}
+
+/* Write a PDU. If batch is set, the PDU may instead be held back in
+ * the connection's batch, to be written together with the PDUs that
+ * follow it.  The batch is written when it holds writebatch-size bytes,
+ * when writebatch-delay msec have passed since it was started, or
+ * along with the next PDU that is not batched, which is at the latest
+ * the result of the operation.  Both limits are checked only as PDUs
+ * are sent, so the delay is not a bound on how long a PDU is held.
+ * Entries of persistent searches are never held back.
+ */
+static long send_ldap_ber(
+	Operation *op,
+	BerElement *ber,
+	int batch )
 {
 	Connection *conn = op->o_conn;
+	BerElement *pending = NULL, *wber;
 	ber_len_t bytes;
 	long ret = 0;
 	char *close_reason;
-	int do_resume = 0;
+	int do_resume = 0, writewait;
 
 	ber_get_option( ber, LBER_OPT_BER_BYTES_TO_WRITE, &bytes );
 
+	if ( batch ) {
+		batch = bytes < (ber_len_t) global_writebatch_size &&
+			op->o_sync == SLAP_CONTROL_NONE;
+#ifdef LDAP_CONNECTIONLESS
+		if ( conn->c_is_udp )
+			batch = 0;
+#endif
+	}
+
 	/* write only one pdu at a time - wait til it's our turn */
 	ldap_pvt_thread_mutex_lock( &conn->c_write1_mutex );
 	if (( op->o_abandon && !op->o_cancel ) || !connection_valid( conn ) ||
@@ -351,6 +446,15 @@ static long send_ldap_ber(
 		return 0;
 	}
 
+	if ( batch && slap_batch_add( conn, ber ) == 0 ) {
+		if ( !slap_batch_due( conn )) {
+			ldap_pvt_thread_mutex_unlock( &conn->c_write1_mutex );
+			return bytes;
+		}
+		/* it goes out with the batch */
+		ber = NULL;
+	}
+
 	conn->c_writers++;
 
 	while ( conn->c_writers > 0 && conn->c_writing ) {
@@ -372,11 +476,27 @@ static long send_ldap_ber(
 	/* Our turn */
 	conn->c_writing = 1;
 
+	/* Take what was batched up, anything added from now on is
+	 * written by whoever comes next. A small PDU goes along with
+	 * the batch.
+	 */
+	pending = conn->c_batch;
+	if ( pending != NULL && ber != NULL &&
+		bytes < (ber_len_t) global_writebatch_size &&
+		slap_batch_add( conn, ber ) == 0 )
+		ber = NULL;
+	conn->c_batch = NULL;
+	wber = pending ? pending : ber;
+
 	/* write the pdu */
 	while( 1 ) {
 		int err;
 
-		if ( ber_flush2( conn->c_sb, ber, LBER_FLUSH_FREE_NEVER ) == 0 ) {
+		if ( ber_flush2( conn->c_sb, wber, LBER_FLUSH_FREE_NEVER ) == 0 ) {
+			if ( wber == pending && ber != NULL ) {
+				wber = ber;
+				continue;
+			}
 			ret = bytes;
 			break;
 		}
@@ -401,15 +521,25 @@ fail:
 			ldap_pvt_thread_mutex_lock( &conn->c_mutex );
 			connection_closing( conn, close_reason );
 			ldap_pvt_thread_mutex_unlock( &conn->c_mutex );
+			if ( pending != NULL )
+				ber_free( pending, 1 );
 			return -1;
 		}
 
+		/* values sent by reference may go away while we wait */
+		writewait = slap_writewait_any( op );
+		if ( writewait && ber != NULL && ber_pvt_inline_refs( ber ) != 0 ) {
+			close_reason = "out of memory on write";
+			goto fail;
+		}
+
 		/* wait for socket to be write-ready */
 		do_resume = 1;
 		conn->c_writewaiter = 1;
 		ldap_pvt_thread_mutex_unlock( &conn->c_write1_mutex );
 		ldap_pvt_thread_pool_idle( &connection_pool );
-		slap_writewait_play( op );
+		if ( writewait )
+			slap_writewait_play( op );
 		err = slapd_wait_writer( conn->c_sd );
 		conn->c_writewaiter = 0;
 		ldap_pvt_thread_pool_unidle( &connection_pool );
@@ -447,6 +577,9 @@ fail:
 	}
 	ldap_pvt_thread_mutex_unlock( &conn->c_write1_mutex );
 
+	if ( pending != NULL )
+		ber_free( pending, 1 );
+
 	/* If there are no more writers, release a pending op */
 	if ( do_resume )
 		connection_write_resume( conn );
@@ -759,7 +892,7 @@ send_ldap_response(
 	}
 
 	/* send BER */
-	bytes = send_ldap_ber( op, ber );
+	bytes = send_ldap_ber( op, ber, 0 );
 #ifdef LDAP_CONNECTIONLESS
 	if (!op->o_conn || op->o_conn->c_is_udp == 0)
 #endif
@@ -1270,7 +1403,7 @@ slap_send_search_entry( Operation *op, SlapReply *rs )
 						goto error_return;
 					}
 				}
-				if (( rc = ber_printf( ber, "O", &a->a_vals[i] )) == -1 ) {
+				if (( rc = slap_put_value( op, ber, &a->a_vals[i] )) == -1 ) {
 					Debug( LDAP_DEBUG_ANY,
 						"send_search_entry: conn %lu  "
 						"ber_printf failed.\n", op->o_connid );
@@ -1420,7 +1553,7 @@ slap_send_search_entry( Operation *op, SlapReply *rs )
 					continue;
 				}
 
-				if (( rc = ber_printf( ber, "O", &a->a_vals[i] )) == -1 ) {
+				if (( rc = slap_put_value( op, ber, &a->a_vals[i] )) == -1 ) {
 					Debug( LDAP_DEBUG_ANY,
 						"send_search_entry: conn %lu  ber_printf failed\n", 
 						op->o_connid );
@@ -1471,6 +1604,11 @@ slap_send_search_entry( Operation *op, SlapReply *rs )
 		}
 	}
 
+	if ( rc != -1 && ( rs->sr_flags & REP_ENTRY_MUSTFLUSH )) {
+		/* the entry goes away before the values are written */
+		rc = ber_pvt_inline_refs( ber );
+	}
+
 	if ( rc == -1 ) {
 		Debug( LDAP_DEBUG_ANY, "ber_printf failed\n" );
 
@@ -1486,7 +1624,7 @@ slap_send_search_entry( Operation *op, SlapReply *rs )
 	rs_flush_entry( op, rs, NULL );
 
 	if ( op->o_res_ber == NULL ) {
-		bytes = send_ldap_ber( op, ber );
+		bytes = send_ldap_ber( op, ber, 1 );
 		ber_free_buf( ber );
 
 		if ( bytes < 0 ) {
@@ -1652,7 +1790,7 @@ slap_send_search_reference( Operation *op, SlapReply *rs )
 #ifdef LDAP_CONNECTIONLESS
 	if (!op->o_conn || op->o_conn->c_is_udp == 0) {
 #endif
-	bytes = send_ldap_ber( op, ber );
+	bytes = send_ldap_ber( op, ber, 1 );
 	ber_free_buf( ber );
 
 	if ( bytes < 0 ) {
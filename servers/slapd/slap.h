@@ -2555,6 +2555,21 @@ typedef struct slap_counters_t {
 	ldap_pvt_mp_t		sc_ops_initiated_[SLAP_OP_LAST];
 } slap_counters_t;
 
+/* per-thread object caches, see operation.c */
+typedef enum slap_obj_e {
+	SLAP_OBJ_OPERATION = 0,
+	SLAP_OBJ_BER,
+
+	SLAP_OBJ_LAST
+} slap_obj_t;
+
+typedef struct slap_objcache_stats_t {
+	unsigned long	os_hits;	/* allocations served from a cache */
+	unsigned long	os_misses;	/* allocations that found it empty */
+	unsigned long	os_drops;	/* frees that found it full */
+	unsigned long	os_cached;	/* objects in the caches now */
+} slap_objcache_stats_t;
+
 /*
  * represents an operation pending from an ldap client
  */
@@ -2935,6 +2950,10 @@ struct Connection {
 	int			c_writers;		/* number of writers waiting */
 	char		c_writing;		/* someone is writing */
 
+	/* search responses not written yet, see send_ldap_ber() */
+	BerElement	*c_batch;
+	struct timeval	c_batch_start;	/* when the first was added */
+
 	char		c_sasl_bind_in_progress;	/* multi-op bind in progress */
 	char		c_writewaiter;	/* true if blocked on write */
 
@@ -3021,6 +3040,8 @@ struct Listener {
 #endif
 	int	sl_mute;	/* Listener is temporarily disabled due to emfile */
 	int	sl_busy;	/* Listener is busy (accept thread activated) */
+	int	sl_shard;	/* Index among SO_REUSEPORT sockets of an address */
+	unsigned long	sl_accepts;	/* Connections accepted */
 	ber_socket_t sl_sd;
 	Sockaddr sl_sa;
 #define sl_addr	sl_sa.sa_in_addr
@@ -3031,6 +3052,17 @@ struct Listener {
 #endif
 };
 
+/*
+ * Activity of a listener thread, see slapd_daemon_stats()
+ */
+typedef struct slap_daemon_stats {
+	unsigned long	sds_accepts;	/* on listeners handled by the thread */
+	unsigned long	sds_waits;	/* calls to the event wait */
+	unsigned long	sds_events;	/* descriptors found ready */
+	long	sds_conns;	/* active connections */
+	int	sds_cpu;	/* bound to, or -1 */
+} slap_daemon_stats;
+
 /*
  * Better know these all around slapd
  */
@@ -56,23 +56,42 @@
 
 extern int slap_DN_strict;	/* dn.c */
 
-static char csnbuf[ LDAP_PVT_CSNSTR_BUFSIZE ];
-
 typedef struct Erec {
 	Entry *e;
 	unsigned long lineno;
 	unsigned long nextline;
 } Erec;
 
+/*
+ * With tool-threads > 1, a reader thread splits the LDIF into
+ * records, tool-threads - 1 parser threads turn them into entries, and
+ * the main thread adds the entries in their original order, so the
+ * backend still sees ascending IDs. Records travel in chunks of up to
+ * TREC_MAX through a ring of slots:
+ *	reader		FREE -> READ	at add_read
+ *	parsers		READ -> PARSING -> DONE	at add_parse
+ *	main thread	DONE -> FREE	at add_write
+ */
+enum { SLOT_FREE = 0, SLOT_READ, SLOT_PARSING, SLOT_DONE };
+
+#define TREC_MAX	64
+
 typedef struct Trec {
-	Entry *e;
-	unsigned long lineno;
-	unsigned long nextline;
-	int rc;
-	int ready;
+	int n;			/* records in this chunk */
+	int next;		/* next one to add */
+	int state;
+	Erec er[TREC_MAX];
+	int rc[TREC_MAX];
+	char *buf[TREC_MAX];
+	int lmax[TREC_MAX];
 } Trec;
 
-static Trec trec;
+static Trec *trecs;
+static int ntrecs;
+static unsigned long add_read, add_parse, add_write;
+static int add_eof;		/* reader is done, add_read is final */
+static int add_eofrc;
+
 static unsigned long sid = SLAP_SYNC_SID_MAX + 1;
 static int checkvals;
 static int enable_meter;
@@ -84,53 +103,38 @@ static int lmax;
 
 static ldap_pvt_thread_mutex_t add_mutex;
 static ldap_pvt_thread_cond_t add_cond;
+static ldap_pvt_thread_mutex_t uuid_mutex;
 static int add_stop;
+static int ldif_threaded;
 
 /* returns:
- *	1: got a record
- *	0: EOF
- * -1: read failure
+ *	1: got an entry
  * -2: parse failure
  */
 static int
-getrec0(Erec *erec)
+getrec_parse(Erec *erec, char *buf, Operation *op)
 {
 	const char *text;
-	int ldifrc;
 	char textbuf[SLAP_TEXT_BUFLEN] = { '\0' };
 	size_t textlen = sizeof textbuf;
+	char csnbuf[ LDAP_PVT_CSNSTR_BUFSIZE ];
 	struct berval csn;
-	Operation *op = &opbuf.ob_op;
-	op->o_hdr = &opbuf.ob_hdr;
 
-again:
-	erec->lineno = erec->nextline+1;
-	/* nextline is the line number of the end of the current entry */
-	ldifrc = ldif_read_record( ldiffp, &erec->nextline, &buf, &lmax );
-	if (ldifrc < 1)
-		return ldifrc < 0 ? -1 : 0;
 	{
 		BackendDB *bd;
 		Entry *e;
 		int prev_DN_strict;
 
-		if ( erec->lineno < jumpline )
-			goto again;
-
-		if ( !dbnum ) {
+		/* threaded, slapadd() sets it for all parsers */
+		if ( !dbnum && !ldif_threaded ) {
 			prev_DN_strict = slap_DN_strict;
 			slap_DN_strict = 0;
 		}
 		e = str2entry2( buf, checkvals );
-		if ( !dbnum ) {
+		if ( !dbnum && !ldif_threaded ) {
 			slap_DN_strict = prev_DN_strict;
 		}
 
-		if ( enable_meter )
-			lutil_meter_update( &meter,
-					 ftello( ldiffp->fp ),
-					 0);
-
 		if( e == NULL ) {
 			fprintf( stderr, "%s: could not parse entry (line=%lu)\n",
 				progname, erec->lineno );
@@ -246,7 +250,11 @@ again:
 				== NULL )
 			{
 				got &= ~GOT_UUID;
+				if ( ldif_threaded )
+					ldap_pvt_thread_mutex_lock( &uuid_mutex );
 				vals[0].bv_len = lutil_uuidstr( uuidbuf, sizeof( uuidbuf ) );
+				if ( ldif_threaded )
+					ldap_pvt_thread_mutex_unlock( &uuid_mutex );
 				vals[0].bv_val = uuidbuf;
 				attr_merge_normalize_one( e, slap_schema.si_ad_entryUUID, vals, NULL );
 			}
@@ -298,50 +306,184 @@ again:
 				      (!(got & GOT_CSN) ? slap_schema.si_ad_entryCSN->ad_cname.bv_val : ""),
 				      e->e_name.bv_val );
 			}
-
-			sid = slap_tool_update_ctxcsn_check( progname, e );
 		}
 		erec->e = e;
 	}
 	return 1;
 }
 
+/* Read the next record to be added.
+ * returns:
+ *	1: got a record
+ *	0: EOF
+ * -1: read failure
+ */
+static int
+getrec_read(Erec *erec, char **bufp, int *lmaxp)
+{
+	int ldifrc;
+
+	do {
+		erec->lineno = erec->nextline+1;
+		/* nextline is the line number of the end of the current entry */
+		ldifrc = ldif_read_record( ldiffp, &erec->nextline, bufp, lmaxp );
+		if (ldifrc < 1)
+			return ldifrc < 0 ? -1 : 0;
+	} while ( erec->lineno < jumpline );
+
+	if ( enable_meter )
+		lutil_meter_update( &meter,
+				 ftello( ldiffp->fp ),
+				 0);
+	return 1;
+}
+
+/* returns:
+ *	1: got a record
+ *	0: EOF
+ * -1: read failure
+ * -2: parse failure
+ */
+static int
+getrec0(Erec *erec)
+{
+	Operation *op = &opbuf.ob_op;
+	int rc;
+
+	op->o_hdr = &opbuf.ob_hdr;
+	rc = getrec_read( erec, &buf, &lmax );
+	if ( rc == 1 )
+		rc = getrec_parse( erec, buf, op );
+	return rc;
+}
+
 static void *
-getrec_thr(void *ctx)
+getrec_read_thr(void *ctx)
 {
+	Erec erec;
+	Trec *t;
+	int rc;
+
+	erec.nextline = 0;
 	ldap_pvt_thread_mutex_lock( &add_mutex );
-	while (!add_stop) {
-		trec.rc = getrec0((Erec *)&trec);
-		trec.ready = 1;
-		while (trec.ready)
+	for (;;) {
+		while ( !add_stop && add_read - add_write >= ntrecs )
 			ldap_pvt_thread_cond_wait( &add_cond, &add_mutex );
-		/* eof or read failure */
-		if ( trec.rc == 0 || trec.rc == -1 )
+		if ( add_stop )
+			break;
+		t = &trecs[add_read % ntrecs];
+		ldap_pvt_thread_mutex_unlock( &add_mutex );
+
+		/* only this thread touches a FREE slot */
+		for ( t->n = 0; t->n < TREC_MAX; t->n++ ) {
+			rc = getrec_read( &erec, &t->buf[t->n], &t->lmax[t->n] );
+			if ( rc < 1 )
+				break;
+			t->er[t->n] = erec;
+		}
+
+		ldap_pvt_thread_mutex_lock( &add_mutex );
+		if ( t->n ) {
+			t->next = 0;
+			t->state = SLOT_READ;
+			add_read++;
+		}
+		if ( rc < 1 ) {
+			add_eof = 1;
+			add_eofrc = rc;
+		}
+		ldap_pvt_thread_cond_broadcast( &add_cond );
+		if ( add_eof )
 			break;
 	}
 	ldap_pvt_thread_mutex_unlock( &add_mutex );
 	return NULL;
 }
 
-static int ldif_threaded;
+static void *
+getrec_parse_thr(void *ctx)
+{
+	OperationBuffer opb = {0};
+	Operation *op = &opb.ob_op;
+	Trec *t;
+	int i;
+
+	op->o_hdr = &opb.ob_hdr;
+	ldap_pvt_thread_mutex_lock( &add_mutex );
+	for (;;) {
+		while ( !add_stop && add_parse == add_read && !add_eof )
+			ldap_pvt_thread_cond_wait( &add_cond, &add_mutex );
+		if ( add_stop || add_parse == add_read )
+			break;
+		t = &trecs[add_parse++ % ntrecs];
+		t->state = SLOT_PARSING;
+		ldap_pvt_thread_mutex_unlock( &add_mutex );
 
+		for ( i = 0; i < t->n; i++ ) {
+			t->er[i].e = NULL;
+			t->rc[i] = getrec_parse( &t->er[i], t->buf[i], op );
+		}
+
+		ldap_pvt_thread_mutex_lock( &add_mutex );
+		t->state = SLOT_DONE;
+		ldap_pvt_thread_cond_broadcast( &add_cond );
+	}
+	ldap_pvt_thread_mutex_unlock( &add_mutex );
+	return NULL;
+}
+
+/* returns:
+ *	1: got a record
+ *	0: EOF
+ * -1: read failure
+ * -2: parse failure
+ */
 static int
 getrec(Erec *erec)
 {
-	int rc;
-	if ( !ldif_threaded )
-		return getrec0(erec);
-
-	while (!trec.ready)
-		ldap_pvt_thread_yield();
-	erec->e = trec.e;
-	erec->lineno = trec.lineno;
-	erec->nextline = trec.nextline;
-	trec.ready = 0;
-	rc = trec.rc;
-	ldap_pvt_thread_mutex_lock( &add_mutex );
-	ldap_pvt_thread_mutex_unlock( &add_mutex );
-	ldap_pvt_thread_cond_signal( &add_cond );
+	Trec *t;
+	int i, rc;
+
+	if ( !ldif_threaded ) {
+		rc = getrec0(erec);
+	} else {
+		t = &trecs[add_write % ntrecs];
+		if ( t->next == 0 ) {
+			/* wait for the next chunk */
+			ldap_pvt_thread_mutex_lock( &add_mutex );
+			while ( t->state != SLOT_DONE ) {
+				if ( add_write == add_read && add_eof ) {
+					ldap_pvt_thread_mutex_unlock( &add_mutex );
+					return add_eofrc;
+				}
+				ldap_pvt_thread_cond_wait( &add_cond, &add_mutex );
+			}
+			ldap_pvt_thread_mutex_unlock( &add_mutex );
+		}
+
+		i = t->next++;
+		rc = t->rc[i];
+		if ( rc == 1 ) {
+			*erec = t->er[i];
+		} else {
+			erec->lineno = t->er[i].lineno;
+			erec->nextline = t->er[i].nextline;
+		}
+
+		if ( t->next == t->n ) {
+			ldap_pvt_thread_mutex_lock( &add_mutex );
+			t->state = SLOT_FREE;
+			t->next = 0;
+			add_write++;
+			ldap_pvt_thread_cond_broadcast( &add_cond );
+			ldap_pvt_thread_mutex_unlock( &add_mutex );
+		}
+	}
+
+	/* the contextCSN must be tracked in the order entries are added */
+	if ( rc == 1 && SLAP_LASTMOD(be) )
+		sid = slap_tool_update_ctxcsn_check( progname, erec->e );
+
 	return rc;
 }
 
@@ -352,9 +494,12 @@ slapadd( int argc, char **argv )
 	size_t textlen = sizeof textbuf;
 	Erec erec;
 	struct berval bvtext;
-	ldap_pvt_thread_t thr;
+	ldap_pvt_thread_t *thr = NULL;
+	int i, nthr = 0, prev_DN_strict = 0;
 	ID id;
 	Entry *prev = NULL;
+	unsigned long nadded = 0;
+	struct timeval start, end;
 
 	int ldifrc;
 	int rc = EXIT_SUCCESS;
@@ -424,11 +569,25 @@ slapadd( int argc, char **argv )
 		enable_meter = 0;
 	}
 
+	gettimeofday( &start, NULL );
+
 	if ( slap_tool_thread_max > 1 ) {
+		/* one reader, the rest parse */
+		nthr = slap_tool_thread_max;
+		ntrecs = 4 * nthr;
+		trecs = ch_calloc( ntrecs, sizeof( Trec ));
+		thr = ch_calloc( nthr, sizeof( ldap_pvt_thread_t ));
 		ldap_pvt_thread_mutex_init( &add_mutex );
 		ldap_pvt_thread_cond_init( &add_cond );
-		ldap_pvt_thread_create( &thr, 0, getrec_thr, NULL );
+		ldap_pvt_thread_mutex_init( &uuid_mutex );
 		ldif_threaded = 1;
+		if ( !dbnum ) {
+			prev_DN_strict = slap_DN_strict;
+			slap_DN_strict = 0;
+		}
+		ldap_pvt_thread_create( &thr[0], 0, getrec_read_thr, NULL );
+		for ( i = 1; i < nthr; i++ )
+			ldap_pvt_thread_create( &thr[i], 0, getrec_parse_thr, NULL );
 	}
 
 	erec.nextline = 0;
@@ -466,6 +625,7 @@ slapadd( int argc, char **argv )
 			if ( verbose )
 				fprintf( stderr, "added: \"%s\" (%08lx)\n",
 					erec.e->e_dn, (long) id );
+			nadded++;
 		} else {
 			if ( verbose )
 				fprintf( stderr, "added: \"%s\"\n",
@@ -479,10 +639,30 @@ slapadd( int argc, char **argv )
 	if ( ldif_threaded ) {
 		ldap_pvt_thread_mutex_lock( &add_mutex );
 		add_stop = 1;
-		trec.ready = 0;
-		ldap_pvt_thread_cond_signal( &add_cond );
+		ldap_pvt_thread_cond_broadcast( &add_cond );
 		ldap_pvt_thread_mutex_unlock( &add_mutex );
-		ldap_pvt_thread_join( thr, NULL );
+		for ( i = 0; i < nthr; i++ )
+			ldap_pvt_thread_join( thr[i], NULL );
+		if ( !dbnum )
+			slap_DN_strict = prev_DN_strict;
+		/* entries parsed after an error stopped us */
+		for ( i = 0; i < ntrecs; i++ ) {
+			Trec *t = &trecs[i];
+			int j;
+			if ( t->state == SLOT_DONE ) {
+				for ( j = t->next; j < t->n; j++ ) {
+					if ( t->er[j].e )
+						entry_free( t->er[j].e );
+				}
+			}
+			for ( j = 0; j < TREC_MAX; j++ )
+				ch_free( t->buf[j] );
+		}
+		ch_free( trecs );
+		ch_free( thr );
+		ldap_pvt_thread_mutex_destroy( &uuid_mutex );
+		ldap_pvt_thread_cond_destroy( &add_cond );
+		ldap_pvt_thread_mutex_destroy( &add_mutex );
 	}
 	if ( erec.e ) entry_free( erec.e );
 
@@ -498,6 +678,18 @@ slapadd( int argc, char **argv )
 		lutil_meter_close( &meter );
 	}
 
+	if ( enable_meter || verbose ) {
+		double secs;
+
+		gettimeofday( &end, NULL );
+		secs = ( end.tv_sec - start.tv_sec ) +
+			( end.tv_usec - start.tv_usec ) / 1000000.0;
+		fprintf( stderr, "%s: %lu entries added in %.1f seconds "
+			"(%.0f entries/s, %d parser threads)\n",
+			progname, nadded, secs, secs > 0 ? nadded / secs : 0.0,
+			nthr > 1 ? nthr - 1 : 0 );
+	}
+
 	if ( rc == EXIT_SUCCESS ) {
 		rc = slap_tool_update_ctxcsn( progname, sid, &bvtext );
 	}
@@ -142,12 +142,15 @@ typedef struct syncinfo_s {
 	int			si_syncdata;
 	int			si_logstate;
 	int			si_lazyCommit;
+	int			si_applythreads;
+	int			si_txnbatch;	/* max changes per backend txn */
+	int			si_txnmsec;	/* max age of a txn batch */
 	int			si_got;
 	int			si_strict_refresh;	/* stop listening during fallback refresh */
 	int			si_too_old;
 	int			si_is_configdb;
 	ber_int_t	si_msgid;
-	Avlnode			*si_presentlist;
+	struct presentlist	*si_presentlist;
 	LDAP			*si_ld;
 	Connection		*si_conn;
 	LDAP_LIST_HEAD(np, nonpresent_entry)	si_nonpresentlist;
@@ -171,13 +174,25 @@ typedef struct syncinfo_s {
 
 	ldap_pvt_thread_mutex_t	si_monitor_mutex;
 	ldap_pvt_thread_mutex_t	si_mutex;
+
+	/* parallel apply of refresh entries */
+	struct syncapply	*si_applying;	/* entries being applied */
+	int			si_napplying;
+	int			si_applyerr;
+	int			si_applylocked;	/* in-flight entries hold cs_pmutex */
+	ldap_pvt_thread_mutex_t	si_apply_mutex;	/* also guards si_presentlist */
+	ldap_pvt_thread_cond_t	si_apply_cond;
+
+	/* batched backend txn */
+	OpExtra			*si_txn;
+	int			si_ntxn;
+	struct timeval		si_txnstart;
 } syncinfo_t;
 
 static int syncuuid_cmp( const void *, const void * );
 static int presentlist_insert( syncinfo_t* si, struct berval *syncUUID );
-static void presentlist_delete( Avlnode **av, struct berval *syncUUID );
-static char *presentlist_find( Avlnode *av, struct berval *syncUUID );
-static int presentlist_free( Avlnode *av );
+static char *presentlist_find( struct presentlist *pl, struct berval *syncUUID );
+static int presentlist_free( struct presentlist *pl );
 static void syncrepl_del_nonpresent( Operation *, syncinfo_t *, BerVarray, struct sync_cookie *, int );
 static int syncrepl_message_to_op(
 					syncinfo_t *, Operation *, LDAPMessage *, int );
@@ -1210,6 +1225,464 @@ get_pmutex(
 	return 0;
 }
 
+/* An entry received during refresh, handed to connection_pool to
+ * be applied. No two entries in flight share a DN or entryUUID,
+ * and none is an ancestor of another, so the order they commit
+ * in doesn't matter. An entry we already have under another DN
+ * is a rename, its old DN counts as well.
+ */
+typedef struct syncapply {
+	struct syncapply	*sa_next;
+	syncinfo_t		*sa_si;
+	void			*sa_cookie;	/* pool task, for retract */
+	int			sa_running;
+	Entry			*sa_entry;
+	Modifications		*sa_modlist;
+	int			sa_syncstate;
+	int			sa_sid;
+	struct berval		sa_uuid;
+	struct berval		sa_ndn;
+	struct berval		sa_ondn;	/* DN before a rename */
+	char			sa_uuidbuf[UUIDLEN];
+} syncapply;
+
+/* Entries that may be applied in parallel, if they carry no cookie
+ * CSN. The rest are applied in turn once everything before them is in.
+ */
+#define SYNC_APPLY_PARALLEL( si, state ) \
+	( (si)->si_applythreads > 1 && !(si)->si_refreshDone && \
+	!(si)->si_is_configdb && \
+	!( (si)->si_syncdata && (si)->si_logstate == SYNCLOG_LOGGING ) && \
+	( (state) == LDAP_SYNC_ADD || (state) == LDAP_SYNC_MODIFY ))
+
+static void
+syncrepl_apply_entry(
+	void *ctx,
+	syncapply *sa )
+{
+	syncinfo_t *si = sa->sa_si;
+	syncapply **sp;
+	Connection conn = {0};
+	OperationBuffer opbuf;
+	Operation *op;
+	struct sync_cookie sc = { NULL };
+	struct berval syncUUID[2];
+	int rc;
+
+	/* may run on the consumer's own thread, don't reset its slab */
+	connection_fake_init2( &conn, &opbuf, ctx, 0 );
+	op = &opbuf.ob_op;
+	op->o_connid = SLAPD_SYNC_RID2SYNCCONN(si->si_rid);
+	op->o_managedsait = SLAP_CONTROL_NONCRITICAL;
+	if ( !si->si_schemachecking )
+		op->o_no_schema_check = 1;
+	op->o_bd = si->si_be;
+	op->o_dn = op->o_bd->be_rootdn;
+	op->o_ndn = op->o_bd->be_rootndn;
+	sc.sid = sa->sa_sid;
+	op->o_controls[slap_cids.sc_LDAPsync] = &sc;
+
+	syncUUID[0] = sa->sa_uuid;
+	(void)slap_uuidstr_from_normalized( &syncUUID[1], &syncUUID[0], op->o_tmpmemctx );
+	rc = syncrepl_entry( si, op, sa->sa_entry, &sa->sa_modlist,
+		sa->sa_syncstate, syncUUID, NULL );
+	if ( sa->sa_modlist )
+		slap_mods_free( sa->sa_modlist, 1 );
+
+	ldap_pvt_thread_mutex_lock( &si->si_apply_mutex );
+	if ( rc != LDAP_SUCCESS && si->si_applyerr == LDAP_SUCCESS )
+		si->si_applyerr = rc;
+	for ( sp = &si->si_applying; *sp != sa; sp = &(*sp)->sa_next )
+		;
+	*sp = sa->sa_next;
+	si->si_napplying--;
+	ldap_pvt_thread_cond_broadcast( &si->si_apply_cond );
+	ldap_pvt_thread_mutex_unlock( &si->si_apply_mutex );
+
+	ch_free( sa );
+}
+
+static void *
+syncrepl_apply_task(
+	void *ctx,
+	void *arg )
+{
+	syncapply *sa = arg;
+	syncinfo_t *si = sa->sa_si;
+
+	/* anyone retracting us holds the mutex until it knows it failed */
+	ldap_pvt_thread_mutex_lock( &si->si_apply_mutex );
+	sa->sa_running = 1;
+	ldap_pvt_thread_mutex_unlock( &si->si_apply_mutex );
+
+	syncrepl_apply_entry( ctx, sa );
+	return NULL;
+}
+
+/* Take back an entry the pool hasn't started and apply it here.
+ * The pool may be busy with other work, or pausing, in which case
+ * it won't start anything until this thread lets go. Called with
+ * si_apply_mutex held; returns 1 if an entry was applied.
+ */
+static int
+syncrepl_apply_help(
+	Operation *op,
+	syncinfo_t *si )
+{
+	syncapply *sa;
+
+	for ( sa = si->si_applying; sa; sa = sa->sa_next ) {
+		if ( !sa->sa_running &&
+			ldap_pvt_thread_pool_retract( sa->sa_cookie ) > 0 )
+		{
+			sa->sa_running = 1;
+			ldap_pvt_thread_mutex_unlock( &si->si_apply_mutex );
+			syncrepl_apply_entry( op->o_threadctx, sa );
+			ldap_pvt_thread_mutex_lock( &si->si_apply_mutex );
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static int
+syncrepl_apply_dnconflict(
+	struct berval *ndn1,
+	struct berval *ndn2 )
+{
+	if ( BER_BVISEMPTY( ndn1 ) || BER_BVISEMPTY( ndn2 ))
+		return 0;
+	return dnIsSuffix( ndn1, ndn2 ) || dnIsSuffix( ndn2, ndn1 );
+}
+
+static int
+syncrepl_apply_conflict(
+	syncapply *s1,
+	syncapply *s2 )
+{
+	return bvmatch( &s1->sa_uuid, &s2->sa_uuid ) ||
+		syncrepl_apply_dnconflict( &s1->sa_ndn, &s2->sa_ndn ) ||
+		syncrepl_apply_dnconflict( &s1->sa_ndn, &s2->sa_ondn ) ||
+		syncrepl_apply_dnconflict( &s1->sa_ondn, &s2->sa_ndn ) ||
+		syncrepl_apply_dnconflict( &s1->sa_ondn, &s2->sa_ondn );
+}
+
+static int
+uuid_dn_callback(
+	Operation *op,
+	SlapReply *rs )
+{
+	struct berval *ndn = op->o_callback->sc_private;
+
+	if ( rs->sr_type == REP_SEARCH && BER_BVISNULL( ndn ))
+		ber_dupbv_x( ndn, &rs->sr_entry->e_nname, op->o_tmpmemctx );
+	return LDAP_SUCCESS;
+}
+
+/* Look up the DN we currently have the entry with syncUUID under */
+static void
+syncrepl_uuid2dn(
+	Operation *op,
+	syncinfo_t *si,
+	struct berval *syncUUID,
+	struct berval *ndn )
+{
+	slap_callback cb = { NULL, uuid_dn_callback, NULL, NULL };
+	SlapReply rs_search = {REP_RESULT};
+	Filter f = {0};
+	AttributeAssertion ava = ATTRIBUTEASSERTION_INIT;
+
+	BER_BVZERO( ndn );
+	cb.sc_private = ndn;
+
+	f.f_choice = LDAP_FILTER_EQUALITY;
+	f.f_ava = &ava;
+	ava.aa_desc = slap_schema.si_ad_entryUUID;
+	ava.aa_value = *syncUUID;
+
+	op->o_tag = LDAP_REQ_SEARCH;
+	op->o_callback = &cb;
+	if ( si->si_rewrite ) {
+		op->o_req_dn = si->si_suffixm;
+		op->o_req_ndn = si->si_suffixm;
+	} else {
+		op->o_req_dn = si->si_base;
+		op->o_req_ndn = si->si_base;
+	}
+	op->o_time = slap_get_time();
+	op->ors_scope = LDAP_SCOPE_SUBTREE;
+	op->ors_deref = LDAP_DEREF_NEVER;
+	op->ors_tlimit = SLAP_NO_LIMIT;
+	op->ors_slimit = 1;
+	op->ors_limit = NULL;
+	op->ors_attrs = slap_anlist_no_attrs;
+	op->ors_attrsonly = 1;
+	op->ors_filter = &f;
+	filter2bv_x( op, op->ors_filter, &op->ors_filterstr );
+
+	op->o_bd->be_search( op, &rs_search );
+	op->o_tmpfree( op->ors_filterstr.bv_val, op->o_tmpmemctx );
+	BER_BVZERO( &op->ors_filterstr );
+}
+
+/* Hand an entry to connection_pool, taking ownership of it and its
+ * modlist. Waits while its DN or entryUUID conflicts with an entry
+ * in flight, so changes within one subtree still land in the order
+ * they were received. The entries in flight hold cs_pmutex for the
+ * consumer, as a serial apply would.
+ */
+static int
+syncrepl_apply_submit(
+	Operation *op,
+	syncinfo_t *si,
+	Entry *entry,
+	Modifications **modlist,
+	int syncstate,
+	struct berval *syncUUID )
+{
+	struct sync_cookie *sc = op->o_controls[slap_cids.sc_LDAPsync];
+	struct berval ondn;
+	syncapply *sa, *s2;
+	int rc, here = 0;
+
+	op->o_tmpfree( syncUUID[1].bv_val, op->o_tmpmemctx );
+	BER_BVZERO( &syncUUID[1] );
+
+	if ( !si->si_applylocked ) {
+		if (( rc = get_pmutex( si ))) {
+			entry_free( entry );
+			return rc;
+		}
+		si->si_applylocked = 1;
+	}
+
+	/* Only an entry in flight with the same UUID can move it, let
+	 * that finish before looking up where it is now.
+	 */
+	ldap_pvt_thread_mutex_lock( &si->si_apply_mutex );
+	while ( si->si_applyerr == LDAP_SUCCESS ) {
+		for ( s2 = si->si_applying; s2; s2 = s2->sa_next ) {
+			if ( bvmatch( &s2->sa_uuid, &syncUUID[0] ))
+				break;
+		}
+		if ( !s2 )
+			break;
+		if ( !syncrepl_apply_help( op, si ))
+			ldap_pvt_thread_cond_wait( &si->si_apply_cond, &si->si_apply_mutex );
+	}
+	ldap_pvt_thread_mutex_unlock( &si->si_apply_mutex );
+
+	syncrepl_uuid2dn( op, si, &syncUUID[0], &ondn );
+	if ( !BER_BVISNULL( &ondn ) && dn_match( &ondn, &entry->e_nname )) {
+		op->o_tmpfree( ondn.bv_val, op->o_tmpmemctx );
+		BER_BVZERO( &ondn );
+	}
+
+	sa = ch_malloc( sizeof( syncapply ) + entry->e_nname.bv_len + 1 +
+		ondn.bv_len + 1 );
+	sa->sa_si = si;
+	sa->sa_cookie = NULL;
+	sa->sa_running = 0;
+	sa->sa_entry = entry;
+	sa->sa_modlist = *modlist;
+	*modlist = NULL;
+	sa->sa_syncstate = syncstate;
+	sa->sa_sid = sc ? sc->sid : -1;
+	sa->sa_uuid.bv_val = sa->sa_uuidbuf;
+	sa->sa_uuid.bv_len = UUIDLEN;
+	AC_MEMCPY( sa->sa_uuidbuf, syncUUID[0].bv_val, UUIDLEN );
+	sa->sa_ndn.bv_val = (char *)(sa+1);
+	sa->sa_ndn.bv_len = entry->e_nname.bv_len;
+	AC_MEMCPY( sa->sa_ndn.bv_val, entry->e_nname.bv_val,
+		entry->e_nname.bv_len + 1 );
+	BER_BVZERO( &sa->sa_ondn );
+	if ( !BER_BVISNULL( &ondn )) {
+		sa->sa_ondn.bv_val = sa->sa_ndn.bv_val + sa->sa_ndn.bv_len + 1;
+		sa->sa_ondn.bv_len = ondn.bv_len;
+		AC_MEMCPY( sa->sa_ondn.bv_val, ondn.bv_val, ondn.bv_len + 1 );
+		op->o_tmpfree( ondn.bv_val, op->o_tmpmemctx );
+	}
+
+	ldap_pvt_thread_mutex_lock( &si->si_apply_mutex );
+	while ( si->si_applyerr == LDAP_SUCCESS ) {
+		if ( si->si_napplying < si->si_applythreads ) {
+			for ( s2 = si->si_applying; s2; s2 = s2->sa_next ) {
+				if ( syncrepl_apply_conflict( sa, s2 ))
+					break;
+			}
+			if ( !s2 )
+				break;
+		}
+		if ( !syncrepl_apply_help( op, si ))
+			ldap_pvt_thread_cond_wait( &si->si_apply_cond, &si->si_apply_mutex );
+	}
+	rc = si->si_applyerr;
+	if ( rc == LDAP_SUCCESS ) {
+		sa->sa_next = si->si_applying;
+		si->si_applying = sa;
+		si->si_napplying++;
+		/* the task can't get past the mutex before sa_cookie is set */
+		if ( ldap_pvt_thread_pool_submit2( &connection_pool,
+			syncrepl_apply_task, sa, &sa->sa_cookie ))
+		{
+			sa->sa_running = 1;
+			here = 1;
+		}
+	}
+	ldap_pvt_thread_mutex_unlock( &si->si_apply_mutex );
+
+	if ( rc != LDAP_SUCCESS ) {
+		entry_free( sa->sa_entry );
+		if ( sa->sa_modlist )
+			slap_mods_free( sa->sa_modlist, 1 );
+		ch_free( sa );
+	} else if ( here ) {
+		/* pool is stopping, apply it here */
+		syncrepl_apply_entry( op->o_threadctx, sa );
+	}
+	return rc;
+}
+
+/* Wait for the entries in flight and release cs_pmutex.
+ * Returns the first error any of them hit.
+ */
+static int
+syncrepl_apply_wait(
+	Operation *op,
+	syncinfo_t *si )
+{
+	int rc;
+
+	ldap_pvt_thread_mutex_lock( &si->si_apply_mutex );
+	while ( si->si_napplying ) {
+		if ( !syncrepl_apply_help( op, si ))
+			ldap_pvt_thread_cond_wait( &si->si_apply_cond, &si->si_apply_mutex );
+	}
+	rc = si->si_applyerr;
+	si->si_applyerr = LDAP_SUCCESS;
+	ldap_pvt_thread_mutex_unlock( &si->si_apply_mutex );
+
+	if ( si->si_applylocked ) {
+		si->si_applylocked = 0;
+		ldap_pvt_thread_mutex_unlock( &si->si_cookieState->cs_pmutex );
+	}
+	return rc;
+}
+
+/* Serially applied changes, and the contextCSN updates that go
+ * with them, can share one backend txn. Nothing else may look at
+ * the uncommitted state in between, so there must be no syncprov
+ * or accesslog on the DB and no other consumer sharing its cookie.
+ */
+static void
+syncrepl_txn_begin(
+	Operation *op,
+	syncinfo_t *si )
+{
+	BackendDB *be = si->si_wbe;
+
+	if ( si->si_txn || si->si_txnbatch < 2 || si->si_is_configdb ||
+		be != si->si_be || !be->bd_info->bi_op_txn ||
+		si->si_cookieState->cs_ref > 1 ||
+		overlay_is_inst( be, "syncprov" ) ||
+		overlay_is_inst( be, "accesslog" ))
+		return;
+
+	op->o_bd = be;
+	if ( be->bd_info->bi_op_txn( op, SLAP_TXN_BEGIN, &si->si_txn )) {
+		Debug( LDAP_DEBUG_ANY, "syncrepl_txn_begin: %s "
+			"couldn't start DB transaction\n", si->si_ridtxt );
+		if ( si->si_txn ) {
+			LDAP_SLIST_REMOVE( &op->o_extra, si->si_txn, OpExtra, oe_next );
+			op->o_tmpfree( si->si_txn, op->o_tmpmemctx );
+			si->si_txn = NULL;
+		}
+		return;
+	}
+	si->si_ntxn = 0;
+	gettimeofday( &si->si_txnstart, NULL );
+}
+
+static int
+syncrepl_txn_end(
+	Operation *op,
+	syncinfo_t *si,
+	int commit )
+{
+	BackendDB *be = si->si_wbe;
+	OpExtra *txn = si->si_txn;
+	cookie_state *cs = si->si_cookieState;
+	int rc = LDAP_SUCCESS;
+
+	if ( !txn )
+		return rc;
+	si->si_txn = NULL;
+	LDAP_SLIST_REMOVE( &op->o_extra, txn, OpExtra, oe_next );
+
+	op->o_bd = be;
+	if ( commit ) {
+		rc = be->bd_info->bi_op_txn( op, SLAP_TXN_COMMIT, &txn );
+		if ( rc ) {
+			Debug( LDAP_DEBUG_ANY, "syncrepl_txn_end: %s "
+				"DB transaction commit failed (%d)\n", si->si_ridtxt, rc );
+			rc = LDAP_OTHER;
+		}
+	} else {
+		be->bd_info->bi_op_txn( op, SLAP_TXN_ABORT, &txn );
+	}
+
+	if ( !commit || rc ) {
+		/* The cookie got ahead of the DB. Drop it so that
+		 * do_syncrep1 reloads the stored contextCSN.
+		 */
+		ldap_pvt_thread_mutex_lock( &cs->cs_pmutex );
+		ldap_pvt_thread_mutex_lock( &cs->cs_mutex );
+		ber_bvarray_free( cs->cs_vals );
+		ch_free( cs->cs_sids );
+		cs->cs_vals = NULL;
+		cs->cs_sids = NULL;
+		cs->cs_num = 0;
+		ber_bvarray_free( cs->cs_pvals );
+		ch_free( cs->cs_psids );
+		cs->cs_pvals = NULL;
+		cs->cs_psids = NULL;
+		cs->cs_pnum = 0;
+		slap_sync_cookie_free( &si->si_syncCookie, 0 );
+		ldap_pvt_thread_mutex_unlock( &cs->cs_mutex );
+		ldap_pvt_thread_mutex_unlock( &cs->cs_pmutex );
+	}
+	return rc;
+}
+
+/* Account for one more change in the open batch, if any */
+static int
+syncrepl_txn_step(
+	Operation *op,
+	syncinfo_t *si,
+	int rc )
+{
+	if ( !si->si_txn )
+		return rc;
+
+	if ( rc != LDAP_SUCCESS ) {
+		syncrepl_txn_end( op, si, 0 );
+		return rc;
+	}
+
+	if ( ++si->si_ntxn >= si->si_txnbatch )
+		return syncrepl_txn_end( op, si, 1 );
+
+	if ( si->si_txnmsec ) {
+		struct timeval now;
+
+		gettimeofday( &now, NULL );
+		if ( ( now.tv_sec - si->si_txnstart.tv_sec ) * 1000 +
+			( now.tv_usec - si->si_txnstart.tv_usec ) / 1000 >= si->si_txnmsec )
+			return syncrepl_txn_end( op, si, 1 );
+	}
+	return rc;
+}
+
 static int
 do_syncrep2(
 	Operation *op,
@@ -1264,6 +1737,14 @@ do_syncrep2(
 			rc = SYNC_SHUTDOWN;
 			goto done;
 		}
+		/* only entries are applied in parallel */
+		if ( si->si_applylocked && ldap_msgtype( msg ) != LDAP_RES_SEARCH_ENTRY &&
+			( rc = syncrepl_apply_wait( op, si )))
+			goto done;
+		/* and only entries are batched */
+		if ( si->si_txn && ldap_msgtype( msg ) != LDAP_RES_SEARCH_ENTRY &&
+			( rc = syncrepl_txn_end( op, si, 1 )))
+			goto done;
 		si->si_lastcontact = slap_get_time();
 		switch( ldap_msgtype( msg ) ) {
 		case LDAP_RES_SEARCH_ENTRY:
@@ -1370,6 +1851,14 @@ do_syncrep2(
 				rc = -1;
 				goto done;
 			}
+			/* a cookie may only move past entries already applied */
+			if ( si->si_applylocked && ( !SYNC_APPLY_PARALLEL( si, syncstate ) ||
+				ber_peek_tag( ber, &len ) == LDAP_TAG_SYNC_COOKIE ) &&
+				( rc = syncrepl_apply_wait( op, si )))
+			{
+				ldap_controls_free( rctrls );
+				goto done;
+			}
 			punlock = -1;
 			if ( ber_peek_tag( ber, &len ) == LDAP_TAG_SYNC_COOKIE ) {
 				if ( ber_scanf( ber, /*"{"*/ "m}", &cookie ) != LBER_ERROR ) {
@@ -1437,6 +1926,8 @@ do_syncrep2(
 				}
 			}
 			rc = 0;
+			if ( !SYNC_APPLY_PARALLEL( si, syncstate ))
+				syncrepl_txn_begin( op, si );
 			if ( si->si_syncdata && si->si_logstate == SYNCLOG_LOGGING ) {
 				modlist = NULL;
 				if ( ( rc = syncrepl_message_to_op( si, op, msg, punlock < 0 ) ) == LDAP_SUCCESS &&
@@ -1468,18 +1959,24 @@ logerr:
 			} else if ( ( rc = syncrepl_message_to_entry( si, op, msg,
 				&modlist, &entry, syncstate, syncUUID ) ) == LDAP_SUCCESS )
 			{
-				if ( punlock < 0 ) {
-					if (( rc = get_pmutex( si )))
-						goto done;
-				}
-				if ( ( rc = syncrepl_entry( si, op, entry, &modlist,
-					syncstate, syncUUID, syncCookie.ctxcsn ) ) == LDAP_SUCCESS &&
-					syncCookie.ctxcsn )
-				{
-					rc = syncrepl_updateCookie( si, op, &syncCookie, 0 );
+				if ( punlock < 0 && SYNC_APPLY_PARALLEL( si, syncstate )) {
+					if ( ( rc = syncrepl_txn_end( op, si, 1 )) == LDAP_SUCCESS )
+						rc = syncrepl_apply_submit( op, si, entry, &modlist,
+							syncstate, syncUUID );
+				} else {
+					if ( punlock < 0 ) {
+						if (( rc = get_pmutex( si )))
+							goto done;
+					}
+					if ( ( rc = syncrepl_entry( si, op, entry, &modlist,
+						syncstate, syncUUID, syncCookie.ctxcsn ) ) == LDAP_SUCCESS &&
+						syncCookie.ctxcsn )
+					{
+						rc = syncrepl_updateCookie( si, op, &syncCookie, 0 );
+					}
+					if ( punlock < 0 )
+						ldap_pvt_thread_mutex_unlock( &si->si_cookieState->cs_pmutex );
 				}
-				if ( punlock < 0 )
-					ldap_pvt_thread_mutex_unlock( &si->si_cookieState->cs_pmutex );
 			}
 			if ( punlock >= 0 ) {
 				/* on failure, revert pending CSN */
@@ -1503,6 +2000,7 @@ logerr:
 			if ( modlist ) {
 				slap_mods_free( modlist, 1 );
 			}
+			rc = syncrepl_txn_step( op, si, rc );
 			if ( rc )
 				goto done;
 			break;
@@ -1875,6 +2373,10 @@ logerr:
 		ldap_msgfree( msg );
 		msg = NULL;
 		if ( ldap_pvt_thread_pool_pausing( &connection_pool )) {
+			if ( si->si_applylocked && ( rc = syncrepl_apply_wait( op, si )))
+				goto done;
+			if ( si->si_txn && ( rc = syncrepl_txn_end( op, si, 1 )))
+				goto done;
 			slap_sync_cookie_free( &syncCookie, 0 );
 			slap_sync_cookie_free( &syncCookie_req, 0 );
 			return SYNC_PAUSED;
@@ -1888,6 +2390,17 @@ logerr:
 	}
 
 done:
+	if ( si->si_applylocked ) {
+		int rc2 = syncrepl_apply_wait( op, si );
+		if ( rc == LDAP_SUCCESS )
+			rc = rc2;
+	}
+	if ( si->si_txn ) {
+		int rc2 = syncrepl_txn_end( op, si, 1 );
+		if ( rc == LDAP_SUCCESS )
+			rc = rc2;
+	}
+
 	if ( err != LDAP_SUCCESS ) {
 		Debug( LDAP_DEBUG_ANY,
 			"do_syncrep2: %s (%d) %s\n",
@@ -3771,104 +4284,135 @@ typedef struct dninfo {
 	AttributeDescription *newDesc;	/* for renames */
 } dninfo;
 
-#define HASHUUID	1
-
-/* return 1 if inserted, 0 otherwise */
+/* The UUIDs received in a present phase. They're appended as they
+ * arrive and only sorted when the nonpresent search needs to look
+ * them up, so each costs UUIDLEN bytes and nothing is allocated per
+ * UUID. Sorting is a one pass bucket sort on the first two bytes,
+ * then each bucket on its own.
+ */
+typedef struct presentlist {
+	unsigned char	(*pl_uuids)[UUIDLEN];
+	ber_len_t	pl_num;
+	ber_len_t	pl_max;
+	ber_len_t	pl_found;	/* looked up by the nonpresent search */
+	ber_len_t	*pl_bucket;	/* start of each bucket once sorted */
+} presentlist;
+
+#define PL_BUCKETS	65536
+#define PL_BUCKET(u)	(((u)[0] << 8) | (u)[1])
+
+/* Duplicates are dropped when the list is sorted, so this
+ * always returns 1.
+ */
 static int
 presentlist_insert(
 	syncinfo_t* si,
 	struct berval *syncUUID )
 {
-	char *val;
-
-#ifdef HASHUUID
-	Avlnode **av;
-	unsigned short s;
+	presentlist *pl = si->si_presentlist;
 
-	if ( !si->si_presentlist )
-		si->si_presentlist = ch_calloc(65536, sizeof( Avlnode * ));
+	if ( !pl )
+		pl = si->si_presentlist = ch_calloc( 1, sizeof( presentlist ));
 
-	av = (Avlnode **)si->si_presentlist;
-
-	val = ch_malloc(UUIDLEN-2);
-	memcpy(&s, syncUUID->bv_val, 2);
-	memcpy(val, syncUUID->bv_val+2, UUIDLEN-2);
-
-	if ( avl_insert( &av[s], val,
-		syncuuid_cmp, avl_dup_error ) )
-	{
-		ch_free( val );
-		return 0;
+	if ( pl->pl_num == pl->pl_max ) {
+		pl->pl_max = pl->pl_max ? pl->pl_max * 2 : 1024;
+		pl->pl_uuids = ch_realloc( pl->pl_uuids, pl->pl_max * UUIDLEN );
 	}
-#else
-	val = ch_malloc(UUIDLEN);
+	AC_MEMCPY( pl->pl_uuids[pl->pl_num], syncUUID->bv_val, UUIDLEN );
+	pl->pl_num++;
 
-	AC_MEMCPY( val, syncUUID->bv_val, UUIDLEN );
+	if ( pl->pl_bucket ) {
+		ch_free( pl->pl_bucket );
+		pl->pl_bucket = NULL;
+	}
+	return 1;
+}
 
-	if ( avl_insert( &si->si_presentlist, val,
-		syncuuid_cmp, avl_dup_error ) )
-	{
-		ch_free( val );
-		return 0;
+static void
+presentlist_sort( presentlist *pl )
+{
+	ber_len_t *next, i, j, k, end;
+	unsigned char tmp[UUIDLEN];
+
+	pl->pl_bucket = ch_calloc( PL_BUCKETS + 1, sizeof( ber_len_t ));
+	for ( i = 0; i < pl->pl_num; i++ )
+		pl->pl_bucket[PL_BUCKET( pl->pl_uuids[i] ) + 1]++;
+	for ( k = 0; k < PL_BUCKETS; k++ )
+		pl->pl_bucket[k+1] += pl->pl_bucket[k];
+
+	/* move every UUID into its bucket, in place */
+	next = ch_malloc( PL_BUCKETS * sizeof( ber_len_t ));
+	AC_MEMCPY( next, pl->pl_bucket, PL_BUCKETS * sizeof( ber_len_t ));
+	for ( k = 0; k < PL_BUCKETS; k++ ) {
+		while ( next[k] < pl->pl_bucket[k+1] ) {
+			i = next[k];
+			j = PL_BUCKET( pl->pl_uuids[i] );
+			if ( j == k ) {
+				next[k]++;
+				continue;
+			}
+			AC_MEMCPY( tmp, pl->pl_uuids[i], UUIDLEN );
+			AC_MEMCPY( pl->pl_uuids[i], pl->pl_uuids[next[j]], UUIDLEN );
+			AC_MEMCPY( pl->pl_uuids[next[j]], tmp, UUIDLEN );
+			next[j]++;
+		}
 	}
-#endif
+	ch_free( next );
 
-	return 1;
+	/* sort each bucket, dropping duplicates */
+	for ( k = 0, j = 0; k < PL_BUCKETS; k++ ) {
+		i = pl->pl_bucket[k];
+		end = pl->pl_bucket[k+1];
+		pl->pl_bucket[k] = j;
+		if ( i == end )
+			continue;
+		qsort( pl->pl_uuids[i], end - i, UUIDLEN, syncuuid_cmp );
+		if ( i != j )
+			AC_MEMCPY( pl->pl_uuids[j], pl->pl_uuids[i], UUIDLEN );
+		for ( i++, j++; i < end; i++ ) {
+			if ( memcmp( pl->pl_uuids[i], pl->pl_uuids[j-1], UUIDLEN )) {
+				if ( i != j )
+					AC_MEMCPY( pl->pl_uuids[j], pl->pl_uuids[i], UUIDLEN );
+				j++;
+			}
+		}
+	}
+	pl->pl_bucket[PL_BUCKETS] = j;
+	pl->pl_num = j;
 }
 
 static char *
 presentlist_find(
-	Avlnode *av,
+	presentlist *pl,
 	struct berval *val )
 {
-#ifdef HASHUUID
-	Avlnode **a2 = (Avlnode **)av;
-	unsigned short s;
+	unsigned char *u = (unsigned char *)val->bv_val;
+	ber_len_t k;
 
-	if (!av)
+	if ( !pl || val->bv_len != UUIDLEN )
 		return NULL;
 
-	memcpy(&s, val->bv_val, 2);
-	return avl_find( a2[s], val->bv_val+2, syncuuid_cmp );
-#else
-	return avl_find( av, val->bv_val, syncuuid_cmp );
-#endif
+	if ( !pl->pl_bucket )
+		presentlist_sort( pl );
+
+	k = PL_BUCKET( u );
+	return bsearch( u, pl->pl_uuids[pl->pl_bucket[k]],
+		pl->pl_bucket[k+1] - pl->pl_bucket[k], UUIDLEN, syncuuid_cmp );
 }
 
+/* returns the number of UUIDs the nonpresent search didn't find */
 static int
-presentlist_free( Avlnode *av )
+presentlist_free( presentlist *pl )
 {
-#ifdef HASHUUID
-	Avlnode **a2 = (Avlnode **)av;
-	int i, count = 0;
+	int count = 0;
 
-	if ( av ) {
-		for (i=0; i<65536; i++) {
-			if (a2[i])
-				count += avl_free( a2[i], ch_free );
-		}
-		ch_free( av );
+	if ( pl ) {
+		count = pl->pl_num - pl->pl_found;
+		ch_free( pl->pl_uuids );
+		ch_free( pl->pl_bucket );
+		ch_free( pl );
 	}
 	return count;
-#else
-	return avl_free( av, ch_free );
-#endif
-}
-
-static void
-presentlist_delete(
-	Avlnode **av,
-	struct berval *val )
-{
-#ifdef HASHUUID
-	Avlnode **a2 = *(Avlnode ***)av;
-	unsigned short s;
-
-	memcpy(&s, val->bv_val, 2);
-	avl_delete( &a2[s], val->bv_val+2, syncuuid_cmp );
-#else
-	avl_delete( av, val->bv_val, syncuuid_cmp );
-#endif
 }
 
 static int
@@ -3901,7 +4445,9 @@ syncrepl_entry(
 
 	if (( syncstate == LDAP_SYNC_PRESENT || syncstate == LDAP_SYNC_ADD ) ) {
 		if ( !si->si_refreshPresent && !si->si_refreshDone ) {
+			ldap_pvt_thread_mutex_lock( &si->si_apply_mutex );
 			syncuuid_inserted = presentlist_insert( si, syncUUID );
+			ldap_pvt_thread_mutex_unlock( &si->si_apply_mutex );
 		}
 	}
 
@@ -5607,8 +6153,7 @@ nonpresent_callback(
 			}
 
 		} else {
-			presentlist_delete( &si->si_presentlist, &a->a_nvals[0] );
-			ch_free( present_uuid );
+			si->si_presentlist->pl_found++;
 		}
 	}
 	return LDAP_SUCCESS;
@@ -5720,11 +6265,7 @@ done:;
 static int
 syncuuid_cmp( const void* v_uuid1, const void* v_uuid2 )
 {
-#ifdef HASHUUID
-	return ( memcmp( v_uuid1, v_uuid2, UUIDLEN-2 ));
-#else
 	return ( memcmp( v_uuid1, v_uuid2, UUIDLEN ));
-#endif
 }
 
 void
@@ -5763,6 +6304,8 @@ syncinfo_free( syncinfo_t *sie, int free_all )
 
 		ldap_pvt_thread_mutex_destroy( &sie->si_mutex );
 		ldap_pvt_thread_mutex_destroy( &sie->si_monitor_mutex );
+		ldap_pvt_thread_mutex_destroy( &sie->si_apply_mutex );
+		ldap_pvt_thread_cond_destroy( &sie->si_apply_cond );
 
 		bindconf_free( &sie->si_bindconf );
 
@@ -5934,6 +6477,8 @@ config_suffixm( ConfigArgs *c, syncinfo_t *si )
 #define SUFFIXMSTR		"suffixmassage"
 #define	STRICT_REFRESH	"strictrefresh"
 #define LAZY_COMMIT		"lazycommit"
+#define APPLYTHREADSSTR		"applythreads"
+#define TXNBATCHSTR		"txnbatch"
 
 /* FIXME: undocumented */
 #define EXATTRSSTR		"exattrs"
@@ -5961,6 +6506,8 @@ enum {
 	GOT_MANAGEDSAIT		= 0x00020000U,
 	GOT_BINDCONF		= 0x00040000U,
 	GOT_SUFFIXM		= 0x00080000U,
+	GOT_APPLYTHREADS	= 0x00100000U,
+	GOT_TXNBATCH		= 0x00200000U,
 
 /* check */
 	GOT_REQUIRED		= (GOT_RID|GOT_PROVIDER|GOT_SEARCHBASE)
@@ -6461,6 +7008,46 @@ parse_syncrepl_line(
 					STRLENOF( LAZY_COMMIT ) ) )
 		{
 			si->si_lazyCommit = 1;
+		} else if ( !strncasecmp( c->argv[ i ], APPLYTHREADSSTR "=",
+					STRLENOF( APPLYTHREADSSTR "=" ) ) )
+		{
+			val = c->argv[ i ] + STRLENOF( APPLYTHREADSSTR "=" );
+			if ( lutil_atoi( &si->si_applythreads, val ) != 0 || si->si_applythreads < 0 ) {
+				snprintf( c->cr_msg, sizeof( c->cr_msg ),
+					"invalid apply threads value \"%s\".\n",
+					val );
+				Debug( LDAP_DEBUG_ANY, "%s: %s.\n", c->log, c->cr_msg );
+				return 1;
+			}
+			si->si_got |= GOT_APPLYTHREADS;
+		} else if ( !strncasecmp( c->argv[ i ], TXNBATCHSTR "=",
+					STRLENOF( TXNBATCHSTR "=" ) ) )
+		{
+			char *next;
+			long l;
+
+			val = c->argv[ i ] + STRLENOF( TXNBATCHSTR "=" );
+			l = strtol( val, &next, 10 );
+			if ( next == val || l < 0 || l > INT_MAX )
+				goto badbatch;
+			si->si_txnbatch = l;
+			si->si_txnmsec = 0;
+			if ( *next == ':' ) {
+				val = next + 1;
+				l = strtol( val, &next, 10 );
+				if ( next == val || l < 0 || l > INT_MAX )
+					goto badbatch;
+				si->si_txnmsec = l;
+			}
+			if ( *next != '\0' ) {
+badbatch:
+				snprintf( c->cr_msg, sizeof( c->cr_msg ),
+					"invalid txn batch value \"%s\".\n",
+					c->argv[ i ] + STRLENOF( TXNBATCHSTR "=" ) );
+				Debug( LDAP_DEBUG_ANY, "%s: %s.\n", c->log, c->cr_msg );
+				return 1;
+			}
+			si->si_got |= GOT_TXNBATCH;
 		} else if ( !bindconf_parse( c->argv[i], &si->si_bindconf ) ) {
 			si->si_got |= GOT_BINDCONF;
 		} else {
@@ -6975,6 +7562,8 @@ add_syncrepl(
 	LDAP_LIST_INIT( &si->si_nonpresentlist );
 	ldap_pvt_thread_mutex_init( &si->si_monitor_mutex );
 	ldap_pvt_thread_mutex_init( &si->si_mutex );
+	ldap_pvt_thread_mutex_init( &si->si_apply_mutex );
+	ldap_pvt_thread_cond_init( &si->si_apply_cond );
 
 	si->si_is_configdb = strcmp( c->be->be_suffix[0].bv_val, "cn=config" ) == 0;
 
@@ -7276,6 +7865,22 @@ syncrepl_unparse( syncinfo_t *si, struct berval *bv )
 		ptr = lutil_strcopy( ptr, " " LAZY_COMMIT );
 	}
 
+	if ( si->si_applythreads ) {
+		len = snprintf( ptr, WHATSLEFT, " " APPLYTHREADSSTR "=%d", si->si_applythreads );
+		if ( WHATSLEFT <= len ) return;
+		ptr += len;
+	}
+
+	if ( si->si_txnbatch ) {
+		if ( si->si_txnmsec )
+			len = snprintf( ptr, WHATSLEFT, " " TXNBATCHSTR "=%d:%d",
+				si->si_txnbatch, si->si_txnmsec );
+		else
+			len = snprintf( ptr, WHATSLEFT, " " TXNBATCHSTR "=%d", si->si_txnbatch );
+		if ( WHATSLEFT <= len ) return;
+		ptr += len;
+	}
+
 	bc.bv_len = ptr - buf;
 	bc.bv_val = buf;
 	ber_dupbv( bv, &bc );
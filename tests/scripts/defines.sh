@@ -87,12 +87,17 @@ CONF=$DATADIR/slapd.conf
 CONFTWO=$DATADIR/slapd2.conf
 CONF2DB=$DATADIR/slapd-2db.conf
 MCONF=$DATADIR/slapd-provider.conf
+GROUPCOMMITCONF=$DATADIR/slapd-mdb-groupcommit.conf
+COMPRESSCONF=$DATADIR/slapd-mdb-compress.conf
+INCREMENTALCONF=$DATADIR/slapd-mdb-incremental.conf
+COMPACTCONF=$DATADIR/slapd-mdb-compact.conf
 COMPCONF=$DATADIR/slapd-component.conf
 PWCONF=$DATADIR/slapd-pw.conf
 WHOAMICONF=$DATADIR/slapd-whoami.conf
 ACLCONF=$DATADIR/slapd-acl.conf
 RCONF=$DATADIR/slapd-referrals.conf
 SRPROVIDERCONF=$DATADIR/slapd-syncrepl-provider.conf
+SLOGPROVIDERCONF=$DATADIR/slapd-syncprov-sessionlog.conf
 DSRPROVIDERCONF=$DATADIR/slapd-deltasync-provider.conf
 DSRCONSUMERCONF=$DATADIR/slapd-deltasync-consumer.conf
 PPOLICYCONF=$DATADIR/slapd-ppolicy.conf
@@ -102,6 +107,8 @@ CACHEPROVIDERCONF=$DATADIR/slapd-cache-provider.conf
 PROXYAUTHZPROVIDERCONF=$DATADIR/slapd-cache-provider-proxyauthz.conf
 R1SRCONSUMERCONF=$DATADIR/slapd-syncrepl-consumer-refresh1.conf
 R2SRCONSUMERCONF=$DATADIR/slapd-syncrepl-consumer-refresh2.conf
+APPLYCONSUMERCONF=$DATADIR/slapd-syncrepl-consumer-applythreads.conf
+TXNCONSUMERCONF=$DATADIR/slapd-syncrepl-consumer-txnbatch.conf
 P1SRCONSUMERCONF=$DATADIR/slapd-syncrepl-consumer-persist1.conf
 P2SRCONSUMERCONF=$DATADIR/slapd-syncrepl-consumer-persist2.conf
 P3SRCONSUMERCONF=$DATADIR/slapd-syncrepl-consumer-persist3.conf
@@ -211,6 +218,8 @@ LDAPEXOP="$CLIENTDIR/ldapexop $TOOLARGS"
 SLAPDTESTER=$PROGDIR/slapd-tester
 LDIFFILTER=$PROGDIR/ldif-filter
 SLAPDMTREAD=$PROGDIR/slapd-mtread
+MDBCOPY=$PROGDIR/mdb_copy
+MDBSTAT=$PROGDIR/mdb_stat
 LVL=${SLAPD_DEBUG-0x4105}
 LOCALHOST=localhost
 LOCALIP=127.0.0.1